@@ -0,0 +1,508 @@
+/* Native microbenchmarks for pair_list.h.
+
+The harness embeds the interpreter and calls pair_list functions
+directly, without argument parsing and method dispatch overhead.
+The module state (istr type etc.) is borrowed from the imported
+multidict._multidict extension.
+
+Build and run with `make benchmark-native` from the project root,
+the extension should be built in place first.
+
+Cycles, instructions and cache misses are collected with
+perf_event_open(2) where available (Linux, perf_event_paranoid <= 2),
+"n/a" is reported otherwise.
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "../multidict/_multilib/pythoncapi_compat.h"
+#include "../multidict/_multilib/dict.h"
+
+#define N_COUNTERS 3
+#define MIN_SCANNED_PAIRS 2000000
+
+static const char *counter_names[N_COUNTERS] = {
+    "cycles", "instructions", "cache-misses"
+};
+
+typedef struct {
+    int fds[N_COUNTERS];
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+} bench_t;
+
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+static void
+bench_open(bench_t *bench)
+{
+    memset(bench, 0, sizeof(*bench));
+    for (int i = 0; i < N_COUNTERS; i++) {
+        bench->fds[i] = -1;
+    }
+#ifdef __linux__
+    static const uint64_t configs[N_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+    for (int i = 0; i < N_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        bench->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+
+static void
+bench_close(bench_t *bench)
+{
+#ifdef __linux__
+    for (int i = 0; i < N_COUNTERS; i++) {
+        if (bench->fds[i] >= 0) {
+            close(bench->fds[i]);
+        }
+    }
+#endif
+}
+
+
+static void
+bench_reset(bench_t *bench)
+{
+    bench->elapsed_ns = 0;
+#ifdef __linux__
+    for (int i = 0; i < N_COUNTERS; i++) {
+        if (bench->fds[i] >= 0) {
+            ioctl(bench->fds[i], PERF_EVENT_IOC_RESET, 0);
+        }
+    }
+#endif
+}
+
+
+static void
+bench_start(bench_t *bench)
+{
+#ifdef __linux__
+    for (int i = 0; i < N_COUNTERS; i++) {
+        if (bench->fds[i] >= 0) {
+            ioctl(bench->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+    bench->start_ns = now_ns();
+}
+
+
+static void
+bench_stop(bench_t *bench)
+{
+    bench->elapsed_ns += now_ns() - bench->start_ns;
+#ifdef __linux__
+    for (int i = 0; i < N_COUNTERS; i++) {
+        if (bench->fds[i] >= 0) {
+            ioctl(bench->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+
+static void
+bench_report(bench_t *bench, const char *name, Py_ssize_t size,
+             const char *op, uint64_t ops)
+{
+    printf("%-20s %8zd %-6s %10.1f", name, size, op,
+           (double)bench->elapsed_ns / (double)ops);
+    for (int i = 0; i < N_COUNTERS; i++) {
+        uint64_t value = 0;
+        if (bench->fds[i] >= 0 &&
+            read(bench->fds[i], &value, sizeof(value)) == sizeof(value)) {
+            printf(" %14.1f", (double)value / (double)ops);
+        } else {
+            printf(" %14s", "n/a");
+        }
+    }
+    printf("\n");
+}
+
+
+static PyObject *
+make_keys(Py_ssize_t size)
+{
+    PyObject *keys = PyList_New(size);
+    if (keys == NULL) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < size; i++) {
+        PyObject *key = PyUnicode_FromFormat("key-%zd", i);
+        if (key == NULL) {
+            Py_DECREF(keys);
+            return NULL;
+        }
+        /* precompute the hash, it is cached in the str object */
+        if (PyObject_Hash(key) == -1) {
+            Py_DECREF(key);
+            Py_DECREF(keys);
+            return NULL;
+        }
+        PyList_SET_ITEM(keys, i, key);
+    }
+    return keys;
+}
+
+
+static int
+fill(pair_list_t *list, PyObject *keys, PyObject *value)
+{
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(keys); i++) {
+        if (pair_list_add(list, PyList_GET_ITEM(keys, i), value) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static uint64_t
+loops_for(uint64_t scanned)
+{
+    // Keep the total work bounded, scanned is the number of pairs
+    // touched by one loop
+    uint64_t loops = MIN_SCANNED_PAIRS / scanned;
+    return loops > 0 ? loops : 1;
+}
+
+
+static int
+bench_add(mod_state *state, bench_t *bench, Py_ssize_t size, bool ci)
+{
+    // provides the full embedded buffer only
+    MultiDictObject md = {.pairs.embedded = EMBEDDED_CAPACITY};
+    pair_list_t *list = &md.pairs;
+    PyObject *keys = make_keys(size);
+    if (keys == NULL) {
+        return -1;
+    }
+    uint64_t loops = loops_for((uint64_t)size);
+
+    bench_reset(bench);
+    for (uint64_t n = 0; n < loops; n++) {
+        int ret = ci ? ci_pair_list_init(list, state, -1)
+                     : pair_list_init(list, state, -1);
+        if (ret < 0) {
+            goto fail;
+        }
+        bench_start(bench);
+        ret = fill(list, keys, Py_None);
+        bench_stop(bench);
+        pair_list_dealloc(list);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+    bench_report(bench, ci ? "ci_pair_list_add" : "pair_list_add",
+                 size, "pair", loops * (uint64_t)size);
+    Py_DECREF(keys);
+    return 0;
+fail:
+    Py_DECREF(keys);
+    return -1;
+}
+
+
+static int
+bench_get_one(mod_state *state, bench_t *bench, Py_ssize_t size)
+{
+    // provides the full embedded buffer only
+    MultiDictObject md = {.pairs.embedded = EMBEDDED_CAPACITY};
+    pair_list_t *list = &md.pairs;
+    PyObject *value = NULL;
+    PyObject *keys = make_keys(size);
+    if (keys == NULL) {
+        return -1;
+    }
+    if (pair_list_init(list, state, size) < 0 ||
+        fill(list, keys, Py_None) < 0) {
+        goto fail;
+    }
+    // the last key is the worst case: the whole list is scanned
+    PyObject *key = PyList_GET_ITEM(keys, size - 1);
+    uint64_t loops = loops_for((uint64_t)size);
+
+    bench_reset(bench);
+    bench_start(bench);
+    for (uint64_t n = 0; n < loops; n++) {
+        if (pair_list_get_one(list, key, &value) < 0) {
+            bench_stop(bench);
+            goto fail;
+        }
+        Py_DECREF(value);
+    }
+    bench_stop(bench);
+    bench_report(bench, "pair_list_get_one", size, "call", loops);
+    pair_list_dealloc(list);
+    Py_DECREF(keys);
+    return 0;
+fail:
+    pair_list_dealloc(list);
+    Py_DECREF(keys);
+    return -1;
+}
+
+
+static int
+bench_replace(mod_state *state, bench_t *bench, Py_ssize_t size)
+{
+    // provides the full embedded buffer only
+    MultiDictObject md = {.pairs.embedded = EMBEDDED_CAPACITY};
+    pair_list_t *list = &md.pairs;
+    PyObject *keys = make_keys(size);
+    if (keys == NULL) {
+        return -1;
+    }
+    if (pair_list_init(list, state, size) < 0 ||
+        fill(list, keys, Py_None) < 0) {
+        goto fail;
+    }
+    // the first key: the match is found immediately,
+    // the tail is scanned for duplicates
+    PyObject *key = PyList_GET_ITEM(keys, 0);
+    uint64_t loops = loops_for((uint64_t)size);
+
+    bench_reset(bench);
+    bench_start(bench);
+    for (uint64_t n = 0; n < loops; n++) {
+        if (pair_list_replace(list, key, Py_None) < 0) {
+            bench_stop(bench);
+            goto fail;
+        }
+    }
+    bench_stop(bench);
+    bench_report(bench, "pair_list_replace", size, "call", loops);
+    pair_list_dealloc(list);
+    Py_DECREF(keys);
+    return 0;
+fail:
+    pair_list_dealloc(list);
+    Py_DECREF(keys);
+    return -1;
+}
+
+
+static int
+bench_drop_tail(mod_state *state, bench_t *bench, Py_ssize_t size)
+{
+    // Every 16th pair has the same key, all of them are dropped
+    // provides the full embedded buffer only
+    MultiDictObject md = {.pairs.embedded = EMBEDDED_CAPACITY};
+    pair_list_t *list = &md.pairs;
+    PyObject *dup = PyUnicode_FromString("duplicated");
+    PyObject *keys = make_keys(size);
+    if (dup == NULL || keys == NULL) {
+        goto fail_keys;
+    }
+    for (Py_ssize_t i = 0; i < size; i += 16) {
+        if (PyList_SetItem(keys, i, Py_NewRef(dup)) < 0) {
+            goto fail_keys;
+        }
+    }
+    Py_hash_t hash = PyObject_Hash(dup);
+    if (hash == -1) {
+        goto fail_keys;
+    }
+    // Every dropped pair shifts the tail
+    uint64_t loops = loops_for((uint64_t)size * 16);
+    uint64_t dropped = 0;
+
+    bench_reset(bench);
+    for (uint64_t n = 0; n < loops; n++) {
+        if (pair_list_init(list, state, size) < 0) {
+            goto fail_keys;
+        }
+        if (fill(list, keys, Py_None) < 0) {
+            goto fail;
+        }
+        Py_ssize_t before = pair_list_len(list);
+        bench_start(bench);
+        int ret = _pair_list_drop_tail(list, dup, hash, 0);
+        bench_stop(bench);
+        if (ret < 0) {
+            goto fail;
+        }
+        dropped += (uint64_t)(before - pair_list_len(list));
+        pair_list_dealloc(list);
+    }
+    bench_report(bench, "_pair_list_drop_tail", size, "pair", dropped);
+    Py_DECREF(keys);
+    Py_DECREF(dup);
+    return 0;
+fail:
+    pair_list_dealloc(list);
+fail_keys:
+    Py_XDECREF(keys);
+    Py_XDECREF(dup);
+    return -1;
+}
+
+
+static int
+bench_update_from_seq(mod_state *state, bench_t *bench, Py_ssize_t size,
+                      bool update)
+{
+    // provides the full embedded buffer only
+    MultiDictObject md = {.pairs.embedded = EMBEDDED_CAPACITY};
+    pair_list_t *list = &md.pairs;
+    PyObject *used = NULL;
+    PyObject *seq = NULL;
+    PyObject *keys = make_keys(size);
+    if (keys == NULL) {
+        return -1;
+    }
+    seq = PyList_New(size);
+    if (seq == NULL) {
+        goto fail_keys;
+    }
+    for (Py_ssize_t i = 0; i < size; i++) {
+        PyObject *item = PyTuple_Pack(2, PyList_GET_ITEM(keys, i), Py_None);
+        if (item == NULL) {
+            goto fail_keys;
+        }
+        PyList_SET_ITEM(seq, i, item);
+    }
+    // Updated keys are searched from the start of the list
+    uint64_t loops = update ? loops_for((uint64_t)size * (uint64_t)size)
+                            : loops_for((uint64_t)size);
+
+    bench_reset(bench);
+    for (uint64_t n = 0; n < loops; n++) {
+        if (pair_list_init(list, state, -1) < 0) {
+            goto fail_keys;
+        }
+        if (update) {
+            // update an existing half, append another one
+            for (Py_ssize_t i = 0; i < size; i += 2) {
+                if (pair_list_add(list, PyList_GET_ITEM(keys, i),
+                                  Py_True) < 0) {
+                    goto fail;
+                }
+            }
+            used = PyDict_New();
+            if (used == NULL) {
+                goto fail;
+            }
+        }
+        bench_start(bench);
+        int ret = pair_list_update_from_seq(list, used, seq);
+        if (ret == 0 && used != NULL) {
+            ret = pair_list_post_update(list, used);
+        }
+        bench_stop(bench);
+        Py_CLEAR(used);
+        if (ret < 0) {
+            goto fail;
+        }
+        pair_list_dealloc(list);
+    }
+    bench_report(bench,
+                 update ? "update_from_seq" : "extend_from_seq",
+                 size, "pair", loops * (uint64_t)size);
+    Py_DECREF(seq);
+    Py_DECREF(keys);
+    return 0;
+fail:
+    Py_CLEAR(used);
+    pair_list_dealloc(list);
+fail_keys:
+    Py_XDECREF(seq);
+    Py_DECREF(keys);
+    return -1;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    static const Py_ssize_t sizes[] = {1, 10, 100, 1000, 10000, 100000};
+    const char *filter = argc > 1 ? argv[1] : NULL;
+    PyObject *mod = NULL;
+    bench_t bench;
+    int ret = 1;
+
+    Py_Initialize();
+
+    mod = PyImport_ImportModule("multidict._multidict");
+    if (mod == NULL) {
+        goto exit;
+    }
+    mod_state *state = (mod_state *)PyModule_GetState(mod);
+
+    bench_open(&bench);
+    printf("%-20s %8s %-6s %10s", "benchmark", "size", "op", "ns/op");
+    for (int i = 0; i < N_COUNTERS; i++) {
+        printf(" %14s", counter_names[i]);
+    }
+    printf("\n");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        Py_ssize_t size = sizes[i];
+#define RUN(name, call) \
+        if (filter == NULL || strstr(name, filter) != NULL) { \
+            if ((call) < 0) { \
+                goto exit_bench; \
+            } \
+        }
+        RUN("pair_list_add", bench_add(state, &bench, size, false));
+        RUN("ci_pair_list_add", bench_add(state, &bench, size, true));
+        RUN("pair_list_get_one", bench_get_one(state, &bench, size));
+        RUN("pair_list_replace", bench_replace(state, &bench, size));
+        RUN("_pair_list_drop_tail", bench_drop_tail(state, &bench, size));
+        RUN("extend_from_seq",
+            bench_update_from_seq(state, &bench, size, false));
+        RUN("update_from_seq",
+            bench_update_from_seq(state, &bench, size, true));
+#undef RUN
+    }
+    ret = 0;
+
+exit_bench:
+    bench_close(&bench);
+exit:
+    if (PyErr_Occurred()) {
+        PyErr_Print();
+    }
+    Py_XDECREF(mod);
+    if (Py_FinalizeEx() < 0) {
+        ret = 120;
+    }
+    return ret;
+}
@@ -5,6 +5,7 @@ multidict. It behaves mostly like a dict but it can have
 several values for the same key.
 """
 
+import os
 from typing import TYPE_CHECKING
 
 from ._abc import MultiMapping, MutableMultiMapping
@@ -17,9 +18,18 @@ __all__ = (
     "CIMultiDictProxy",
     "MultiDict",
     "CIMultiDict",
+    "BytesMultiDict",
+    "CIBytesMultiDict",
+    "CIMultiDictBuilder",
+    "MultiDictArena",
+    "SharedMultiDict",
+    "ChainMultiDict",
+    "RawHeadersView",
     "upstr",
     "istr",
     "getversion",
+    "get_include",
+    "set_trace_hook",
 )
 
 __version__ = "6.4.2"
@@ -27,33 +37,56 @@ __version__ = "6.4.2"
 
 if TYPE_CHECKING or not USE_EXTENSIONS:
     from ._multidict_py import (
+        BytesMultiDict,
+        ChainMultiDict,
+        CIBytesMultiDict,
         CIMultiDict,
+        CIMultiDictBuilder,
         CIMultiDictProxy,
         MultiDict,
+        MultiDictArena,
         MultiDictProxy,
+        RawHeadersView,
+        SharedMultiDict,
         getversion,
         istr,
+        set_trace_hook,
     )
 else:
     from collections.abc import ItemsView, KeysView, ValuesView
 
     from ._multidict import (
+        BytesMultiDict,
+        ChainMultiDict,
+        CIBytesMultiDict,
         CIMultiDict,
+        CIMultiDictBuilder,
         CIMultiDictProxy,
         MultiDict,
+        MultiDictArena,
         MultiDictProxy,
+        RawHeadersView,
+        SharedMultiDict,
         _ItemsView,
         _KeysView,
         _ValuesView,
         getversion,
         istr,
+        set_trace_hook,
     )
 
     MultiMapping.register(MultiDictProxy)
+    MultiMapping.register(RawHeadersView)
     MutableMultiMapping.register(MultiDict)
+    MutableMultiMapping.register(BytesMultiDict)
     KeysView.register(_KeysView)
     ItemsView.register(_ItemsView)
     ValuesView.register(_ValuesView)
 
 
+def get_include() -> str:
+    """Return the directory that contains the multidict_api.h header."""
+    return os.path.dirname(__file__)
+
+
 upstr = istr
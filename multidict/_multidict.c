@@ -3,11 +3,17 @@
 
 #include "_multilib/pythoncapi_compat.h"
 
+#include "_multilib/arena.h"
+#include "_multilib/builder.h"
+#include "_multilib/capi.h"
+#include "_multilib/chain.h"
 #include "_multilib/dict.h"
 #include "_multilib/istr.h"
 #include "_multilib/iter.h"
 #include "_multilib/pair_list.h"
 #include "_multilib/parser.h"
+#include "_multilib/raw.h"
+#include "_multilib/shared.h"
 #include "_multilib/state.h"
 #include "_multilib/views.h"
 
@@ -20,10 +26,6 @@
 #define CIMultiDict_Check(state, obj) \
     (CIMultiDict_CheckExact(state, obj) \
      || PyObject_TypeCheck(obj, state->CIMultiDictType))
-#define AnyMultiDict_Check(state, obj) \
-    (MultiDict_CheckExact(state, obj) \
-     || CIMultiDict_CheckExact(state, obj) \
-     || PyObject_TypeCheck(obj, state->MultiDictType))
 #define MultiDictProxy_CheckExact(state, obj) Py_IS_TYPE(obj, state->MultiDictProxyType)
 #define MultiDictProxy_Check(state, obj) \
     (MultiDictProxy_CheckExact(state, obj) \
@@ -38,6 +40,9 @@
      || CIMultiDictProxy_CheckExact(state, obj) \
      || PyObject_TypeCheck(obj, state->MultiDictProxyType))
 
+// the lowest pickle protocol using the flat format
+#define FLAT_PICKLE_PROTOCOL 5
+
 /******************** Internal Methods ********************/
 
 static inline PyObject *
@@ -77,6 +82,9 @@ _multidict_extend(MultiDictObject *self, PyObject *arg,
         if (used == NULL) {
             goto fail;
         }
+        if (pair_list_pre_update(&self->pairs) < 0) {
+            goto fail;
+        }
     }
 
     if (kwds && !PyArg_ValidateKeywordArguments(kwds)) {
@@ -157,9 +165,10 @@ _multidict_extend_parse_args(PyObject *args, PyObject *kwds,
         if (s < 0) {
             // e.g. cannot calc size of generator object
             PyErr_Clear();
-        } else {
-            size += s;
+            s = 0;
         }
+        // the positional argument itself is not an item
+        size = s;
     } else {
         *parg = NULL;
     }
@@ -175,44 +184,80 @@ _multidict_extend_parse_args(PyObject *args, PyObject *kwds,
     return size;
 }
 
-static inline PyObject *
-multidict_copy(MultiDictObject *self)
+static inline Py_ssize_t
+_multidict_size_hint(mod_state *state, PyObject *args, PyObject *kwds)
 {
-    MultiDictObject *new_multidict = NULL;
+    // Estimate the number of items without calling Python code
+    // to choose the size class.
+    // Return -1 if the number is unknown or there are no arguments at all:
+    // an empty MultiDict() is usually filled later.
+    Py_ssize_t size = 0;
+    PyObject *arg;
 
-    new_multidict = (MultiDictObject*)PyType_GenericNew(
-        Py_TYPE(self), NULL, NULL);
-    if (new_multidict == NULL) {
-        goto fail;
+    if (kwds != NULL) {
+        size = PyDict_GET_SIZE(kwds);
     }
 
-    if (Py_TYPE(self)->tp_init((PyObject*)new_multidict, NULL, NULL) < 0) {
-        goto fail;
+    if (args == NULL || PyTuple_GET_SIZE(args) == 0) {
+        return size > 0 ? size : -1;
+    }
+    if (PyTuple_GET_SIZE(args) > 1) {
+        return -1;
     }
 
-    if (pair_list_update_from_pair_list(&new_multidict->pairs,
-                                        NULL, &self->pairs) < 0) {
-        goto fail;
+    arg = PyTuple_GET_ITEM(args, 0);
+    if (PyList_CheckExact(arg)) {
+        size += PyList_GET_SIZE(arg);
+    } else if (PyTuple_CheckExact(arg)) {
+        size += PyTuple_GET_SIZE(arg);
+    } else if (PyDict_CheckExact(arg)) {
+        size += PyDict_GET_SIZE(arg);
+    } else if (AnyMultiDict_Check(state, arg)) {
+        size += pair_list_len(&((MultiDictObject*)arg)->pairs);
+    } else if (AnyMultiDictProxy_Check(state, arg)) {
+        size += pair_list_len(&((MultiDictProxyObject*)arg)->md->pairs);
+    } else {
+        return -1;
     }
-    return (PyObject*)new_multidict;
-fail:
-    Py_CLEAR(new_multidict);
-    return NULL;
+    return size;
+}
+
+static inline int
+_multidict_init_empty(MultiDictObject *md)
+{
+    // Call __init__() without arguments, Python subclasses can't take
+    // NULL args
+    PyObject *args = PyTuple_New(0);
+    if (args == NULL) {
+        return -1;
+    }
+    int ret = Py_TYPE(md)->tp_init((PyObject*)md, args, NULL);
+    Py_DECREF(args);
+    return ret;
 }
 
 static inline PyObject *
-_multidict_proxy_copy(MultiDictProxyObject *self, PyTypeObject *type)
+_multidict_copy_from(PyTypeObject *type, pair_list_t *list)
 {
     MultiDictObject *new_multidict = NULL;
-    new_multidict = (MultiDictObject*)PyType_GenericNew(type, NULL, NULL);
+
+    // keep the size class of the original if the items fit,
+    // the copy can be filled later
+    Py_ssize_t size = pair_list_len(list);
+    if (size <= pair_list_embedded(list)) {
+        size = pair_list_embedded(list);
+    }
+    new_multidict = multidict_alloc(list->state, type, size);
     if (new_multidict == NULL) {
         goto fail;
     }
-    if (type->tp_init((PyObject*)new_multidict, NULL, NULL) < 0) {
+
+    if (_multidict_init_empty(new_multidict) < 0) {
         goto fail;
     }
+
     if (pair_list_update_from_pair_list(&new_multidict->pairs,
-                                        NULL, &self->md->pairs) < 0) {
+                                        NULL, list) < 0) {
         goto fail;
     }
     return (PyObject*)new_multidict;
@@ -221,6 +266,18 @@ fail:
     return NULL;
 }
 
+static inline PyObject *
+multidict_copy(MultiDictObject *self)
+{
+    return _multidict_copy_from(Py_TYPE(self), &self->pairs);
+}
+
+static inline PyObject *
+_multidict_proxy_copy(MultiDictProxyObject *self, PyTypeObject *type)
+{
+    return _multidict_copy_from(type, &self->md->pairs);
+}
+
 
 /******************** Base Methods ********************/
 
@@ -337,6 +394,126 @@ ret:
     return result;
 }
 
+static inline int
+_multidict_overrides_reduce(MultiDictObject *self)
+{
+    // Return 1 if a subclass overrides __reduce__(), 0 if not
+    mod_state *state = get_mod_state_by_def((PyObject *)self);
+    PyTypeObject *type = Py_TYPE(self);
+    if (type == state->MultiDictType || type == state->CIMultiDictType
+            || type == state->BytesMultiDictType
+            || type == state->CIBytesMultiDictType) {
+        return 0;
+    }
+    PyObject *reduce = PyObject_GetAttrString((PyObject *)type, "__reduce__");
+    if (reduce == NULL) {
+        return -1;
+    }
+    PyTypeObject *root = (PyObject_TypeCheck(self, state->BytesMultiDictType)
+                          ? state->BytesMultiDictType : state->MultiDictType);
+    PyObject *base = PyObject_GetAttrString((PyObject *)root, "__reduce__");
+    Py_DECREF(reduce);
+    if (base == NULL) {
+        return -1;
+    }
+    Py_DECREF(base);
+    return reduce != base;
+}
+
+static inline PyObject *
+multidict_reduce_ex(MultiDictObject *self, PyObject *protocol)
+{
+    // Protocol 5 pickles are reduced to cls._from_flat([k1, v1, k2, v2...]),
+    // older protocols and subclasses overriding __reduce__() use it
+    pair_list_t *list = &self->pairs;
+    Py_ssize_t pos;
+
+    long proto = PyLong_AsLong(protocol);
+    if (proto == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    int overrides = _multidict_overrides_reduce(self);
+    if (overrides < 0) {
+        return NULL;
+    }
+    if (overrides) {
+        return PyObject_CallMethod((PyObject *)self, "__reduce__", NULL);
+    }
+    if (proto < FLAT_PICKLE_PROTOCOL) {
+        return multidict_reduce(self);
+    }
+
+    PyObject *flat = PyList_New(2 * pair_list_len(list));
+    if (flat == NULL) {
+        return NULL;
+    }
+    Py_ssize_t i = 0;
+    for (pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        PyObject *value = pair_list_value(list, pair);
+        if (value == NULL) {
+            Py_DECREF(flat);
+            return NULL;
+        }
+        PyList_SET_ITEM(flat, 2 * i,
+                        Py_NewRef(pair_list_pair_key(list, pair)));
+        PyList_SET_ITEM(flat, 2 * i + 1, Py_NewRef(value));
+        i++;
+    }
+
+    PyObject *ctor = PyObject_GetAttrString((PyObject *)Py_TYPE(self),
+                                            "_from_flat");
+    if (ctor == NULL) {
+        Py_DECREF(flat);
+        return NULL;
+    }
+    return Py_BuildValue("N(N)", ctor, flat);
+}
+
+static inline PyObject *
+multidict_from_flat(PyTypeObject *type, PyObject *flat)
+{
+    MultiDictObject *md = NULL;
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    mod_state *state = get_mod_state(mod);
+    // a tuple can't be changed by key.lower() calls of str subclasses
+    PyObject *seq = PySequence_Tuple(flat);
+    if (seq == NULL) {
+        return NULL;
+    }
+    Py_ssize_t size = PyTuple_GET_SIZE(seq);
+    if (size % 2 != 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "_from_flat() argument should contain "
+                        "an even number of items");
+        goto fail;
+    }
+
+    md = multidict_alloc(state, type, size / 2);
+    if (md == NULL) {
+        goto fail;
+    }
+    if (_multidict_init_empty(md) < 0) {
+        goto fail;
+    }
+    if (pair_list_extend_flat(&md->pairs,
+                              &PyTuple_GET_ITEM(seq, 0), size) < 0) {
+        goto fail;
+    }
+    Py_DECREF(seq);
+    return (PyObject*)md;
+fail:
+    Py_XDECREF(md);
+    Py_DECREF(seq);
+    return NULL;
+}
+
 static inline PyObject *
 multidict_repr(MultiDictObject *self)
 {
@@ -410,6 +587,10 @@ multidict_tp_richcompare(PyObject *self, PyObject *other, int op)
     }
 
     mod_state *state = ((MultiDictObject*)self)->pairs.state;
+    if (Py_IS_TYPE(other, state->ChainMultiDictType)) {
+        // the chain compares as its flat copy, like the pure Python version
+        Py_RETURN_NOTIMPLEMENTED;
+    }
     if (AnyMultiDict_Check(state, other)) {
         cmp = pair_list_eq(
             &((MultiDictObject*)self)->pairs,
@@ -493,6 +674,19 @@ PyDoc_STRVAR(multidict_values_doc,
 
 /******************** MultiDict ********************/
 
+static inline PyObject *
+multidict_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    // The size class is chosen here, __init__() runs on the allocated object
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    mod_state *state = get_mod_state(mod);
+    return (PyObject *)multidict_alloc(state, type,
+                                       _multidict_size_hint(state, args, kwds));
+}
+
 static inline int
 multidict_tp_init(MultiDictObject *self, PyObject *args, PyObject *kwds)
 {
@@ -505,6 +699,9 @@ multidict_tp_init(MultiDictObject *self, PyObject *args, PyObject *kwds)
     if (pair_list_init(&self->pairs, state, size) < 0) {
         goto fail;
     }
+    if (Py_IS_TYPE(self, state->MultiDictType)) {
+        pair_list_untrack(&self->pairs);
+    }
     if (_multidict_extend(self, arg, kwds, "MultiDict", 1) < 0) {
         goto fail;
     }
@@ -533,6 +730,46 @@ multidict_add(MultiDictObject *self, PyObject *const *args,
     Py_RETURN_NONE;
 }
 
+static inline PyObject *
+multidict_add_many(MultiDictObject *self, PyObject *const *args,
+                   Py_ssize_t nargs)
+{
+    PyObject *keys = NULL;
+    PyObject *values = NULL;
+    PyObject *ret = NULL;
+
+    if (nargs != 2) {
+        PyErr_Format(PyExc_TypeError,
+                     "add_many() takes exactly 2 arguments (%zd given)", nargs);
+        return NULL;
+    }
+    // tuples can't be changed by key.lower() calls of str subclasses
+    keys = PySequence_Tuple(args[0]);
+    if (keys == NULL) {
+        goto done;
+    }
+    values = PySequence_Tuple(args[1]);
+    if (values == NULL) {
+        goto done;
+    }
+    Py_ssize_t size = PyTuple_GET_SIZE(keys);
+    if (size != PyTuple_GET_SIZE(values)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "add_many() keys and values should have "
+                        "the same length");
+        goto done;
+    }
+    if (pair_list_add_many(&self->pairs, &PyTuple_GET_ITEM(keys, 0),
+                           &PyTuple_GET_ITEM(values, 0), size) < 0) {
+        goto done;
+    }
+    ret = Py_NewRef(Py_None);
+done:
+    Py_XDECREF(keys);
+    Py_XDECREF(values);
+    return ret;
+}
+
 static inline PyObject *
 multidict_extend(MultiDictObject *self, PyObject *args, PyObject *kwds)
 {
@@ -541,7 +778,9 @@ multidict_extend(MultiDictObject *self, PyObject *args, PyObject *kwds)
     if (size < 0) {
         goto fail;
     }
-    pair_list_grow(&self->pairs, size);
+    if (pair_list_reserve(&self->pairs, pair_list_len(&self->pairs) + size) < 0) {
+        goto fail;
+    }
     if (_multidict_extend(self, arg, kwds, "extend", 1) < 0) {
         goto fail;
     }
@@ -667,12 +906,230 @@ multidict_popall(MultiDictObject *self, PyObject *const *args,
     }
 }
 
+static inline Py_ssize_t
+_multidict_remove_many(MultiDictObject *self, PyObject *keys,
+                       PyObject *removed)
+{
+    // a tuple can't be changed by key.lower() calls of str subclasses
+    PyObject *seq = PySequence_Tuple(keys);
+    if (seq == NULL) {
+        return -1;
+    }
+    Py_ssize_t ret = pair_list_remove_many(&self->pairs,
+                                           &PyTuple_GET_ITEM(seq, 0),
+                                           PyTuple_GET_SIZE(seq), removed);
+    Py_DECREF(seq);
+    return ret;
+}
+
+static inline PyObject *
+multidict_discard_many(MultiDictObject *self, PyObject *keys)
+{
+    if (_multidict_remove_many(self, keys, NULL) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static inline PyObject *
+multidict_popmany(MultiDictObject *self, PyObject *keys)
+{
+    PyObject *removed = PyList_New(0);
+    if (removed == NULL) {
+        return NULL;
+    }
+    if (_multidict_remove_many(self, keys, removed) < 0) {
+        Py_DECREF(removed);
+        return NULL;
+    }
+    return removed;
+}
+
+static inline PyObject *
+_multidict_retain_selected(MultiDictObject *self, char *keep,
+                           Py_ssize_t ndropped, bool partition)
+{
+    // Remove pairs selected by pair_list_select*(),
+    // return the multidict of removed pairs if partition is true.
+    // The keep flags are released.
+    pair_list_t *list = &self->pairs;
+    uint64_t version = list->version;
+    MultiDictObject *dropped = NULL;
+    PyObject *ret = NULL;
+
+    if (ndropped < 0) {
+        goto done;
+    }
+    if (partition) {
+        PyTypeObject *type = Py_TYPE(self);
+        dropped = multidict_alloc(list->state, type, ndropped);
+        if (dropped == NULL) {
+            goto done;
+        }
+        if (_multidict_init_empty(dropped) < 0
+                || pair_list_reserve(&dropped->pairs, ndropped) < 0) {
+            goto done;
+        }
+        if (version != list->version) {
+            // changed by __init__() of a subclass
+            PyErr_SetString(PyExc_RuntimeError,
+                            "MultiDict changed during iteration");
+            goto done;
+        }
+    }
+    if (ndropped > 0
+            && pair_list_retain(list, keep,
+                                partition ? &dropped->pairs : NULL) < 0) {
+        goto done;
+    }
+    ret = partition ? Py_NewRef((PyObject*)dropped) : Py_NewRef(Py_None);
+done:
+    PyMem_Free(keep);
+    Py_XDECREF(dropped);
+    return ret;
+}
+
+static inline char *
+_multidict_keep_flags(MultiDictObject *self)
+{
+    char *keep = PyMem_Malloc(self->pairs.size ? (size_t)self->pairs.size : 1);
+    if (keep == NULL) {
+        PyErr_NoMemory();
+    }
+    return keep;
+}
+
+static inline PyObject *
+multidict_retain(MultiDictObject *self, PyObject *pred)
+{
+    char *keep = _multidict_keep_flags(self);
+    if (keep == NULL) {
+        return NULL;
+    }
+    Py_ssize_t ndropped = pair_list_select(&self->pairs, pred, keep);
+    return _multidict_retain_selected(self, keep, ndropped, false);
+}
+
+static inline PyObject *
+multidict_partition(MultiDictObject *self, PyObject *pred)
+{
+    char *keep = _multidict_keep_flags(self);
+    if (keep == NULL) {
+        return NULL;
+    }
+    Py_ssize_t ndropped = pair_list_select(&self->pairs, pred, keep);
+    return _multidict_retain_selected(self, keep, ndropped, true);
+}
+
+static inline PyObject *
+multidict_retain_prefix(MultiDictObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "invert", NULL};
+    PyObject *prefix = NULL;
+    PyObject *prefixes = NULL;
+    int invert = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$p:retain_prefix", kwlist,
+                                     &prefix, &invert)) {
+        return NULL;
+    }
+    // a str or a tuple of str like str.startswith() accepts
+    prefixes = PyTuple_Check(prefix) ? PyTuple_New(PyTuple_GET_SIZE(prefix))
+                                     : PyTuple_New(1);
+    if (prefixes == NULL) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(prefixes); i++) {
+        PyObject *item = PyTuple_Check(prefix) ? PyTuple_GET_ITEM(prefix, i)
+                                               : prefix;
+        PyObject *identity = pair_list_calc_identity(&self->pairs, item);
+        if (identity == NULL) {
+            Py_DECREF(prefixes);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(prefixes, i, identity);
+    }
+
+    char *keep = _multidict_keep_flags(self);
+    if (keep == NULL) {
+        Py_DECREF(prefixes);
+        return NULL;
+    }
+    Py_ssize_t ndropped = pair_list_select_prefix(&self->pairs, prefixes,
+                                                  invert, keep);
+    Py_DECREF(prefixes);
+    return _multidict_retain_selected(self, keep, ndropped, false);
+}
+
 static inline PyObject *
 multidict_popitem(MultiDictObject *self)
 {
     return pair_list_pop_item(&self->pairs);
 }
 
+static inline PyObject *
+multidict_reserve(MultiDictObject *self, PyObject *arg)
+{
+    Py_ssize_t size = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    if (size == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be non-negative");
+        return NULL;
+    }
+    if (pair_list_reserve(&self->pairs, size) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static inline int
+_limit_converter(PyObject *arg, Py_ssize_t *limit)
+{
+    // None is no limit
+    if (arg == Py_None) {
+        *limit = PY_SSIZE_T_MAX;
+        return 1;
+    }
+    *limit = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    if (*limit == -1 && PyErr_Occurred()) {
+        return 0;
+    }
+    if (*limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "limit must be non-negative");
+        return 0;
+    }
+    return 1;
+}
+
+static inline PyObject *
+multidict_set_limits(MultiDictObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"max_items", "max_duplicates", NULL};
+    Py_ssize_t max_items = PY_SSIZE_T_MAX;
+    Py_ssize_t max_duplicates = PY_SSIZE_T_MAX;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$O&O&:set_limits", kwlist,
+                                     _limit_converter, &max_items,
+                                     _limit_converter, &max_duplicates)) {
+        return NULL;
+    }
+    if (pair_list_set_limits(&self->pairs, max_items, max_duplicates) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static inline PyObject *
+multidict_shrink_to_fit(MultiDictObject *self)
+{
+    if (pair_list_shrink_to_fit(&self->pairs) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static inline PyObject *
 multidict_update(MultiDictObject *self, PyObject *args, PyObject *kwds)
 {
@@ -693,6 +1150,9 @@ fail:
 PyDoc_STRVAR(multidict_add_doc,
 "Add the key and value, not overwriting any previous value.");
 
+PyDoc_STRVAR(multidict_add_many_doc,
+"Add keys[i] and values[i] pairs, not overwriting any previous value.");
+
 PyDoc_STRVAR(multidict_copy_doc,
 "Return a copy of itself.");
 
@@ -721,21 +1181,53 @@ PyDoc_STRVAR(multidict_popall_doc,
 If key is not found, default is returned if given, otherwise KeyError is \
 raised.\n");
 
+PyDoc_STRVAR(multidict_discard_many_doc,
+"Remove all occurrences of every key in keys, missing keys are ignored.");
+
+PyDoc_STRVAR(multidict_popmany_doc,
+"Remove all occurrences of every key in keys and return the list of \
+removed (key, value) pairs in order.");
+
+PyDoc_STRVAR(multidict_retain_doc,
+"Keep only pairs for which pred(key, value) is true.");
+
+PyDoc_STRVAR(multidict_partition_doc,
+"Keep only pairs for which pred(key, value) is true and return \
+a multidict of the removed pairs.");
+
+PyDoc_STRVAR(multidict_retain_prefix_doc,
+"Keep only pairs whose keys start with prefix.\n\n\
+prefix can also be a tuple of prefixes to look for, pairs with \
+matching keys are removed instead if invert is true.");
+
 PyDoc_STRVAR(multidict_popitem_doc,
 "Remove and return an arbitrary (key, value) pair.");
 
 PyDoc_STRVAR(multidict_update_doc,
 "Update the dictionary from *other*, overwriting existing keys.");
 
+PyDoc_STRVAR(multidict_reserve_doc,
+"Preallocate memory for at least *size* items.");
+
+PyDoc_STRVAR(multidict_shrink_to_fit_doc,
+"Release unused preallocated memory.");
+
+PyDoc_STRVAR(multidict_set_limits_doc,
+"Limit the number of items and the number of items with the same key.\n\n"
+"Adding an item over the limit raises ValueError, None means no limit.");
+
 PyDoc_STRVAR(sizeof__doc__,
 "D.__sizeof__() -> size of D in memory, in bytes");
 
 static inline PyObject *
 _multidict_sizeof(MultiDictObject *self)
 {
-    Py_ssize_t size = sizeof(MultiDictObject);
-    if (self->pairs.pairs != self->pairs.buffer) {
-        size += (Py_ssize_t)sizeof(pair_t) * self->pairs.capacity;
+    // subclasses always have the full buffer
+    Py_ssize_t cut = EMBEDDED_CAPACITY - pair_list_embedded(&self->pairs);
+    Py_ssize_t size = Py_TYPE(self)->tp_basicsize
+        - cut * (Py_ssize_t)sizeof(pair_t);
+    if (self->pairs.pairs != self->buffer) {
+        size += pair_list_pair_size(&self->pairs) * self->pairs.capacity;
     }
     return PyLong_FromSsize_t(size);
 }
@@ -784,6 +1276,12 @@ static PyMethodDef multidict_methods[] = {
         METH_FASTCALL | METH_KEYWORDS,
         multidict_add_doc
     },
+    {
+        "add_many",
+        (PyCFunction)(void(*)(void))multidict_add_many,
+        METH_FASTCALL,
+        multidict_add_many_doc
+    },
     {
         "copy",
         (PyCFunction)multidict_copy,
@@ -826,6 +1324,36 @@ static PyMethodDef multidict_methods[] = {
         METH_FASTCALL | METH_KEYWORDS,
         multidict_popall_doc
     },
+    {
+        "discard_many",
+        (PyCFunction)multidict_discard_many,
+        METH_O,
+        multidict_discard_many_doc
+    },
+    {
+        "popmany",
+        (PyCFunction)multidict_popmany,
+        METH_O,
+        multidict_popmany_doc
+    },
+    {
+        "retain",
+        (PyCFunction)multidict_retain,
+        METH_O,
+        multidict_retain_doc
+    },
+    {
+        "partition",
+        (PyCFunction)multidict_partition,
+        METH_O,
+        multidict_partition_doc
+    },
+    {
+        "retain_prefix",
+        (PyCFunction)multidict_retain_prefix,
+        METH_VARARGS | METH_KEYWORDS,
+        multidict_retain_prefix_doc
+    },
     {
         "popitem",
         (PyCFunction)multidict_popitem,
@@ -838,12 +1366,42 @@ static PyMethodDef multidict_methods[] = {
         METH_VARARGS | METH_KEYWORDS,
         multidict_update_doc
     },
+    {
+        "reserve",
+        (PyCFunction)multidict_reserve,
+        METH_O,
+        multidict_reserve_doc
+    },
+    {
+        "shrink_to_fit",
+        (PyCFunction)multidict_shrink_to_fit,
+        METH_NOARGS,
+        multidict_shrink_to_fit_doc
+    },
+    {
+        "set_limits",
+        (PyCFunction)multidict_set_limits,
+        METH_VARARGS | METH_KEYWORDS,
+        multidict_set_limits_doc
+    },
     {
         "__reduce__",
         (PyCFunction)multidict_reduce,
         METH_NOARGS,
         NULL,
     },
+    {
+        "__reduce_ex__",
+        (PyCFunction)multidict_reduce_ex,
+        METH_O,
+        NULL,
+    },
+    {
+        "_from_flat",
+        (PyCFunction)multidict_from_flat,
+        METH_O | METH_CLASS,
+        NULL,
+    },
     {
         "__class_getitem__",
         (PyCFunction)Py_GenericAlias,
@@ -891,7 +1449,7 @@ static PyType_Slot multidict_slots[] = {
     {Py_tp_methods, multidict_methods},
     {Py_tp_init, multidict_tp_init},
     {Py_tp_alloc, PyType_GenericAlloc},
-    {Py_tp_new, PyType_GenericNew},
+    {Py_tp_new, multidict_tp_new},
     {Py_tp_free, PyObject_GC_Del},
 
 #ifndef MANAGED_WEAKREFS
@@ -930,6 +1488,9 @@ cimultidict_tp_init(MultiDictObject *self, PyObject *args, PyObject *kwds)
     if (ci_pair_list_init(&self->pairs, state, size) < 0) {
         goto fail;
     }
+    if (Py_IS_TYPE(self, state->CIMultiDictType)) {
+        pair_list_untrack(&self->pairs);
+    }
 
     if (_multidict_extend(self, arg, kwds, "CIMultiDict", 1) < 0) {
         goto fail;
@@ -962,6 +1523,158 @@ static PyType_Spec cimultidict_spec = {
     .slots = cimultidict_slots,
 };
 
+/******************** BytesMultiDict ********************/
+
+static inline int
+_bytesmultidict_init(MultiDictObject *self, PyObject *args, PyObject *kwds,
+                     const char *name, bool ci, PyTypeObject *exact_type)
+{
+    mod_state *state = get_mod_state_by_def((PyObject *)self);
+    PyObject *arg = NULL;
+    Py_ssize_t size = _multidict_extend_parse_args(args, kwds, name, &arg);
+    if (size < 0) {
+        goto fail;
+    }
+    if (bytes_pair_list_init(&self->pairs, state, ci, size) < 0) {
+        goto fail;
+    }
+    if (Py_IS_TYPE(self, exact_type)) {
+        pair_list_untrack(&self->pairs);
+    }
+    if (_multidict_extend(self, arg, kwds, name, 1) < 0) {
+        goto fail;
+    }
+    Py_CLEAR(arg);
+    return 0;
+fail:
+    Py_CLEAR(arg);
+    return -1;
+}
+
+static inline int
+bytesmultidict_tp_init(MultiDictObject *self, PyObject *args, PyObject *kwds)
+{
+    mod_state *state = get_mod_state_by_def((PyObject *)self);
+    return _bytesmultidict_init(self, args, kwds, "BytesMultiDict", false,
+                                state->BytesMultiDictType);
+}
+
+static inline int
+cibytesmultidict_tp_init(MultiDictObject *self, PyObject *args, PyObject *kwds)
+{
+    mod_state *state = get_mod_state_by_def((PyObject *)self);
+    return _bytesmultidict_init(self, args, kwds, "CIBytesMultiDict", true,
+                                state->CIBytesMultiDictType);
+}
+
+
+PyDoc_STRVAR(BytesMultiDict_doc,
+"Dictionary with the support for duplicate bytes keys.");
+
+PyDoc_STRVAR(CIBytesMultiDict_doc,
+"Dictionary with the support for duplicate bytes keys\n"
+"compared with ASCII case folding.");
+
+// A sibling of MultiDict rather than a subclass, bytes keys can't be
+// passed where a MultiDict is expected
+static PyType_Slot bytesmultidict_slots[] = {
+    {Py_tp_dealloc, multidict_tp_dealloc},
+    {Py_tp_repr, multidict_repr},
+    {Py_tp_doc, (void *)BytesMultiDict_doc},
+
+    {Py_sq_contains, multidict_sq_contains},
+    {Py_mp_length, multidict_mp_len},
+    {Py_mp_subscript, multidict_mp_subscript},
+    {Py_mp_ass_subscript, multidict_mp_as_subscript},
+
+    {Py_tp_traverse, multidict_tp_traverse},
+    {Py_tp_clear, multidict_tp_clear},
+    {Py_tp_richcompare, multidict_tp_richcompare},
+    {Py_tp_iter, multidict_tp_iter},
+    {Py_tp_methods, multidict_methods},
+    {Py_tp_init, bytesmultidict_tp_init},
+    {Py_tp_alloc, PyType_GenericAlloc},
+    {Py_tp_new, multidict_tp_new},
+    {Py_tp_free, PyObject_GC_Del},
+
+#ifndef MANAGED_WEAKREFS
+    {Py_tp_members, multidict_members},
+#endif
+    {0, NULL},
+};
+
+static PyType_Spec bytesmultidict_spec = {
+    .name = "multidict._multidict.BytesMultiDict",
+    .basicsize = sizeof(MultiDictObject),
+    .flags = (Py_TPFLAGS_DEFAULT  | Py_TPFLAGS_BASETYPE
+#if PY_VERSION_HEX >= 0x030a00f0
+              | Py_TPFLAGS_IMMUTABLETYPE
+#endif
+#ifdef MANAGED_WEAKREFS
+              | Py_TPFLAGS_MANAGED_WEAKREF
+#endif
+              | Py_TPFLAGS_HAVE_GC),
+    .slots = bytesmultidict_slots,
+};
+
+static PyType_Slot cibytesmultidict_slots[] = {
+    {Py_tp_doc, (void *)CIBytesMultiDict_doc},
+    {Py_tp_init, cibytesmultidict_tp_init},
+    {0, NULL},
+};
+
+static PyType_Spec cibytesmultidict_spec = {
+    .name = "multidict._multidict.CIBytesMultiDict",
+    .basicsize = sizeof(MultiDictObject),
+    .flags = (Py_TPFLAGS_DEFAULT
+#if PY_VERSION_HEX >= 0x030a00f0
+              | Py_TPFLAGS_IMMUTABLETYPE
+#endif
+              | Py_TPFLAGS_BASETYPE),
+    .slots = cibytesmultidict_slots,
+};
+
+/******************** Size class layouts ********************/
+
+// Internal types allocating exact multidicts with a cut buffer,
+// see the note about the size classes in dict.h
+static PyType_Slot multidict_layout_slots[] = {
+    {Py_tp_dealloc, multidict_tp_dealloc},
+    {Py_tp_traverse, multidict_tp_traverse},
+    {Py_tp_clear, multidict_tp_clear},
+    {0, NULL},
+};
+
+#define MULTIDICT_LAYOUT_FLAGS (Py_TPFLAGS_DEFAULT \
+                                | LAYOUT_IMMUTABLE_FLAGS \
+                                | LAYOUT_WEAKREF_FLAGS \
+                                | Py_TPFLAGS_HAVE_GC)
+#if PY_VERSION_HEX >= 0x030a00f0
+#define LAYOUT_IMMUTABLE_FLAGS \
+    (Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION)
+#else
+#define LAYOUT_IMMUTABLE_FLAGS 0
+#endif
+#ifdef MANAGED_WEAKREFS
+#define LAYOUT_WEAKREF_FLAGS Py_TPFLAGS_MANAGED_WEAKREF
+#else
+#define LAYOUT_WEAKREF_FLAGS 0
+#endif
+
+static PyType_Spec multidict_no_buffer_layout_spec = {
+    .name = "multidict._multidict._NoBufferLayout",
+    .basicsize = (int)MULTIDICT_LAYOUT_SIZE(0),
+    .flags = MULTIDICT_LAYOUT_FLAGS,
+    .slots = multidict_layout_slots,
+};
+
+static PyType_Spec multidict_small_layout_spec = {
+    .name = "multidict._multidict._SmallLayout",
+    .basicsize = (int)MULTIDICT_LAYOUT_SIZE(SMALL_EMBEDDED_CAPACITY),
+    .flags = MULTIDICT_LAYOUT_FLAGS,
+    .slots = multidict_layout_slots,
+};
+
 /******************** MultiDictProxy ********************/
 
 static inline int
@@ -1001,6 +1714,12 @@ multidict_proxy_tp_init(MultiDictProxyObject *self, PyObject *args,
     } else {
         md = (MultiDictObject*)arg;
     }
+    if (md->pairs.bytes_keys) {
+        PyErr_Format(PyExc_TypeError,
+                     "ctor doesn't support bytes keys of <class '%s'>",
+                     Py_TYPE(arg)->tp_name);
+        return -1;
+    }
     Py_INCREF(md);
     self->md = md;
 
@@ -1349,6 +2068,97 @@ getversion(PyObject *self, PyObject *md)
     return PyLong_FromUnsignedLong(pair_list_version(pairs));
 }
 
+PyDoc_STRVAR(stats__doc__,
+"Return runtime statistics counters of the C extension.\n\n"
+"Available only if the extension is built with MULTIDICT_STATS defined.");
+
+static inline PyObject *
+stats(PyObject *self, PyObject *Py_UNUSED(unused))
+{
+#ifdef MULTIDICT_STATS
+    multidict_stats_t *st = &get_mod_state(self)->stats;
+    double avg_scan_length = 0.0;
+    if (st->lookups > 0) {
+        avg_scan_length = (double)st->probes / (double)st->lookups;
+    }
+    return Py_BuildValue(
+        "{s:{n:K,n:K,n:K},s:K,s:K,s:K,s:K,s:K,s:K,s:d,s:K,s:K,s:K,s:K}",
+        "constructed",
+        (Py_ssize_t)0, (unsigned long long)st->constructed_no_buffer,
+        (Py_ssize_t)SMALL_EMBEDDED_CAPACITY,
+        (unsigned long long)st->constructed_small,
+        (Py_ssize_t)EMBEDDED_CAPACITY,
+        (unsigned long long)st->constructed_full,
+        "spills", (unsigned long long)st->spills,
+        "shrinks", (unsigned long long)st->shrinks,
+        "lookups", (unsigned long long)st->lookups,
+        "signature_rejects", (unsigned long long)st->signature_rejects,
+        "lookup_cache_hits", (unsigned long long)st->lookup_cache_hits,
+        "probes", (unsigned long long)st->probes,
+        "avg_scan_length", avg_scan_length,
+        "str_cmps", (unsigned long long)st->str_cmps,
+        "hash_collisions", (unsigned long long)st->hash_collisions,
+        "ci_identities", (unsigned long long)st->ci_identities,
+        "istr_materializations",
+        (unsigned long long)st->istr_materializations);
+#else
+    PyErr_SetString(PyExc_RuntimeError,
+                    "multidict is built without statistics, "
+                    "rebuild it with MULTIDICT_STATS=1");
+    return NULL;
+#endif
+}
+
+PyDoc_STRVAR(set_trace_hook__doc__,
+"set_trace_hook(threshold_ns, fn, *, size_threshold=None)\n\n"
+"Call fn(operation, size, elapsed_ns) for multidict operations that take\n"
+"at least threshold_ns nanoseconds or run on multidicts with at least\n"
+"size_threshold items.  Pass None as fn to remove the hook.");
+
+static inline PyObject *
+set_trace_hook(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"threshold_ns", "fn", "size_threshold", NULL};
+    mod_state *state = get_mod_state(self);
+    long long threshold_ns;
+    PyObject *fn;
+    PyObject *size_arg = Py_None;
+    Py_ssize_t size_threshold = PY_SSIZE_T_MAX;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "LO|$O:set_trace_hook",
+                                     kwlist, &threshold_ns, &fn, &size_arg)) {
+        return NULL;
+    }
+    if (threshold_ns < 0) {
+        PyErr_SetString(PyExc_ValueError, "threshold_ns must be non-negative");
+        return NULL;
+    }
+    if (fn != Py_None && !PyCallable_Check(fn)) {
+        PyErr_SetString(PyExc_TypeError, "fn must be callable or None");
+        return NULL;
+    }
+    if (size_arg != Py_None) {
+        size_threshold = PyLong_AsSsize_t(size_arg);
+        if (size_threshold == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (size_threshold < 0) {
+            PyErr_SetString(PyExc_ValueError,
+                            "size_threshold must be non-negative");
+            return NULL;
+        }
+    }
+
+    state->trace_threshold_ns = (int64_t)threshold_ns;
+    state->trace_size_threshold = size_threshold;
+    if (fn == Py_None) {
+        Py_CLEAR(state->trace_hook);
+    } else {
+        Py_XSETREF(state->trace_hook, Py_NewRef(fn));
+    }
+    Py_RETURN_NONE;
+}
+
 /******************** Module ********************/
 
 static int
@@ -1357,9 +2167,18 @@ module_traverse(PyObject *mod, visitproc visit, void *arg)
     mod_state *state = get_mod_state(mod);
 
     Py_VISIT(state->IStrType);
+    Py_VISIT(state->ArenaType);
+    Py_VISIT(state->SharedMultiDictType);
+    Py_VISIT(state->ChainMultiDictType);
+    Py_VISIT(state->BuilderType);
+    Py_VISIT(state->RawHeadersViewType);
 
     Py_VISIT(state->MultiDictType);
     Py_VISIT(state->CIMultiDictType);
+    Py_VISIT(state->BytesMultiDictType);
+    Py_VISIT(state->CIBytesMultiDictType);
+    Py_VISIT(state->NoBufferLayoutType);
+    Py_VISIT(state->SmallLayoutType);
     Py_VISIT(state->MultiDictProxyType);
     Py_VISIT(state->CIMultiDictProxyType);
 
@@ -1374,6 +2193,9 @@ module_traverse(PyObject *mod, visitproc visit, void *arg)
     Py_VISIT(state->str_lower);
     Py_VISIT(state->str_canonical);
 
+    Py_VISIT(state->arena_var);
+    Py_VISIT(state->trace_hook);
+
     return 0;
 }
 
@@ -1383,9 +2205,18 @@ module_clear(PyObject *mod)
     mod_state *state = get_mod_state(mod);
 
     Py_CLEAR(state->IStrType);
+    Py_CLEAR(state->ArenaType);
+    Py_CLEAR(state->SharedMultiDictType);
+    Py_CLEAR(state->ChainMultiDictType);
+    Py_CLEAR(state->BuilderType);
+    Py_CLEAR(state->RawHeadersViewType);
 
     Py_CLEAR(state->MultiDictType);
     Py_CLEAR(state->CIMultiDictType);
+    Py_CLEAR(state->BytesMultiDictType);
+    Py_CLEAR(state->CIBytesMultiDictType);
+    Py_CLEAR(state->NoBufferLayoutType);
+    Py_CLEAR(state->SmallLayoutType);
     Py_CLEAR(state->MultiDictProxyType);
     Py_CLEAR(state->CIMultiDictProxyType);
 
@@ -1400,6 +2231,9 @@ module_clear(PyObject *mod)
     Py_CLEAR(state->str_lower);
     Py_CLEAR(state->str_canonical);
 
+    Py_CLEAR(state->arena_var);
+    Py_CLEAR(state->trace_hook);
+
     return 0;
 }
 
@@ -1411,6 +2245,9 @@ module_free(void *mod)
 
 static PyMethodDef module_methods[] = {
     {"getversion", (PyCFunction)getversion, METH_O},
+    {"stats", (PyCFunction)stats, METH_NOARGS, stats__doc__},
+    {"set_trace_hook", (PyCFunction)set_trace_hook,
+     METH_VARARGS | METH_KEYWORDS, set_trace_hook__doc__},
     {NULL, NULL}   /* sentinel */
 };
 
@@ -1431,6 +2268,10 @@ module_exec(PyObject *mod)
         goto fail;
     }
 
+    if (pair_list_index_init(state) < 0) {
+        goto fail;
+    }
+
     if (multidict_views_init(mod, state) < 0) {
         goto fail;
     }
@@ -1443,6 +2284,26 @@ module_exec(PyObject *mod)
         goto fail;
     }
 
+    if (arena_init(mod, state) < 0) {
+        goto fail;
+    }
+
+    if (shared_init(mod, state) < 0) {
+        goto fail;
+    }
+
+    if (chain_init(mod, state) < 0) {
+        goto fail;
+    }
+
+    if (builder_init(mod, state) < 0) {
+        goto fail;
+    }
+
+    if (raw_init(mod, state) < 0) {
+        goto fail;
+    }
+
     tmp = PyType_FromModuleAndSpec(mod, &multidict_spec, NULL);
     if (tmp == NULL) {
         goto fail;
@@ -1460,6 +2321,34 @@ module_exec(PyObject *mod)
     state->CIMultiDictType = (PyTypeObject *)tmp;
     Py_CLEAR(tpl);
 
+    tmp = PyType_FromModuleAndSpec(mod, &bytesmultidict_spec, NULL);
+    if (tmp == NULL) {
+        goto fail;
+    }
+    state->BytesMultiDictType = (PyTypeObject *)tmp;
+
+    tpl = PyTuple_Pack(1, (PyObject *)state->BytesMultiDictType);
+    if (tpl == NULL) {
+        goto fail;
+    }
+    tmp = PyType_FromModuleAndSpec(mod, &cibytesmultidict_spec, tpl);
+    if (tmp == NULL) {
+        goto fail;
+    }
+    state->CIBytesMultiDictType = (PyTypeObject *)tmp;
+    Py_CLEAR(tpl);
+
+    tmp = PyType_FromModuleAndSpec(mod, &multidict_no_buffer_layout_spec, NULL);
+    if (tmp == NULL) {
+        goto fail;
+    }
+    state->NoBufferLayoutType = (PyTypeObject *)tmp;
+    tmp = PyType_FromModuleAndSpec(mod, &multidict_small_layout_spec, NULL);
+    if (tmp == NULL) {
+        goto fail;
+    }
+    state->SmallLayoutType = (PyTypeObject *)tmp;
+
     tmp = PyType_FromModuleAndSpec(mod, &multidict_proxy_spec, NULL);
     if (tmp == NULL) {
         goto fail;
@@ -1480,12 +2369,43 @@ module_exec(PyObject *mod)
     if (PyModule_AddType(mod, state->IStrType) < 0) {
         goto fail;
     }
+    if (PyModule_AddType(mod, state->ArenaType) < 0) {
+        goto fail;
+    }
+    if (PyModule_AddType(mod, state->SharedMultiDictType) < 0) {
+        goto fail;
+    }
+    if (PyModule_AddType(mod, state->ChainMultiDictType) < 0) {
+        goto fail;
+    }
+    if (PyModule_AddType(mod, state->BuilderType) < 0) {
+        goto fail;
+    }
+    if (PyModule_AddType(mod, state->RawHeadersViewType) < 0) {
+        goto fail;
+    }
+
+    tmp = capi_new_capsule(state);
+    if (tmp == NULL) {
+        goto fail;
+    }
+    if (PyModule_AddObjectRef(mod, "CAPI", tmp) < 0) {
+        Py_DECREF(tmp);
+        goto fail;
+    }
+    Py_DECREF(tmp);
     if (PyModule_AddType(mod, state->MultiDictType) < 0) {
         goto fail;
     }
     if (PyModule_AddType(mod, state->CIMultiDictType) < 0) {
         goto fail;
     }
+    if (PyModule_AddType(mod, state->BytesMultiDictType) < 0) {
+        goto fail;
+    }
+    if (PyModule_AddType(mod, state->CIBytesMultiDictType) < 0) {
+        goto fail;
+    }
     if (PyModule_AddType(mod, state->MultiDictProxyType) < 0) {
         goto fail;
     }
@@ -1,5 +1,7 @@
 import enum
+import operator
 import reprlib
+import struct
 import sys
 from abc import abstractmethod
 from array import array
@@ -18,6 +20,7 @@ from typing import (
     Generic,
     NoReturn,
     Optional,
+    SupportsIndex,
     TypeVar,
     Union,
     cast,
@@ -26,6 +29,9 @@ from typing import (
 
 from ._abc import MDArg, MultiMapping, MutableMultiMapping, SupportsKeys
 
+if TYPE_CHECKING:
+    import mmap
+
 if sys.version_info >= (3, 11):
     from typing import Self
 else:
@@ -45,14 +51,46 @@ _T = TypeVar("_T")
 _SENTINEL = enum.Enum("_SENTINEL", "sentinel")
 sentinel = _SENTINEL.sentinel
 
+# the lowest pickle protocol using the flat format
+_FLAT_PICKLE_PROTOCOL = 5
+
 _version = array("Q", [0])
 
 
+class _Limits:
+    __slots__ = ("max_items", "max_duplicates", "counts")
+
+    def __init__(self, max_items: int, max_duplicates: Optional[int]) -> None:
+        self.max_items = max_items
+        self.max_duplicates = max_duplicates
+        # identity -> number of items, None if not counted
+        self.counts: Optional[dict[str, int]] = None
+
+    def check(self, items: list[tuple[str, str, _V]], identity: str, key: str) -> None:
+        if len(items) >= self.max_items:
+            raise ValueError(f"too many items, the limit is {self.max_items}")
+        if self.max_duplicates is None:
+            return
+        counts = self.counts
+        if counts is None:
+            counts = self.counts = {}
+            for i, _, _ in items:
+                counts[i] = counts.get(i, 0) + 1
+        num = counts.get(identity, 0)
+        if num >= self.max_duplicates:
+            raise ValueError(
+                f"too many items with key {key!r}, "
+                f"the limit is {self.max_duplicates}"
+            )
+        counts[identity] = num + 1
+
+
 class _Impl(Generic[_V]):
-    __slots__ = ("_items", "_version")
+    __slots__ = ("_items", "_version", "_limits")
 
     def __init__(self) -> None:
         self._items: list[tuple[str, str, _V]] = []
+        self._limits: Optional[_Limits] = None
         self.incr_version()
 
     def incr_version(self) -> None:
@@ -60,6 +98,15 @@ class _Impl(Generic[_V]):
         v[0] += 1
         self._version = v[0]
 
+    def check_limits(self, identity: str, key: str) -> None:
+        if self._limits is not None:
+            self._limits.check(self._items, identity, key)
+
+    def forget_counts(self) -> None:
+        # items are removed, duplicates are recounted on the next check
+        if self._limits is not None:
+            self._limits.counts = None
+
     if sys.implementation.name != "pypy":
 
         def __sizeof__(self) -> int:
@@ -83,16 +130,22 @@ class _Iter(Generic[_T]):
         return self._size
 
 
+def _repr_key(key: object) -> str:
+    return repr(key) if isinstance(key, bytes) else f"'{key}'"
+
+
 class _ViewBase(Generic[_V]):
     def __init__(
         self,
         impl: _Impl[_V],
         identfunc: Callable[[str], str],
         keyfunc: Callable[[str], str],
+        keytype: type = str,
     ):
         self._impl = impl
         self._identfunc = identfunc
         self._keyfunc = keyfunc
+        self._keytype = keytype
 
     def __len__(self) -> int:
         return len(self._impl._items)
@@ -125,7 +178,7 @@ class _ItemsView(_ViewBase[_V], ItemsView[str, _V]):
     def __repr__(self) -> str:
         lst = []
         for i, k, v in self._impl._items:
-            lst.append(f"'{k}': {v!r}")
+            lst.append(f"{_repr_key(k)}: {v!r}")
         body = ", ".join(lst)
         return f"<{self.__class__.__name__}({body})>"
 
@@ -300,7 +353,7 @@ class _ValuesView(_ViewBase[_V], ValuesView[_V]):
 
 class _KeysView(_ViewBase[_V], KeysView[str]):
     def __contains__(self, key: object) -> bool:
-        if not isinstance(key, str):
+        if not isinstance(key, self._keytype):
             return False
         identity = self._identfunc(key)
         for i, k, v in self._impl._items:
@@ -320,7 +373,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
     def __repr__(self) -> str:
         lst = []
         for i, k, v in self._impl._items:
-            lst.append(f"'{k}'")
+            lst.append(_repr_key(k))
         body = ", ".join(lst)
         return f"<{self.__class__.__name__}({body})>"
 
@@ -331,7 +384,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
         except TypeError:
             return NotImplemented
         for key in it:
-            if not isinstance(key, str):
+            if not isinstance(key, self._keytype):
                 continue
             identity = self._identfunc(key)
             for i, k, v in self._impl._items:
@@ -346,7 +399,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
         except TypeError:
             return NotImplemented
         for key in it:
-            if not isinstance(key, str):
+            if not isinstance(key, self._keytype):
                 continue
             identity = self._identfunc(key)
             for i, k, v in self._impl._items:
@@ -361,7 +414,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
         except TypeError:
             return NotImplemented
         for key in it:
-            if not isinstance(key, str):
+            if not isinstance(key, self._keytype):
                 ret.add(key)
                 continue
             identity = self._identfunc(key)
@@ -380,7 +433,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
 
         tmp = set()
         for key in ret:
-            if not isinstance(key, str):
+            if not isinstance(key, self._keytype):
                 continue
             identity = self._identfunc(key)
             tmp.add(identity)
@@ -397,7 +450,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
         except TypeError:
             return NotImplemented
         for key in it:
-            if not isinstance(key, str):
+            if not isinstance(key, self._keytype):
                 continue
             identity = self._identfunc(key)
             for i, k, v in self._impl._items:
@@ -412,7 +465,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
         except TypeError:
             return NotImplemented
         for key in other:
-            if not isinstance(key, str):
+            if not isinstance(key, self._keytype):
                 continue
             identity = self._identfunc(key)
             for i, k, v in self._impl._items:
@@ -434,7 +487,7 @@ class _KeysView(_ViewBase[_V], KeysView[str]):
 
     def isdisjoint(self, other: Iterable[object]) -> bool:
         for key in other:
-            if not isinstance(key, str):
+            if not isinstance(key, self._keytype):
                 continue
             identity = self._identfunc(key)
             for i, k, v in self._impl._items:
@@ -476,9 +529,33 @@ class _CIMixin:
             raise TypeError("MultiDict keys should be either str or subclasses of str")
 
 
+class _BytesMixin:
+    _bytes: bool = True
+
+    def _key(self, key: bytes) -> bytes:
+        return key
+
+    def _title(self, key: bytes) -> bytes:
+        if isinstance(key, bytes):
+            return key
+        else:
+            raise TypeError(
+                "BytesMultiDict keys should be either bytes or subclasses of bytes"
+            )
+
+
+class _CIBytesMixin(_BytesMixin):
+    _ci: bool = True
+
+    def _title(self, key: bytes) -> bytes:
+        # bytes.lower() only changes ASCII letters
+        return super()._title(key).lower()
+
+
 class _Base(MultiMapping[_V]):
     _impl: _Impl[_V]
     _ci: bool = False
+    _bytes: bool = False
 
     @abstractmethod
     def _key(self, key: str) -> str: ...
@@ -545,7 +622,9 @@ class _Base(MultiMapping[_V]):
 
     def keys(self) -> KeysView[str]:
         """Return a new view of the dictionary's keys."""
-        return _KeysView(self._impl, self._title, self._key)
+        return _KeysView(
+            self._impl, self._title, self._key, bytes if self._bytes else str
+        )
 
     def items(self) -> ItemsView[str, _V]:
         """Return a new view of the dictionary's items *(key, value) pairs)."""
@@ -576,9 +655,9 @@ class _Base(MultiMapping[_V]):
         return True
 
     def __contains__(self, key: object) -> bool:
-        if not isinstance(key, str):
+        if not isinstance(key, bytes if self._bytes else str):
             return False
-        identity = self._title(key)
+        identity = self._title(key)  # type: ignore[arg-type]
         for i, k, v in self._impl._items:
             if i == identity:
                 return True
@@ -586,13 +665,13 @@ class _Base(MultiMapping[_V]):
 
     @reprlib.recursive_repr()
     def __repr__(self) -> str:
-        body = ", ".join(f"'{k}': {v!r}" for i, k, v in self._impl._items)
+        body = ", ".join(f"{_repr_key(k)}: {v!r}" for i, k, v in self._impl._items)
         return f"<{self.__class__.__name__}({body})>"
 
 
-class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
-    """Dictionary with the support for duplicate keys."""
-
+class _MutableBase(_Base[_V], MutableMultiMapping[_V]):
+    # The implementation shared by MultiDict and BytesMultiDict,
+    # the latter isn't a MultiDict: its keys are bytes
     def __init__(self, arg: MDArg[_V] = None, /, **kwargs: _V):
         self._impl = _Impl()
 
@@ -606,11 +685,60 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
     def __reduce__(self) -> tuple[type[Self], tuple[list[tuple[str, _V]]]]:
         return (self.__class__, (list(self.items()),))
 
+    def __reduce_ex__(self, protocol: SupportsIndex, /) -> tuple[Any, ...]:
+        # protocol 5 pickles are reduced to cls._from_flat([k1, v1, k2, v2...]),
+        # older protocols and subclasses overriding __reduce__() use it
+        if (
+            operator.index(protocol) < _FLAT_PICKLE_PROTOCOL
+            or type(self).__reduce__ is not _MutableBase.__reduce__
+        ):
+            return self.__reduce__()
+        flat: list[Any] = []
+        for _, key, value in self._impl._items:
+            flat.append(key)
+            flat.append(value)
+        return (self.__class__._from_flat, (flat,))
+
+    @classmethod
+    def _from_flat(cls, flat: Iterable[Any], /) -> Self:
+        flat = tuple(flat)
+        if len(flat) % 2 != 0:
+            raise ValueError(
+                "_from_flat() argument should contain an even number of items"
+            )
+        md = cls()
+        md._extend_items(
+            [
+                (md._title(key), key, value)
+                for key, value in zip(flat[::2], flat[1::2])
+            ]
+        )
+        return md
+
     def add(self, key: str, value: _V) -> None:
         identity = self._title(key)
+        self._impl.check_limits(identity, key)
         self._impl._items.append((identity, key, value))
         self._impl.incr_version()
 
+    def add_many(self, keys: Iterable[str], values: Iterable[_V], /) -> None:
+        """Add keys[i] and values[i] pairs, not overwriting any previous value."""
+        keys = tuple(keys)
+        values = tuple(values)
+        if len(keys) != len(values):
+            raise ValueError("add_many() keys and values should have the same length")
+        if not keys:
+            return
+        items = [(self._title(key), key, value) for key, value in zip(keys, values)]
+        size = len(self._impl._items)
+        try:
+            self._extend_items(items)
+        except BaseException:
+            # all or nothing, drop the items added before the limit is hit
+            del self._impl._items[size:]
+            self._impl.forget_counts()
+            raise
+
     def copy(self) -> Self:
         """Return a copy of itself."""
         cls = self.__class__
@@ -633,8 +761,8 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
         method: Callable[[list[tuple[str, str, _V]]], None],
     ) -> None:
         if arg:
-            if isinstance(arg, (MultiDict, MultiDictProxy)):
-                if self._ci is not arg._ci:
+            if isinstance(arg, (_MutableBase, MultiDictProxy)):
+                if self._ci is not arg._ci or self._bytes is not arg._bytes:
                     items = [(self._title(k), k, v) for _, k, v in arg._impl._items]
                 else:
                     items = arg._impl._items
@@ -644,7 +772,9 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
                     for key, value in kwargs.items():
                         items.append((self._title(key), key, value))
             else:
-                if hasattr(arg, "keys"):
+                if isinstance(arg, RawHeadersView):
+                    arg = cast(list[tuple[str, _V]], arg.items())
+                elif hasattr(arg, "keys"):
                     arg = cast(SupportsKeys[_V], arg)
                     arg = [(k, arg[k]) for k in arg.keys()]
                 if kwargs:
@@ -664,15 +794,60 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
             method([(self._title(key), key, value) for key, value in kwargs.items()])
 
     def _extend_items(self, items: Iterable[tuple[str, str, _V]]) -> None:
-        for identity, key, value in items:
-            self._impl._items.append((identity, key, value))
-        self._impl.incr_version()
+        if self._impl._limits is not None:
+            try:
+                for identity, key, value in items:
+                    self._impl.check_limits(identity, key)
+                    self._impl._items.append((identity, key, value))
+            finally:
+                # some items may be added before the limit is hit
+                self._impl.incr_version()
+        else:
+            for identity, key, value in items:
+                self._impl._items.append((identity, key, value))
+            self._impl.incr_version()
 
     def clear(self) -> None:
         """Remove all items from MultiDict."""
         self._impl._items.clear()
+        self._impl.forget_counts()
         self._impl.incr_version()
 
+    def reserve(self, size: int, /) -> None:
+        """Preallocate memory for at least *size* items."""
+        size = operator.index(size)
+        if size < 0:
+            raise ValueError("size must be non-negative")
+        # list has no capacity control, nothing to preallocate
+
+    def shrink_to_fit(self) -> None:
+        """Release unused preallocated memory."""
+
+    def set_limits(
+        self,
+        *,
+        max_items: Optional[int] = None,
+        max_duplicates: Optional[int] = None,
+    ) -> None:
+        """Limit the number of items and the number of items with the same key.
+
+        Adding an item over the limit raises ValueError, None means no limit.
+        """
+        if max_items is not None:
+            max_items = operator.index(max_items)
+            if max_items < 0:
+                raise ValueError("limit must be non-negative")
+        if max_duplicates is not None:
+            max_duplicates = operator.index(max_duplicates)
+            if max_duplicates < 0:
+                raise ValueError("limit must be non-negative")
+        if max_items is None and max_duplicates is None:
+            self._impl._limits = None
+        else:
+            self._impl._limits = _Limits(
+                sys.maxsize if max_items is None else max_items, max_duplicates
+            )
+
     # Mapping interface #
 
     def __setitem__(self, key: str, value: _V) -> None:
@@ -681,19 +856,17 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
     def __delitem__(self, key: str) -> None:
         identity = self._title(key)
         items = self._impl._items
-        found = False
-        for i in range(len(items) - 1, -1, -1):
-            if items[i][0] == identity:
-                del items[i]
-                found = True
-        if not found:
+        kept = [item for item in items if item[0] != identity]
+        if len(kept) == len(items):
             raise KeyError(key)
         else:
+            items[:] = kept
+            self._impl.forget_counts()
             self._impl.incr_version()
 
     @overload
     def setdefault(
-        self: "MultiDict[Union[_T, None]]", key: str, default: None = None
+        self: "_MutableBase[Union[_T, None]]", key: str, default: None = None
     ) -> Union[_T, None]: ...
     @overload
     def setdefault(self, key: str, default: _V) -> _V: ...
@@ -724,6 +897,7 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
             if self._impl._items[i][0] == identity:
                 value = self._impl._items[i][2]
                 del self._impl._items[i]
+                self._impl.forget_counts()
                 self._impl.incr_version()
                 return value
         if default is sentinel:
@@ -749,29 +923,89 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
         KeyError is raised.
 
         """
-        found = False
         identity = self._title(key)
-        ret = []
-        for i in range(len(self._impl._items) - 1, -1, -1):
-            item = self._impl._items[i]
-            if item[0] == identity:
-                ret.append(item[2])
-                del self._impl._items[i]
-                self._impl.incr_version()
-                found = True
-        if not found:
+        items = self._impl._items
+        ret = [v for i, k, v in items if i == identity]
+        if not ret:
             if default is sentinel:
                 raise KeyError(key)
             else:
                 return default
         else:
-            ret.reverse()
+            items[:] = [item for item in items if item[0] != identity]
+            self._impl.forget_counts()
+            self._impl.incr_version()
             return ret
 
+    def discard_many(self, keys: Iterable[str], /) -> None:
+        """Remove all occurrences of every key in keys, missing keys are ignored."""
+        self._remove_many(keys)
+
+    def popmany(self, keys: Iterable[str], /) -> list[tuple[str, _V]]:
+        """Remove all occurrences of every key in keys and return the list of
+        removed (key, value) pairs in order."""
+        return self._remove_many(keys)
+
+    def _remove_many(self, keys: Iterable[str]) -> list[tuple[str, _V]]:
+        identities = {self._title(key) for key in keys}
+        items = self._impl._items
+        removed = [(self._key(k), v) for i, k, v in items if i in identities]
+        if removed:
+            items[:] = [item for item in items if item[0] not in identities]
+            self._impl.forget_counts()
+            self._impl.incr_version()
+        return removed
+
+    def retain(self, pred: Callable[[str, _V], object], /) -> None:
+        """Keep only pairs for which pred(key, value) is true."""
+        self._retain(self._select(pred))
+
+    def partition(self, pred: Callable[[str, _V], object], /) -> Self:
+        """Keep only pairs for which pred(key, value) is true and return
+        a multidict of the removed pairs."""
+        keep = self._select(pred)
+        ret = self.__class__()
+        ret._extend_items(self._retain(keep))
+        return ret
+
+    def retain_prefix(
+        self, prefix: Union[str, tuple[str, ...]], /, *, invert: bool = False
+    ) -> None:
+        """Keep only pairs whose keys start with prefix.
+
+        prefix can also be a tuple of prefixes to look for, pairs with
+        matching keys are removed instead if invert is true.
+        """
+        prefixes = tuple(
+            self._title(p) for p in (prefix if isinstance(prefix, tuple) else (prefix,))
+        )
+        self._retain(
+            [item[0].startswith(prefixes) != invert for item in self._impl._items]
+        )
+
+    def _select(self, pred: Callable[[str, _V], object]) -> list[bool]:
+        version = self._impl._version
+        keep = []
+        for _, k, v in self._impl._items:
+            keep.append(bool(pred(k, v)))
+            if version != self._impl._version:
+                raise RuntimeError("Dictionary changed during iteration")
+        return keep
+
+    def _retain(self, keep: list[bool]) -> list[tuple[str, str, _V]]:
+        items = self._impl._items
+        dropped = [item for item, flag in zip(items, keep) if not flag]
+        if dropped:
+            items[:] = [item for item, flag in zip(items, keep) if flag]
+            self._impl.forget_counts()
+            self._impl.incr_version()
+        return dropped
+
     def popitem(self) -> tuple[str, _V]:
         """Remove and return an arbitrary (key, value) pair."""
         if self._impl._items:
             i, k, v = self._impl._items.pop()
+            self._impl.forget_counts()
             self._impl.incr_version()
             return self._key(k), v
         else:
@@ -794,22 +1028,20 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
                     self._impl._items[i] = (identity, key, value)
                     break
             else:
+                self._impl.check_limits(identity, key)
                 self._impl._items.append((identity, key, value))
                 used_keys[identity] = len(self._impl._items)
 
-        # drop tails
-        i = 0
-        while i < len(self._impl._items):
-            item = self._impl._items[i]
-            identity = item[0]
-            pos = used_keys.get(identity)
-            if pos is None:
-                i += 1
-                continue
-            if i >= pos:
-                del self._impl._items[i]
-            else:
-                i += 1
+        # drop tails, positions are compared after the removal
+        # of preceding items
+        kept: list[tuple[str, str, _V]] = []
+        for item in self._impl._items:
+            pos = used_keys.get(item[0])
+            if pos is None or len(kept) < pos:
+                kept.append(item)
+        if len(kept) != len(self._impl._items):
+            self._impl._items[:] = kept
+            self._impl.forget_counts()
 
         self._impl.incr_version()
 
@@ -826,34 +1058,48 @@ class MultiDict(_CSMixin, _Base[_V], MutableMultiMapping[_V]):
                 self._impl.incr_version()
                 break
         else:
+            self._impl.check_limits(identity, key)
             self._impl._items.append((identity, key, value))
             self._impl.incr_version()
             return
 
         # remove all tail items
         # Mypy bug: https://github.com/python/mypy/issues/14209
-        i = rgt + 1  # type: ignore[possibly-undefined]
-        while i < len(items):
-            item = items[i]
-            if item[0] == identity:
-                del items[i]
-            else:
-                i += 1
+        tail = items[rgt + 1 :]  # type: ignore[possibly-undefined]
+        kept = [item for item in tail if item[0] != identity]
+        if len(kept) != len(tail):
+            items[rgt + 1 :] = kept
+            self._impl.forget_counts()
+
+
+class MultiDict(_CSMixin, _MutableBase[_V]):
+    """Dictionary with the support for duplicate keys."""
 
 
 class CIMultiDict(_CIMixin, MultiDict[_V]):
     """Dictionary with the support for duplicate case-insensitive keys."""
 
 
+class BytesMultiDict(_BytesMixin, _MutableBase[_V]):  # type: ignore[misc]
+    """Dictionary with the support for duplicate bytes keys."""
+
+
+class CIBytesMultiDict(_CIBytesMixin, BytesMultiDict[_V]):  # type: ignore[misc]
+    """Dictionary with the support for duplicate bytes keys
+    compared with ASCII case folding."""
+
+
 class MultiDictProxy(_CSMixin, _Base[_V]):
     """Read-only proxy for MultiDict instance."""
 
     def __init__(self, arg: Union[MultiDict[_V], "MultiDictProxy[_V]"]):
-        if not isinstance(arg, (MultiDict, MultiDictProxy)):
+        if not isinstance(arg, (_MutableBase, MultiDictProxy)):
             raise TypeError(
                 "ctor requires MultiDict or MultiDictProxy instance"
                 f", not {type(arg)}"
             )
+        if arg._bytes:
+            raise TypeError(f"ctor doesn't support bytes keys of {type(arg)}")
 
         self._impl = arg._impl
 
@@ -882,7 +1128,888 @@ class CIMultiDictProxy(_CIMixin, MultiDictProxy[_V]):
         return CIMultiDict(self.items())
 
 
+class MultiDictArena:
+    """Request-scoped memory arena for multidicts.
+
+    The pure Python implementation doesn't manage memory,
+    the class only mirrors the C extension API.
+    """
+
+    __slots__ = ("_active", "_closed")
+
+    def __init__(self) -> None:
+        self._active = False
+        self._closed = False
+
+    def __enter__(self) -> Self:
+        if self._closed:
+            raise RuntimeError("MultiDictArena is closed")
+        if self._active:
+            raise RuntimeError("MultiDictArena is already active")
+        self._active = True
+        return self
+
+    def __exit__(self, *exc_info: object) -> None:
+        self._active = False
+        self.close()
+
+    def close(self) -> None:
+        """Release the arena memory."""
+        self._closed = True
+
+
+class CIMultiDictBuilder:
+    """Incremental builder of CIMultiDict from raw header bytes.
+
+    Names and values are decoded as UTF-8 with surrogateescape
+    when build() is called, values are decoded on first access
+    if lazy_values is true.
+
+    The pure Python implementation accepts lazy_values
+    but always decodes values in build().
+    """
+
+    __slots__ = ("_items",)
+
+    def __init__(self, size_hint: int = 0, *, lazy_values: bool = False) -> None:
+        size_hint = operator.index(size_hint)
+        if size_hint < 0:
+            raise ValueError("size_hint must be non-negative")
+        self._items: list[tuple[bytes, bytes]] = []
+
+    def add(
+        self,
+        name: Union[bytes, bytearray, memoryview],
+        value: Union[bytes, bytearray, memoryview],
+        /,
+    ) -> None:
+        """Append a header from bytes-like name and value."""
+        self._items.append((bytes(memoryview(name)), bytes(memoryview(value))))
+
+    def build(self) -> CIMultiDict[str]:
+        """Return a CIMultiDict with the collected headers and reset the builder."""
+        md: CIMultiDict[str] = CIMultiDict()
+        items = []
+        for name, value in self._items:
+            key = name.decode("utf-8", "surrogateescape")
+            items.append(
+                (md._title(key), key, value.decode("utf-8", "surrogateescape"))
+            )
+        md._extend_items(items)
+        self._items.clear()
+        return md
+
+    def clear(self) -> None:
+        """Drop the collected headers."""
+        self._items.clear()
+
+    def __len__(self) -> int:
+        return len(self._items)
+
+
+# The packed layout of SharedMultiDict, all integers are little-endian:
+#   header:  magic, version, flags, number of entries, number of slots, size
+#   entries: identity hash, offsets of identity, key and value,
+#            1-based index of the next entry with the same identity, flags
+#   slots:   1-based index of the first entry of an identity, 0 is empty
+#   heap:    strings as a 32-bit length followed by UTF-8 or raw bytes,
+#            str are encoded with surrogateescape like CIMultiDictBuilder does
+# Offsets are counted from the start of the buffer.
+_PACK_MAGIC = b"MDPK"
+_PACK_VERSION = 1
+_PACK_HEADER = struct.Struct("<4sHHIII12x")
+_PACK_ENTRY = struct.Struct("<QIIIII4x")
+_PACK_SLOT = struct.Struct("<I")
+_PACK_LEN = struct.Struct("<I")
+_PACK_MAX_SIZE = 0xFFFFFFFF
+_PACK_CI = 0x1  # header flag
+_PACK_BYTES = 0x1  # entry flag, the value is bytes
+
+_FNV_OFFSET = 0xCBF29CE484222325
+_FNV_PRIME = 0x100000001B3
+_U64_MASK = 0xFFFFFFFFFFFFFFFF
+
+
+def _pack_hash(data: bytes) -> int:
+    # FNV-1a, str hashes are randomized per process
+    ret = _FNV_OFFSET
+    for byte in data:
+        ret = ((ret ^ byte) * _FNV_PRIME) & _U64_MASK
+    return ret
+
+
+def _pack_check_next(count: int, index: int, next_: int) -> bool:
+    # 0 ends the chain, other links point strictly forward
+    return next_ == 0 or index < next_ - 1 < count
+
+
+def _pack_identity(key: str, ci: bool) -> bytes:
+    return (key.lower() if ci else key).encode("utf-8", "surrogateescape")
+
+
+class SharedMultiDict:
+    """Read-only multidict over a buffer written by SharedMultiDict.pack().
+
+    Lookups are served from the buffer, keys and values are
+    materialized on first access and cached.
+    """
+
+    __slots__ = ("_buf", "_ci", "_count", "_nslots", "_heap", "_keys", "_values")
+
+    def __init__(
+        self, buffer: Union[bytes, bytearray, memoryview, "mmap.mmap"]
+    ) -> None:
+        buf = memoryview(buffer).cast("B")
+        if len(buf) < _PACK_HEADER.size:
+            raise ValueError("buffer is too small for a packed multidict")
+        magic, version, flags, count, nslots, size = _PACK_HEADER.unpack_from(buf)
+        if magic != _PACK_MAGIC:
+            raise ValueError("buffer doesn't contain a packed multidict")
+        if version != _PACK_VERSION:
+            raise ValueError(f"unsupported packed multidict version {version}")
+        heap = _PACK_HEADER.size + count * _PACK_ENTRY.size + nslots * _PACK_SLOT.size
+        if (
+            size > len(buf)
+            or heap > size
+            or nslots == 0
+            or nslots & (nslots - 1)
+            or flags & ~_PACK_CI
+        ):
+            raise ValueError("packed multidict is corrupted")
+        buf = buf[:size]
+
+        def check_str(offset: int) -> None:
+            if offset < heap or offset + _PACK_LEN.size > size:
+                raise ValueError("packed multidict is corrupted")
+            (length,) = _PACK_LEN.unpack_from(buf, offset)
+            if offset + _PACK_LEN.size + length > size:
+                raise ValueError("packed multidict is corrupted")
+
+        for i in range(count):
+            entry = _PACK_ENTRY.unpack_from(
+                buf, _PACK_HEADER.size + i * _PACK_ENTRY.size
+            )
+            _, identity, key, value, next_, entry_flags = entry
+            check_str(identity)
+            check_str(key)
+            check_str(value)
+            if not _pack_check_next(count, i, next_) or entry_flags & ~_PACK_BYTES:
+                raise ValueError("packed multidict is corrupted")
+        slots = _PACK_HEADER.size + count * _PACK_ENTRY.size
+        for i in range(nslots):
+            (slot,) = _PACK_SLOT.unpack_from(buf, slots + i * _PACK_SLOT.size)
+            if slot > count:
+                raise ValueError("packed multidict is corrupted")
+
+        self._buf = buf
+        self._ci = bool(flags & _PACK_CI)
+        self._count = count
+        self._nslots = nslots
+        self._heap = heap
+        self._keys: list[Optional[str]] = [None] * count
+        self._values: list[Union[str, bytes, None]] = [None] * count
+
+    @classmethod
+    def pack(cls, md: Union[MultiDict[Any], MultiDictProxy[Any]]) -> bytes:
+        """Serialize a multidict with str or bytes values."""
+        if not isinstance(md, _Base):
+            raise TypeError(
+                f"pack() argument should be a multidict, not {type(md).__name__}"
+            )
+        if md._bytes:
+            raise TypeError("pack() doesn't support bytes keys")
+        ci = md._ci
+        items = md._impl._items
+        heap = bytearray()
+        strings: dict[bytes, int] = {}
+
+        def store(data: bytes) -> int:
+            offset = strings.get(data)
+            if offset is None:
+                offset = strings[data] = len(heap)
+                heap.extend(_PACK_LEN.pack(len(data)))
+                heap.extend(data)
+            return offset
+
+        entries: list[list[int]] = []
+        last: dict[bytes, int] = {}
+        firsts: list[int] = []
+        for i, (_, key, value) in enumerate(items):
+            if isinstance(value, str):
+                data = value.encode("utf-8", "surrogateescape")
+                flags = 0
+            elif isinstance(value, bytes):
+                data = bytes(value)
+                flags = _PACK_BYTES
+            else:
+                raise TypeError(
+                    "SharedMultiDict values should be str or bytes, "
+                    f"not {type(value).__name__}"
+                )
+            identity = _pack_identity(key, ci)
+            entries.append(
+                [
+                    _pack_hash(identity),
+                    store(identity),
+                    store(key.encode("utf-8", "surrogateescape")),
+                    store(data),
+                    0,
+                    flags,
+                ]
+            )
+            prev = last.get(identity)
+            if prev is None:
+                firsts.append(i)
+            else:
+                entries[prev][4] = i + 1
+            last[identity] = i
+
+        nslots = 1
+        while nslots < 2 * len(firsts):
+            nslots *= 2
+        mask = nslots - 1
+        slots = [0] * nslots
+        for i in firsts:
+            pos = entries[i][0] & mask
+            while slots[pos]:
+                pos = (pos + 1) & mask
+            slots[pos] = i + 1
+
+        base = (
+            _PACK_HEADER.size
+            + len(entries) * _PACK_ENTRY.size
+            + nslots * _PACK_SLOT.size
+        )
+        size = base + len(heap)
+        if size > _PACK_MAX_SIZE:
+            raise ValueError("multidict is too large to pack")
+        ret = bytearray(
+            _PACK_HEADER.pack(
+                _PACK_MAGIC,
+                _PACK_VERSION,
+                _PACK_CI if ci else 0,
+                len(entries),
+                nslots,
+                size,
+            )
+        )
+        for hash_, identity_off, key_off, value_off, next_, flags in entries:
+            ret.extend(
+                _PACK_ENTRY.pack(
+                    hash_,
+                    base + identity_off,
+                    base + key_off,
+                    base + value_off,
+                    next_,
+                    flags,
+                )
+            )
+        for slot in slots:
+            ret.extend(_PACK_SLOT.pack(slot))
+        ret.extend(heap)
+        return bytes(ret)
+
+    def _entry(self, index: int) -> tuple[int, int, int, int, int, int]:
+        return _PACK_ENTRY.unpack_from(
+            self._buf, _PACK_HEADER.size + index * _PACK_ENTRY.size
+        )
+
+    def _str(self, offset: int) -> memoryview:
+        # the buffer can be changed by another process, check it again
+        size = len(self._buf)
+        if offset < self._heap or offset + _PACK_LEN.size > size:
+            raise ValueError("packed multidict is corrupted")
+        (length,) = _PACK_LEN.unpack_from(self._buf, offset)
+        start = offset + _PACK_LEN.size
+        if start + length > size:
+            raise ValueError("packed multidict is corrupted")
+        return self._buf[start : start + length]
+
+    def _find(self, key: object) -> int:
+        # Return the index of the first entry for the key or -1
+        if not isinstance(key, str):
+            raise TypeError("MultiDict keys should be either str or subclasses of str")
+        try:
+            identity = _pack_identity(key, self._ci)
+        except UnicodeEncodeError:
+            return -1
+        hash_ = _pack_hash(identity)
+        mask = self._nslots - 1
+        pos = hash_ & mask
+        slots = _PACK_HEADER.size + self._count * _PACK_ENTRY.size
+        for _ in range(self._nslots):
+            (slot,) = _PACK_SLOT.unpack_from(self._buf, slots + pos * _PACK_SLOT.size)
+            if not slot:
+                break
+            if slot > self._count:
+                raise ValueError("packed multidict is corrupted")
+            entry = self._entry(slot - 1)
+            if entry[0] == hash_ and self._str(entry[1]) == identity:
+                return slot - 1
+            pos = (pos + 1) & mask
+        return -1
+
+    def _key(self, index: int) -> str:
+        ret = self._keys[index]
+        if ret is None:
+            key = str(self._str(self._entry(index)[2]), "utf-8", "surrogateescape")
+            ret = self._keys[index] = istr(key) if self._ci else key
+        return ret
+
+    def _value(self, index: int) -> Union[str, bytes]:
+        ret = self._values[index]
+        if ret is None:
+            entry = self._entry(index)
+            data = self._str(entry[3])
+            if entry[5] & _PACK_BYTES:
+                ret = bytes(data)
+            else:
+                ret = str(data, "utf-8", "surrogateescape")
+            self._values[index] = ret
+        return ret
+
+    def _indexes(self, key: object) -> Iterator[int]:
+        index = self._find(key)
+        while index >= 0:
+            yield index
+            next_ = self._entry(index)[4]
+            if not _pack_check_next(self._count, index, next_):
+                raise ValueError("packed multidict is corrupted")
+            index = next_ - 1
+
+    @overload
+    def getall(self, key: str) -> list[Union[str, bytes]]: ...
+    @overload
+    def getall(self, key: str, default: _T) -> Union[list[Union[str, bytes]], _T]: ...
+    def getall(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[list[Union[str, bytes]], _T]:
+        """Return a list of all values matching the key."""
+        res = [self._value(i) for i in self._indexes(key)]
+        if res:
+            return res
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    @overload
+    def getone(self, key: str) -> Union[str, bytes]: ...
+    @overload
+    def getone(self, key: str, default: _T) -> Union[str, bytes, _T]: ...
+    def getone(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[str, bytes, _T]:
+        """Get first value matching the key.
+
+        Raises KeyError if the key is not found and no default is provided.
+        """
+        index = self._find(key)
+        if index >= 0:
+            return self._value(index)
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    def __getitem__(self, key: str) -> Union[str, bytes]:
+        return self.getone(key)
+
+    @overload
+    def get(self, key: str, /) -> Union[str, bytes, None]: ...
+    @overload
+    def get(self, key: str, /, default: _T) -> Union[str, bytes, _T]: ...
+    def get(
+        self, key: str, default: Optional[_T] = None
+    ) -> Union[str, bytes, _T, None]:
+        """Get first value matching the key.
+
+        If the key is not found, returns the default (or None if no default is provided)
+        """
+        return self.getone(key, default)
+
+    def __contains__(self, key: object) -> bool:
+        if not isinstance(key, str):
+            return False
+        return self._find(key) >= 0
+
+    def __len__(self) -> int:
+        return self._count
+
+    def __iter__(self) -> Iterator[str]:
+        return iter(self.keys())
+
+    def keys(self) -> list[str]:
+        """Return a list of keys, duplicates included."""
+        return [self._key(i) for i in range(self._count)]
+
+    def values(self) -> list[Union[str, bytes]]:
+        """Return a list of values."""
+        return [self._value(i) for i in range(self._count)]
+
+    def items(self) -> list[tuple[str, Union[str, bytes]]]:
+        """Return a list of (key, value) pairs."""
+        return [(self._key(i), self._value(i)) for i in range(self._count)]
+
+    def __repr__(self) -> str:
+        body = ", ".join(f"'{k}': {v!r}" for k, v in self.items())
+        return f"<{self.__class__.__name__}({body})>"
+
+
+class ChainMultiDict(Generic[_V]):
+    """Mutable multidict layered over a base multidict.
+
+    Added and overridden pairs are kept in an overlay, the base is
+    shared and never copied.  Setting or deleting a key hides all
+    its values in the base.
+    """
+
+    __slots__ = ("_base", "_version", "_overlay", "_masked", "_hidden")
+
+    def __init__(self, base: Union[MultiDict[_V], MultiDictProxy[_V]], /) -> None:
+        if not isinstance(base, _Base):
+            raise TypeError(
+                "ChainMultiDict() argument should be a multidict, "
+                f"not {type(base).__name__}"
+            )
+        if base._bytes:
+            raise TypeError("ChainMultiDict() doesn't support bytes keys")
+        self._base = base
+        self._version = base._impl._version
+        self._overlay: Optional[MultiDict[_V]] = None
+        # hidden identity -> place of its values, see copy()
+        self._masked: dict[str, Optional[int]] = {}
+        self._hidden = 0
+
+    def _check(self) -> None:
+        if self._base._impl._version != self._version:
+            raise RuntimeError("Base multidict changed")
+
+    def _get_overlay(self) -> MultiDict[_V]:
+        if self._overlay is None:
+            self._overlay = CIMultiDict() if self._base._ci else MultiDict()
+        return self._overlay
+
+    def _mask(self, identity: str, keep_place: bool) -> bool:
+        # Hide base values of the identity, keep_place is false if all
+        # values are removed.  Return True if the base has any.
+        if identity in self._masked:
+            if not keep_place:
+                self._masked[identity] = None
+            return False
+        places = [
+            pos
+            for pos, item in enumerate(self._base._impl._items)
+            if item[0] == identity
+        ]
+        if places:
+            self._masked[identity] = places[0] if keep_place else None
+            self._hidden += len(places)
+        return bool(places)
+
+    @overload
+    def getall(self, key: str) -> list[_V]: ...
+    @overload
+    def getall(self, key: str, default: _T) -> Union[list[_V], _T]: ...
+    def getall(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[list[_V], _T]:
+        """Return a list of all values matching the key."""
+        self._check()
+        identity = self._base._title(key)
+        res: list[_V] = []
+        if identity not in self._masked:
+            res = [v for i, k, v in self._base._impl._items if i == identity]
+        if self._overlay is not None:
+            res.extend(v for i, k, v in self._overlay._impl._items if i == identity)
+        if res:
+            return res
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    @overload
+    def getone(self, key: str) -> _V: ...
+    @overload
+    def getone(self, key: str, default: _T) -> Union[_V, _T]: ...
+    def getone(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[_V, _T]:
+        """Get first value matching the key.
+
+        Raises KeyError if the key is not found and no default is provided.
+        """
+        self._check()
+        identity = self._base._title(key)
+        if identity not in self._masked:
+            for i, k, v in self._base._impl._items:
+                if i == identity:
+                    return v
+        if self._overlay is not None:
+            for i, k, v in self._overlay._impl._items:
+                if i == identity:
+                    return v
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    def __getitem__(self, key: str) -> _V:
+        return self.getone(key)
+
+    @overload
+    def get(self, key: str, /) -> Union[_V, None]: ...
+    @overload
+    def get(self, key: str, /, default: _T) -> Union[_V, _T]: ...
+    def get(self, key: str, default: Union[_T, None] = None) -> Union[_V, _T, None]:
+        """Get first value matching the key.
+
+        If the key is not found, returns the default (or None if no default is provided)
+        """
+        return self.getone(key, default)
+
+    def __contains__(self, key: object) -> bool:
+        self._check()
+        if not isinstance(key, str):
+            return False
+        if self._base._title(key) not in self._masked and key in self._base:
+            return True
+        return self._overlay is not None and key in self._overlay
+
+    def __len__(self) -> int:
+        self._check()
+        ret = len(self._base) - self._hidden
+        if self._overlay is not None:
+            ret += len(self._overlay)
+        return ret
+
+    def __iter__(self) -> Iterator[str]:
+        return iter(self.copy())
+
+    # The views of the flat copy show the pairs at the time of the call.
+
+    def keys(self) -> KeysView[str]:
+        """Return a new view of the keys."""
+        return self.copy().keys()
+
+    def values(self) -> ValuesView[_V]:
+        """Return a new view of the values."""
+        return self.copy().values()
+
+    def items(self) -> ItemsView[str, _V]:
+        """Return a new view of the (key, value) pairs."""
+        return self.copy().items()
+
+    def add(self, key: str, value: _V) -> None:
+        """Add the key and value to the overlay."""
+        self._check()
+        self._get_overlay().add(key, value)
+
+    def __setitem__(self, key: str, value: _V) -> None:
+        self._check()
+        self._mask(self._base._title(key), True)
+        self._get_overlay()[key] = value
+
+    def __delitem__(self, key: str) -> None:
+        self._check()
+        found = self._mask(self._base._title(key), False)
+        if self._overlay is not None and key in self._overlay:
+            del self._overlay[key]
+            found = True
+        if not found:
+            raise KeyError(key)
+
+    @overload
+    def popone(self, key: str) -> _V: ...
+    @overload
+    def popone(self, key: str, default: _T) -> Union[_V, _T]: ...
+    def popone(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[_V, _T]:
+        """Remove specified key and return the corresponding value.
+
+        If key is not found, d is returned if given, otherwise
+        KeyError is raised.
+
+        """
+        self._check()
+        base = self._base
+        identity = base._title(key)
+        if identity not in self._masked:
+            items = base._impl._items
+            places = [pos for pos, item in enumerate(items) if item[0] == identity]
+            if places:
+                # the rest of base values move to the overlay ahead of
+                # values added there, they take the place of the second one
+                overlay = self._get_overlay()
+                moved = overlay.popmany([key])
+                self._mask(identity, False)
+                if len(places) > 1:
+                    self._masked[identity] = places[1]
+                for pos in places[1:]:
+                    overlay.add(items[pos][1], items[pos][2])
+                for k, v in moved:
+                    overlay.add(k, v)
+                return items[places[0]][2]
+        if self._overlay is not None and key in self._overlay:
+            ret = self._overlay.popone(key)
+            if key not in self._overlay:
+                # the key loses its place with the last value
+                self._mask(identity, False)
+            return ret
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    pop = popone
+
+    @overload
+    def popall(self, key: str) -> list[_V]: ...
+    @overload
+    def popall(self, key: str, default: _T) -> Union[list[_V], _T]: ...
+    def popall(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[list[_V], _T]:
+        """Remove all occurrences of key and return the list of corresponding
+        values.
+
+        If key is not found, default is returned if given, otherwise
+        KeyError is raised.
+
+        """
+        self._check()
+        res: list[_V] = []
+        identity = self._base._title(key)
+        masked = identity in self._masked
+        if not masked:
+            res = self._base.getall(key, [])
+        if masked or res:
+            self._mask(identity, False)
+        if self._overlay is not None:
+            res.extend(self._overlay.popall(key, ()))
+        if res:
+            return res
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    def copy(self) -> MultiDict[_V]:
+        """Return a flat MultiDict (CIMultiDict for case-insensitive bases)."""
+        self._check()
+        ret: MultiDict[_V] = CIMultiDict() if self._base._ci else MultiDict()
+        masked = self._masked
+        overlay = self._overlay._impl._items if self._overlay is not None else []
+        items: list[tuple[str, str, _V]] = []
+        for pos, item in enumerate(self._base._impl._items):
+            if item[0] not in masked:
+                items.append(item)
+            elif masked[item[0]] == pos:
+                # overlay values of a set or popped key keep its place
+                items.extend(i for i in overlay if i[0] == item[0])
+        items.extend(i for i in overlay if masked.get(i[0]) is None)
+        ret._extend_items(items)
+        return ret
+
+    def __eq__(self, other: object) -> bool:
+        # compare as the flat copy
+        if isinstance(other, ChainMultiDict):
+            other = other.copy()
+        return self.copy() == other
+
+    __hash__ = None  # type: ignore[assignment]
+
+    @reprlib.recursive_repr()
+    def __repr__(self) -> str:
+        body = ", ".join(f"'{k}': {v!r}" for k, v in self.items())
+        return f"<{self.__class__.__name__}({body})>"
+
+
+class RawHeadersView(_CIMixin, MultiMapping[str]):
+    """Read-only case-insensitive multidict over a raw header buffer.
+
+    offsets is an iterable of (name_start, name_len, value_start,
+    value_len) tuples, data is parsed as 'Name: value' lines if
+    it is omitted.  Names and values are decoded on access.
+    """
+
+    __slots__ = ("_data", "_offsets")
+
+    def __init__(
+        self,
+        data: Union[bytes, bytearray, memoryview],
+        /,
+        offsets: Optional[Iterable[tuple[int, int, int, int]]] = None,
+    ) -> None:
+        self._data = memoryview(data).cast("B")
+        size = len(self._data)
+        if offsets is None:
+            offsets = self._parse()
+        self._offsets: list[tuple[int, int, int, int]] = []
+        for item in offsets:
+            if not isinstance(item, tuple):
+                raise TypeError(
+                    f"header offsets should be tuples, not {type(item).__name__}"
+                )
+            if len(item) != 4:
+                raise TypeError(
+                    "header offsets should be "
+                    "(name_start, name_len, value_start, value_len)"
+                )
+            name, name_size, value, value_size = map(operator.index, item)
+            if (
+                min(name, name_size, value, value_size) < 0
+                or name + name_size > size
+                or value + value_size > size
+            ):
+                raise ValueError("header offsets out of range")
+            self._offsets.append((name, name_size, value, value_size))
+
+    def _parse(self) -> list[tuple[int, int, int, int]]:
+        # Split "Name: value" lines up to the first empty line,
+        # lines end with LF or CRLF, spaces and tabs around values are dropped.
+        # Whitespace around the name is rejected, RFC 9112 section 5.1.
+        data = bytes(self._data)
+        ret = []
+        pos = 0
+        while pos < len(data):
+            eol = data.find(b"\n", pos)
+            end = eol if eol >= 0 else len(data)
+            eol = end + 1
+            if end > pos and data[end - 1] == 0x0D:
+                end -= 1
+            if end == pos:
+                break
+            colon = data.find(b":", pos, end)
+            if colon <= pos or data[pos] in b" \t" or data[colon - 1] in b" \t":
+                raise ValueError(f"invalid header line at offset {pos}")
+            line = data[colon + 1 : end]
+            value = colon + 1 + len(line) - len(line.lstrip(b" \t"))
+            ret.append((pos, colon - pos, value, len(line.strip(b" \t"))))
+            pos = eol
+        return ret
+
+    def _decode(self, pos: int, size: int) -> str:
+        return str(self._data[pos : pos + size], "utf-8", "surrogateescape")
+
+    def _find(self, key: str) -> Iterator[str]:
+        identity = self._title(key)
+        for name, name_size, value, value_size in self._offsets:
+            if self._title(self._decode(name, name_size)) == identity:
+                yield self._decode(value, value_size)
+
+    @overload
+    def getall(self, key: str) -> list[str]: ...
+    @overload
+    def getall(self, key: str, default: _T) -> Union[list[str], _T]: ...
+    def getall(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[list[str], _T]:
+        """Return a list of all values matching the key."""
+        res = list(self._find(key))
+        if res:
+            return res
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    @overload
+    def getone(self, key: str) -> str: ...
+    @overload
+    def getone(self, key: str, default: _T) -> Union[str, _T]: ...
+    def getone(
+        self, key: str, default: Union[_T, _SENTINEL] = sentinel
+    ) -> Union[str, _T]:
+        """Get first value matching the key.
+
+        Raises KeyError if the key is not found and no default is provided.
+        """
+        for value in self._find(key):
+            return value
+        if default is not sentinel:
+            return default
+        raise KeyError("Key not found: %r" % key)
+
+    def __getitem__(self, key: str) -> str:
+        return self.getone(key)
+
+    @overload
+    def get(self, key: str, /) -> Union[str, None]: ...
+    @overload
+    def get(self, key: str, /, default: _T) -> Union[str, _T]: ...
+    def get(self, key: str, default: Union[_T, None] = None) -> Union[str, _T, None]:
+        """Get first value matching the key.
+
+        If the key is not found, returns the default (or None if no default is provided)
+        """
+        return self.getone(key, default)
+
+    def __contains__(self, key: object) -> bool:
+        if not isinstance(key, str):
+            return False
+        return any(True for _ in self._find(key))
+
+    def __len__(self) -> int:
+        return len(self._offsets)
+
+    def __iter__(self) -> Iterator[str]:
+        return iter(
+            [self._key(self._decode(name, size)) for name, size, _, _ in self._offsets]
+        )
+
+    def _items(self) -> list[tuple[str, str]]:
+        return [
+            (self._key(self._decode(name, name_size)), self._decode(value, value_size))
+            for name, name_size, value, value_size in self._offsets
+        ]
+
+    # The views of the decoded copy behave like the views of a proxy,
+    # the headers can't change.
+
+    def keys(self) -> KeysView[str]:
+        """Return a new view of the decoded keys."""
+        return self.copy().keys()
+
+    def values(self) -> ValuesView[str]:
+        """Return a new view of the decoded values."""
+        return self.copy().values()
+
+    def items(self) -> ItemsView[str, str]:
+        """Return a new view of the decoded (key, value) pairs."""
+        return self.copy().items()
+
+    def copy(self) -> CIMultiDict[str]:
+        """Return a CIMultiDict with the decoded headers."""
+        return CIMultiDict(self._items())
+
+    def __eq__(self, other: object) -> bool:
+        if isinstance(other, RawHeadersView):
+            other = other.copy()
+        return self.copy() == other
+
+    __hash__ = None  # type: ignore[assignment]
+
+    def __repr__(self) -> str:
+        body = ", ".join(f"'{k}': {v!r}" for k, v in self._items())
+        return f"<{self.__class__.__name__}({body})>"
+
+
 def getversion(md: Union[MultiDict[object], MultiDictProxy[object]]) -> int:
     if not isinstance(md, _Base):
         raise TypeError("Parameter should be multidict or proxy")
     return md._impl._version
+
+
+def set_trace_hook(
+    threshold_ns: int,
+    fn: Optional[Callable[[str, int, int], object]],
+    *,
+    size_threshold: Optional[int] = None,
+) -> None:
+    """Install a hook for slow multidict operations.
+
+    Only the C extension reports operations, the pure Python
+    implementation validates the arguments and ignores the hook.
+    """
+    if threshold_ns < 0:
+        raise ValueError("threshold_ns must be non-negative")
+    if fn is not None and not callable(fn):
+        raise TypeError("fn must be callable or None")
+    if size_threshold is not None and size_threshold < 0:
+        raise ValueError("size_threshold must be non-negative")
@@ -0,0 +1,436 @@
+#ifndef _MULTIDICT_ARENA_H
+#define _MULTIDICT_ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "state.h"
+
+/* Implementation note.
+The arena is a request-scoped allocator for pairs that don't fit into
+the embedded buffer of a multidict.  Memory is bump-allocated from
+large blocks and all blocks are released at once when the arena is closed.
+
+The arena is activated by the `with` statement: it is stored in a context
+variable (it works for both threads and asyncio tasks), multidicts created
+inside the block allocate from it.
+
+Every allocation starts with a header that points to the owning pair list.
+Freed and reallocated chunks are marked as unowned.  On close, the arena
+moves pairs of still living owners to PyMem, so multidicts can safely
+outlive the arena.
+
+Free-threading: multidicts of one arena can be used by several threads
+(e.g. a context copied by asyncio.to_thread()), so the allocator runs in
+a critical section on the arena and the module-wide active_arenas counter
+is atomic.  Closing the arena moves pairs of living owners, the threads
+that use them must be done by the end of the `with` block.
+*/
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct pair_list;
+
+typedef struct arena_chunk {
+    struct pair_list *owner;  // NULL when released
+    size_t size;
+} arena_chunk_t;
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    PyObject_HEAD
+    mod_state *state;
+    arena_block_t *blocks;  // the current block is the first one
+    PyObject *token;  // context variable token while the arena is active
+    bool closed;
+} ArenaObject;
+
+// Defined in pair_list.h, moves the owner's pairs to PyMem
+static inline int
+_pair_list_arena_detach(struct pair_list *list, void *pairs, size_t size);
+
+
+static inline arena_chunk_t *
+_arena_chunk(void *ptr)
+{
+    return (arena_chunk_t *)((char *)ptr - sizeof(arena_chunk_t));
+}
+
+
+static inline bool
+_arena_is_last(ArenaObject *arena, arena_chunk_t *chunk)
+{
+    arena_block_t *block = arena->blocks;
+    return (block != NULL &&
+            (char *)chunk + sizeof(arena_chunk_t) + chunk->size
+                == block->data + block->used);
+}
+
+
+static inline Py_ssize_t
+_arena_active_count(mod_state *state)
+{
+#ifdef Py_GIL_DISABLED
+    return _Py_atomic_load_ssize_relaxed(&state->active_arenas);
+#else
+    return state->active_arenas;
+#endif
+}
+
+
+static inline void
+_arena_add_active(mod_state *state, Py_ssize_t delta)
+{
+#ifdef Py_GIL_DISABLED
+    _Py_atomic_add_ssize(&state->active_arenas, delta);
+#else
+    state->active_arenas += delta;
+#endif
+}
+
+
+static inline void *
+_arena_alloc(ArenaObject *arena, struct pair_list *owner, size_t size)
+{
+    size_t required = sizeof(arena_chunk_t) + size;
+    arena_block_t *block = arena->blocks;
+
+    assert(!arena->closed);
+    assert(size % sizeof(void *) == 0);
+
+    if (block == NULL || block->size - block->used < required) {
+        size_t block_size = ARENA_BLOCK_SIZE - sizeof(arena_block_t);
+        if (block_size < required) {
+            block_size = required;
+        }
+        block = PyMem_Malloc(sizeof(arena_block_t) + block_size);
+        if (block == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->size = block_size;
+        block->used = 0;
+        arena->blocks = block;
+    }
+
+    arena_chunk_t *chunk = (arena_chunk_t *)(block->data + block->used);
+    chunk->owner = owner;
+    chunk->size = size;
+    block->used += required;
+    return (char *)chunk + sizeof(arena_chunk_t);
+}
+
+
+static inline void *
+arena_alloc(ArenaObject *arena, struct pair_list *owner, size_t size)
+{
+    void *ret;
+    Py_BEGIN_CRITICAL_SECTION(arena);
+    ret = _arena_alloc(arena, owner, size);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+
+static inline void
+_arena_free(ArenaObject *arena, void *ptr)
+{
+    arena_chunk_t *chunk = _arena_chunk(ptr);
+    if (_arena_is_last(arena, chunk)) {
+        // give the tail back to the current block
+        arena->blocks->used -= sizeof(arena_chunk_t) + chunk->size;
+    }
+    chunk->owner = NULL;
+}
+
+
+static inline void
+arena_free(ArenaObject *arena, void *ptr)
+{
+    Py_BEGIN_CRITICAL_SECTION(arena);
+    // The last reference to the owner can be dropped by another thread
+    // while the arena is closing, the pairs are in PyMem already then.
+    if (!arena->closed) {
+        _arena_free(arena, ptr);
+    }
+    Py_END_CRITICAL_SECTION();
+}
+
+
+static inline void *
+_arena_realloc(ArenaObject *arena, struct pair_list *owner,
+               void *ptr, size_t size)
+{
+    arena_chunk_t *chunk = _arena_chunk(ptr);
+
+    if (_arena_is_last(arena, chunk)) {
+        // grow or shrink the last chunk in place
+        arena_block_t *block = arena->blocks;
+        size_t available = block->size - block->used + chunk->size;
+        if (size <= available) {
+            block->used = block->used - chunk->size + size;
+            chunk->size = size;
+            return ptr;
+        }
+    } else if (size <= chunk->size) {
+        return ptr;
+    }
+
+    void *new_ptr = _arena_alloc(arena, owner, size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, chunk->size < size ? chunk->size : size);
+    chunk->owner = NULL;
+    return new_ptr;
+}
+
+
+static inline void *
+arena_realloc(ArenaObject *arena, struct pair_list *owner,
+              void *ptr, size_t size)
+{
+    void *ret;
+    Py_BEGIN_CRITICAL_SECTION(arena);
+    ret = _arena_realloc(arena, owner, ptr, size);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+
+static inline int
+arena_current(mod_state *state, ArenaObject **ret)
+{
+    // Return the active arena (a new reference) or NULL
+    PyObject *arena = NULL;
+
+    *ret = NULL;
+    if (_arena_active_count(state) == 0) {
+        return 0;
+    }
+    if (PyContextVar_Get(state->arena_var, NULL, &arena) < 0) {
+        return -1;
+    }
+    if (arena == NULL) {
+        return 0;
+    }
+    if (((ArenaObject *)arena)->closed) {
+        Py_DECREF(arena);
+        return 0;
+    }
+    *ret = (ArenaObject *)arena;
+    return 0;
+}
+
+
+static inline int
+_arena_close(ArenaObject *arena)
+{
+    arena_block_t *block;
+
+    if (arena->closed) {
+        return 0;
+    }
+
+    // Detach living owners first, nothing is released on failure
+    for (block = arena->blocks; block != NULL; block = block->next) {
+        size_t offset = 0;
+        while (offset < block->used) {
+            arena_chunk_t *chunk = (arena_chunk_t *)(block->data + offset);
+            void *ptr = (char *)chunk + sizeof(arena_chunk_t);
+            if (chunk->owner != NULL) {
+                if (_pair_list_arena_detach(chunk->owner, ptr,
+                                            chunk->size) < 0) {
+                    return -1;
+                }
+                chunk->owner = NULL;
+            }
+            offset += sizeof(arena_chunk_t) + chunk->size;
+        }
+    }
+
+    while (arena->blocks != NULL) {
+        block = arena->blocks;
+        arena->blocks = block->next;
+        PyMem_Free(block);
+    }
+    arena->closed = true;
+    return 0;
+}
+
+
+static inline int
+arena_close(ArenaObject *arena)
+{
+    int ret;
+    Py_BEGIN_CRITICAL_SECTION(arena);
+    ret = _arena_close(arena);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+
+/******************** MultiDictArena ********************/
+
+PyDoc_STRVAR(arena__doc__,
+"Request-scoped memory arena for multidicts.\n\n"
+"Multidicts created inside the `with` block allocate their storage\n"
+"from the arena, the memory is released in bulk on exit.");
+
+PyDoc_STRVAR(arena_close_doc,
+"Release the arena memory.\n\n"
+"Multidicts that are still alive keep their items.");
+
+
+static inline PyObject *
+arena_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, ":MultiDictArena", kwlist)) {
+        return NULL;
+    }
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    ArenaObject *self = (ArenaObject *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->state = get_mod_state(mod);
+    self->blocks = NULL;
+    self->token = NULL;
+    self->closed = false;
+    return (PyObject *)self;
+}
+
+
+static inline void
+_arena_deactivate(ArenaObject *self)
+{
+    if (self->token != NULL) {
+        _arena_add_active(self->state, -1);
+    }
+    Py_CLEAR(self->token);
+}
+
+
+static inline void
+arena_tp_dealloc(ArenaObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    // Owners keep strong references, nothing to detach here
+    if (arena_close(self) < 0) {
+        PyErr_WriteUnraisable((PyObject *)self);
+    }
+    _arena_deactivate(self);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
+}
+
+
+static inline PyObject *
+arena_enter(ArenaObject *self)
+{
+    if (self->closed) {
+        PyErr_SetString(PyExc_RuntimeError, "MultiDictArena is closed");
+        return NULL;
+    }
+    if (self->token != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "MultiDictArena is already active");
+        return NULL;
+    }
+    self->token = PyContextVar_Set(self->state->arena_var, (PyObject *)self);
+    if (self->token == NULL) {
+        return NULL;
+    }
+    _arena_add_active(self->state, 1);
+    return Py_NewRef(self);
+}
+
+
+static inline PyObject *
+arena_exit(ArenaObject *self, PyObject *const *args, Py_ssize_t nargs)
+{
+    if (self->token != NULL) {
+        if (PyContextVar_Reset(self->state->arena_var, self->token) < 0) {
+            return NULL;
+        }
+        _arena_deactivate(self);
+    }
+    if (arena_close(self) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static inline PyObject *
+arena_close_meth(ArenaObject *self, PyObject *Py_UNUSED(unused))
+{
+    if (arena_close(self) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef arena_methods[] = {
+    {"__enter__", (PyCFunction)arena_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)(void(*)(void))arena_exit, METH_FASTCALL, NULL},
+    {"close", (PyCFunction)arena_close_meth, METH_NOARGS, arena_close_doc},
+    {NULL, NULL}   /* sentinel */
+};
+
+static PyType_Slot arena_slots[] = {
+    {Py_tp_dealloc, arena_tp_dealloc},
+    {Py_tp_doc, (void *)arena__doc__},
+    {Py_tp_methods, arena_methods},
+    {Py_tp_new, arena_tp_new},
+    {0, NULL},
+};
+
+static PyType_Spec arena_spec = {
+    .name = "multidict._multidict.MultiDictArena",
+    .basicsize = sizeof(ArenaObject),
+    .flags = (Py_TPFLAGS_DEFAULT
+#if PY_VERSION_HEX >= 0x030a00f0
+              | Py_TPFLAGS_IMMUTABLETYPE
+#endif
+              ),
+    .slots = arena_slots,
+};
+
+
+static inline int
+arena_init(PyObject *module, mod_state *state)
+{
+    state->arena_var = PyContextVar_New("multidict_arena", NULL);
+    if (state->arena_var == NULL) {
+        return -1;
+    }
+    state->active_arenas = 0;
+    PyObject *tmp = PyType_FromModuleAndSpec(module, &arena_spec, NULL);
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->ArenaType = (PyTypeObject *)tmp;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
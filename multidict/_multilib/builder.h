@@ -0,0 +1,389 @@
+#ifndef _MULTIDICT_BUILDER_H
+#define _MULTIDICT_BUILDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "dict.h"
+#include "pair_list.h"
+#include "state.h"
+
+/* Implementation note.
+CIMultiDictBuilder collects headers from a parser callback one at a time
+and produces a CIMultiDict at the end of the header block.
+
+builder_add_raw() only copies the name and value bytes into a growing
+buffer, it doesn't create objects, compute identities or bump versions.
+builder_build() decodes everything in one pass, reserves the pair list of
+the new CIMultiDict once and moves the pairs in.  Names and values are
+decoded as UTF-8 with surrogateescape, like HTTP parsers do.
+
+The identity of an ASCII name is computed without calling str.lower():
+a name without upper case letters is its own identity, others are
+lowered byte by byte.  Non-ASCII names take the generic path.
+
+With lazy_values=True values are stored as raw bytes and decoded on
+first access, see the note about raw values in pair_list.h.
+
+The builder is empty after build() and can be reused for the next message.
+*/
+
+typedef struct {
+    Py_ssize_t name;  // offset in the data buffer
+    Py_ssize_t name_size;
+    Py_ssize_t value;
+    Py_ssize_t value_size;
+} builder_entry_t;
+
+typedef struct {
+    PyObject_HEAD
+    mod_state *state;
+    char *data;
+    Py_ssize_t data_size;
+    Py_ssize_t data_capacity;
+    builder_entry_t *entries;
+    Py_ssize_t size;
+    Py_ssize_t capacity;
+    bool lazy_values;
+} BuilderObject;
+
+
+static inline int
+_builder_reserve(BuilderObject *self, Py_ssize_t size, Py_ssize_t data_size)
+{
+    if (size > self->capacity) {
+        Py_ssize_t capacity = self->capacity ? self->capacity : 16;
+        while (capacity < size) {
+            capacity *= 2;
+        }
+        builder_entry_t *entries = PyMem_Resize(self->entries,
+                                                builder_entry_t,
+                                                (size_t)capacity);
+        if (entries == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->entries = entries;
+        self->capacity = capacity;
+    }
+    // the data is allocated on the first add even if the header is empty,
+    // memcpy() and pointer arithmetic on NULL are undefined
+    if (data_size > self->data_capacity || self->data == NULL) {
+        Py_ssize_t capacity = self->data_capacity ? self->data_capacity : 1024;
+        while (capacity < data_size) {
+            capacity *= 2;
+        }
+        char *data = PyMem_Realloc(self->data, (size_t)capacity);
+        if (data == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->data = data;
+        self->data_capacity = capacity;
+    }
+    return 0;
+}
+
+
+static inline int
+builder_add_raw(BuilderObject *self,
+                const char *name, Py_ssize_t name_size,
+                const char *value, Py_ssize_t value_size)
+{
+    // Append a header, the bytes are copied
+    if (name_size > PY_SSIZE_T_MAX - value_size
+            || self->data_size > PY_SSIZE_T_MAX - name_size - value_size) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (_builder_reserve(self, self->size + 1,
+                         self->data_size + name_size + value_size) < 0) {
+        return -1;
+    }
+    builder_entry_t *entry = &self->entries[self->size];
+    entry->name = self->data_size;
+    entry->name_size = name_size;
+    memcpy(self->data + self->data_size, name, (size_t)name_size);
+    self->data_size += name_size;
+    entry->value = self->data_size;
+    entry->value_size = value_size;
+    memcpy(self->data + self->data_size, value, (size_t)value_size);
+    self->data_size += value_size;
+    self->size++;
+    return 0;
+}
+
+
+static inline void
+builder_clear(BuilderObject *self)
+{
+    self->size = 0;
+    self->data_size = 0;
+}
+
+
+static inline PyObject *
+_builder_identity(mod_state *state, PyObject *key)
+{
+    // Return key.lower(), ASCII names don't call the method
+    if (!PyUnicode_IS_ASCII(key)) {
+        return _ci_key_to_ident(state, key);
+    }
+    Py_ssize_t size = PyUnicode_GET_LENGTH(key);
+    const Py_UCS1 *src = PyUnicode_1BYTE_DATA(key);
+    Py_ssize_t pos = 0;
+    while (pos < size && !(src[pos] >= 'A' && src[pos] <= 'Z')) {
+        pos++;
+    }
+    if (pos == size) {
+        return Py_NewRef(key);
+    }
+    PyObject *ret = PyUnicode_New(size, 127);
+    if (ret == NULL) {
+        return NULL;
+    }
+    Py_UCS1 *dst = PyUnicode_1BYTE_DATA(ret);
+    memcpy(dst, src, (size_t)pos);
+    for (; pos < size; pos++) {
+        Py_UCS1 ch = src[pos];
+        dst[pos] = (ch >= 'A' && ch <= 'Z') ? (Py_UCS1)(ch + ('a' - 'A')) : ch;
+    }
+    return ret;
+}
+
+
+static inline PyObject *
+_builder_make_dict(mod_state *state, const char *data,
+                   builder_entry_t *entries, Py_ssize_t size, bool lazy_values)
+{
+    // Decode the entries into a new CIMultiDict
+    PyTypeObject *type = state->CIMultiDictType;
+    PyObject *key = NULL;
+    PyObject *identity = NULL;
+    PyObject *value = NULL;
+
+    MultiDictObject *md = multidict_alloc(state, type, size);
+    if (md == NULL) {
+        return NULL;
+    }
+    if (type->tp_init((PyObject *)md, NULL, NULL) < 0) {
+        goto fail;
+    }
+    pair_list_t *list = &md->pairs;
+    if (pair_list_reserve(list, size) < 0) {
+        goto fail;
+    }
+
+    for (Py_ssize_t i = 0; i < size; i++) {
+        builder_entry_t *entry = &entries[i];
+        key = PyUnicode_DecodeUTF8(data + entry->name,
+                                   entry->name_size, "surrogateescape");
+        if (key == NULL) {
+            goto fail;
+        }
+        identity = _builder_identity(state, key);
+        if (identity == NULL) {
+            goto fail;
+        }
+        Py_hash_t hash = PyObject_Hash(identity);
+        if (hash == -1) {
+            goto fail;
+        }
+        if (lazy_values) {
+            value = PyBytes_FromStringAndSize(data + entry->value,
+                                              entry->value_size);
+        } else {
+            value = PyUnicode_DecodeUTF8(data + entry->value,
+                                         entry->value_size, "surrogateescape");
+        }
+        if (value == NULL) {
+            goto fail;
+        }
+        if (_pair_list_add_with_hash_steal_refs(list, identity, key,
+                                                value, hash) < 0) {
+            goto fail;
+        }
+        key = identity = value = NULL;
+    }
+    // set after the pairs are added, they are raw values
+    list->raw_values = lazy_values && size > 0;
+    return (PyObject *)md;
+fail:
+    Py_XDECREF(key);
+    Py_XDECREF(identity);
+    Py_XDECREF(value);
+    Py_DECREF(md);
+    return NULL;
+}
+
+
+static inline PyObject *
+builder_build(BuilderObject *self)
+{
+    // Move the collected headers into a new CIMultiDict
+    PyObject *ret = _builder_make_dict(self->state, self->data, self->entries,
+                                       self->size, self->lazy_values);
+    if (ret != NULL) {
+        builder_clear(self);
+    }
+    return ret;
+}
+
+
+/******************** CIMultiDictBuilder ********************/
+
+PyDoc_STRVAR(builder__doc__,
+"Incremental builder of CIMultiDict from raw header bytes.\n\n"
+"Names and values are decoded as UTF-8 with surrogateescape\n"
+"when build() is called, values are decoded on first access\n"
+"if lazy_values is true.");
+
+PyDoc_STRVAR(builder_add_doc,
+"Append a header from bytes-like name and value.");
+
+PyDoc_STRVAR(builder_build_doc,
+"Return a CIMultiDict with the collected headers and reset the builder.");
+
+PyDoc_STRVAR(builder_clear_doc,
+"Drop the collected headers.");
+
+
+static inline PyObject *
+builder_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"size_hint", "lazy_values", NULL};
+    Py_ssize_t size_hint = 0;
+    int lazy_values = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|n$p:CIMultiDictBuilder",
+                                     kwlist, &size_hint, &lazy_values)) {
+        return NULL;
+    }
+    if (size_hint < 0) {
+        PyErr_SetString(PyExc_ValueError, "size_hint must be non-negative");
+        return NULL;
+    }
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    BuilderObject *self = (BuilderObject *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->state = get_mod_state(mod);
+    self->lazy_values = lazy_values;
+    if (size_hint > 0 && _builder_reserve(self, size_hint, 0) < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+
+static inline void
+builder_tp_dealloc(BuilderObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    PyMem_Free(self->data);
+    PyMem_Free(self->entries);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
+}
+
+
+static inline PyObject *
+builder_add(BuilderObject *self, PyObject *const *args, Py_ssize_t nargs)
+{
+    Py_buffer name, value;
+    if (nargs != 2) {
+        PyErr_Format(PyExc_TypeError,
+                     "add() takes exactly 2 arguments (%zd given)", nargs);
+        return NULL;
+    }
+    if (PyObject_GetBuffer(args[0], &name, PyBUF_SIMPLE) < 0) {
+        return NULL;
+    }
+    if (PyObject_GetBuffer(args[1], &value, PyBUF_SIMPLE) < 0) {
+        PyBuffer_Release(&name);
+        return NULL;
+    }
+    int ret = builder_add_raw(self, name.buf, name.len, value.buf, value.len);
+    PyBuffer_Release(&name);
+    PyBuffer_Release(&value);
+    if (ret < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static inline PyObject *
+builder_build_meth(BuilderObject *self, PyObject *Py_UNUSED(unused))
+{
+    return builder_build(self);
+}
+
+
+static inline PyObject *
+builder_clear_meth(BuilderObject *self, PyObject *Py_UNUSED(unused))
+{
+    builder_clear(self);
+    Py_RETURN_NONE;
+}
+
+
+static inline Py_ssize_t
+builder_mp_len(BuilderObject *self)
+{
+    return self->size;
+}
+
+
+static PyMethodDef builder_methods[] = {
+    {"add", (PyCFunction)(void(*)(void))builder_add, METH_FASTCALL,
+     builder_add_doc},
+    {"build", (PyCFunction)builder_build_meth, METH_NOARGS, builder_build_doc},
+    {"clear", (PyCFunction)builder_clear_meth, METH_NOARGS, builder_clear_doc},
+    {NULL, NULL}   /* sentinel */
+};
+
+static PyType_Slot builder_slots[] = {
+    {Py_tp_dealloc, builder_tp_dealloc},
+    {Py_tp_doc, (void *)builder__doc__},
+    {Py_tp_methods, builder_methods},
+    {Py_tp_new, builder_tp_new},
+    {Py_mp_length, builder_mp_len},
+    {0, NULL},
+};
+
+static PyType_Spec builder_spec = {
+    .name = "multidict._multidict.CIMultiDictBuilder",
+    .basicsize = sizeof(BuilderObject),
+    .flags = (Py_TPFLAGS_DEFAULT
+#if PY_VERSION_HEX >= 0x030a00f0
+              | Py_TPFLAGS_IMMUTABLETYPE
+#endif
+              ),
+    .slots = builder_slots,
+};
+
+
+static inline int
+builder_init(PyObject *module, mod_state *state)
+{
+    PyObject *tmp = PyType_FromModuleAndSpec(module, &builder_spec, NULL);
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->BuilderType = (PyTypeObject *)tmp;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
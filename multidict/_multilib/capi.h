@@ -0,0 +1,290 @@
+#ifndef _MULTIDICT_CAPI_H
+#define _MULTIDICT_CAPI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "builder.h"
+#include "dict.h"
+#include "pair_list.h"
+#include "state.h"
+
+/* Implementation note.
+The functions of the C API capsule, see multidict_api.h for the contract.
+They check argument types (cheap pointer comparisons for exact types)
+and go straight to the pair_list layer, skipping argument parsing and
+method lookup of the Python level API.
+*/
+
+static inline PyTypeObject *
+capi_multidict_get_type(void *state)
+{
+    return ((mod_state *)state)->MultiDictType;
+}
+
+static inline PyTypeObject *
+capi_cimultidict_get_type(void *state)
+{
+    return ((mod_state *)state)->CIMultiDictType;
+}
+
+static inline PyTypeObject *
+capi_multidict_proxy_get_type(void *state)
+{
+    return ((mod_state *)state)->MultiDictProxyType;
+}
+
+static inline PyTypeObject *
+capi_cimultidict_proxy_get_type(void *state)
+{
+    return ((mod_state *)state)->CIMultiDictProxyType;
+}
+
+
+static inline pair_list_t *
+_capi_pair_list(mod_state *state, PyObject *md, bool proxy_ok)
+{
+    // The API is str keyed, lists with bytes keys are never accepted
+    pair_list_t *list = NULL;
+    if (PyObject_TypeCheck(md, state->MultiDictType)) {
+        list = &((MultiDictObject *)md)->pairs;
+    } else if (proxy_ok
+               && PyObject_TypeCheck(md, state->MultiDictProxyType)) {
+        list = &((MultiDictProxyObject *)md)->md->pairs;
+    }
+    if (list != NULL && !list->bytes_keys) {
+        return list;
+    }
+    PyErr_Format(PyExc_TypeError,
+                 proxy_ok ? "a multidict or proxy is required, not %.100s"
+                          : "a multidict is required, not %.100s",
+                 Py_TYPE(md)->tp_name);
+    return NULL;
+}
+
+
+static inline PyObject *
+capi_multidict_new(void *state_, int ci, Py_ssize_t capacity)
+{
+    mod_state *state = state_;
+    PyTypeObject *type = ci ? state->CIMultiDictType : state->MultiDictType;
+
+    if (capacity < 0) {
+        PyErr_SetString(PyExc_ValueError, "capacity must be non-negative");
+        return NULL;
+    }
+    // a multidict created empty is going to be filled
+    MultiDictObject *md = multidict_alloc(state, type,
+                                          capacity > 0 ? capacity : -1);
+    if (md == NULL) {
+        return NULL;
+    }
+    if (type->tp_init((PyObject *)md, NULL, NULL) < 0
+            || pair_list_reserve(&md->pairs, capacity) < 0) {
+        Py_DECREF(md);
+        return NULL;
+    }
+    return (PyObject *)md;
+}
+
+
+static inline int
+capi_multidict_add(void *state, PyObject *md, PyObject *key, PyObject *value)
+{
+    pair_list_t *list = _capi_pair_list(state, md, false);
+    if (list == NULL) {
+        return -1;
+    }
+    return pair_list_add(list, key, value);
+}
+
+
+static inline int
+capi_multidict_add_with_hash(void *state, PyObject *md,
+                             PyObject *identity, Py_hash_t hash,
+                             PyObject *key, PyObject *value)
+{
+    pair_list_t *list = _capi_pair_list(state, md, false);
+    if (list == NULL) {
+        return -1;
+    }
+    if (!PyUnicode_CheckExact(identity) || !PyUnicode_Check(key)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "identity should be str and key should be "
+                        "either str or subclasses of str");
+        return -1;
+    }
+    assert(hash == PyObject_Hash(identity));
+    return pair_list_add_with_hash(list, identity, hash, key, value);
+}
+
+
+static inline int
+capi_multidict_get_one(void *state, PyObject *md,
+                       const char *key, Py_ssize_t size, PyObject **result)
+{
+    PyObject *value = NULL;
+
+    *result = NULL;
+    pair_list_t *list = _capi_pair_list(state, md, true);
+    if (list == NULL) {
+        return -1;
+    }
+    PyObject *str = PyUnicode_DecodeUTF8(key, size, NULL);
+    if (str == NULL) {
+        return -1;
+    }
+    int ret = pair_list_get_one(list, str, &value);
+    Py_DECREF(str);
+    if (ret < 0) {
+        return -1;
+    }
+    *result = value;
+    return value != NULL;
+}
+
+
+static inline int
+capi_multidict_next(void *state, PyObject *md, Py_ssize_t *pos,
+                    PyObject **key, PyObject **value)
+{
+    pair_list_t *list = _capi_pair_list(state, md, true);
+    if (list == NULL) {
+        return -1;
+    }
+    if (*pos < 0 || *pos >= list->size) {
+        return 0;
+    }
+    // the last pair is never a tombstone
+    while (pair_list_at(list, *pos)->identity == NULL) {
+        (*pos)++;
+    }
+    pair_t *pair = pair_list_at(list, *pos);
+    if (key != NULL) {
+        *key = pair_list_pair_key(list, pair);
+    }
+    if (value != NULL) {
+        *value = pair_list_value(list, pair);
+        if (*value == NULL) {
+            return -1;
+        }
+    }
+    (*pos)++;
+    return 1;
+}
+
+
+static inline PyObject *
+capi_multidict_proxy_new(void *state_, PyObject *md)
+{
+    mod_state *state = state_;
+    if (_capi_pair_list(state, md, false) == NULL) {
+        return NULL;
+    }
+    PyTypeObject *type = (PyObject_TypeCheck(md, state->CIMultiDictType)
+                          ? state->CIMultiDictProxyType
+                          : state->MultiDictProxyType);
+    return PyObject_CallOneArg((PyObject *)type, md);
+}
+
+
+static inline BuilderObject *
+_capi_builder(mod_state *state, PyObject *builder)
+{
+    if (!Py_IS_TYPE(builder, state->BuilderType)) {
+        PyErr_Format(PyExc_TypeError,
+                     "a CIMultiDictBuilder is required, not %.100s",
+                     Py_TYPE(builder)->tp_name);
+        return NULL;
+    }
+    return (BuilderObject *)builder;
+}
+
+
+static inline PyObject *
+capi_builder_new_ex(void *state_, Py_ssize_t size_hint, int flags)
+{
+    mod_state *state = state_;
+    if (size_hint < 0) {
+        PyErr_SetString(PyExc_ValueError, "size_hint must be non-negative");
+        return NULL;
+    }
+    if (flags & ~MULTIDICT_BUILDER_LAZY_VALUES) {
+        PyErr_Format(PyExc_ValueError, "unknown builder flags %d", flags);
+        return NULL;
+    }
+    BuilderObject *self = (BuilderObject *)state->BuilderType->tp_alloc(
+        state->BuilderType, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->state = state;
+    self->lazy_values = (flags & MULTIDICT_BUILDER_LAZY_VALUES) != 0;
+    if (size_hint > 0 && _builder_reserve(self, size_hint, 0) < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+
+static inline PyObject *
+capi_builder_new(void *state, Py_ssize_t size_hint)
+{
+    return capi_builder_new_ex(state, size_hint, 0);
+}
+
+
+static inline int
+capi_builder_add_raw(void *state, PyObject *builder,
+                     const char *name, Py_ssize_t name_size,
+                     const char *value, Py_ssize_t value_size)
+{
+    BuilderObject *self = _capi_builder(state, builder);
+    if (self == NULL) {
+        return -1;
+    }
+    return builder_add_raw(self, name, name_size, value, value_size);
+}
+
+
+static inline PyObject *
+capi_builder_build(void *state, PyObject *builder)
+{
+    BuilderObject *self = _capi_builder(state, builder);
+    if (self == NULL) {
+        return NULL;
+    }
+    return builder_build(self);
+}
+
+
+static inline PyObject *
+capi_new_capsule(mod_state *state)
+{
+    MultiDict_CAPI *api = &state->capi;
+
+    api->version = MULTIDICT_CAPI_VERSION;
+    api->state = state;
+    api->MultiDict_GetType = capi_multidict_get_type;
+    api->CIMultiDict_GetType = capi_cimultidict_get_type;
+    api->MultiDictProxy_GetType = capi_multidict_proxy_get_type;
+    api->CIMultiDictProxy_GetType = capi_cimultidict_proxy_get_type;
+    api->MultiDict_New = capi_multidict_new;
+    api->MultiDict_Add = capi_multidict_add;
+    api->MultiDict_AddWithHash = capi_multidict_add_with_hash;
+    api->MultiDict_GetOne = capi_multidict_get_one;
+    api->MultiDict_Next = capi_multidict_next;
+    api->MultiDictProxy_New = capi_multidict_proxy_new;
+    api->Builder_New = capi_builder_new;
+    api->Builder_AddRaw = capi_builder_add_raw;
+    api->Builder_Build = capi_builder_build;
+    api->Builder_NewEx = capi_builder_new_ex;
+    return PyCapsule_New(api, MULTIDICT_CAPSULE_NAME, NULL);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,977 @@
+#ifndef _MULTIDICT_CHAIN_H
+#define _MULTIDICT_CHAIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dict.h"
+#include "pair_list.h"
+#include "parser.h"
+#include "state.h"
+#include "views.h"
+
+/* Implementation note.
+ChainMultiDict(base) is a mutable multidict layered over a base multidict,
+e.g. default response headers shared by all responses.  The base is
+referenced, not copied, so creating a chain is O(1) and every request
+pays only for its own changes.
+
+Added and overridden pairs live in the overlay, a MultiDict or CIMultiDict
+matching the base created on the first change.  Setting, deleting or
+popping a key puts its identity into the masked dict: base values of masked
+identities are hidden and the overlay holds all values of the key.
+Values of other keys are base values followed by overlay values.
+
+Keys keep the place of their first value like in a multidict: all
+values of a set key take the place of its first base pair, popone()
+moves the rest of them to the place of the next one.  The dict maps the
+identity to that position.  Removing all values drops the place (None),
+values added later follow the base pairs like other overlay pairs.
+copy() builds the flat multidict in this order, keys(), values() and
+items() return the views of such a copy.
+
+The base must not change while the chain is used, its version is
+remembered on creation and every operation raises RuntimeError if
+it differs.
+*/
+
+typedef struct {
+    PyObject_HEAD
+    mod_state *state;
+    MultiDictObject *base;
+    MultiDictObject *overlay;  // NULL until the first change
+    PyObject *masked;  // hidden identity -> place, NULL if empty
+    Py_ssize_t hidden;  // number of hidden base pairs
+    uint64_t version;  // version of the base
+} ChainMultiDictObject;
+
+
+PyDoc_STRVAR(chain__doc__,
+"Mutable multidict layered over a base multidict.\n\n"
+"Added and overridden pairs are kept in an overlay, the base is\n"
+"shared and never copied.  Setting or deleting a key hides all\n"
+"its values in the base.");
+
+PyDoc_STRVAR(chain_getall_doc,
+"Return a list of all values matching the key.");
+
+PyDoc_STRVAR(chain_getone_doc,
+"Get first value matching the key.\n\n"
+"Raises KeyError if the key is not found and no default is provided.");
+
+PyDoc_STRVAR(chain_get_doc,
+"Get first value matching the key.\n\n"
+"If the key is not found, returns the default (or None if no default is provided)");
+
+PyDoc_STRVAR(chain_keys_doc,
+"Return a new view of the keys.");
+
+PyDoc_STRVAR(chain_values_doc,
+"Return a new view of the values.");
+
+PyDoc_STRVAR(chain_items_doc,
+"Return a new view of the (key, value) pairs.");
+
+PyDoc_STRVAR(chain_add_doc,
+"Add the key and value to the overlay.");
+
+PyDoc_STRVAR(chain_popone_doc,
+"Remove specified key and return the corresponding value.\n\n"
+"If key is not found, d is returned if given, otherwise\n"
+"KeyError is raised.");
+
+PyDoc_STRVAR(chain_popall_doc,
+"Remove all occurrences of key and return the list of corresponding values.\n\n"
+"If key is not found, default is returned if given, otherwise\n"
+"KeyError is raised.");
+
+PyDoc_STRVAR(chain_copy_doc,
+"Return a flat MultiDict (CIMultiDict for case-insensitive bases).");
+
+
+static inline int
+_chain_check(ChainMultiDictObject *self)
+{
+    if (self->base->pairs.version != self->version) {
+        PyErr_SetString(PyExc_RuntimeError, "Base multidict changed");
+        return -1;
+    }
+    return 0;
+}
+
+
+static inline int
+_chain_is_masked(ChainMultiDictObject *self, PyObject *key)
+{
+    // Return 1 if base values of the key are hidden
+    if (self->masked == NULL) {
+        return 0;
+    }
+    PyObject *identity = pair_list_calc_identity(&self->base->pairs, key);
+    if (identity == NULL) {
+        return -1;
+    }
+    int ret = PyDict_Contains(self->masked, identity);
+    Py_DECREF(identity);
+    return ret;
+}
+
+
+static inline int
+_chain_set_place(ChainMultiDictObject *self, PyObject *identity, Py_ssize_t place)
+{
+    // Set the place of a hidden identity, -1 drops it
+    PyObject *value = place >= 0 ? PyLong_FromSsize_t(place) : Py_NewRef(Py_None);
+    if (value == NULL) {
+        return -1;
+    }
+    int ret = PyDict_SetItem(self->masked, identity, value);
+    Py_DECREF(value);
+    return ret;
+}
+
+
+static inline int
+_chain_mask(ChainMultiDictObject *self, PyObject *key, bool keep_place)
+{
+    // Hide base values of the key, keep_place is false if all values
+    // of the key are removed.
+    // Return 1 if the base has any, 0 if not or if already hidden.
+    pair_list_t *list = &self->base->pairs;
+    Py_ssize_t pos = 0;
+    Py_ssize_t first = 0;
+    Py_ssize_t count = 0;
+    int ret = -1;
+
+    PyObject *identity = pair_list_calc_identity(list, key);
+    if (identity == NULL) {
+        return -1;
+    }
+    Py_hash_t hash = PyObject_Hash(identity);
+    if (hash == -1) {
+        goto done;
+    }
+    if (self->masked != NULL) {
+        ret = PyDict_Contains(self->masked, identity);
+        if (ret > 0) {
+            // already hidden, removing all values drops the place
+            ret = keep_place ? 0 : _chain_set_place(self, identity, -1);
+            goto done;
+        }
+        if (ret < 0) {
+            goto done;
+        }
+    }
+    ret = _pair_list_find(list, identity, hash, &pos);
+    first = pos;
+    while (ret > 0) {
+        count++;
+        ret = _pair_list_find_next(list, identity, hash, &pos);
+    }
+    if (ret < 0 || count == 0) {
+        goto done;
+    }
+    if (self->masked == NULL) {
+        self->masked = PyDict_New();
+        if (self->masked == NULL) {
+            ret = -1;
+            goto done;
+        }
+    }
+    ret = _chain_set_place(self, identity, keep_place ? first : -1);
+    if (ret == 0) {
+        self->hidden += count;
+        ret = 1;
+    }
+done:
+    Py_DECREF(identity);
+    return ret;
+}
+
+
+static inline MultiDictObject *
+_chain_overlay(ChainMultiDictObject *self)
+{
+    if (self->overlay == NULL) {
+        PyTypeObject *type = self->base->pairs.calc_ci_indentity
+            ? self->state->CIMultiDictType : self->state->MultiDictType;
+        self->overlay = (MultiDictObject *)PyObject_CallNoArgs((PyObject *)type);
+    }
+    return self->overlay;
+}
+
+
+static inline PyObject *
+_chain_getone(ChainMultiDictObject *self, PyObject *key, PyObject *_default)
+{
+    PyObject *ret = NULL;
+
+    if (_chain_check(self) < 0) {
+        return NULL;
+    }
+    int masked = _chain_is_masked(self, key);
+    if (masked < 0) {
+        return NULL;
+    }
+    if (!masked && pair_list_get_one(&self->base->pairs, key, &ret) < 0) {
+        return NULL;
+    }
+    if (ret == NULL && self->overlay != NULL
+            && pair_list_get_one(&self->overlay->pairs, key, &ret) < 0) {
+        return NULL;
+    }
+    if (ret != NULL) {
+        return ret;
+    }
+    if (_default != NULL) {
+        return Py_NewRef(_default);
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+}
+
+
+static inline PyObject *
+_chain_join(PyObject *first, PyObject *second)
+{
+    // Concatenate two value lists, either may be NULL, references are stolen
+    if (first == NULL || second == NULL) {
+        return first != NULL ? first : second;
+    }
+    Py_ssize_t size = PyList_GET_SIZE(first);
+    int ret = PyList_SetSlice(first, size, size, second);
+    Py_DECREF(second);
+    if (ret < 0) {
+        Py_DECREF(first);
+        return NULL;
+    }
+    return first;
+}
+
+
+static inline PyObject *
+chain_getall(ChainMultiDictObject *self, PyObject *const *args,
+             Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+    PyObject *ret = NULL;
+    PyObject *tail = NULL;
+
+    if (parse2("getall", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    if (_chain_check(self) < 0) {
+        return NULL;
+    }
+    int masked = _chain_is_masked(self, key);
+    if (masked < 0) {
+        return NULL;
+    }
+    if (!masked && pair_list_get_all(&self->base->pairs, key, &ret) < 0) {
+        return NULL;
+    }
+    if (self->overlay != NULL
+            && pair_list_get_all(&self->overlay->pairs, key, &tail) < 0) {
+        Py_XDECREF(ret);
+        return NULL;
+    }
+    if (ret != NULL || tail != NULL) {
+        return _chain_join(ret, tail);
+    }
+    if (_default != NULL) {
+        return Py_NewRef(_default);
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+}
+
+
+static inline PyObject *
+chain_getone(ChainMultiDictObject *self, PyObject *const *args,
+             Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("getone", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _chain_getone(self, key, _default);
+}
+
+
+static inline PyObject *
+chain_get(ChainMultiDictObject *self, PyObject *const *args,
+          Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("get", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _chain_getone(self, key, _default != NULL ? _default : Py_None);
+}
+
+
+static inline PyObject *
+chain_add(ChainMultiDictObject *self, PyObject *const *args,
+          Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *value = NULL;
+
+    if (parse2("add", args, nargs, kwnames, 2,
+               "key", &key, "value", &value) < 0) {
+        return NULL;
+    }
+    if (_chain_check(self) < 0) {
+        return NULL;
+    }
+    MultiDictObject *overlay = _chain_overlay(self);
+    if (overlay == NULL) {
+        return NULL;
+    }
+    if (pair_list_add(&overlay->pairs, key, value) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static inline PyObject *
+_chain_popone(ChainMultiDictObject *self, PyObject *key, PyObject *_default)
+{
+    pair_list_t *list = &self->base->pairs;
+    PyObject *identity = NULL;
+    PyObject *moved = NULL;
+    PyObject *ret = NULL;
+    Py_ssize_t pos = 0;
+
+    if (_chain_check(self) < 0) {
+        return NULL;
+    }
+    int masked = _chain_is_masked(self, key);
+    if (masked < 0) {
+        return NULL;
+    }
+    if (!masked) {
+        identity = pair_list_calc_identity(list, key);
+        if (identity == NULL) {
+            return NULL;
+        }
+        Py_hash_t hash = PyObject_Hash(identity);
+        if (hash == -1) {
+            goto fail;
+        }
+        int tmp = _pair_list_find(list, identity, hash, &pos);
+        if (tmp < 0) {
+            goto fail;
+        }
+        if (tmp > 0) {
+            // the rest of base values move to the overlay ahead of
+            // values added there, they take the place of the second one
+            Py_ssize_t place = -1;
+            ret = Py_XNewRef(pair_list_value(list, pair_list_at(list, pos)));
+            if (ret == NULL) {
+                goto fail;
+            }
+            MultiDictObject *overlay = _chain_overlay(self);
+            if (overlay == NULL) {
+                goto fail;
+            }
+            moved = PyList_New(0);
+            if (moved == NULL) {
+                goto fail;
+            }
+            if (pair_list_remove_many(&overlay->pairs, &key, 1, moved) < 0) {
+                goto fail;
+            }
+            if (_chain_mask(self, key, false) < 0) {
+                goto fail;
+            }
+            while ((tmp = _pair_list_find_next(list, identity, hash, &pos)) > 0) {
+                if (place < 0) {
+                    place = pos;
+                }
+                pair_t *pair = pair_list_at(list, pos);
+                PyObject *value = pair_list_value(list, pair);
+                if (value == NULL
+                        || pair_list_add_with_hash(&overlay->pairs, identity, hash,
+                                                   pair_list_pair_key(list, pair),
+                                                   value) < 0) {
+                    goto fail;
+                }
+            }
+            if (tmp < 0 || _chain_set_place(self, identity, place) < 0) {
+                goto fail;
+            }
+            for (pos = 0; pos < PyList_GET_SIZE(moved); pos++) {
+                PyObject *item = PyList_GET_ITEM(moved, pos);
+                if (pair_list_add(&overlay->pairs, PyTuple_GET_ITEM(item, 0),
+                                  PyTuple_GET_ITEM(item, 1)) < 0) {
+                    goto fail;
+                }
+            }
+            Py_DECREF(identity);
+            Py_DECREF(moved);
+            return ret;
+        }
+        Py_CLEAR(identity);
+    }
+    if (self->overlay != NULL
+            && pair_list_pop_one(&self->overlay->pairs, key, &ret) < 0) {
+        return NULL;
+    }
+    if (ret != NULL && masked) {
+        // the key loses its place with the last value
+        int tmp = pair_list_contains(&self->overlay->pairs, key, NULL);
+        if (tmp < 0 || (tmp == 0 && _chain_mask(self, key, false) < 0)) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+    }
+    if (ret != NULL) {
+        return ret;
+    }
+    if (_default != NULL) {
+        return Py_NewRef(_default);
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+fail:
+    Py_XDECREF(identity);
+    Py_XDECREF(moved);
+    Py_XDECREF(ret);
+    return NULL;
+}
+
+
+static inline PyObject *
+chain_popone(ChainMultiDictObject *self, PyObject *const *args,
+             Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("popone", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _chain_popone(self, key, _default);
+}
+
+
+static inline PyObject *
+chain_pop(ChainMultiDictObject *self, PyObject *const *args,
+          Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("pop", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _chain_popone(self, key, _default);
+}
+
+
+static inline PyObject *
+chain_popall(ChainMultiDictObject *self, PyObject *const *args,
+             Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+    PyObject *ret = NULL;
+    PyObject *tail = NULL;
+
+    if (parse2("popall", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    if (_chain_check(self) < 0) {
+        return NULL;
+    }
+    int masked = _chain_is_masked(self, key);
+    if (masked < 0) {
+        return NULL;
+    }
+    if (!masked) {
+        if (pair_list_get_all(&self->base->pairs, key, &ret) < 0) {
+            return NULL;
+        }
+    }
+    if ((masked || ret != NULL) && _chain_mask(self, key, false) < 0) {
+        goto fail;
+    }
+    if (self->overlay != NULL
+            && pair_list_pop_all(&self->overlay->pairs, key, &tail) < 0) {
+        goto fail;
+    }
+    if (ret != NULL || tail != NULL) {
+        return _chain_join(ret, tail);
+    }
+    if (_default != NULL) {
+        return Py_NewRef(_default);
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+fail:
+    Py_XDECREF(ret);
+    return NULL;
+}
+
+
+static inline int
+_chain_place(ChainMultiDictObject *self, PyObject *identity, Py_ssize_t *pplace)
+{
+    // Return 1 and set *pplace to the place of a hidden identity,
+    // -1 if it has none, return 0 if the identity is not hidden.
+    PyObject *place = NULL;
+    if (self->masked == NULL) {
+        return 0;
+    }
+    int ret = PyDict_GetItemRef(self->masked, identity, &place);
+    if (ret <= 0) {
+        return ret;
+    }
+    *pplace = place != Py_None ? PyLong_AsSsize_t(place) : -1;
+    Py_DECREF(place);
+    return *pplace == -1 && PyErr_Occurred() ? -1 : 1;
+}
+
+
+static inline int
+_chain_copy_overlay(pair_list_t *dst, pair_list_t *overlay,
+                    PyObject *identity, Py_hash_t hash)
+{
+    // Add overlay values of the identity in their place
+    Py_ssize_t pos = 0;
+    int ret = _pair_list_find(overlay, identity, hash, &pos);
+    while (ret > 0) {
+        pair_t *pair = pair_list_at(overlay, pos);
+        if (pair_list_add_with_hash(dst, identity, hash,
+                                    pair_list_pair_key(overlay, pair),
+                                    pair->value) < 0) {
+            return -1;
+        }
+        ret = _pair_list_find_next(overlay, identity, hash, &pos);
+    }
+    return ret;
+}
+
+
+static inline PyObject *
+chain_copy(ChainMultiDictObject *self, PyObject *Py_UNUSED(unused))
+{
+    pair_list_t *list = &self->base->pairs;
+    pair_list_t *overlay = self->overlay != NULL ? &self->overlay->pairs : NULL;
+    Py_ssize_t place;
+
+    if (_chain_check(self) < 0) {
+        return NULL;
+    }
+    PyTypeObject *type = list->calc_ci_indentity
+        ? self->state->CIMultiDictType : self->state->MultiDictType;
+    MultiDictObject *ret = (MultiDictObject *)PyObject_CallNoArgs((PyObject *)type);
+    if (ret == NULL) {
+        return NULL;
+    }
+    Py_ssize_t size = pair_list_len(list) - self->hidden;
+    if (overlay != NULL) {
+        size += pair_list_len(overlay);
+    }
+    if (pair_list_reserve(&ret->pairs, size) < 0) {
+        goto fail;
+    }
+    // raw values are copied as is if overlay values go last, a bytes
+    // value in between can't be told from them, see the note about
+    // raw values
+    bool raw = list->raw_values && self->masked == NULL;
+    for (Py_ssize_t pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        int tmp = _chain_place(self, pair->identity, &place);
+        if (tmp < 0) {
+            goto fail;
+        }
+        if (tmp > 0) {
+            if (place == pos && overlay != NULL
+                    && _chain_copy_overlay(&ret->pairs, overlay,
+                                           pair->identity, pair->hash) < 0) {
+                goto fail;
+            }
+            continue;
+        }
+        PyObject *value = raw ? pair->value : pair_list_value(list, pair);
+        if (value == NULL
+                || pair_list_add_with_hash(&ret->pairs, pair->identity, pair->hash,
+                                           pair_list_pair_key(list, pair),
+                                           value) < 0) {
+            goto fail;
+        }
+    }
+    ret->pairs.raw_values = raw;
+    if (overlay == NULL) {
+        return (PyObject *)ret;
+    }
+    if (self->masked == NULL) {
+        if (pair_list_update_from_pair_list(&ret->pairs, NULL, overlay) < 0) {
+            goto fail;
+        }
+        return (PyObject *)ret;
+    }
+    for (Py_ssize_t pos = 0; pos < overlay->size; pos++) {
+        pair_t *pair = pair_list_at(overlay, pos);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        int tmp = _chain_place(self, pair->identity, &place);
+        if (tmp < 0) {
+            goto fail;
+        }
+        if (tmp > 0 && place >= 0) {
+            // already added in the place of the key
+            continue;
+        }
+        if (pair_list_add_with_hash(&ret->pairs, pair->identity, pair->hash,
+                                    pair_list_pair_key(overlay, pair),
+                                    pair->value) < 0) {
+            goto fail;
+        }
+    }
+    return (PyObject *)ret;
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+
+static inline PyObject *
+_chain_view(ChainMultiDictObject *self,
+            PyObject *(*view_new)(MultiDictObject *md))
+{
+    // The view of the flat copy, see the note
+    PyObject *md = chain_copy(self, NULL);
+    if (md == NULL) {
+        return NULL;
+    }
+    PyObject *ret = view_new((MultiDictObject *)md);
+    Py_DECREF(md);
+    return ret;
+}
+
+static inline PyObject *
+chain_keys(ChainMultiDictObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _chain_view(self, multidict_keysview_new);
+}
+
+static inline PyObject *
+chain_values(ChainMultiDictObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _chain_view(self, multidict_valuesview_new);
+}
+
+static inline PyObject *
+chain_items(ChainMultiDictObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _chain_view(self, multidict_itemsview_new);
+}
+
+
+static inline PyObject *
+chain_tp_richcompare(PyObject *self, PyObject *other, int op)
+{
+    // Compare as the flat copy
+    if (op != Py_EQ && op != Py_NE) {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    PyObject *lft = chain_copy((ChainMultiDictObject *)self, NULL);
+    if (lft == NULL) {
+        return NULL;
+    }
+    PyObject *rht;
+    if (Py_TYPE(other) == Py_TYPE(self)) {
+        rht = chain_copy((ChainMultiDictObject *)other, NULL);
+        if (rht == NULL) {
+            Py_DECREF(lft);
+            return NULL;
+        }
+    } else {
+        rht = Py_NewRef(other);
+    }
+    PyObject *ret = PyObject_RichCompare(lft, rht, op);
+    Py_DECREF(lft);
+    Py_DECREF(rht);
+    return ret;
+}
+
+
+static inline PyObject *
+chain_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", NULL};
+    PyObject *base = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:ChainMultiDict",
+                                     kwlist, &base)) {
+        return NULL;
+    }
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    mod_state *state = get_mod_state(mod);
+    MultiDictObject *md;
+    if (AnyMultiDict_Check(state, base)) {
+        md = (MultiDictObject *)base;
+    } else if (PyObject_TypeCheck(base, state->MultiDictProxyType)) {
+        md = ((MultiDictProxyObject *)base)->md;
+    } else {
+        PyErr_Format(PyExc_TypeError,
+                     "ChainMultiDict() argument should be a multidict, "
+                     "not %.100s", Py_TYPE(base)->tp_name);
+        return NULL;
+    }
+    if (md->pairs.bytes_keys) {
+        PyErr_SetString(PyExc_TypeError,
+                        "ChainMultiDict() doesn't support bytes keys");
+        return NULL;
+    }
+    ChainMultiDictObject *self = (ChainMultiDictObject *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->state = state;
+    self->base = (MultiDictObject *)Py_NewRef(md);
+    self->version = md->pairs.version;
+    return (PyObject *)self;
+}
+
+
+static inline int
+chain_tp_traverse(ChainMultiDictObject *self, visitproc visit, void *arg)
+{
+    Py_VISIT(Py_TYPE(self));
+    Py_VISIT(self->base);
+    Py_VISIT(self->overlay);
+    Py_VISIT(self->masked);
+    return 0;
+}
+
+static inline int
+chain_tp_clear(ChainMultiDictObject *self)
+{
+    Py_CLEAR(self->base);
+    Py_CLEAR(self->overlay);
+    Py_CLEAR(self->masked);
+    return 0;
+}
+
+static inline void
+chain_tp_dealloc(ChainMultiDictObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    PyObject_GC_UnTrack(self);
+    chain_tp_clear(self);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
+}
+
+
+static inline Py_ssize_t
+chain_mp_len(ChainMultiDictObject *self)
+{
+    if (_chain_check(self) < 0) {
+        return -1;
+    }
+    Py_ssize_t ret = pair_list_len(&self->base->pairs) - self->hidden;
+    if (self->overlay != NULL) {
+        ret += pair_list_len(&self->overlay->pairs);
+    }
+    return ret;
+}
+
+static inline PyObject *
+chain_mp_subscript(ChainMultiDictObject *self, PyObject *key)
+{
+    return _chain_getone(self, key, NULL);
+}
+
+static inline int
+chain_mp_ass_subscript(ChainMultiDictObject *self, PyObject *key, PyObject *value)
+{
+    if (_chain_check(self) < 0) {
+        return -1;
+    }
+    int found = _chain_mask(self, key, value != NULL);
+    if (found < 0) {
+        return -1;
+    }
+    if (value != NULL) {
+        MultiDictObject *overlay = _chain_overlay(self);
+        if (overlay == NULL) {
+            return -1;
+        }
+        return pair_list_replace(&overlay->pairs, key, value);
+    }
+    if (self->overlay != NULL) {
+        int tmp = pair_list_contains(&self->overlay->pairs, key, NULL);
+        if (tmp < 0) {
+            return -1;
+        }
+        if (tmp > 0) {
+            return pair_list_del(&self->overlay->pairs, key);
+        }
+    }
+    if (!found) {
+        PyErr_SetObject(PyExc_KeyError, key);
+        return -1;
+    }
+    return 0;
+}
+
+static inline int
+chain_sq_contains(ChainMultiDictObject *self, PyObject *key)
+{
+    if (_chain_check(self) < 0) {
+        return -1;
+    }
+    if (!PyUnicode_Check(key)) {
+        return 0;
+    }
+    int tmp = _chain_is_masked(self, key);
+    if (tmp == 0) {
+        tmp = pair_list_contains(&self->base->pairs, key, NULL);
+    } else if (tmp > 0) {
+        tmp = 0;
+    }
+    if (tmp == 0 && self->overlay != NULL) {
+        tmp = pair_list_contains(&self->overlay->pairs, key, NULL);
+    }
+    return tmp;
+}
+
+static inline PyObject *
+chain_tp_iter(ChainMultiDictObject *self)
+{
+    PyObject *md = chain_copy(self, NULL);
+    if (md == NULL) {
+        return NULL;
+    }
+    PyObject *ret = PyObject_GetIter(md);
+    Py_DECREF(md);
+    return ret;
+}
+
+static inline PyObject *
+chain_tp_repr(ChainMultiDictObject *self)
+{
+    PyObject *name = NULL;
+    PyObject *md = NULL;
+    PyObject *ret = NULL;
+
+    int tmp = Py_ReprEnter((PyObject *)self);
+    if (tmp < 0) {
+        return NULL;
+    }
+    if (tmp > 0) {
+        return PyUnicode_FromString("...");
+    }
+    name = PyObject_GetAttrString((PyObject *)Py_TYPE(self), "__name__");
+    if (name == NULL) {
+        goto done;
+    }
+    md = chain_copy(self, NULL);
+    if (md == NULL) {
+        goto done;
+    }
+    ret = pair_list_repr(&((MultiDictObject *)md)->pairs, name, true, true);
+done:
+    Py_ReprLeave((PyObject *)self);
+    Py_XDECREF(name);
+    Py_XDECREF(md);
+    return ret;
+}
+
+
+static PyMethodDef chain_methods[] = {
+    {"getall", (PyCFunction)(void(*)(void))chain_getall,
+     METH_FASTCALL | METH_KEYWORDS, chain_getall_doc},
+    {"getone", (PyCFunction)(void(*)(void))chain_getone,
+     METH_FASTCALL | METH_KEYWORDS, chain_getone_doc},
+    {"get", (PyCFunction)(void(*)(void))chain_get,
+     METH_FASTCALL | METH_KEYWORDS, chain_get_doc},
+    {"keys", (PyCFunction)chain_keys, METH_NOARGS, chain_keys_doc},
+    {"values", (PyCFunction)chain_values, METH_NOARGS, chain_values_doc},
+    {"items", (PyCFunction)chain_items, METH_NOARGS, chain_items_doc},
+    {"add", (PyCFunction)(void(*)(void))chain_add,
+     METH_FASTCALL | METH_KEYWORDS, chain_add_doc},
+    {"popone", (PyCFunction)(void(*)(void))chain_popone,
+     METH_FASTCALL | METH_KEYWORDS, chain_popone_doc},
+    {"pop", (PyCFunction)(void(*)(void))chain_pop,
+     METH_FASTCALL | METH_KEYWORDS, chain_popone_doc},
+    {"popall", (PyCFunction)(void(*)(void))chain_popall,
+     METH_FASTCALL | METH_KEYWORDS, chain_popall_doc},
+    {"copy", (PyCFunction)chain_copy, METH_NOARGS, chain_copy_doc},
+    {"__class_getitem__", (PyCFunction)Py_GenericAlias,
+     METH_O | METH_CLASS, NULL},
+    {NULL, NULL}   /* sentinel */
+};
+
+static PyType_Slot chain_slots[] = {
+    {Py_tp_dealloc, chain_tp_dealloc},
+    {Py_tp_traverse, chain_tp_traverse},
+    {Py_tp_clear, chain_tp_clear},
+    {Py_tp_doc, (void *)chain__doc__},
+    {Py_tp_methods, chain_methods},
+    {Py_tp_new, chain_tp_new},
+    {Py_tp_iter, chain_tp_iter},
+    {Py_tp_repr, chain_tp_repr},
+    {Py_tp_richcompare, chain_tp_richcompare},
+    {Py_mp_length, chain_mp_len},
+    {Py_mp_subscript, chain_mp_subscript},
+    {Py_mp_ass_subscript, chain_mp_ass_subscript},
+    {Py_sq_contains, chain_sq_contains},
+    {0, NULL},
+};
+
+static PyType_Spec chain_spec = {
+    .name = "multidict._multidict.ChainMultiDict",
+    .basicsize = sizeof(ChainMultiDictObject),
+    .flags = (Py_TPFLAGS_DEFAULT
+              | Py_TPFLAGS_HAVE_GC
+#if PY_VERSION_HEX >= 0x030a00f0
+              | Py_TPFLAGS_IMMUTABLETYPE
+#endif
+              ),
+    .slots = chain_slots,
+};
+
+
+static inline int
+chain_init(PyObject *module, mod_state *state)
+{
+    PyObject *tmp = PyType_FromModuleAndSpec(module, &chain_spec, NULL);
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->ChainMultiDictType = (PyTypeObject *)tmp;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -19,8 +19,21 @@ typedef struct {  // 16 or 24 for GC prefix
     PyObject *weaklist;
 #endif
     pair_list_t pairs;
+    pair_t buffer[EMBEDDED_CAPACITY];
 } MultiDictObject;
 
+static inline PyObject *
+pair_list_owner(pair_list_t *list)
+{
+    return (PyObject *)((char *)list - offsetof(MultiDictObject, pairs));
+}
+
+static inline void *
+pair_list_buffer(pair_list_t *list)
+{
+    return ((MultiDictObject *)pair_list_owner(list))->buffer;
+}
+
 typedef struct {
     PyObject_HEAD
 #ifndef MANAGED_WEAKREFS
@@ -30,6 +43,60 @@ typedef struct {
 } MultiDictProxyObject;
 
 
+/* Note about the size classes
+The buffer of an exact multidict type is cut to the size class chosen
+for the expected number of items: the object is allocated by an internal
+layout type of the smaller basicsize, which shares the flags and thus
+the GC and weakref pre-header of multidict types, and then retyped.
+Subclasses may put __slots__ or __dict__ right after the buffer and
+always get the full layout.  Both are released by PyObject_GC_Del().
+*/
+
+#define MULTIDICT_LAYOUT_SIZE(capacity) \
+    (offsetof(MultiDictObject, buffer) + (capacity) * sizeof(pair_t))
+
+static inline MultiDictObject *
+multidict_alloc(mod_state *state, PyTypeObject *type, Py_ssize_t size)
+{
+    // Allocate a multidict for size items, -1 if the number is unknown
+    Py_ssize_t embedded = pair_list_size_class(size);
+    PyTypeObject *layout = type;
+
+    if (embedded < EMBEDDED_CAPACITY
+            && (type == state->MultiDictType
+                || type == state->CIMultiDictType
+                || type == state->BytesMultiDictType
+                || type == state->CIBytesMultiDictType)) {
+        layout = (embedded == 0 ? state->NoBufferLayoutType
+                                : state->SmallLayoutType);
+    } else {
+        embedded = EMBEDDED_CAPACITY;
+    }
+    MultiDictObject *md = (MultiDictObject *)layout->tp_alloc(layout, 0);
+    if (md == NULL) {
+        return NULL;
+    }
+    if (layout != type) {
+        Py_SET_TYPE(md, type);
+        Py_INCREF(type);
+        Py_DECREF(layout);
+    }
+    md->pairs.embedded = (uint8_t)embedded;
+    return md;
+}
+
+
+static inline int
+AnyMultiDict_Check(mod_state *state, PyObject *obj)
+{
+    // BytesMultiDict shares the layout but isn't a MultiDict subclass
+    return (Py_IS_TYPE(obj, state->MultiDictType)
+            || Py_IS_TYPE(obj, state->CIMultiDictType)
+            || PyObject_TypeCheck(obj, state->MultiDictType)
+            || PyObject_TypeCheck(obj, state->BytesMultiDictType));
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -131,6 +131,7 @@ IStr_New(mod_state *state, PyObject *str, PyObject *canonical)
     Py_INCREF(canonical);
     ((istrobject*)res)->canonical = canonical;
     ((istrobject*)res)->state = state;
+    MULTIDICT_STATS_INC(state, istr_materializations);
 ret:
     Py_CLEAR(args);
     return res;
@@ -12,11 +12,15 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "arena.h"
 #include "istr.h"
+#include "siphash.h"
 #include "state.h"
+#include "trace.h"
 
 /* Implementation note.
-identity always has exact PyUnicode_Type type, not a subclass.
+identity always has exact PyUnicode_Type type, not a subclass
+(exact PyBytes_Type for bytes-keyed lists, see the note about bytes keys).
 It guarantees that identity hashing and comparison never calls
 Python code back, and these operations has no weird side effects,
 e.g. deletion the key from multidict.
@@ -29,23 +33,125 @@ over pair_list for, e.g., md.get() or md.pop() is safe.
 
 typedef struct pair {
     PyObject  *identity;  // 8
-    PyObject  *key;       // 8
     PyObject  *value;     // 8
     Py_hash_t  hash;      // 8
+    PyObject  *key;       // 8, absent in compact pairs
 } pair_t;
 
-/* Note about the structure size
-With 28 pairs the MultiDict object size is slightly less than 1KiB
+/* Note about compact pairs
+Case-sensitive lists start with the compact layout: pairs don't have
+the key field because the key is the identity itself for exact str keys.
+It saves 1/4 of memory and a reference per pair for the most common case.
+
+The first key that differs from its identity (str subclass or istr)
+switches the list to the full layout, the conversion is performed once.
+Case-insensitive lists always use the full layout.
+
+Pairs are accessed with pair_list_at() only, the stride depends on the
+layout.  pair->key should never be touched for compact lists,
+pair_list_pair_key() returns the key for both layouts.
+*/
 
-To fit into 512 bytes, the structure can contain only 13 pairs
-which is too small, e.g. https://www.python.org returns 16 headers
-(9 of them are caching proxy information though).
+#define COMPACT_PAIR_SIZE offsetof(pair_t, key)
 
-The embedded buffer intention is to fit the vast majority of possible
-HTTP headers into the buffer without allocating an extra memory block.
+/* Note about the structure size
+The owner object embeds a buffer of pairs, the list switches to a heap
+allocated block when the buffer is full.  The buffer is not a part of
+pair_list_t but lives at the end of the owner object.
+
+The full layout has EMBEDDED_CAPACITY pairs: it fits the vast majority
+of HTTP headers, e.g. https://www.python.org returns 16 headers (9 of
+them are caching proxy information though).  But multidicts are also
+created by the million for empty or short query strings, so the owner
+is allocated in one of the size classes of 0, SMALL_EMBEDDED_CAPACITY
+or EMBEDDED_CAPACITY inline pairs chosen by the known number of items,
+see pair_list_size_class().  Lists larger than the full buffer use no
+buffer at all and reserve the exact heap block on construction.
+
+The type stays fixed-size (a var-sized type forbids __slots__ in
+subclasses): smaller classes are allocated by internal types that cut
+the buffer, subclasses always get the full layout, see dict.h.
 */
 
 #define EMBEDDED_CAPACITY 28
+#define SMALL_EMBEDDED_CAPACITY 4
+
+/* Note about limits
+Multidicts built from untrusted input (e.g. a header flood) may be limited
+by the number of pairs and the number of pairs with the same identity.
+The limits are checked on adding a pair.  Duplicates are counted in
+a dict (identity -> count), it is built on the first check and dropped
+when the count cannot be updated, e.g. on memory error, to be rebuilt
+on the next check.
+*/
+
+/* Note about the hash index
+Lookups scan the list linearly, it is the fastest way for HTTP headers
+and other small multidicts.  Large lists (INDEX_MIN_SIZE pairs or more)
+build a hash index after lookups have scanned as many pairs as the list
+holds, so a big query string dict answers repeated lookups in O(1)
+while a list that is looked up once or twice never pays for the index.
+
+The index maps an identity to the positions of its pairs: entries keep
+the first and the last position, next[] chains the positions of pairs
+with the same identity.  Appending a pair updates the index, any other
+structural change (removal, reordering, clear) drops it, the scan budget
+starts from zero again.  An index dropped before serving INDEX_MIN_SIZE
+lookups doubles the budget for the next build (up to
+INDEX_MAX_BUILD_FACTOR full scans), so interleaved lookups and removals
+don't rebuild it over and over.
+
+Slots are chosen by SipHash-1-3 of the stored identity hash with
+a per-process random key, so attacker-chosen keys colliding in the low
+bits of PyObject_Hash() don't collide in the table.  Full hash collisions
+still cluster, when an insertion probes more than INDEX_MAX_PROBES slots
+the index switches to a treap ordered by (hash, identity) with priorities
+derived from the same key, and lookups stay logarithmic.
+*/
+
+#define INDEX_MIN_SIZE 64
+#define INDEX_MAX_BUILD_FACTOR 64
+#ifndef INDEX_MAX_PROBES
+#define INDEX_MAX_PROBES 32
+#endif
+
+typedef struct pair_index_entry {
+    Py_hash_t hash;
+    Py_ssize_t first;  // position of the first pair with the identity
+    Py_ssize_t last;  // position of the last one
+} pair_index_entry_t;
+
+/* Rarely used parts of the list live in a separately allocated block,
+small lists don't pay for them. */
+
+typedef struct pair_list_ext {
+    // see the note about limits
+    Py_ssize_t max_pairs;  // PY_SSIZE_T_MAX if unlimited
+    Py_ssize_t max_duplicates;  // PY_SSIZE_T_MAX if unlimited
+    PyObject *counts;  // identity -> number of pairs, NULL if not counted
+
+    // see the note about the hash index
+    Py_ssize_t scanned;  // pairs scanned by lookups since the index drop
+    Py_ssize_t build_factor;  // build after scanning build_factor * size pairs
+    Py_ssize_t hits;  // lookups served by the index
+    Py_ssize_t index_capacity;  // in pairs, 0 if there is no index
+    Py_ssize_t *next;  // next position with the same identity or -1
+    pair_index_entry_t *entries;
+    Py_ssize_t nentries;
+    Py_ssize_t *slots;  // entry numbers or -1, NULL in the tree mode
+    size_t mask;
+    Py_ssize_t *children;  // left and right entries in the tree mode
+    Py_ssize_t root;
+
+    Py_ssize_t tombstones;  // see the note about tombstones
+
+    // the last found pair, see the note about the lookup cache
+    uint64_t cache_version;  // 0 if empty
+    Py_hash_t cache_hash;
+    Py_ssize_t cache_pos;
+} pair_list_ext_t;
+
+#define SIGNATURE_WORDS 2  // 128 bits
 
 typedef struct pair_list {
     mod_state *state;
@@ -53,12 +159,49 @@ typedef struct pair_list {
     Py_ssize_t size;
     uint64_t version;
     bool calc_ci_indentity;
-    pair_t *pairs;
-    pair_t buffer[EMBEDDED_CAPACITY];
+    bool compact;
+    bool untracked;  // the owner is not tracked by GC, see the note
+    bool signature_stale;  // pairs were removed after the last rebuild
+    bool raw_values;  // may hold undecoded values, see the note
+    bool bytes_keys;  // see the note about bytes keys
+    // the size class of the owner's buffer in full pairs, set by the
+    // allocator, see the note about the structure size
+    uint8_t embedded;
+    void *pairs;
+    uint64_t signature[SIGNATURE_WORDS];  // see the note about the signature
+    ArenaObject *arena;  // heap allocated pairs live in the arena if set
+    pair_list_ext_t *ext;  // NULL if not needed
 } pair_list_t;
 
+// Defined in dict.h, the object embedding the list
+static inline PyObject *pair_list_owner(pair_list_t *list);
+// the embedded buffer at its end
+static inline void *pair_list_buffer(pair_list_t *list);
+
+
+static inline Py_ssize_t
+pair_list_embedded(pair_list_t *list)
+{
+    return list->embedded;
+}
+
 #define MIN_CAPACITY 64
 #define CAPACITY_STEP MIN_CAPACITY
+#define MIN_HEAP_CAPACITY 8
+
+/* Note about the growth policy
+Small lists grow by doubling up to CAPACITY_STEP and by CAPACITY_STEP
+after that, large ones grow geometrically by 1/2 of the requested size
+to keep the amortized cost of pair_list_add() constant, e.g. a 100k-entry
+form dict performs ~20 reallocations instead of ~1.5k.
+
+The list shrinks when less than 1/4 of the capacity is used
+and returns to the embedded buffer when the size drops below
+a half of the embedded capacity.  The gaps between grow and shrink
+thresholds prevent grow-shrink jitter on add-remove sequences.
+*/
+
+#define GEOMETRIC_GROWTH_THRESHOLD (4 * CAPACITY_STEP)
 
 /* Global counter used to set ma_version_tag field of dictionary.
  * It is incremented each time that a dictionary is created and each
@@ -77,6 +220,13 @@ typedef struct pair_list_pos {
 static inline int
 str_cmp(PyObject *s1, PyObject *s2)
 {
+    if (PyBytes_CheckExact(s1)) {
+        // identities of bytes-keyed lists
+        Py_ssize_t size = PyBytes_GET_SIZE(s1);
+        return PyBytes_CheckExact(s2) && PyBytes_GET_SIZE(s2) == size
+            && memcmp(PyBytes_AS_STRING(s1), PyBytes_AS_STRING(s2),
+                      (size_t)size) == 0;
+    }
     PyObject *ret = PyUnicode_RichCompare(s1, s2, Py_EQ);
     if (Py_IsTrue(ret)) {
         Py_DECREF(ret);
@@ -92,6 +242,19 @@ str_cmp(PyObject *s1, PyObject *s2)
 }
 
 
+static inline int
+_pair_list_str_cmp(pair_list_t *list, PyObject *s1, PyObject *s2)
+{
+    // str_cmp() for identities with equal hashes
+    int ret = str_cmp(s1, s2);
+    MULTIDICT_STATS_INC(list->state, str_cmps);
+    if (ret == 0) {
+        MULTIDICT_STATS_INC(list->state, hash_collisions);
+    }
+    return ret;
+}
+
+
 static inline PyObject *
 _key_to_ident(mod_state *state, PyObject *key)
 {
@@ -119,6 +282,7 @@ _ci_key_to_ident(mod_state *state, PyObject *key)
     }
     if (PyUnicode_Check(key)) {
         PyObject *ret = PyObject_CallMethodNoArgs(key, state->str_lower);
+        MULTIDICT_STATS_INC(state, ci_identities);
         if (!PyUnicode_CheckExact(ret)) {
             PyObject *tmp = PyUnicode_FromObject(ret);
             Py_CLEAR(ret);
@@ -165,300 +329,1985 @@ _ci_arg_to_key(mod_state *state, PyObject *key, PyObject *ident)
 }
 
 
-static inline int
-pair_list_grow(pair_list_t *list, Py_ssize_t amount)
-{
-    // Grow by one element if needed
-    Py_ssize_t capacity = ((Py_ssize_t)((list->size + amount)
-                                        / CAPACITY_STEP) + 1) * CAPACITY_STEP;
-
-    pair_t *new_pairs;
+/* Note about bytes keys
+BytesMultiDict and CIBytesMultiDict lists have bytes_keys set: keys are
+bytes, identities are exact bytes compared with memcmp().  The
+case-insensitive identity is the key with ASCII letters lowered, other
+bytes are kept as is, so wire-level code never decodes header names.
+Keys are returned as passed, there is no istr counterpart.
+*/
 
-    if (list->size + amount -1 < list->capacity) {
-        return 0;
+static inline PyObject *
+_bytes_key_to_ident(PyObject *key, bool ci)
+{
+    if (!PyBytes_Check(key)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "BytesMultiDict keys should be either bytes "
+                        "or subclasses of bytes");
+        return NULL;
     }
-
-    if (list->pairs == list->buffer) {
-        new_pairs = PyMem_New(pair_t, (size_t)capacity);
-        memcpy(new_pairs, list->buffer, (size_t)list->capacity * sizeof(pair_t));
-
-        list->pairs = new_pairs;
-        list->capacity = capacity;
-        return 0;
+    const char *src = PyBytes_AS_STRING(key);
+    Py_ssize_t size = PyBytes_GET_SIZE(key);
+    Py_ssize_t pos = 0;
+    if (ci) {
+        while (pos < size && !(src[pos] >= 'A' && src[pos] <= 'Z')) {
+            pos++;
+        }
     } else {
-        new_pairs = PyMem_Resize(list->pairs, pair_t, (size_t)capacity);
-
-        if (NULL == new_pairs) {
-            // Resizing error
-            return -1;
+        pos = size;
+    }
+    if (pos == size) {
+        if (PyBytes_CheckExact(key)) {
+            return Py_NewRef(key);
         }
-
-        list->pairs = new_pairs;
-        list->capacity = capacity;
-        return 0;
+        return PyBytes_FromStringAndSize(src, size);
+    }
+    PyObject *ret = PyBytes_FromStringAndSize(NULL, size);
+    if (ret == NULL) {
+        return NULL;
+    }
+    char *dst = PyBytes_AS_STRING(ret);
+    memcpy(dst, src, (size_t)pos);
+    for (; pos < size; pos++) {
+        char ch = src[pos];
+        dst[pos] = (ch >= 'A' && ch <= 'Z') ? (char)(ch + ('a' - 'A')) : ch;
     }
+    return ret;
 }
 
 
-static inline int
-pair_list_shrink(pair_list_t *list)
+static inline Py_ssize_t
+pair_list_pair_size(pair_list_t *list)
 {
-    // Shrink by one element if needed.
-    // Optimization is applied to prevent jitter
-    // (grow-shrink-grow-shrink on adding-removing the single element
-    // when the buffer is full).
-    // To prevent this, the buffer is resized if the size is less than the capacity
-    // by 2*CAPACITY_STEP factor.
-    // The switch back to embedded buffer is never performed for both reasons:
-    // the code simplicity and the jitter prevention.
+    return list->compact ? (Py_ssize_t)COMPACT_PAIR_SIZE
+                         : (Py_ssize_t)sizeof(pair_t);
+}
 
-    pair_t *new_pairs;
-    Py_ssize_t new_capacity;
 
-    if (list->capacity - list->size < 2 * CAPACITY_STEP) {
-        return 0;
-    }
-    new_capacity = list->capacity - CAPACITY_STEP;
-    if (new_capacity < MIN_CAPACITY) {
-        return 0;
-    }
+static inline Py_ssize_t
+pair_list_buffer_capacity(pair_list_t *list)
+{
+    // The embedded buffer capacity in pairs of the current layout
+    return pair_list_embedded(list) * (Py_ssize_t)sizeof(pair_t)
+        / pair_list_pair_size(list);
+}
 
-    new_pairs = PyMem_Resize(list->pairs, pair_t, (size_t)new_capacity);
 
-    if (NULL == new_pairs) {
-        // Resizing error
-        return -1;
-    }
+static inline pair_t *
+pair_list_at(pair_list_t *list, Py_ssize_t pos)
+{
+    return (pair_t *)((char *)list->pairs + pos * pair_list_pair_size(list));
+}
 
-    list->pairs = new_pairs;
-    list->capacity = new_capacity;
 
-    return 0;
-}
+/* Note about tombstones
+Removing a pair from the middle of a list shifts the tail, proxies
+stripping hop-by-hop headers from the front of a large multidict would
+pay O(n) per removal.  Lists of TOMBSTONE_MIN_SIZE pairs or more mark
+the removed pair as a tombstone instead: all its fields are NULL and
+the hash is -1, which PyObject_Hash() never returns, so hash comparisons
+of lookup loops skip tombstones for free.
+
+list->size counts tombstones, pair_list_len() doesn't.  Loops over
+positions skip pairs with NULL identity, the last pair is never
+a tombstone: they are trimmed from the tail right away.  The list is
+compacted when tombstones exceed 1/TOMBSTONE_RATIO of the pairs, the
+order of pairs is kept.
+
+Read-only operations (iteration, repr, pickling, comparison) skip
+tombstones instead of compacting the list: compaction moves pairs and
+would break positions of live iterators.  Operations that compact the
+list anyway (del, popall) keep tombstones as ordinary pairs, update()
+drops them first.
+*/
 
+#define TOMBSTONE_MIN_SIZE 64
+#define TOMBSTONE_RATIO 4
 
-static inline int
-_pair_list_init(pair_list_t *list, mod_state *state,
-                bool calc_ci_identity, Py_ssize_t preallocate)
-{
-    list->state = state;
-    list->calc_ci_indentity = calc_ci_identity;
-    Py_ssize_t capacity = EMBEDDED_CAPACITY;
-    if (preallocate >= capacity) {
-        capacity = ((Py_ssize_t)(preallocate / CAPACITY_STEP) + 1) * CAPACITY_STEP;
-        list->pairs = PyMem_New(pair_t, (size_t)capacity);
-    } else {
-        list->pairs = list->buffer;
-    }
-    list->capacity = capacity;
-    list->size = 0;
-    list->version = NEXT_VERSION();
-    return 0;
-}
 
-static inline int
-pair_list_init(pair_list_t *list, mod_state *state, Py_ssize_t size)
+static inline Py_ssize_t
+_pair_list_tombstones(pair_list_t *list)
 {
-    return _pair_list_init(list, state, /* calc_ci_identity = */ false, size);
+    return list->ext != NULL ? list->ext->tombstones : 0;
 }
 
 
-static inline int
-ci_pair_list_init(pair_list_t *list, mod_state *state, Py_ssize_t size)
+static inline void
+_pair_list_trim_tombstones(pair_list_t *list)
 {
-    return _pair_list_init(list, state, /* calc_ci_identity = */ true, size);
+    // Keep the last pair alive
+    if (_pair_list_tombstones(list) == 0) {
+        return;
+    }
+    while (list->size > 0
+            && pair_list_at(list, list->size - 1)->identity == NULL) {
+        list->size--;
+        list->ext->tombstones--;
+    }
 }
 
 
 static inline PyObject *
-pair_list_calc_identity(pair_list_t *list, PyObject *key)
+pair_list_pair_key(pair_list_t *list, pair_t *pair)
 {
-    if (list->calc_ci_indentity)
-        return _ci_key_to_ident(list->state, key);
-    return _key_to_ident(list->state, key);
+    // Borrowed reference, compact pairs keep the key as the identity
+    return list->compact ? pair->identity : pair->key;
 }
 
+
+/* Note about raw values
+Most header values are never read by handlers.  A list built by
+CIMultiDictBuilder(lazy_values=True) stores them as raw exact bytes
+objects, pair_list_value() decodes a raw value (UTF-8 with
+surrogateescape, like the builder) on first access and caches the str
+in place, so unread values never get a str.
+
+raw_values is set while the list may hold raw values.  Such a list can't
+tell a bytes value stored by the user from a raw one, so storing a bytes
+value decodes all raw values first (_pair_list_before_store()).
+Every path handing a value out reads it with pair_list_value(),
+copies into an empty list keep raw values as is.
+
+Decoding writes to the pair on the read path.  Without the GIL two
+readers could decode the same value and both release the raw bytes, so
+raw values are read and replaced in a critical section on the owner.
+Decoded values are never replaced by readers and are read without it.
+*/
+
 static inline PyObject *
-pair_list_calc_key(pair_list_t *list, PyObject *key, PyObject *ident)
+pair_list_decode_value(PyObject *raw)
 {
-    if (list->calc_ci_indentity)
-        return _ci_arg_to_key(list->state, key, ident);
-    return _arg_to_key(list->state, key, ident);
+    return PyUnicode_DecodeUTF8(PyBytes_AS_STRING(raw),
+                                PyBytes_GET_SIZE(raw), "surrogateescape");
 }
 
-static inline void
-pair_list_dealloc(pair_list_t *list)
-{
-    Py_ssize_t pos;
-
-    for (pos = 0; pos < list->size; pos++) {
-        pair_t *pair = list->pairs + pos;
 
-        Py_CLEAR(pair->identity);
-        Py_CLEAR(pair->key);
-        Py_CLEAR(pair->value);
+static inline PyObject *
+pair_list_value(pair_list_t *list, pair_t *pair)
+{
+    // Borrowed reference, NULL on error
+    if (!list->raw_values) {
+        return pair->value;
     }
-
-    /*
-    Strictly speaking, resetting size and capacity and
-    assigning pairs to buffer is not necessary.
-    Do it to consistency and idemotency.
-    The cleanup doesn't hurt performance.
-    !!!
-    !!! The buffer deletion is crucial though.
-    !!!
-    */
-    list->size = 0;
-    if (list->pairs != list->buffer) {
-        PyMem_Free(list->pairs);
-        list->pairs = list->buffer;
-        list->capacity = EMBEDDED_CAPACITY;
+    PyObject *value;
+    Py_BEGIN_CRITICAL_SECTION(pair_list_owner(list));
+    value = pair->value;
+    if (PyBytes_CheckExact(value)) {
+        value = pair_list_decode_value(value);
+        if (value != NULL) {
+            Py_SETREF(pair->value, value);
+        }
     }
+    Py_END_CRITICAL_SECTION();
+    return value;
 }
 
 
-static inline Py_ssize_t
-pair_list_len(pair_list_t *list)
+static inline PyObject *
+pair_list_raw_value(pair_list_t *list, pair_t *pair)
 {
-    return list->size;
+    // New reference to the value as is, raw or decoded
+    PyObject *value;
+    Py_BEGIN_CRITICAL_SECTION(pair_list_owner(list));
+    value = Py_NewRef(pair->value);
+    Py_END_CRITICAL_SECTION();
+    return value;
 }
 
 
 static inline int
-_pair_list_add_with_hash_steal_refs(pair_list_t *list,
-                                    PyObject *identity,
-                                    PyObject *key,
-                                    PyObject *value,
-                                    Py_hash_t hash)
+pair_list_load_values(pair_list_t *list)
 {
-    if (pair_list_grow(list, 1) < 0) {
-        return -1;
+    // Decode all raw values
+    if (!list->raw_values) {
+        return 0;
     }
+    for (Py_ssize_t pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity != NULL && pair_list_value(list, pair) == NULL) {
+            return -1;
+        }
+    }
+    list->raw_values = false;
+    return 0;
+}
 
-    pair_t *pair = list->pairs + list->size;
-
-    pair->identity = identity;
-    pair->key = key;
-    pair->value = value;
-    pair->hash = hash;
-
-    list->version = NEXT_VERSION();
-    list->size += 1;
 
+static inline int
+_pair_list_before_store(pair_list_t *list, PyObject *value)
+{
+    if (list->raw_values && PyBytes_CheckExact(value)) {
+        return pair_list_load_values(list);
+    }
     return 0;
 }
 
-static inline int
-_pair_list_add_with_hash(pair_list_t *list,
-                         PyObject *identity,
-                         PyObject *key,
-                         PyObject *value,
-                         Py_hash_t hash)
+
+static inline void *
+_pair_list_alloc(pair_list_t *list, Py_ssize_t nbytes)
 {
-    Py_INCREF(identity);
-    Py_INCREF(key);
-    Py_INCREF(value);
-    return _pair_list_add_with_hash_steal_refs(list, identity, key, value, hash);
+    // Allocate a new heap block for pairs.
+    // Pairs can't live in a closed arena, it moves them to PyMem on close.
+    if (list->arena != NULL) {
+        if (!list->arena->closed) {
+            return arena_alloc(list->arena, list, (size_t)nbytes);
+        }
+        Py_CLEAR(list->arena);
+    }
+    void *ret = PyMem_Malloc((size_t)nbytes);
+    if (ret == NULL) {
+        PyErr_NoMemory();
+    }
+    return ret;
 }
 
 
-static inline int
-pair_list_add(pair_list_t *list, PyObject *key, PyObject *value)
+static inline void *
+_pair_list_realloc(pair_list_t *list, Py_ssize_t nbytes)
 {
-    PyObject *identity = pair_list_calc_identity(list, key);
-    if (identity == NULL) {
-        goto fail;
+    if (list->arena != NULL) {
+        return arena_realloc(list->arena, list, list->pairs, (size_t)nbytes);
     }
-    Py_hash_t hash = PyObject_Hash(identity);
-    if (hash == -1) {
-        goto fail;
+    void *ret = PyMem_Realloc(list->pairs, (size_t)nbytes);
+    if (ret == NULL) {
+        PyErr_NoMemory();
     }
-    int ret = _pair_list_add_with_hash(list, identity, key, value, hash);
-    Py_DECREF(identity);
     return ret;
-fail:
-    Py_XDECREF(identity);
-    return -1;
 }
 
 
-static inline int
-pair_list_del_at(pair_list_t *list, Py_ssize_t pos)
+static inline void
+_pair_list_free(pair_list_t *list, void *pairs)
 {
-    // return 1 on success, -1 on failure
-    pair_t *pair = list->pairs + pos;
-    Py_DECREF(pair->identity);
-    Py_DECREF(pair->key);
-    Py_DECREF(pair->value);
+    if (list->arena != NULL) {
+        arena_free(list->arena, pairs);
+    } else {
+        PyMem_Free(pairs);
+    }
+}
 
-    list->size -= 1;
-    list->version = NEXT_VERSION();
 
-    if (list->size == pos) {
-        // remove from tail, no need to shift body
-        return 0;
+static inline int
+_pair_list_arena_detach(pair_list_t *list, void *pairs, size_t size)
+{
+    // The arena is closing, move the pairs to PyMem
+    assert(list->pairs == pairs);
+    void *new_pairs = PyMem_Malloc(size);
+    if (new_pairs == NULL) {
+        PyErr_NoMemory();
+        return -1;
     }
+    memcpy(new_pairs, pairs, size);
+    list->pairs = new_pairs;
+    Py_CLEAR(list->arena);
+    return 0;
+}
 
-    Py_ssize_t tail = list->size - pos;
-    // TODO: raise an error if tail < 0
-    memmove((void *)(list->pairs + pos),
-            (void *)(list->pairs + pos + 1),
-            sizeof(pair_t) * (size_t)tail);
 
-    return pair_list_shrink(list);
+static inline Py_ssize_t
+_pair_list_round_capacity(Py_ssize_t capacity)
+{
+    if (capacity <= MIN_HEAP_CAPACITY) {
+        return MIN_HEAP_CAPACITY;
+    }
+    if (capacity < CAPACITY_STEP) {
+        Py_ssize_t ret = MIN_HEAP_CAPACITY;
+        while (ret < capacity) {
+            ret <<= 1;
+        }
+        return ret;
+    }
+    return ((Py_ssize_t)((capacity - 1) / CAPACITY_STEP) + 1) * CAPACITY_STEP;
 }
 
 
 static inline int
-_pair_list_drop_tail(pair_list_t *list, PyObject *identity, Py_hash_t hash,
-                     Py_ssize_t pos)
+_pair_list_resize(pair_list_t *list, Py_ssize_t capacity)
 {
-    // return 1 if deleted, 0 if not found
-    int found = 0;
+    // Move pairs into a heap allocated block of the given capacity,
+    // or back into the embedded buffer if it is large enough.
+    // The caller guarantees that capacity >= list->size.
+    void *new_pairs;
+    Py_ssize_t pair_size = pair_list_pair_size(list);
+    Py_ssize_t buffer_capacity = pair_list_buffer_capacity(list);
 
-    if (pos >= list->size) {
+    assert(capacity >= list->size);
+
+    if (capacity == list->capacity) {
         return 0;
     }
+    if (capacity < list->capacity) {
+        MULTIDICT_STATS_INC(list->state, shrinks);
+    }
 
-    for (; pos < list->size; pos++) {
-        pair_t *pair = list->pairs + pos;
-        if (pair->hash != hash) {
-            continue;
+    if (capacity <= buffer_capacity) {
+        if (list->pairs != pair_list_buffer(list)) {
+            memcpy(pair_list_buffer(list), list->pairs,
+                   (size_t)(list->size * pair_size));
+            _pair_list_free(list, list->pairs);
+            list->pairs = pair_list_buffer(list);
         }
-        int ret = str_cmp(pair->identity, identity);
-        if (ret > 0) {
-            if (pair_list_del_at(list, pos) < 0) {
-               return -1;
-            }
-            found = 1;
-            pos--;
+        list->capacity = buffer_capacity;
+        return 0;
+    }
+
+    if (capacity > PY_SSIZE_T_MAX / pair_size) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    if (list->pairs == pair_list_buffer(list)) {
+        MULTIDICT_STATS_INC(list->state, spills);
+        new_pairs = _pair_list_alloc(list, capacity * pair_size);
+        if (NULL == new_pairs) {
+            return -1;
         }
-        else if (ret == -1) {
+        memcpy(new_pairs, pair_list_buffer(list),
+               (size_t)(list->size * pair_size));
+    } else {
+        new_pairs = _pair_list_realloc(list, capacity * pair_size);
+        if (NULL == new_pairs) {
+            // Resizing error
             return -1;
         }
     }
 
-    return found;
+    list->pairs = new_pairs;
+    list->capacity = capacity;
+    return 0;
 }
 
 
 static inline int
-pair_list_del(pair_list_t *list, PyObject *key)
+pair_list_reserve(pair_list_t *list, Py_ssize_t size)
 {
-    PyObject *identity = pair_list_calc_identity(list, key);
-    if (identity == NULL) {
-        goto fail;
+    // Make room for exactly size pairs (rounded up to CAPACITY_STEP)
+    // without the geometric overallocation.
+    size += _pair_list_tombstones(list);
+    if (size <= list->capacity) {
+        return 0;
     }
+    return _pair_list_resize(list, _pair_list_round_capacity(size));
+}
 
-    Py_hash_t hash = PyObject_Hash(identity);
-    if (hash == -1) {
-        goto fail;
-    }
 
-    int ret = _pair_list_drop_tail(list, identity, hash, 0);
+static inline int
+pair_list_grow(pair_list_t *list, Py_ssize_t amount)
+{
+    // Grow to fit amount extra elements if needed
+    Py_ssize_t size = list->size + amount;
 
-    if (ret < 0) {
-        goto fail;
+    if (size <= list->capacity) {
+        return 0;
+    }
+
+    if (size >= GEOMETRIC_GROWTH_THRESHOLD) {
+        size += size >> 1;
+    }
+    return _pair_list_resize(list, _pair_list_round_capacity(size));
+}
+
+
+static inline int
+pair_list_shrink(pair_list_t *list)
+{
+    // Shrink the list if it is mostly empty.
+    // The buffer is halved when less than a quarter of it is used,
+    // the switch back to the embedded buffer is performed
+    // when the size is less than a half of the embedded capacity.
+    // Both thresholds leave enough headroom to prevent jitter
+    // (grow-shrink-grow-shrink on adding-removing the single element).
+
+    if (list->pairs == pair_list_buffer(list)) {
+        return 0;
+    }
+
+    if (list->size < pair_list_buffer_capacity(list) / 2) {
+        return _pair_list_resize(list, pair_list_buffer_capacity(list));
+    }
+
+    if (list->size >= list->capacity / 4) {
+        return 0;
+    }
+
+    Py_ssize_t new_capacity = _pair_list_round_capacity(list->capacity / 2);
+    if (new_capacity >= list->capacity) {
+        return 0;
+    }
+    return _pair_list_resize(list, new_capacity);
+}
+
+
+static inline int
+_pair_list_widen(pair_list_t *list)
+{
+    // Switch the compact list to the full layout.
+    // Pointers to pairs are invalidated, positions are kept.
+    pair_t *new_pairs;
+    Py_ssize_t capacity;
+    Py_ssize_t pos;
+
+    assert(list->compact);
+
+    if (list->size <= pair_list_embedded(list)) {
+        // Full pairs are larger than compact ones, the conversion from
+        // the end to the start is safe for the same buffer.
+        new_pairs = pair_list_buffer(list);
+        capacity = pair_list_embedded(list);
+    } else {
+        capacity = list->capacity;
+        if (capacity > PY_SSIZE_T_MAX / (Py_ssize_t)sizeof(pair_t)) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        new_pairs = _pair_list_alloc(list,
+                                     capacity * (Py_ssize_t)sizeof(pair_t));
+        if (NULL == new_pairs) {
+            return -1;
+        }
+    }
+
+    for (pos = list->size - 1; pos >= 0; pos--) {
+        pair_t *pair = pair_list_at(list, pos);
+        PyObject *identity = pair->identity;
+        PyObject *value = pair->value;
+        Py_hash_t hash = pair->hash;
+
+        pair = new_pairs + pos;
+        pair->identity = identity;
+        pair->value = value;
+        pair->hash = hash;
+        pair->key = Py_XNewRef(identity);  // NULL for tombstones
+    }
+
+    if (list->pairs != pair_list_buffer(list)) {
+        _pair_list_free(list, list->pairs);
+    }
+    list->pairs = new_pairs;
+    list->capacity = capacity;
+    list->compact = false;
+    return 0;
+}
+
+
+static inline int
+_pair_list_init(pair_list_t *list, mod_state *state,
+                bool calc_ci_identity, Py_ssize_t preallocate)
+{
+    list->state = state;
+    list->calc_ci_indentity = calc_ci_identity;
+    list->ext = NULL;
+    list->compact = !calc_ci_identity;
+    list->untracked = false;
+    memset(list->signature, 0, sizeof(list->signature));
+    list->signature_stale = false;
+    list->raw_values = false;
+    list->bytes_keys = false;
+    list->pairs = pair_list_buffer(list);
+    list->capacity = pair_list_buffer_capacity(list);
+    list->size = 0;
+    list->version = NEXT_VERSION();
+#ifdef MULTIDICT_STATS
+    if (pair_list_embedded(list) == EMBEDDED_CAPACITY) {
+        state->stats.constructed_full++;
+    } else if (pair_list_embedded(list) > 0) {
+        state->stats.constructed_small++;
+    } else {
+        state->stats.constructed_no_buffer++;
+    }
+#endif
+    if (arena_current(state, &list->arena) < 0) {
+        return -1;
+    }
+    return pair_list_reserve(list, preallocate);
+}
+
+static inline int
+pair_list_init(pair_list_t *list, mod_state *state, Py_ssize_t size)
+{
+    return _pair_list_init(list, state, /* calc_ci_identity = */ false, size);
+}
+
+
+static inline int
+ci_pair_list_init(pair_list_t *list, mod_state *state, Py_ssize_t size)
+{
+    return _pair_list_init(list, state, /* calc_ci_identity = */ true, size);
+}
+
+
+static inline int
+bytes_pair_list_init(pair_list_t *list, mod_state *state, bool ci,
+                     Py_ssize_t size)
+{
+    if (_pair_list_init(list, state, ci, size) < 0) {
+        return -1;
+    }
+    list->bytes_keys = true;
+    return 0;
+}
+
+
+/* Note about GC tracking
+Multidicts with atomic keys and values can't be a part of a reference
+cycle, e.g. headers and query strings with str keys and values.
+Like dict, an exact MultiDict or CIMultiDict is untracked on construction
+and starts to be tracked when a pair with a key or value that can refer
+to other objects is stored, so GC generations don't scan such
+multidicts at all.
+
+Objects of non-GC types (str, bytes, int, float, None, bool, istr)
+and untracked tuples are atomic.  Every path storing a key or a value
+calls _pair_list_track_if_needed(), the owner is never untracked again.
+Subclass instances may have __dict__ and are always tracked.
+*/
+
+
+static inline void
+pair_list_untrack(pair_list_t *list)
+{
+    // Stop tracking the owner of an empty list
+    assert(list->size == 0);
+    PyObject_GC_UnTrack(pair_list_owner(list));
+    list->untracked = true;
+}
+
+
+static inline void
+_pair_list_track_if_needed(pair_list_t *list, PyObject *obj)
+{
+    if (!list->untracked || !PyObject_IS_GC(obj)) {
+        return;
+    }
+    if (PyTuple_CheckExact(obj) && !PyObject_GC_IsTracked(obj)) {
+        return;
+    }
+    list->untracked = false;
+    PyObject_GC_Track(pair_list_owner(list));
+}
+
+
+static inline Py_ssize_t
+pair_list_size_class(Py_ssize_t size)
+{
+    // Choose the embedded buffer capacity for the expected number
+    // of items, -1 means the number is unknown.  Lists that don't fit
+    // the full buffer reserve their heap block on construction.
+    if (size < 0) {
+        return EMBEDDED_CAPACITY;
+    }
+    if (size == 0 || size > EMBEDDED_CAPACITY) {
+        return 0;
+    }
+    if (size <= SMALL_EMBEDDED_CAPACITY) {
+        return SMALL_EMBEDDED_CAPACITY;
+    }
+    return EMBEDDED_CAPACITY;
+}
+
+
+static inline PyObject *
+pair_list_calc_identity(pair_list_t *list, PyObject *key)
+{
+    if (list->bytes_keys)
+        return _bytes_key_to_ident(key, list->calc_ci_indentity);
+    if (list->calc_ci_indentity)
+        return _ci_key_to_ident(list->state, key);
+    return _key_to_ident(list->state, key);
+}
+
+static inline bool
+pair_list_is_key(pair_list_t *list, PyObject *key)
+{
+    // Keys of other types are never found in the list
+    return list->bytes_keys ? PyBytes_Check(key) : PyUnicode_Check(key);
+}
+
+static inline PyObject *
+pair_list_calc_key(pair_list_t *list, PyObject *key, PyObject *ident)
+{
+    if (list->bytes_keys)
+        return Py_NewRef(key);
+    if (list->calc_ci_indentity)
+        return _ci_arg_to_key(list->state, key, ident);
+    return _arg_to_key(list->state, key, ident);
+}
+
+static inline pair_list_ext_t *
+_pair_list_load_ext(pair_list_t *list)
+{
+#ifdef Py_GIL_DISABLED
+    return _Py_atomic_load_ptr_acquire(&list->ext);
+#else
+    return list->ext;
+#endif
+}
+
+
+static inline pair_list_ext_t *
+_pair_list_ext(pair_list_t *list)
+{
+    // Get the extension block, it is allocated on the first use.
+    // Read-only lookups allocate it too, free-threaded builds publish
+    // the block atomically and the loser of a race frees its own one.
+    pair_list_ext_t *ext = _pair_list_load_ext(list);
+    if (ext == NULL) {
+        ext = PyMem_Calloc(1, sizeof(pair_list_ext_t));
+        if (ext == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        ext->max_pairs = PY_SSIZE_T_MAX;
+        ext->max_duplicates = PY_SSIZE_T_MAX;
+        ext->root = -1;
+        ext->build_factor = 1;
+#ifdef Py_GIL_DISABLED
+        pair_list_ext_t *expected = NULL;
+        if (!_Py_atomic_compare_exchange_ptr(&list->ext, &expected, ext)) {
+            PyMem_Free(ext);
+            ext = expected;
+        }
+#else
+        list->ext = ext;
+#endif
+    }
+    return ext;
+}
+
+
+static inline int
+pair_list_index_init(mod_state *state)
+{
+    // Generate the per-process key of hash indexes
+    PyObject *os = PyImport_ImportModule("os");
+    if (os == NULL) {
+        return -1;
+    }
+    PyObject *seed = PyObject_CallMethod(os, "urandom", "n",
+                                         (Py_ssize_t)sizeof(state->index_key));
+    Py_DECREF(os);
+    if (seed == NULL) {
+        return -1;
+    }
+    if (!PyBytes_Check(seed)
+            || PyBytes_GET_SIZE(seed) != (Py_ssize_t)sizeof(state->index_key)) {
+        PyErr_SetString(PyExc_RuntimeError, "os.urandom() returned bad data");
+        Py_DECREF(seed);
+        return -1;
+    }
+    memcpy(state->index_key, PyBytes_AS_STRING(seed),
+           sizeof(state->index_key));
+    Py_DECREF(seed);
+    return 0;
+}
+
+
+static inline bool
+_pair_list_has_index(pair_list_t *list)
+{
+    return list->ext != NULL && list->ext->index_capacity != 0;
+}
+
+
+static void
+_pair_list_index_free(pair_list_ext_t *ext)
+{
+    PyMem_Free(ext->next);
+    PyMem_Free(ext->entries);
+    PyMem_Free(ext->slots);
+    PyMem_Free(ext->children);
+    ext->next = NULL;
+    ext->entries = NULL;
+    ext->slots = NULL;
+    ext->children = NULL;
+    ext->index_capacity = 0;
+    ext->nentries = 0;
+    ext->mask = 0;
+    ext->root = -1;
+    ext->scanned = 0;
+}
+
+
+static inline void
+pair_list_index_drop(pair_list_t *list)
+{
+    // Forget the index after a structural change of the list
+    pair_list_ext_t *ext = list->ext;
+    if (ext == NULL) {
+        return;
+    }
+    if (ext->index_capacity != 0) {
+        // an index dropped before paying off is built later next time
+        if (ext->hits < INDEX_MIN_SIZE) {
+            if (ext->build_factor < INDEX_MAX_BUILD_FACTOR) {
+                ext->build_factor *= 2;
+            }
+        }
+        else {
+            ext->build_factor = 1;
+        }
+        ext->hits = 0;
+        _pair_list_index_free(ext);
+    }
+    ext->scanned = 0;
+}
+
+
+static inline uint64_t
+_pair_list_index_mix(pair_list_t *list, uint64_t value)
+{
+    return siphash13_u64(list->state->index_key, value);
+}
+
+
+static inline int
+_pair_list_index_cmp(pair_list_t *list, Py_ssize_t e,
+                     PyObject *identity, Py_hash_t hash)
+{
+    // Compare (hash, identity) with the entry e in the tree mode.
+    // Identities are exact str or bytes, the comparison never fails.
+    pair_index_entry_t *entry = &list->ext->entries[e];
+    if (entry->hash != hash) {
+        return (uint64_t)hash < (uint64_t)entry->hash ? -1 : 1;
+    }
+    PyObject *other = pair_list_at(list, entry->first)->identity;
+    if (other == identity) {
+        return 0;
+    }
+    if (list->bytes_keys) {
+        Py_ssize_t size1 = PyBytes_GET_SIZE(identity);
+        Py_ssize_t size2 = PyBytes_GET_SIZE(other);
+        int ret = memcmp(PyBytes_AS_STRING(identity), PyBytes_AS_STRING(other),
+                         (size_t)Py_MIN(size1, size2));
+        if (ret == 0) {
+            return size1 < size2 ? -1 : size1 > size2;
+        }
+        return ret < 0 ? -1 : 1;
+    }
+    return PyUnicode_Compare(identity, other);
+}
+
+
+static int
+_pair_list_index_lookup(pair_list_t *list, PyObject *identity,
+                        Py_hash_t hash, Py_ssize_t *pentry,
+                        size_t *pslot, Py_ssize_t *pprobes)
+{
+    // Find the entry of the identity.
+    // Return 1 if found, 0 if not found, -1 on error.
+    // In the hash mode *pslot is set to the free slot for the identity,
+    // *pprobes to the number of occupied slots visited.
+    pair_list_ext_t *ext = list->ext;
+
+    if (ext->slots == NULL) {
+        Py_ssize_t node = ext->root;
+        while (node >= 0) {
+            int cmp = _pair_list_index_cmp(list, node, identity, hash);
+            if (cmp == 0) {
+                *pentry = node;
+                return 1;
+            }
+            node = ext->children[2 * node + (cmp > 0)];
+        }
+        return 0;
+    }
+
+    uint64_t h = _pair_list_index_mix(list, (uint64_t)hash);
+    size_t perturb = (size_t)h;
+    size_t i = (size_t)h & ext->mask;
+    Py_ssize_t probes = 0;
+
+    for (;;) {
+        Py_ssize_t e = ext->slots[i];
+        if (e < 0) {
+            *pslot = i;
+            *pprobes = probes;
+            return 0;
+        }
+        probes++;
+        if (ext->entries[e].hash == hash) {
+            pair_t *pair = pair_list_at(list, ext->entries[e].first);
+            int tmp = _pair_list_str_cmp(list, identity, pair->identity);
+            if (tmp > 0) {
+                *pentry = e;
+                return 1;
+            }
+            else if (tmp < 0) {
+                return -1;
+            }
+        }
+        perturb >>= 5;
+        i = (i * 5 + perturb + 1) & ext->mask;
+    }
+}
+
+
+static Py_ssize_t
+_pair_list_index_tree_insert(pair_list_t *list, Py_ssize_t node,
+                             Py_ssize_t e, PyObject *identity)
+{
+    // Insert the entry e into the treap rooted at node, return the new root
+    pair_list_ext_t *ext = list->ext;
+
+    if (node < 0) {
+        return e;
+    }
+    int dir = _pair_list_index_cmp(list, node, identity,
+                                   ext->entries[e].hash) > 0;
+    Py_ssize_t child = _pair_list_index_tree_insert(
+        list, ext->children[2 * node + dir], e, identity);
+    ext->children[2 * node + dir] = child;
+    // priorities are keyed, the tree shape can't be forced from outside
+    if (_pair_list_index_mix(list, ~(uint64_t)child)
+            > _pair_list_index_mix(list, ~(uint64_t)node)) {
+        ext->children[2 * node + dir] = ext->children[2 * child + !dir];
+        ext->children[2 * child + !dir] = node;
+        return child;
+    }
+    return node;
+}
+
+
+static inline void
+_pair_list_index_tree_add(pair_list_t *list, Py_ssize_t e)
+{
+    pair_list_ext_t *ext = list->ext;
+    PyObject *identity = pair_list_at(list, ext->entries[e].first)->identity;
+    ext->children[2 * e] = -1;
+    ext->children[2 * e + 1] = -1;
+    ext->root = _pair_list_index_tree_insert(list, ext->root, e, identity);
+}
+
+
+static int
+_pair_list_index_to_tree(pair_list_t *list)
+{
+    // Switch to the tree mode on too long probe sequences
+    pair_list_ext_t *ext = list->ext;
+    Py_ssize_t e;
+
+    ext->children = PyMem_Malloc(2 * (size_t)ext->index_capacity
+                                 * sizeof(Py_ssize_t));
+    if (ext->children == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    PyMem_Free(ext->slots);
+    ext->slots = NULL;
+    ext->mask = 0;
+    ext->root = -1;
+    for (e = 0; e < ext->nentries; e++) {
+        _pair_list_index_tree_add(list, e);
+    }
+    return 0;
+}
+
+
+static int
+_pair_list_index_rehash(pair_list_t *list, size_t nslots)
+{
+    pair_list_ext_t *ext = list->ext;
+    Py_ssize_t e;
+    size_t i;
+
+    Py_ssize_t *slots = PyMem_Malloc(nslots * sizeof(Py_ssize_t));
+    if (slots == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < nslots; i++) {
+        slots[i] = -1;
+    }
+    PyMem_Free(ext->slots);
+    ext->slots = slots;
+    ext->mask = nslots - 1;
+
+    for (e = 0; e < ext->nentries; e++) {
+        uint64_t h = _pair_list_index_mix(list, (uint64_t)ext->entries[e].hash);
+        size_t perturb = (size_t)h;
+        Py_ssize_t probes = 0;
+        i = (size_t)h & ext->mask;
+        while (slots[i] >= 0) {
+            if (++probes > INDEX_MAX_PROBES) {
+                return _pair_list_index_to_tree(list);
+            }
+            perturb >>= 5;
+            i = (i * 5 + perturb + 1) & ext->mask;
+        }
+        slots[i] = e;
+    }
+    return 0;
+}
+
+
+static int
+_pair_list_index_grow(pair_list_t *list, Py_ssize_t capacity)
+{
+    pair_list_ext_t *ext = list->ext;
+    void *tmp;
+
+    tmp = PyMem_Realloc(ext->next, (size_t)capacity * sizeof(Py_ssize_t));
+    if (tmp == NULL) {
+        goto fail;
+    }
+    ext->next = tmp;
+    tmp = PyMem_Realloc(ext->entries,
+                        (size_t)capacity * sizeof(pair_index_entry_t));
+    if (tmp == NULL) {
+        goto fail;
+    }
+    ext->entries = tmp;
+    if (ext->children != NULL) {
+        tmp = PyMem_Realloc(ext->children,
+                            2 * (size_t)capacity * sizeof(Py_ssize_t));
+        if (tmp == NULL) {
+            goto fail;
+        }
+        ext->children = tmp;
+    }
+    ext->index_capacity = capacity;
+    return 0;
+fail:
+    PyErr_NoMemory();
+    return -1;
+}
+
+
+static int
+_pair_list_index_append(pair_list_t *list, Py_ssize_t pos)
+{
+    // Index the last pair of the list
+    pair_list_ext_t *ext = list->ext;
+    pair_t *pair = pair_list_at(list, pos);
+    Py_ssize_t e = -1;
+    size_t slot = 0;
+    Py_ssize_t probes = 0;
+
+    if (pos >= ext->index_capacity
+            && _pair_list_index_grow(list, list->capacity) < 0) {
+        return -1;
+    }
+    ext->next[pos] = -1;
+
+    int found = _pair_list_index_lookup(list, pair->identity, pair->hash,
+                                        &e, &slot, &probes);
+    if (found < 0) {
+        return -1;
+    }
+    if (found) {
+        ext->next[ext->entries[e].last] = pos;
+        ext->entries[e].last = pos;
+        return 0;
+    }
+
+    e = ext->nentries++;
+    ext->entries[e].hash = pair->hash;
+    ext->entries[e].first = pos;
+    ext->entries[e].last = pos;
+    if (ext->slots == NULL) {
+        _pair_list_index_tree_add(list, e);
+        return 0;
+    }
+    if (probes > INDEX_MAX_PROBES) {
+        return _pair_list_index_to_tree(list);
+    }
+    ext->slots[slot] = e;
+    if ((size_t)ext->nentries * 2 > ext->mask + 1) {
+        return _pair_list_index_rehash(list, (ext->mask + 1) * 2);
+    }
+    return 0;
+}
+
+
+static int
+_pair_list_index_build(pair_list_t *list)
+{
+    pair_list_ext_t *ext = list->ext;
+    size_t nslots = 8;
+    Py_ssize_t pos;
+
+    while (nslots < (size_t)list->size * 2) {
+        nslots <<= 1;
+    }
+    if (_pair_list_index_grow(list, list->capacity) < 0
+            || _pair_list_index_rehash(list, nslots) < 0) {
+        goto fail;
+    }
+    for (pos = 0; pos < list->size; pos++) {
+        if (pair_list_at(list, pos)->identity == NULL) {
+            continue;
+        }
+        if (_pair_list_index_append(list, pos) < 0) {
+            goto fail;
+        }
+    }
+    return 0;
+fail:
+    _pair_list_index_free(ext);
+    return -1;
+}
+
+
+static void
+_pair_list_index_account(pair_list_t *list, Py_ssize_t scanned)
+{
+    // Build the index when lookups have scanned as many pairs
+    // as the list holds.  The list works without the index,
+    // errors are not reported.
+    pair_list_ext_t *ext = _pair_list_ext(list);
+    if (ext == NULL) {
+        PyErr_Clear();
+        return;
+    }
+    ext->scanned += scanned;
+    if (ext->scanned < list->size * ext->build_factor) {
+        return;
+    }
+    if (_pair_list_index_build(list) < 0) {
+        PyErr_Clear();
+    }
+}
+
+
+static inline void
+_pair_list_index_added(pair_list_t *list)
+{
+    // Keep the index up to date after appending a pair
+    if (_pair_list_has_index(list)
+            && _pair_list_index_append(list, list->size - 1) < 0) {
+        PyErr_Clear();
+        pair_list_index_drop(list);
+    }
+}
+
+
+/* Note about the signature
+Many lookups are misses, e.g. optional headers like If-None-Match,
+and proving that a key is absent requires scanning all pairs.
+The signature makes most misses O(1): it is a 128-bit Bloom filter
+with one bit per stored pair chosen by the low 7 bits of the pair hash.
+A lookup of a key whose bit is not set returns "not found" without
+touching the pairs.  With 20 pairs, a typical request header block,
+about 15% of the misses get past it, 27% with 64 bits.
+
+Adding a pair sets its bit.  Removing pairs can't clear bits because
+other pairs may share them, the signature is marked stale instead and
+rebuilt by the next lookup miss it didn't reject, the rebuild costs
+about as much as the scan that preceded it.
+*/
+
+#define SIGNATURE_WORD(hash) (((size_t)(hash) >> 6) & (SIGNATURE_WORDS - 1))
+#define SIGNATURE_BIT(hash) ((uint64_t)1 << ((size_t)(hash) & 63))
+#define SIGNATURE_ADD(signature, hash) \
+    ((signature)[SIGNATURE_WORD(hash)] |= SIGNATURE_BIT(hash))
+#define SIGNATURE_HAS(signature, hash) \
+    (((signature)[SIGNATURE_WORD(hash)] & SIGNATURE_BIT(hash)) != 0)
+
+
+static inline void
+_pair_list_signature_rebuild(pair_list_t *list)
+{
+    uint64_t signature[SIGNATURE_WORDS] = {0};
+    for (Py_ssize_t pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity != NULL) {
+            SIGNATURE_ADD(signature, pair->hash);
+        }
+    }
+    memcpy(list->signature, signature, sizeof(signature));
+    list->signature_stale = false;
+}
+
+
+static inline int
+_pair_list_scan(pair_list_t *list, PyObject *identity, Py_hash_t hash,
+                Py_ssize_t start, Py_ssize_t *ppos)
+{
+    Py_ssize_t pos;
+    int ret = 0;
+
+    for (pos = start; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        MULTIDICT_STATS_INC(list->state, probes);
+        if (pair->hash != hash) {
+            continue;
+        }
+        ret = _pair_list_str_cmp(list, identity, pair->identity);
+        if (ret > 0) {
+            *ppos = pos;
+            break;
+        }
+        else if (ret < 0) {
+            return -1;
+        }
+    }
+    if (list->size >= INDEX_MIN_SIZE) {
+        _pair_list_index_account(list, pos - start);
+    }
+    return ret;
+}
+
+
+static inline int
+_pair_list_find(pair_list_t *list, PyObject *identity, Py_hash_t hash,
+                Py_ssize_t *ppos)
+{
+    // Find the first pair with the identity.
+    // Return 1 and set *ppos if found, 0 if not found, -1 on error.
+    MULTIDICT_STATS_INC(list->state, lookups);
+    if (!SIGNATURE_HAS(list->signature, hash)) {
+        MULTIDICT_STATS_INC(list->state, signature_rejects);
+        return 0;
+    }
+    int ret;
+    if (_pair_list_has_index(list)) {
+        Py_ssize_t e = -1;
+        size_t slot;
+        Py_ssize_t probes;
+        MULTIDICT_STATS_INC(list->state, probes);
+        list->ext->hits++;
+        ret = _pair_list_index_lookup(list, identity, hash,
+                                      &e, &slot, &probes);
+        if (ret > 0) {
+            *ppos = list->ext->entries[e].first;
+        }
+    } else {
+        ret = _pair_list_scan(list, identity, hash, 0, ppos);
+    }
+    if (ret == 0 && list->signature_stale) {
+        _pair_list_signature_rebuild(list);
+    }
+    return ret;
+}
+
+
+static inline int
+_pair_list_find_next(pair_list_t *list, PyObject *identity, Py_hash_t hash,
+                     Py_ssize_t *ppos)
+{
+    // Find the next pair with the identity after *ppos,
+    // the pair at *ppos has the identity.
+    if (_pair_list_has_index(list)) {
+        Py_ssize_t pos = list->ext->next[*ppos];
+        if (pos < 0) {
+            return 0;
+        }
+        *ppos = pos;
+        return 1;
+    }
+    return _pair_list_scan(list, identity, hash, *ppos + 1, ppos);
+}
+
+
+/* Note about the lookup cache
+Handlers often read the same key of the same multidict several times,
+e.g. Host in routing, logging and auth middlewares.  get_one() and
+contains() remember the position of the last found pair with its
+identity hash and the list version.  Every modification changes the
+version, so the entry never matches a modified list and there is no
+explicit invalidation.
+
+The entry is keyed by the hash instead of the identity pointer:
+CIMultiDict lookups with str keys create a new identity on every call.
+A hit is checked against the pair at the cached position, misses are
+not cached: the signature answers most of them.
+
+The entry lives in the extension block: scanning a few pairs costs less
+than the check, so only lists of LOOKUP_CACHE_MIN_SIZE pairs or more
+allocate it.  Read-only lookups write the entry, free-threaded builds
+access its fields with relaxed atomics.  Readers of an unchanged list
+store the same version, a torn entry may only point to a pair of
+another identity and the check rejects it.
+*/
+
+#define LOOKUP_CACHE_MIN_SIZE 8
+
+#ifdef Py_GIL_DISABLED
+#define CACHE_LOAD_VERSION(ext) \
+    _Py_atomic_load_uint64_relaxed(&(ext)->cache_version)
+#define CACHE_STORE_VERSION(ext, value) \
+    _Py_atomic_store_uint64_relaxed(&(ext)->cache_version, (value))
+#define CACHE_LOAD(field) _Py_atomic_load_ssize_relaxed(&(field))
+#define CACHE_STORE(field, value) \
+    _Py_atomic_store_ssize_relaxed(&(field), (value))
+#else
+#define CACHE_LOAD_VERSION(ext) ((ext)->cache_version)
+#define CACHE_STORE_VERSION(ext, value) ((ext)->cache_version = (value))
+#define CACHE_LOAD(field) (field)
+#define CACHE_STORE(field, value) ((field) = (value))
+#endif
+
+
+static inline int
+_pair_list_find_cached(pair_list_t *list, PyObject *identity, Py_hash_t hash,
+                       Py_ssize_t *ppos)
+{
+    // _pair_list_find() for read-only lookups
+    if (list->size < LOOKUP_CACHE_MIN_SIZE) {
+        return _pair_list_find(list, identity, hash, ppos);
+    }
+    pair_list_ext_t *ext = _pair_list_load_ext(list);
+    if (ext != NULL && CACHE_LOAD_VERSION(ext) == list->version
+            && CACHE_LOAD(ext->cache_hash) == hash) {
+        Py_ssize_t pos = CACHE_LOAD(ext->cache_pos);
+        pair_t *pair = pos < list->size ? pair_list_at(list, pos) : NULL;
+        if (pair != NULL && pair->hash == hash) {
+            int ret = 1;
+            if (pair->identity != identity) {
+                ret = _pair_list_str_cmp(list, identity, pair->identity);
+            }
+            if (ret > 0) {
+                MULTIDICT_STATS_INC(list->state, lookup_cache_hits);
+                *ppos = pos;
+                return 1;
+            }
+            if (ret < 0) {
+                return -1;
+            }
+        }
+    }
+    int ret = _pair_list_find(list, identity, hash, ppos);
+    if (ret > 0) {
+        ext = _pair_list_ext(list);
+        if (ext == NULL) {
+            // the cache is optional
+            PyErr_Clear();
+            return ret;
+        }
+        CACHE_STORE(ext->cache_hash, hash);
+        CACHE_STORE(ext->cache_pos, *ppos);
+        CACHE_STORE_VERSION(ext, list->version);
+    }
+    return ret;
+}
+
+
+static inline void
+pair_list_dealloc(pair_list_t *list)
+{
+    // The owner is unreachable, decrefs can't change the list
+    char *pairs = (char *)list->pairs;
+    Py_ssize_t pair_size = pair_list_pair_size(list);
+    bool compact = list->compact;
+    Py_ssize_t pos;
+
+    for (pos = 0; pos < list->size; pos++) {
+        pair_t *pair = (pair_t *)(pairs + pos * pair_size);
+
+        Py_XDECREF(pair->identity);
+        if (!compact) {
+            Py_XDECREF(pair->key);
+        }
+        Py_XDECREF(pair->value);
+    }
+
+    /*
+    Strictly speaking, resetting size and capacity and
+    assigning pairs to buffer is not necessary.
+    Do it to consistency and idemotency.
+    The cleanup doesn't hurt performance.
+    !!!
+    !!! The buffer deletion is crucial though.
+    !!!
+    */
+    list->size = 0;
+    if (list->pairs != pair_list_buffer(list)) {
+        _pair_list_free(list, list->pairs);
+        list->pairs = pair_list_buffer(list);
+    }
+    list->compact = !list->calc_ci_indentity;
+    list->capacity = pair_list_buffer_capacity(list);
+    memset(list->signature, 0, sizeof(list->signature));
+    list->signature_stale = false;
+    Py_CLEAR(list->arena);
+    if (list->ext != NULL) {
+        Py_CLEAR(list->ext->counts);
+        _pair_list_index_free(list->ext);
+        PyMem_Free(list->ext);
+        list->ext = NULL;
+    }
+}
+
+
+static inline Py_ssize_t
+pair_list_len(pair_list_t *list)
+{
+    return list->size - _pair_list_tombstones(list);
+}
+
+
+static inline int
+_dict_set_number(PyObject *dict, PyObject *key, Py_ssize_t num)
+{
+    PyObject *tmp = PyLong_FromSsize_t(num);
+    if (tmp == NULL) {
+       return -1;
+    }
+
+    if (PyDict_SetItem(dict, key, tmp) < 0) {
+        Py_DECREF(tmp);
+        return -1;
+    }
+
+    Py_DECREF(tmp);
+    return 0;
+}
+
+
+static inline int
+_pair_list_count_identities(pair_list_t *list)
+{
+    // Build the duplicates counter from scratch
+    PyObject *counts = PyDict_New();
+    Py_ssize_t pos;
+
+    if (counts == NULL) {
+        return -1;
+    }
+    for (pos = 0; pos < list->size; pos++) {
+        PyObject *identity = pair_list_at(list, pos)->identity;
+        if (identity == NULL) {
+            continue;
+        }
+        PyObject *num = PyDict_GetItemWithError(counts, identity);
+        Py_ssize_t n = 0;
+        if (num != NULL) {
+            n = PyLong_AsSsize_t(num);
+        } else if (PyErr_Occurred()) {
+            goto fail;
+        }
+        if (_dict_set_number(counts, identity, n + 1) < 0) {
+            goto fail;
+        }
+    }
+    list->ext->counts = counts;
+    return 0;
+fail:
+    Py_DECREF(counts);
+    return -1;
+}
+
+
+static inline int
+_pair_list_check_limits(pair_list_t *list, PyObject *identity, PyObject *key)
+{
+    // Check and count a new pair, the counter is dropped
+    // if the pair is not added after all
+    pair_list_ext_t *ext = list->ext;
+
+    if (pair_list_len(list) >= ext->max_pairs) {
+        PyErr_Format(PyExc_ValueError,
+                     "too many items, the limit is %zd",
+                     ext->max_pairs);
+        return -1;
+    }
+    if (ext->max_duplicates == PY_SSIZE_T_MAX) {
+        return 0;
+    }
+    if (ext->counts == NULL && _pair_list_count_identities(list) < 0) {
+        return -1;
+    }
+
+    Py_ssize_t n = 0;
+    PyObject *num = PyDict_GetItemWithError(ext->counts, identity);
+    if (num != NULL) {
+        n = PyLong_AsSsize_t(num);
+    } else if (PyErr_Occurred()) {
+        return -1;
+    }
+    if (n >= ext->max_duplicates) {
+        PyErr_Format(PyExc_ValueError,
+                     "too many items with key %R, the limit is %zd",
+                     key, ext->max_duplicates);
+        return -1;
+    }
+    if (_dict_set_number(ext->counts, identity, n + 1) < 0) {
+        Py_CLEAR(ext->counts);
+        return -1;
+    }
+    return 0;
+}
+
+
+static inline void
+_pair_list_uncount(pair_list_t *list, PyObject *identity)
+{
+    // Forget a removed pair, never fails: the counter is dropped instead
+    if (list->ext == NULL || list->ext->counts == NULL) {
+        return;
+    }
+    PyObject *counts = list->ext->counts;
+    if (PyErr_Occurred()) {
+        // keep the pending exception intact
+        Py_CLEAR(list->ext->counts);
+        return;
+    }
+    PyObject *num = PyDict_GetItemWithError(counts, identity);
+    if (num == NULL) {
+        goto fail;
+    }
+    Py_ssize_t n = PyLong_AsSsize_t(num);
+    if (n == -1) {
+        goto fail;
+    }
+    if (n <= 1) {
+        if (PyDict_DelItem(counts, identity) < 0) {
+            goto fail;
+        }
+    } else if (_dict_set_number(counts, identity, n - 1) < 0) {
+        goto fail;
+    }
+    return;
+fail:
+    PyErr_Clear();
+    Py_CLEAR(list->ext->counts);
+}
+
+
+static inline int
+pair_list_set_limits(pair_list_t *list, Py_ssize_t max_pairs,
+                     Py_ssize_t max_duplicates)
+{
+    // PY_SSIZE_T_MAX means unlimited, existing pairs are not checked
+    if (list->ext == NULL
+            && max_pairs == PY_SSIZE_T_MAX && max_duplicates == PY_SSIZE_T_MAX) {
+        return 0;
+    }
+    pair_list_ext_t *ext = _pair_list_ext(list);
+    if (ext == NULL) {
+        return -1;
+    }
+    ext->max_pairs = max_pairs;
+    ext->max_duplicates = max_duplicates;
+    if (max_duplicates == PY_SSIZE_T_MAX) {
+        Py_CLEAR(ext->counts);
+    }
+    return 0;
+}
+
+
+static inline int
+_pair_list_push_steal_refs(pair_list_t *list,
+                           PyObject *identity,
+                           PyObject *key,
+                           PyObject *value,
+                           Py_hash_t hash)
+{
+    // Append a pair without changing the version
+    if (_pair_list_before_store(list, value) < 0) {
+        return -1;
+    }
+    if (list->ext != NULL &&
+            _pair_list_check_limits(list, identity, key) < 0) {
+        return -1;
+    }
+
+    if (list->compact && key != identity) {
+        if (_pair_list_widen(list) < 0) {
+            goto fail;
+        }
+    }
+
+    if (pair_list_grow(list, 1) < 0) {
+        goto fail;
+    }
+
+    pair_t *pair = pair_list_at(list, list->size);
+
+    if (list->untracked) {
+        // the identity is always an exact str
+        _pair_list_track_if_needed(list, value);
+        if (key != identity) {
+            _pair_list_track_if_needed(list, key);
+        }
+    }
+
+    pair->identity = identity;
+    pair->value = value;
+    pair->hash = hash;
+    SIGNATURE_ADD(list->signature, hash);
+    if (list->compact) {
+        // the key is the identity, drop the second reference
+        Py_DECREF(key);
+    } else {
+        pair->key = key;
+    }
+
+    list->size += 1;
+    _pair_list_index_added(list);
+
+    return 0;
+fail:
+    if (list->ext != NULL) {
+        // the pair is counted already
+        Py_CLEAR(list->ext->counts);
+    }
+    return -1;
+}
+
+static inline int
+_pair_list_add_with_hash_steal_refs(pair_list_t *list,
+                                    PyObject *identity,
+                                    PyObject *key,
+                                    PyObject *value,
+                                    Py_hash_t hash)
+{
+    if (_pair_list_push_steal_refs(list, identity, key, value, hash) < 0) {
+        return -1;
+    }
+    list->version = NEXT_VERSION();
+    return 0;
+}
+
+static inline int
+_pair_list_add_with_hash(pair_list_t *list,
+                         PyObject *identity,
+                         PyObject *key,
+                         PyObject *value,
+                         Py_hash_t hash)
+{
+    Py_INCREF(identity);
+    Py_INCREF(key);
+    Py_INCREF(value);
+    if (_pair_list_add_with_hash_steal_refs(list, identity,
+                                            key, value, hash) < 0) {
+        Py_DECREF(identity);
+        Py_DECREF(key);
+        Py_DECREF(value);
+        return -1;
+    }
+    return 0;
+}
+
+
+static inline int
+pair_list_add_with_hash(pair_list_t *list, PyObject *identity, Py_hash_t hash,
+                        PyObject *key, PyObject *value)
+{
+    // The identity and hash are computed by the caller
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_add_with_hash(list, identity, key, value, hash);
+    trace_stop(list->state, "add", list->size, start);
+    return status;
+}
+
+
+static inline int
+_pair_list_add(pair_list_t *list, PyObject *key, PyObject *value)
+{
+    PyObject *identity = pair_list_calc_identity(list, key);
+    if (identity == NULL) {
+        goto fail;
+    }
+    Py_hash_t hash = PyObject_Hash(identity);
+    if (hash == -1) {
+        goto fail;
+    }
+    int ret = _pair_list_add_with_hash(list, identity, key, value, hash);
+    Py_DECREF(identity);
+    return ret;
+fail:
+    Py_XDECREF(identity);
+    return -1;
+}
+
+
+static inline int
+pair_list_add(pair_list_t *list, PyObject *key, PyObject *value)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_add(list, key, value);
+    trace_stop(list->state, "add", list->size, start);
+    return status;
+}
+
+
+static inline int
+_pair_list_truncate(pair_list_t *list, Py_ssize_t size);
+
+
+static inline int
+_pair_list_add_many(pair_list_t *list, PyObject *const *keys,
+                    PyObject *const *values, Py_ssize_t size)
+{
+    // Append keys[i], values[i] pairs, the room is reserved at once
+    // and the version is changed once per batch.
+    // The batch is all or nothing, a failure drops the pairs added so far.
+    Py_ssize_t pos;
+    Py_ssize_t old_size = list->size;
+    int ret = -1;
+
+    if (pair_list_reserve(list, list->size + size) < 0) {
+        return -1;
+    }
+    for (pos = 0; pos < size; pos++) {
+        // istr keys resolve to the canonical str with a cached hash
+        PyObject *identity = pair_list_calc_identity(list, keys[pos]);
+        if (identity == NULL) {
+            goto done;
+        }
+        Py_hash_t hash = PyObject_Hash(identity);
+        if (hash == -1) {
+            Py_DECREF(identity);
+            goto done;
+        }
+        Py_INCREF(keys[pos]);
+        Py_INCREF(values[pos]);
+        if (_pair_list_push_steal_refs(list, identity, keys[pos],
+                                       values[pos], hash) < 0) {
+            Py_DECREF(identity);
+            Py_DECREF(keys[pos]);
+            Py_DECREF(values[pos]);
+            goto done;
+        }
+    }
+    ret = 0;
+done:
+    if (ret < 0 && _pair_list_truncate(list, old_size) == 0) {
+        return -1;
+    }
+    if (list->size != old_size) {
+        list->version = NEXT_VERSION();
+    }
+    return ret;
+}
+
+
+static inline int
+pair_list_add_many(pair_list_t *list, PyObject *const *keys,
+                   PyObject *const *values, Py_ssize_t size)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_add_many(list, keys, values, size);
+    trace_stop(list->state, "add_many", list->size, start);
+    return status;
+}
+
+
+static inline bool
+_pair_list_can_bury(pair_list_t *list)
+{
+    // Tombstones are used by large lists only
+    if (list->size < TOMBSTONE_MIN_SIZE) {
+        return false;
+    }
+    if (_pair_list_ext(list) == NULL) {
+        // fall back to shifting the tail
+        PyErr_Clear();
+        return false;
+    }
+    return true;
+}
+
+
+static inline void
+_pair_list_bury(pair_list_t *list, pair_t *pair)
+{
+    // Turn the pair into a tombstone, the caller owns the references
+    pair->identity = NULL;
+    pair->value = NULL;
+    pair->hash = -1;
+    if (!list->compact) {
+        pair->key = NULL;
+    }
+    list->ext->tombstones++;
+}
+
+
+static inline int
+_pair_list_compact(pair_list_t *list)
+{
+    // Drop tombstones keeping the order of pairs
+    size_t pair_size = (size_t)pair_list_pair_size(list);
+    Py_ssize_t kept = 0;
+
+    for (Py_ssize_t pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        if (kept != pos) {
+            memcpy(pair_list_at(list, kept), pair, pair_size);
+        }
+        kept++;
+    }
+    list->size = kept;
+    list->ext->tombstones = 0;
+    return pair_list_shrink(list);
+}
+
+
+static inline int
+_pair_list_buried(pair_list_t *list)
+{
+    // Finish the removal of pairs turned into tombstones
+    list->version = NEXT_VERSION();
+    list->signature_stale = true;
+    pair_list_index_drop(list);
+    _pair_list_trim_tombstones(list);
+    if (list->ext->tombstones * TOMBSTONE_RATIO > list->size) {
+        return _pair_list_compact(list);
+    }
+    return 0;
+}
+
+
+static inline int
+pair_list_shrink_to_fit(pair_list_t *list)
+{
+    if (_pair_list_tombstones(list) > 0) {
+        list->version = NEXT_VERSION();
+        pair_list_index_drop(list);
+        if (_pair_list_compact(list) < 0) {
+            return -1;
+        }
+    }
+
+    if (list->pairs == pair_list_buffer(list)) {
+        return 0;
+    }
+
+    if (list->size <= pair_list_buffer_capacity(list)) {
+        return _pair_list_resize(list, pair_list_buffer_capacity(list));
+    }
+    return _pair_list_resize(list, _pair_list_round_capacity(list->size));
+}
+
+
+static inline int
+pair_list_del_at(pair_list_t *list, Py_ssize_t pos)
+{
+    // return 1 on success, -1 on failure
+    pair_t *pair = pair_list_at(list, pos);
+    _pair_list_uncount(list, pair->identity);
+
+    if (pos < list->size - 1 && _pair_list_can_bury(list)) {
+        // the references are released after the list is consistent
+        PyObject *identity = pair->identity;
+        PyObject *key = list->compact ? NULL : pair->key;
+        PyObject *value = pair->value;
+        _pair_list_bury(list, pair);
+        int ret = _pair_list_buried(list);
+        Py_DECREF(identity);
+        Py_XDECREF(key);
+        Py_DECREF(value);
+        return ret;
+    }
+
+    Py_DECREF(pair->identity);
+    if (!list->compact) {
+        Py_DECREF(pair->key);
+    }
+    Py_DECREF(pair->value);
+
+    list->size -= 1;
+    list->version = NEXT_VERSION();
+    list->signature_stale = true;
+    pair_list_index_drop(list);
+
+    if (list->size != pos) {
+        // remove from the middle, shift the tail
+        Py_ssize_t tail = list->size - pos;
+        // TODO: raise an error if tail < 0
+        memmove((void *)pair_list_at(list, pos),
+                (void *)pair_list_at(list, pos + 1),
+                (size_t)(pair_list_pair_size(list) * tail));
+    }
+    _pair_list_trim_tombstones(list);
+
+    return pair_list_shrink(list);
+}
+
+
+/* Note about duplicates removal
+Removing the pairs one by one shifts the tail every time, O(n * k) for k
+removed pairs.  Paths that may remove many duplicates (del, __setitem__,
+popall, update) compact the list in a single pass instead: kept pairs
+are moved to the front with their order preserved, removed ones are
+collected at the end and cut off by _pair_list_truncate().
+*/
+
+static inline void
+_pair_list_swap(pair_list_t *list, Py_ssize_t pos1, Py_ssize_t pos2)
+{
+    pair_t tmp;
+    size_t pair_size = (size_t)pair_list_pair_size(list);
+    pair_list_index_drop(list);
+    memcpy(&tmp, pair_list_at(list, pos1), pair_size);
+    memcpy(pair_list_at(list, pos1), pair_list_at(list, pos2), pair_size);
+    memcpy(pair_list_at(list, pos2), &tmp, pair_size);
+}
+
+
+static inline int
+_pair_list_truncate(pair_list_t *list, Py_ssize_t size)
+{
+    // Remove pairs starting from size.
+    // The references are released after the list is consistent,
+    // so destructors can't see the list in the middle of the update.
+    Py_ssize_t count = list->size - size;
+    Py_ssize_t pair_size = pair_list_pair_size(list);
+    bool compact = list->compact;
+    Py_ssize_t pos;
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    char *tail = PyMem_Malloc((size_t)(count * pair_size));
+    if (tail == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memcpy(tail, pair_list_at(list, size), (size_t)(count * pair_size));
+    for (pos = 0; pos < count; pos++) {
+        PyObject *identity = ((pair_t *)(tail + pos * pair_size))->identity;
+        if (identity == NULL) {
+            list->ext->tombstones--;
+        } else {
+            _pair_list_uncount(list, identity);
+        }
+    }
+    list->size = size;
+    list->version = NEXT_VERSION();
+    list->signature_stale = true;
+    pair_list_index_drop(list);
+    _pair_list_trim_tombstones(list);
+    int ret = pair_list_shrink(list);
+
+    for (pos = 0; pos < count; pos++) {
+        pair_t *pair = (pair_t *)(tail + pos * pair_size);
+        Py_XDECREF(pair->identity);
+        if (!compact) {
+            Py_XDECREF(pair->key);
+        }
+        Py_XDECREF(pair->value);
+    }
+    PyMem_Free(tail);
+    return ret;
+}
+
+
+static inline int
+_pair_list_bury_tail(pair_list_t *list, PyObject *identity, Py_hash_t hash,
+                     Py_ssize_t pos)
+{
+    // _pair_list_drop_tail() with tombstones, no pairs are moved
+    pair_t *dead = NULL;
+    Py_ssize_t ndead = 0;
+    Py_ssize_t capacity = 0;
+    int ret = 0;
+
+    for (; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        MULTIDICT_STATS_INC(list->state, probes);
+        if (pair->hash != hash) {
+            continue;
+        }
+        ret = _pair_list_str_cmp(list, pair->identity, identity);
+        if (ret < 0) {
+            break;
+        }
+        if (ret == 0) {
+            continue;
+        }
+        ret = 0;
+        if (ndead == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            pair_t *tmp = PyMem_Resize(dead, pair_t, (size_t)capacity);
+            if (tmp == NULL) {
+                PyErr_NoMemory();
+                ret = -1;
+                break;
+            }
+            dead = tmp;
+        }
+        dead[ndead].identity = pair->identity;
+        dead[ndead].key = list->compact ? NULL : pair->key;
+        dead[ndead].value = pair->value;
+        _pair_list_uncount(list, pair->identity);
+        _pair_list_bury(list, pair);
+        ndead++;
+    }
+
+    if (ndead > 0 && _pair_list_buried(list) < 0) {
+        ret = -1;
+    }
+    for (pos = 0; pos < ndead; pos++) {
+        Py_DECREF(dead[pos].identity);
+        Py_XDECREF(dead[pos].key);
+        Py_DECREF(dead[pos].value);
+    }
+    PyMem_Free(dead);
+    if (ret < 0) {
+        return -1;
+    }
+    return ndead > 0;
+}
+
+
+static inline int
+_pair_list_drop_tail(pair_list_t *list, PyObject *identity, Py_hash_t hash,
+                     Py_ssize_t pos)
+{
+    // return 1 if deleted, 0 if not found
+    int found = 0;
+    int ret = 0;
+    Py_ssize_t kept = pos;
+
+    if (pos >= list->size) {
+        return 0;
+    }
+    if (_pair_list_can_bury(list)) {
+        return _pair_list_bury_tail(list, identity, hash, pos);
+    }
+
+    for (; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        MULTIDICT_STATS_INC(list->state, probes);
+        if (pair->hash == hash && ret == 0) {
+            ret = _pair_list_str_cmp(list, pair->identity, identity);
+            if (ret > 0) {
+                found = 1;
+                ret = 0;
+                continue;
+            }
+            // on error keep the rest of pairs
+        }
+        if (kept != pos) {
+            _pair_list_swap(list, kept, pos);
+        }
+        kept++;
+    }
+
+    if (_pair_list_truncate(list, kept) < 0 || ret < 0) {
+        return -1;
+    }
+    return found;
+}
+
+
+static inline int
+_pair_list_del(pair_list_t *list, PyObject *key)
+{
+    PyObject *identity = pair_list_calc_identity(list, key);
+    if (identity == NULL) {
+        goto fail;
+    }
+
+    Py_hash_t hash = PyObject_Hash(identity);
+    if (hash == -1) {
+        goto fail;
+    }
+
+    Py_ssize_t pos;
+    int ret = _pair_list_find(list, identity, hash, &pos);
+    if (ret > 0) {
+        ret = _pair_list_drop_tail(list, identity, hash, pos);
+    }
+
+    if (ret < 0) {
+        goto fail;
     }
     else if (ret == 0) {
         PyErr_SetObject(PyExc_KeyError, key);
@@ -475,6 +2324,16 @@ fail:
 }
 
 
+static inline int
+pair_list_del(pair_list_t *list, PyObject *key)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_del(list, key);
+    trace_stop(list->state, "del", list->size, start);
+    return status;
+}
+
+
 static inline uint64_t
 pair_list_version(pair_list_t *list)
 {
@@ -521,24 +2380,34 @@ pair_list_next(pair_list_t *list, pair_list_pos_t *pos,
         return -1;
     }
 
-
-    pair_t *pair = list->pairs + pos->pos;
+    // the last pair is never a tombstone
+    while (pair_list_at(list, pos->pos)->identity == NULL) {
+        ++pos->pos;
+    }
+    pair_t *pair = pair_list_at(list, pos->pos);
+    if (pvalue && pair_list_value(list, pair) == NULL) {
+        return -1;
+    }
 
     if (pidentity) {
         *pidentity = Py_NewRef(pair->identity);;
     }
 
     if (pkey) {
-        PyObject *key = pair_list_calc_key(list, pair->key, pair->identity);
+        PyObject *key = pair_list_calc_key(list, pair_list_pair_key(list, pair),
+                                           pair->identity);
         if (key == NULL) {
             return -1;
         }
-        if (key != pair->key) {
+        if (key != pair_list_pair_key(list, pair)) {
+            // only istr keys of CI lists are materialized,
+            // the list has the full layout
+            assert(!list->compact);
             Py_SETREF(pair->key, key);
         } else {
             Py_CLEAR(key);
         }
-        *pkey = Py_NewRef(pair->key);
+        *pkey = Py_NewRef(pair_list_pair_key(list, pair));
     }
     if (pvalue) {
         *pvalue = Py_NewRef(pair->value);
@@ -577,29 +2446,36 @@ pair_list_next_by_identity(pair_list_t *list, pair_list_pos_t *pos,
 
 
     for (; pos->pos < list->size; ++pos->pos) {
-        pair_t *pair = list->pairs + pos->pos;
-        PyObject *ret = PyUnicode_RichCompare(identity, pair->identity, Py_EQ);
-        if (Py_IsFalse(ret)) {
-            Py_DECREF(ret);
+        pair_t *pair = pair_list_at(list, pos->pos);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        int tmp = str_cmp(identity, pair->identity);
+        if (tmp < 0) {
+            return -1;
+        }
+        if (tmp == 0) {
             continue;
-        } else if (ret == NULL) {
+        }
+        if (pvalue && pair_list_value(list, pair) == NULL) {
             return -1;
-        } else {
-            // equals
-            Py_DECREF(ret);
         }
 
         if (pkey) {
-            PyObject *key = pair_list_calc_key(list, pair->key, pair->identity);
+            PyObject *key = pair_list_calc_key(list, pair_list_pair_key(list, pair),
+                                               pair->identity);
             if (key == NULL) {
                 return -1;
             }
-            if (key != pair->key) {
+            if (key != pair_list_pair_key(list, pair)) {
+                // only istr keys of CI lists are materialized,
+                // the list has the full layout
+                assert(!list->compact);
                 Py_SETREF(pair->key, key);
             } else {
                 Py_CLEAR(key);
             }
-            *pkey = Py_NewRef(pair->key);
+            *pkey = Py_NewRef(pair_list_pair_key(list, pair));
         }
         if (pvalue) {
             *pvalue = Py_NewRef(pair->value);
@@ -618,11 +2494,11 @@ pair_list_next_by_identity(pair_list_t *list, pair_list_pos_t *pos,
 
 
 static inline int
-pair_list_contains(pair_list_t *list, PyObject *key, PyObject **pret)
+_pair_list_contains(pair_list_t *list, PyObject *key, PyObject **pret)
 {
-    Py_ssize_t pos;
+    Py_ssize_t pos = 0;
 
-    if (!PyUnicode_Check(key)) {
+    if (!pair_list_is_key(list, key)) {
         return 0;
     }
 
@@ -636,24 +2512,17 @@ pair_list_contains(pair_list_t *list, PyObject *key, PyObject **pret)
         goto fail;
     }
 
-    Py_ssize_t size = pair_list_len(list);
-
-    for(pos = 0; pos < size; ++pos) {
-        pair_t * pair = list->pairs + pos;
-        if (hash != pair->hash) {
-            continue;
-        }
-        int tmp = str_cmp(ident, pair->identity);
-        if (tmp > 0) {
-            Py_DECREF(ident);
-            if (pret != NULL) {
-                *pret = Py_NewRef(pair->key);
-            }
-            return 1;
-        }
-        else if (tmp < 0) {
-            goto fail;
+    int tmp = _pair_list_find_cached(list, ident, hash, &pos);
+    if (tmp > 0) {
+        Py_DECREF(ident);
+        if (pret != NULL) {
+            pair_t *pair = pair_list_at(list, pos);
+            *pret = Py_NewRef(pair_list_pair_key(list, pair));
         }
+        return 1;
+    }
+    else if (tmp < 0) {
+        goto fail;
     }
 
     Py_DECREF(ident);
@@ -671,9 +2540,19 @@ fail:
 
 
 static inline int
-pair_list_get_one(pair_list_t *list, PyObject *key, PyObject **ret)
+pair_list_contains(pair_list_t *list, PyObject *key, PyObject **pret)
 {
-    Py_ssize_t pos;
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_contains(list, key, pret);
+    trace_stop(list->state, "contains", list->size, start);
+    return status;
+}
+
+
+static inline int
+_pair_list_get_one(pair_list_t *list, PyObject *key, PyObject **ret)
+{
+    Py_ssize_t pos = 0;
 
     PyObject *ident = pair_list_calc_identity(list, key);
     if (ident == NULL) {
@@ -685,22 +2564,18 @@ pair_list_get_one(pair_list_t *list, PyObject *key, PyObject **ret)
         goto fail;
     }
 
-    Py_ssize_t size = pair_list_len(list);
-
-    for(pos = 0; pos < size; ++pos) {
-        pair_t *pair = list->pairs + pos;
-        if (hash != pair->hash) {
-            continue;
-        }
-        int tmp = str_cmp(ident, pair->identity);
-        if (tmp > 0) {
-            Py_DECREF(ident);
-            *ret = Py_NewRef(pair->value);
-            return 0;
-        }
-        else if (tmp < 0) {
+    int tmp = _pair_list_find_cached(list, ident, hash, &pos);
+    if (tmp > 0) {
+        PyObject *value = pair_list_value(list, pair_list_at(list, pos));
+        if (value == NULL) {
             goto fail;
         }
+        Py_DECREF(ident);
+        *ret = Py_NewRef(value);
+        return 0;
+    }
+    else if (tmp < 0) {
+        goto fail;
     }
 
     Py_DECREF(ident);
@@ -712,9 +2587,19 @@ fail:
 
 
 static inline int
-pair_list_get_all(pair_list_t *list, PyObject *key, PyObject **ret)
+pair_list_get_one(pair_list_t *list, PyObject *key, PyObject **ret)
 {
-    Py_ssize_t pos;
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_get_one(list, key, ret);
+    trace_stop(list->state, "get_one", list->size, start);
+    return status;
+}
+
+
+static inline int
+_pair_list_get_all(pair_list_t *list, PyObject *key, PyObject **ret)
+{
+    Py_ssize_t pos = 0;
     PyObject *res = NULL;
 
     PyObject *ident = pair_list_calc_identity(list, key);
@@ -727,31 +2612,28 @@ pair_list_get_all(pair_list_t *list, PyObject *key, PyObject **ret)
         goto fail;
     }
 
-    Py_ssize_t size = pair_list_len(list);
-    for(pos = 0; pos < size; ++pos) {
-        pair_t *pair = list->pairs + pos;
-
-        if (hash != pair->hash) {
-            continue;
+    int tmp = _pair_list_find(list, ident, hash, &pos);
+    while (tmp > 0) {
+        PyObject *value = pair_list_value(list, pair_list_at(list, pos));
+        if (value == NULL) {
+            goto fail;
         }
-        int tmp = str_cmp(ident, pair->identity);
-        if (tmp > 0) {
+        if (res == NULL) {
+            res = PyList_New(1);
             if (res == NULL) {
-                res = PyList_New(1);
-                if (res == NULL) {
-                    goto fail;
-                }
-                if (PyList_SetItem(res, 0, Py_NewRef(pair->value)) < 0) {
-                    goto fail;
-                }
+                goto fail;
             }
-            else if (PyList_Append(res, pair->value) < 0) {
+            if (PyList_SetItem(res, 0, Py_NewRef(value)) < 0) {
                 goto fail;
             }
         }
-        else if (tmp < 0) {
+        else if (PyList_Append(res, value) < 0) {
             goto fail;
         }
+        tmp = _pair_list_find_next(list, ident, hash, &pos);
+    }
+    if (tmp < 0) {
+        goto fail;
     }
 
     if (res != NULL) {
@@ -767,10 +2649,20 @@ fail:
 }
 
 
+static inline int
+pair_list_get_all(pair_list_t *list, PyObject *key, PyObject **ret)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_get_all(list, key, ret);
+    trace_stop(list->state, "get_all", list->size, start);
+    return status;
+}
+
+
 static inline PyObject *
-pair_list_set_default(pair_list_t *list, PyObject *key, PyObject *value)
+_pair_list_set_default(pair_list_t *list, PyObject *key, PyObject *value)
 {
-    Py_ssize_t pos;
+    Py_ssize_t pos = 0;
 
     PyObject *ident = pair_list_calc_identity(list, key);
     if (ident == NULL) {
@@ -781,22 +2673,17 @@ pair_list_set_default(pair_list_t *list, PyObject *key, PyObject *value)
     if (hash == -1) {
         goto fail;
     }
-    Py_ssize_t size = pair_list_len(list);
-
-    for(pos = 0; pos < size; ++pos) {
-        pair_t * pair = list->pairs + pos;
-
-        if (hash != pair->hash) {
-            continue;
-        }
-        int tmp = str_cmp(ident, pair->identity);
-        if (tmp > 0) {
-            Py_DECREF(ident);
-            return Py_NewRef(pair->value);
-        }
-        else if (tmp < 0) {
+    int tmp = _pair_list_find(list, ident, hash, &pos);
+    if (tmp > 0) {
+        PyObject *value = pair_list_value(list, pair_list_at(list, pos));
+        if (value == NULL) {
             goto fail;
         }
+        Py_DECREF(ident);
+        return Py_NewRef(value);
+    }
+    else if (tmp < 0) {
+        goto fail;
     }
 
     if (_pair_list_add_with_hash(list, ident, key, value, hash) < 0) {
@@ -811,10 +2698,20 @@ fail:
 }
 
 
+static inline PyObject *
+pair_list_set_default(pair_list_t *list, PyObject *key, PyObject *value)
+{
+    PyTime_t start = trace_start(list->state);
+    PyObject *ret = _pair_list_set_default(list, key, value);
+    trace_stop(list->state, "set_default", list->size, start);
+    return ret;
+}
+
+
 static inline int
-pair_list_pop_one(pair_list_t *list, PyObject *key, PyObject **ret)
+_pair_list_pop_one(pair_list_t *list, PyObject *key, PyObject **ret)
 {
-    Py_ssize_t pos;
+    Py_ssize_t pos = 0;
     PyObject *value = NULL;
 
     PyObject *ident = pair_list_calc_identity(list, key);
@@ -822,104 +2719,453 @@ pair_list_pop_one(pair_list_t *list, PyObject *key, PyObject **ret)
         goto fail;
     }
 
-    Py_hash_t hash = PyObject_Hash(ident);
-    if (hash == -1) {
-        goto fail;
-    }
+    Py_hash_t hash = PyObject_Hash(ident);
+    if (hash == -1) {
+        goto fail;
+    }
+
+    int tmp = _pair_list_find(list, ident, hash, &pos);
+    if (tmp > 0) {
+        value = Py_XNewRef(pair_list_value(list, pair_list_at(list, pos)));
+        if (value == NULL || pair_list_del_at(list, pos) < 0) {
+            goto fail;
+        }
+        Py_DECREF(ident);
+        *ret = value;
+        return 0;
+    }
+    else if (tmp < 0) {
+        goto fail;
+    }
+
+    Py_DECREF(ident);
+    return 0;
+fail:
+    Py_XDECREF(value);
+    Py_XDECREF(ident);
+    return -1;
+}
+
+
+static inline int
+pair_list_pop_one(pair_list_t *list, PyObject *key, PyObject **ret)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_pop_one(list, key, ret);
+    trace_stop(list->state, "pop_one", list->size, start);
+    return status;
+}
+
+
+static inline int
+_pair_list_pop_all(pair_list_t *list, PyObject *key, PyObject ** ret)
+{
+    Py_ssize_t pos = 0;
+    PyObject *lst = NULL;
+
+    PyObject *ident = pair_list_calc_identity(list, key);
+    if (ident == NULL) {
+        goto fail;
+    }
+
+    Py_hash_t hash = PyObject_Hash(ident);
+    if (hash == -1) {
+        goto fail;
+    }
+
+    int tmp = _pair_list_find(list, ident, hash, &pos);
+    if (tmp <= 0) {
+        Py_DECREF(ident);
+        return tmp;
+    }
+
+    // compact the list starting from the first found pair
+    Py_ssize_t kept = pos;
+    tmp = 0;
+    for (; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        MULTIDICT_STATS_INC(list->state, probes);
+        if (hash == pair->hash && tmp == 0) {
+            tmp = _pair_list_str_cmp(list, ident, pair->identity);
+            if (tmp > 0) {
+                if (lst == NULL) {
+                    lst = PyList_New(0);
+                }
+                PyObject *value = pair_list_value(list, pair);
+                if (lst != NULL && value != NULL
+                        && PyList_Append(lst, value) == 0) {
+                    tmp = 0;
+                    continue;
+                }
+                tmp = -1;
+            }
+            // on error keep the rest of pairs
+        }
+        if (kept != pos) {
+            _pair_list_swap(list, kept, pos);
+        }
+        kept++;
+    }
+
+    if (_pair_list_truncate(list, kept) < 0 || tmp < 0) {
+        goto fail;
+    }
+    *ret = lst;
+    Py_DECREF(ident);
+    return 0;
+fail:
+    Py_XDECREF(ident);
+    Py_XDECREF(lst);
+    return -1;
+}
+
+
+static inline int
+pair_list_pop_all(pair_list_t *list, PyObject *key, PyObject ** ret)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_pop_all(list, key, ret);
+    trace_stop(list->state, "pop_all", list->size, start);
+    return status;
+}
+
+
+typedef struct {
+    Py_hash_t hash;
+    PyObject *identity;  // NULL for free slots
+} key_set_entry_t;
+
+#define KEY_SET_SMALL_SLOTS 16
+
+
+static inline int
+_pair_list_key_set_add(pair_list_t *list, key_set_entry_t *slots, size_t mask,
+                       PyObject *key, uint64_t *signature)
+{
+    // Add the identity of the key to the open addressing table,
+    // duplicates are ignored.  Return 0 on success, -1 on error.
+    PyObject *identity = pair_list_calc_identity(list, key);
+    if (identity == NULL) {
+        return -1;
+    }
+    Py_hash_t hash = PyObject_Hash(identity);
+    if (hash == -1) {
+        Py_DECREF(identity);
+        return -1;
+    }
+    size_t i = (size_t)hash & mask;
+    for (; slots[i].identity != NULL; i = (i + 1) & mask) {
+        if (slots[i].hash != hash) {
+            continue;
+        }
+        int tmp = _pair_list_str_cmp(list, identity, slots[i].identity);
+        if (tmp != 0) {
+            Py_DECREF(identity);
+            return tmp < 0 ? -1 : 0;
+        }
+    }
+    slots[i].hash = hash;
+    slots[i].identity = identity;
+    SIGNATURE_ADD(signature, hash);
+    return 0;
+}
+
+
+static inline int
+_pair_list_key_set_has(pair_list_t *list, key_set_entry_t *slots, size_t mask,
+                       pair_t *pair)
+{
+    // Return 1 if the identity of the pair is in the table, 0 if not,
+    // -1 on error
+    size_t i = (size_t)pair->hash & mask;
+    for (; slots[i].identity != NULL; i = (i + 1) & mask) {
+        if (slots[i].hash != pair->hash) {
+            continue;
+        }
+        int tmp = _pair_list_str_cmp(list, pair->identity, slots[i].identity);
+        if (tmp != 0) {
+            return tmp;
+        }
+    }
+    return 0;
+}
+
+
+static inline int
+_pair_list_removed_append(pair_list_t *list, PyObject *removed, pair_t *pair)
+{
+    if (removed == NULL) {
+        return 0;
+    }
+    PyObject *key = pair_list_calc_key(list, pair_list_pair_key(list, pair),
+                                       pair->identity);
+    if (key == NULL) {
+        return -1;
+    }
+    PyObject *value = pair_list_value(list, pair);
+    PyObject *item = value != NULL ? PyTuple_Pack(2, key, value) : NULL;
+    Py_DECREF(key);
+    if (item == NULL) {
+        return -1;
+    }
+    int ret = PyList_Append(removed, item);
+    Py_DECREF(item);
+    return ret;
+}
+
+
+static inline Py_ssize_t
+_pair_list_remove_many(pair_list_t *list, PyObject *const *keys,
+                       Py_ssize_t nkeys, PyObject *removed)
+{
+    // Remove pairs of all keys in one pass keeping the order of the rest,
+    // (key, value) tuples of removed pairs are appended to the removed
+    // list if it is not NULL.
+    // Return the number of removed pairs, -1 on error.
+    key_set_entry_t small[KEY_SET_SMALL_SLOTS] = {{0}};
+    key_set_entry_t *slots = small;
+    size_t nslots = KEY_SET_SMALL_SLOTS;
+    uint64_t signature[SIGNATURE_WORDS] = {0};
+    Py_ssize_t found = 0;
+    Py_ssize_t kept = 0;
+    Py_ssize_t pos;
+    int ret = 0;
+
+    if (nkeys == 0 || list->size == 0) {
+        return 0;
+    }
+    if (nkeys > PY_SSIZE_T_MAX / 4) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    while (nslots < (size_t)nkeys * 2) {
+        nslots <<= 1;
+    }
+    if (nslots > KEY_SET_SMALL_SLOTS) {
+        slots = PyMem_Calloc(nslots, sizeof(key_set_entry_t));
+        if (slots == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    for (pos = 0; pos < nkeys; pos++) {
+        if (_pair_list_key_set_add(list, slots, nslots - 1, keys[pos],
+                                   signature) < 0) {
+            ret = -1;
+            goto done;
+        }
+    }
+    if (!list->signature_stale) {
+        uint64_t common = 0;
+        for (int i = 0; i < SIGNATURE_WORDS; i++) {
+            common |= list->signature[i] & signature[i];
+        }
+        if (common == 0) {
+            goto done;
+        }
+    }
+
+    for (pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity == NULL) {
+            if (found > 0) {
+                // pairs are moved anyway, drop the tombstone
+                continue;
+            }
+        }
+        else if (ret == 0 && SIGNATURE_HAS(signature, pair->hash)) {
+            MULTIDICT_STATS_INC(list->state, probes);
+            ret = _pair_list_key_set_has(list, slots, nslots - 1, pair);
+            if (ret > 0) {
+                ret = _pair_list_removed_append(list, removed, pair);
+                if (ret == 0) {
+                    found++;
+                    continue;
+                }
+            }
+            // on error keep the rest of pairs
+        }
+        if (kept != pos) {
+            _pair_list_swap(list, kept, pos);
+        }
+        kept++;
+    }
+
+    if (_pair_list_truncate(list, kept) < 0) {
+        ret = -1;
+    }
+done:
+    for (pos = 0; pos < (Py_ssize_t)nslots; pos++) {
+        Py_XDECREF(slots[pos].identity);
+    }
+    if (slots != small) {
+        PyMem_Free(slots);
+    }
+    return ret < 0 ? -1 : found;
+}
+
+
+static inline Py_ssize_t
+pair_list_remove_many(pair_list_t *list, PyObject *const *keys,
+                      Py_ssize_t nkeys, PyObject *removed)
+{
+    PyTime_t start = trace_start(list->state);
+    Py_ssize_t status = _pair_list_remove_many(list, keys, nkeys, removed);
+    trace_stop(list->state, "remove_many", list->size, start);
+    return status;
+}
+
+
+static inline Py_ssize_t
+pair_list_select(pair_list_t *list, PyObject *pred, char *keep)
+{
+    // Set keep[pos] to the truth of pred(key, value) for every pair,
+    // tombstones are kept.  Return the number of dropped pairs, -1 on error.
+    uint64_t version = list->version;
+    Py_ssize_t dropped = 0;
+
+    for (Py_ssize_t pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        keep[pos] = 1;
+        if (pair->identity == NULL) {
+            continue;
+        }
+        if (pair_list_value(list, pair) == NULL) {
+            return -1;
+        }
+        // the predicate may remove the pair, hold the references
+        PyObject *args[2] = {Py_NewRef(pair_list_pair_key(list, pair)),
+                             Py_NewRef(pair->value)};
+        PyObject *res = PyObject_Vectorcall(pred, args, 2, NULL);
+        Py_DECREF(args[0]);
+        Py_DECREF(args[1]);
+        if (res == NULL) {
+            return -1;
+        }
+        int tmp = PyObject_IsTrue(res);
+        Py_DECREF(res);
+        if (tmp < 0) {
+            return -1;
+        }
+        if (version != list->version) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "MultiDict changed during iteration");
+            return -1;
+        }
+        if (!tmp) {
+            keep[pos] = 0;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
 
-    for (pos=0; pos < list->size; pos++) {
-        pair_t *pair = list->pairs + pos;
-        if (pair->hash != hash) {
+static inline Py_ssize_t
+pair_list_select_prefix(pair_list_t *list, PyObject *prefixes, bool invert,
+                        char *keep)
+{
+    // Set keep[pos] if the identity of the pair starts with an identity
+    // from the prefixes tuple (doesn't start if invert is true).
+    // Python code is never called.
+    // Return the number of dropped pairs, -1 on error.
+    Py_ssize_t nprefixes = PyTuple_GET_SIZE(prefixes);
+    Py_ssize_t dropped = 0;
+
+    for (Py_ssize_t pos = 0; pos < list->size; pos++) {
+        PyObject *identity = pair_list_at(list, pos)->identity;
+        keep[pos] = 1;
+        if (identity == NULL) {
             continue;
         }
-        int tmp = str_cmp(ident, pair->identity);
-        if (tmp > 0) {
-            value = Py_NewRef(pair->value);
-            if (pair_list_del_at(list, pos) < 0) {
-                goto fail;
+        bool match = false;
+        for (Py_ssize_t i = 0; i < nprefixes && !match; i++) {
+            PyObject *prefix = PyTuple_GET_ITEM(prefixes, i);
+            if (list->bytes_keys) {
+                Py_ssize_t size = PyBytes_GET_SIZE(prefix);
+                match = PyBytes_GET_SIZE(identity) >= size
+                    && memcmp(PyBytes_AS_STRING(identity),
+                              PyBytes_AS_STRING(prefix), (size_t)size) == 0;
+                continue;
             }
-            Py_DECREF(ident);
-            *ret = value;
-            return 0;
+            Py_ssize_t tmp = PyUnicode_Tailmatch(
+                identity, prefix, 0, PY_SSIZE_T_MAX, -1);
+            if (tmp < 0) {
+                return -1;
+            }
+            match = tmp > 0;
         }
-        else if (tmp < 0) {
-            goto fail;
+        if (match == invert) {
+            keep[pos] = 0;
+            dropped++;
         }
     }
-
-    return 0;
-fail:
-    Py_XDECREF(value);
-    Py_XDECREF(ident);
-    return -1;
+    return dropped;
 }
 
 
 static inline int
-pair_list_pop_all(pair_list_t *list, PyObject *key, PyObject ** ret)
+_pair_list_retain(pair_list_t *list, const char *keep, pair_list_t *dropped)
 {
+    // Remove pairs with zero keep flags in one pass keeping the order
+    // of the rest, the removed pairs are appended to the dropped list
+    // if it is not NULL.
+    Py_ssize_t found = 0;
+    Py_ssize_t kept = 0;
     Py_ssize_t pos;
-    PyObject *lst = NULL;
-
-    PyObject *ident = pair_list_calc_identity(list, key);
-    if (ident == NULL) {
-        goto fail;
-    }
-
-    Py_hash_t hash = PyObject_Hash(ident);
-    if (hash == -1) {
-        goto fail;
-    }
+    int ret = 0;
+    // raw values move to an empty list as is
+    bool raw = dropped != NULL && dropped->size == 0 && list->raw_values;
 
-    if (list->size == 0) {
-        Py_DECREF(ident);
-        return 0;
-    }
-
-    for (pos = list->size - 1; pos >= 0; pos--) {
-        pair_t *pair = list->pairs + pos;
-        if (hash != pair->hash) {
-            continue;
+    for (pos = 0; pos < list->size; pos++) {
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity == NULL) {
+            if (found > 0) {
+                // pairs are moved anyway, drop the tombstone
+                continue;
+            }
         }
-        int tmp = str_cmp(ident, pair->identity);
-        if (tmp > 0) {
-            if (lst == NULL) {
-                lst = PyList_New(1);
-                if (lst == NULL) {
-                    goto fail;
-                }
-                if (PyList_SetItem(lst, 0, Py_NewRef(pair->value)) < 0) {
-                    goto fail;
-                }
-            } else if (PyList_Append(lst, pair->value) < 0) {
-                goto fail;
+        else if (ret == 0 && !keep[pos]) {
+            if (dropped != NULL) {
+                PyObject *value = raw ? pair->value : pair_list_value(list, pair);
+                ret = value == NULL ? -1 : _pair_list_add_with_hash(
+                    dropped, pair->identity, pair_list_pair_key(list, pair),
+                    value, pair->hash);
             }
-            if (pair_list_del_at(list, pos) < 0) {
-                goto fail;
+            if (ret == 0) {
+                found++;
+                continue;
             }
+            // on error keep the rest of pairs
         }
-        else if (tmp < 0) {
-            goto fail;
+        if (kept != pos) {
+            _pair_list_swap(list, kept, pos);
         }
+        kept++;
     }
 
-    if (lst != NULL) {
-        if (PyList_Reverse(lst) < 0) {
-            goto fail;
-        }
+    if (raw) {
+        dropped->raw_values = true;
     }
-    *ret = lst;
-    Py_DECREF(ident);
-    return 0;
-fail:
-    Py_XDECREF(ident);
-    Py_XDECREF(lst);
-    return -1;
+    if (_pair_list_truncate(list, kept) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+
+static inline int
+pair_list_retain(pair_list_t *list, const char *keep, pair_list_t *dropped)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_retain(list, keep, dropped);
+    trace_stop(list->state, "retain", list->size, start);
+    return status;
 }
 
 
 static inline PyObject *
-pair_list_pop_item(pair_list_t *list)
+_pair_list_pop_item(pair_list_t *list)
 {
     if (list->size == 0) {
         PyErr_SetString(PyExc_KeyError, "empty multidict");
@@ -927,12 +3173,14 @@ pair_list_pop_item(pair_list_t *list)
     }
 
     Py_ssize_t pos = list->size - 1;
-    pair_t *pair = list->pairs + pos;
-    PyObject *key = pair_list_calc_key(list, pair->key, pair->identity);
+    pair_t *pair = pair_list_at(list, pos);
+    PyObject *key = pair_list_calc_key(list, pair_list_pair_key(list, pair),
+                                       pair->identity);
     if (key == NULL) {
         return NULL;
     }
-    PyObject *ret = PyTuple_Pack(2, key, pair->value);
+    PyObject *value = pair_list_value(list, pair);
+    PyObject *ret = value != NULL ? PyTuple_Pack(2, key, value) : NULL;
     Py_CLEAR(key);
     if (ret == NULL) {
         return NULL;
@@ -947,11 +3195,42 @@ pair_list_pop_item(pair_list_t *list)
 }
 
 
+static inline PyObject *
+pair_list_pop_item(pair_list_t *list)
+{
+    PyTime_t start = trace_start(list->state);
+    PyObject *ret = _pair_list_pop_item(list);
+    trace_stop(list->state, "pop_item", list->size, start);
+    return ret;
+}
+
+
 static inline int
-pair_list_replace(pair_list_t *list, PyObject * key, PyObject *value)
+_pair_list_set_key(pair_list_t *list, Py_ssize_t pos, PyObject *key)
 {
-    Py_ssize_t pos;
-    int found = 0;
+    // Replace the key of the pair with the same identity.
+    // Pointers to pairs are invalidated if the list switches to the full layout.
+    if (list->compact) {
+        if (list->bytes_keys ? PyBytes_CheckExact(key) : PyUnicode_CheckExact(key)) {
+            pair_t *pair = pair_list_at(list, pos);
+            Py_SETREF(pair->identity, Py_NewRef(key));
+            return 0;
+        }
+        if (_pair_list_widen(list) < 0) {
+            return -1;
+        }
+    }
+    _pair_list_track_if_needed(list, key);
+    pair_t *pair = pair_list_at(list, pos);
+    Py_SETREF(pair->key, Py_NewRef(key));
+    return 0;
+}
+
+
+static inline int
+_pair_list_replace(pair_list_t *list, PyObject * key, PyObject *value)
+{
+    Py_ssize_t pos = 0;
 
     PyObject *identity = pair_list_calc_identity(list, key);
     if (identity == NULL) {
@@ -963,24 +3242,10 @@ pair_list_replace(pair_list_t *list, PyObject * key, PyObject *value)
         goto fail;
     }
 
-
-    for (pos = 0; pos < list->size; pos++) {
-        pair_t *pair = list->pairs + pos;
-        if (hash != pair->hash) {
-            continue;
-        }
-        int tmp = str_cmp(identity, pair->identity);
-        if (tmp > 0) {
-            found = 1;
-            Py_SETREF(pair->key, Py_NewRef(key));
-            Py_SETREF(pair->value, Py_NewRef(value));
-            break;
-        }
-        else if (tmp < 0) {
-            goto fail;
-        }
+    int found = _pair_list_find(list, identity, hash, &pos);
+    if (found < 0) {
+        goto fail;
     }
-
     if (!found) {
         if (_pair_list_add_with_hash(list, identity, key, value, hash) < 0) {
             goto fail;
@@ -989,8 +3254,19 @@ pair_list_replace(pair_list_t *list, PyObject * key, PyObject *value)
         return 0;
     }
     else {
+        if (_pair_list_before_store(list, value) < 0
+                || _pair_list_set_key(list, pos, key) < 0) {
+            goto fail;
+        }
+        _pair_list_track_if_needed(list, value);
+        Py_SETREF(pair_list_at(list, pos)->value, Py_NewRef(value));
         list->version = NEXT_VERSION();
-        if (_pair_list_drop_tail(list, identity, hash, pos+1) < 0) {
+        // drop duplicates if any
+        int tmp = _pair_list_find_next(list, identity, hash, &pos);
+        if (tmp > 0) {
+            tmp = _pair_list_drop_tail(list, identity, hash, pos);
+        }
+        if (tmp < 0) {
             goto fail;
         }
         Py_DECREF(identity);
@@ -1003,59 +3279,73 @@ fail:
 
 
 static inline int
-_dict_set_number(PyObject *dict, PyObject *key, Py_ssize_t num)
+pair_list_replace(pair_list_t *list, PyObject * key, PyObject *value)
 {
-    PyObject *tmp = PyLong_FromSsize_t(num);
-    if (tmp == NULL) {
-       return -1;
-    }
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_replace(list, key, value);
+    trace_stop(list->state, "replace", list->size, start);
+    return status;
+}
 
-    if (PyDict_SetItem(dict, key, tmp) < 0) {
-        Py_DECREF(tmp);
-        return -1;
-    }
 
-    Py_DECREF(tmp);
-    return 0;
+static inline int
+pair_list_pre_update(pair_list_t *list)
+{
+    // Positions in used are compared with counts of kept pairs,
+    // they should not include tombstones
+    if (_pair_list_tombstones(list) == 0) {
+        return 0;
+    }
+    list->version = NEXT_VERSION();
+    pair_list_index_drop(list);
+    return _pair_list_compact(list);
 }
 
 
 static inline int
 pair_list_post_update(pair_list_t *list, PyObject* used)
 {
+    // Drop pairs of updated identities past the last updated one.
+    // Positions in used are compared with positions after the removal
+    // of preceding pairs.
     PyObject *tmp = NULL;
     Py_ssize_t pos;
+    Py_ssize_t kept = 0;
+    int ret = 0;
 
     for (pos = 0; pos < list->size; pos++) {
-        pair_t *pair = list->pairs + pos;
-        int status = PyDict_GetItemRef(used, pair->identity, &tmp);
-        if (status == -1) {
-            // exception set
-            return -1;
-        }
-        else if (status == 0) {
-            // not found
-            continue;
-        }
-
-        Py_ssize_t num = PyLong_AsSsize_t(tmp);
-        Py_DECREF(tmp);
-        if (num == -1) {
-            if (!PyErr_Occurred()) {
-                PyErr_SetString(PyExc_RuntimeError, "invalid internal state");
+        pair_t *pair = pair_list_at(list, pos);
+        if (ret == 0 && pair->identity != NULL) {
+            int status = PyDict_GetItemRef(used, pair->identity, &tmp);
+            if (status == -1) {
+                // exception set, keep the rest of pairs
+                ret = -1;
             }
-            return -1;
-        }
-
-        if (pos >= num) {
-            // del self[pos]
-            if (pair_list_del_at(list, pos) < 0) {
-                return -1;
+            else if (status == 1) {
+                Py_ssize_t num = PyLong_AsSsize_t(tmp);
+                Py_DECREF(tmp);
+                if (num == -1) {
+                    if (!PyErr_Occurred()) {
+                        PyErr_SetString(PyExc_RuntimeError,
+                                        "invalid internal state");
+                    }
+                    ret = -1;
+                }
+                else if (kept >= num) {
+                    // del self[pos]
+                    continue;
+                }
             }
-            pos--;
         }
+        if (kept != pos) {
+            _pair_list_swap(list, kept, pos);
+        }
+        kept++;
     }
 
+    if (_pair_list_truncate(list, kept) < 0 || ret < 0) {
+        return -1;
+    }
     list->version = NEXT_VERSION();
     return 0;
 }
@@ -1067,7 +3357,7 @@ _pair_list_update(pair_list_t *list, PyObject *key,
                   PyObject *identity, Py_hash_t hash)
 {
     PyObject *item = NULL;
-    Py_ssize_t pos;
+    Py_ssize_t pos = 0;
     int found;
 
     int status = PyDict_GetItemRef(used, identity, &item);
@@ -1077,39 +3367,35 @@ _pair_list_update(pair_list_t *list, PyObject *key,
     }
     else if (status == 0) {
         // not found
-        pos = 0;
+        found = _pair_list_find(list, identity, hash, &pos);
     }
     else {
         pos = PyLong_AsSsize_t(item);
         Py_DECREF(item);
-        if (pos == -1) {
+        if (pos <= 0) {
             if (!PyErr_Occurred()) {
                 PyErr_SetString(PyExc_RuntimeError, "invalid internal state");
             }
             return -1;
         }
+        // continue after the last updated pair
+        pos -= 1;
+        found = _pair_list_find_next(list, identity, hash, &pos);
+    }
+    if (found < 0) {
+        return -1;
     }
 
-    found = 0;
-    for (; pos < list->size; pos++) {
-        pair_t *pair = list->pairs + pos;
-        if (pair->hash != hash) {
-            continue;
+    if (found) {
+        if (_pair_list_before_store(list, value) < 0
+                || _pair_list_set_key(list, pos, key) < 0) {
+            return -1;
         }
+        _pair_list_track_if_needed(list, value);
+        pair_t *pair = pair_list_at(list, pos);
+        Py_SETREF(pair->value, Py_NewRef(value));
 
-        int ident_cmp_res = str_cmp(pair->identity, identity);
-        if (ident_cmp_res > 0) {
-            Py_SETREF(pair->key, Py_NewRef(key));
-            Py_SETREF(pair->value, Py_NewRef(value));
-
-            if (_dict_set_number(used, pair->identity, pos + 1) < 0) {
-                return -1;
-            }
-
-            found = 1;
-            break;
-        }
-        else if (ident_cmp_res < 0) {
+        if (_dict_set_number(used, pair->identity, pos + 1) < 0) {
             return -1;
         }
     }
@@ -1128,19 +3414,99 @@ _pair_list_update(pair_list_t *list, PyObject *key,
 
 
 static inline int
-pair_list_update_from_pair_list(pair_list_t *list,
-                                PyObject* used, pair_list_t *other)
+_pair_list_copy_pairs(pair_list_t *list, pair_list_t *other)
+{
+    // Fill an empty list from a list of the same kind: identities, hashes
+    // and the signature are reused, raw values are copied as is.
+    // The other list has passed the checks of adding a pair already.
+    assert(list->size == 0);
+    assert(list->ext == NULL);
+    if (pair_list_reserve(list, pair_list_len(other)) < 0) {
+        return -1;
+    }
+    Py_ssize_t size = 0;
+    Py_BEGIN_CRITICAL_SECTION(pair_list_owner(other));
+    // both lists have the same layout
+    char *src = (char *)other->pairs;
+    char *dst = (char *)list->pairs;
+    Py_ssize_t pair_size = pair_list_pair_size(list);
+    bool compact = list->compact;
+    bool track = !other->untracked;
+    for (Py_ssize_t pos = 0; pos < other->size; pos++) {
+        pair_t *pair = (pair_t *)(src + pos * pair_size);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        pair_t *copy = (pair_t *)(dst + size * pair_size);
+        copy->identity = Py_NewRef(pair->identity);
+        copy->value = Py_NewRef(pair->value);
+        copy->hash = pair->hash;
+        if (!compact) {
+            copy->key = Py_NewRef(pair->key);
+        }
+        if (track) {
+            _pair_list_track_if_needed(list, copy->value);
+            if (!compact && copy->key != copy->identity) {
+                _pair_list_track_if_needed(list, copy->key);
+            }
+        }
+        size += 1;
+    }
+    list->size = size;
+    memcpy(list->signature, other->signature, sizeof(list->signature));
+    list->signature_stale = other->signature_stale;
+    list->raw_values |= other->raw_values;
+    Py_END_CRITICAL_SECTION();
+    list->version = NEXT_VERSION();
+    return 0;
+}
+
+
+static inline int
+_pair_list_update_from_pair_list(pair_list_t *list,
+                                 PyObject* used, pair_list_t *other)
 {
     Py_ssize_t pos;
     Py_hash_t hash;
     PyObject *identity = NULL;
     PyObject *key = NULL;
-    bool recalc_identity = list->calc_ci_indentity != other->calc_ci_indentity;
+    PyObject *value = NULL;
+    bool recalc_identity = list->calc_ci_indentity != other->calc_ci_indentity
+                           || list->bytes_keys != other->bytes_keys;
+    // raw values are copied as is if the list can't hold bytes values
+    // stored by the user, see the note about raw values
+    bool raw = other->raw_values && used == NULL
+               && (list->size == 0 || list->raw_values);
+
+    if (used == NULL && list->size == 0 && list->ext == NULL
+            && !recalc_identity && list->compact == other->compact) {
+        return _pair_list_copy_pairs(list, other);
+    }
+
+    // the pairs of an untracked list are atomic, skip the per-pair checks
+    // of the GC tracking, see the note about GC tracking
+    bool untracked = list->untracked;
+    if (other->untracked) {
+        list->untracked = false;
+    }
 
+    if (raw) {
+        // appended raw values shouldn't decode the list
+        list->raw_values = false;
+    }
     for (pos = 0; pos < other->size; pos++) {
-        pair_t *pair = other->pairs + pos;
+        pair_t *pair = pair_list_at(other, pos);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        value = raw ? pair_list_raw_value(other, pair)
+                    : Py_XNewRef(pair_list_value(other, pair));
+        if (value == NULL) {
+            goto fail;
+        }
         if (recalc_identity) {
-            identity = pair_list_calc_identity(list, pair->key);
+            identity = pair_list_calc_identity(list,
+                                               pair_list_pair_key(other, pair));
             if (identity == NULL) {
                 goto fail;
             }
@@ -1149,23 +3515,24 @@ pair_list_update_from_pair_list(pair_list_t *list,
                 goto fail;
             }
             /* materialize key */
-            key = pair_list_calc_key(other, pair->key, identity);
+            key = pair_list_calc_key(other, pair_list_pair_key(other, pair),
+                                     identity);
             if (key == NULL) {
                 goto fail;
             }
         } else {
             identity = pair->identity;
             hash = pair->hash;
-            key = pair->key;
+            key = pair_list_pair_key(other, pair);
         }
         if (used != NULL) {
-            if (_pair_list_update(list, key, pair->value, used,
+            if (_pair_list_update(list, key, value, used,
                                   identity, hash) < 0) {
                 goto fail;
             }
         } else {
             if (_pair_list_add_with_hash(list, identity, key,
-                                         pair->value, hash) < 0) {
+                                         value, hash) < 0) {
                 goto fail;
             }
         }
@@ -1173,6 +3540,13 @@ pair_list_update_from_pair_list(pair_list_t *list,
             Py_CLEAR(identity);
             Py_CLEAR(key);
         }
+        Py_CLEAR(value);
+    }
+    if (raw) {
+        list->raw_values = true;
+    }
+    if (other->untracked) {
+        list->untracked = untracked;
     }
     return 0;
 fail:
@@ -1180,11 +3554,60 @@ fail:
         Py_CLEAR(identity);
         Py_CLEAR(key);
     }
+    Py_XDECREF(value);
+    if (raw) {
+        list->raw_values = true;
+    }
+    if (other->untracked) {
+        list->untracked = untracked;
+    }
     return -1;
 }
 
+
 static inline int
-pair_list_update_from_dict(pair_list_t *list, PyObject* used, PyObject *kwds)
+pair_list_update_from_pair_list(pair_list_t *list,
+                                PyObject* used, pair_list_t *other)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_update_from_pair_list(list, used, other);
+    trace_stop(list->state, "update_from_pair_list", list->size, start);
+    return status;
+}
+
+static inline int
+_pair_list_extend_flat(pair_list_t *list, PyObject *const *items,
+                       Py_ssize_t size)
+{
+    // Add pairs from a flat key, value, key, value... array,
+    // the room for all of them is reserved at once
+    Py_ssize_t pos;
+
+    if (pair_list_reserve(list, list->size + size / 2) < 0) {
+        return -1;
+    }
+    for (pos = 0; pos + 1 < size; pos += 2) {
+        if (_pair_list_add(list, items[pos], items[pos + 1]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static inline int
+pair_list_extend_flat(pair_list_t *list, PyObject *const *items,
+                      Py_ssize_t size)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_extend_flat(list, items, size);
+    trace_stop(list->state, "extend_flat", list->size, start);
+    return status;
+}
+
+
+static inline int
+_pair_list_update_from_dict(pair_list_t *list, PyObject* used, PyObject *kwds)
 {
     Py_ssize_t pos = 0;
     PyObject *identity = NULL;
@@ -1220,6 +3643,16 @@ fail:
     return -1;
 }
 
+
+static inline int
+pair_list_update_from_dict(pair_list_t *list, PyObject* used, PyObject *kwds)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_update_from_dict(list, used, kwds);
+    trace_stop(list->state, "update_from_dict", list->size, start);
+    return status;
+}
+
 static inline void _err_not_sequence(Py_ssize_t i)
 {
     PyErr_Format(PyExc_TypeError,
@@ -1295,7 +3728,7 @@ fail:
 
 
 static inline int
-pair_list_update_from_seq(pair_list_t *list, PyObject *used, PyObject *seq)
+_pair_list_update_from_seq(pair_list_t *list, PyObject *used, PyObject *seq)
 {
     PyObject *it = NULL;
     PyObject *item = NULL; // seq[i]
@@ -1402,6 +3835,16 @@ fail:
 }
 
 
+static inline int
+pair_list_update_from_seq(pair_list_t *list, PyObject *used, PyObject *seq)
+{
+    PyTime_t start = trace_start(list->state);
+    int status = _pair_list_update_from_seq(list, used, seq);
+    trace_stop(list->state, "update_from_seq", list->size, start);
+    return status;
+}
+
+
 static inline int
 pair_list_eq(pair_list_t *list, pair_list_t *other)
 {
@@ -1417,9 +3860,22 @@ pair_list_eq(pair_list_t *list, pair_list_t *other)
         return 0;
     }
 
-    for(pos = 0; pos < size; ++pos) {
-        pair_t *pair1 = list->pairs + pos;
-        pair_t *pair2 = other->pairs +pos;
+    Py_ssize_t pos2 = 0;
+    for(pos = 0; pos < list->size; ++pos, ++pos2) {
+        pair_t *pair1 = pair_list_at(list, pos);
+        if (pair1->identity == NULL) {
+            --pos2;
+            continue;
+        }
+        while (pos2 < other->size
+               && pair_list_at(other, pos2)->identity == NULL) {
+            ++pos2;
+        }
+        if (pos2 >= other->size) {
+            // the other list was changed by a comparison
+            return 0;
+        }
+        pair_t *pair2 = pair_list_at(other, pos2);
 
         if (pair1->hash != pair2->hash) {
             return 0;
@@ -1433,7 +3889,12 @@ pair_list_eq(pair_list_t *list, pair_list_t *other)
             return 0;
         }
 
-        cmp = PyObject_RichCompareBool(pair1->value, pair2->value, Py_EQ);
+        PyObject *value1 = pair_list_value(list, pair1);
+        PyObject *value2 = pair_list_value(other, pair2);
+        if (value1 == NULL || value2 == NULL) {
+            return -1;
+        }
+        cmp = PyObject_RichCompareBool(value1, value2, Py_EQ);
         if (cmp < 0) {
             return -1;
         };
@@ -1532,8 +3993,14 @@ pair_list_repr(pair_list_t *list, PyObject *name,
             PyErr_SetString(PyExc_RuntimeError, "MultiDict changed during iteration");
             return NULL;
         }
-        pair_t *pair = list->pairs + pos;
-        key = Py_NewRef(pair->key);
+        pair_t *pair = pair_list_at(list, pos);
+        if (pair->identity == NULL) {
+            continue;
+        }
+        key = Py_NewRef(pair_list_pair_key(list, pair));
+        if (show_values && pair_list_value(list, pair) == NULL) {
+            goto fail;
+        }
         value = Py_NewRef(pair->value);
 
         if (comma) {
@@ -1543,13 +4010,18 @@ pair_list_repr(pair_list_t *list, PyObject *name,
                 goto fail;
         }
         if (show_keys) {
-            if (PyUnicodeWriter_WriteChar(writer, '\'') <0)
-                goto fail;
-            /* Don't need to convert key to istr, the text is the same*/
-            if (PyUnicodeWriter_WriteStr(writer, key) <0)
-                goto fail;
-            if (PyUnicodeWriter_WriteChar(writer, '\'') <0)
-                goto fail;
+            if (list->bytes_keys) {
+                if (PyUnicodeWriter_WriteRepr(writer, key) <0)
+                    goto fail;
+            } else {
+                if (PyUnicodeWriter_WriteChar(writer, '\'') <0)
+                    goto fail;
+                /* Don't need to convert key to istr, the text is the same*/
+                if (PyUnicodeWriter_WriteStr(writer, key) <0)
+                    goto fail;
+                if (PyUnicodeWriter_WriteChar(writer, '\'') <0)
+                    goto fail;
+            }
         }
         if (show_keys && show_values) {
             if (PyUnicodeWriter_WriteChar(writer, ':') <0)
@@ -1590,9 +4062,12 @@ pair_list_traverse(pair_list_t *list, visitproc visit, void *arg)
     Py_ssize_t pos;
 
     for (pos = 0; pos < list->size; pos++) {
-        pair = list->pairs + pos;
-        // Don't need traverse the identity: it is a terminal
-        Py_VISIT(pair->key);
+        pair = pair_list_at(list, pos);
+        // Don't need traverse the identity: it is a terminal,
+        // the same for keys of compact pairs
+        if (!list->compact) {
+            Py_VISIT(pair->key);
+        }
         Py_VISIT(pair->value);
     }
 
@@ -1612,15 +4087,27 @@ pair_list_clear(pair_list_t *list)
 
     list->version = NEXT_VERSION();
     for (pos = 0; pos < list->size; pos++) {
-        pair = list->pairs + pos;
-        Py_CLEAR(pair->key);
+        pair = pair_list_at(list, pos);
+        if (!list->compact) {
+            Py_CLEAR(pair->key);
+        }
         Py_CLEAR(pair->identity);
         Py_CLEAR(pair->value);
     }
     list->size = 0;
-    if (list->pairs != list->buffer) {
-        PyMem_Free(list->pairs);
-        list->pairs = list->buffer;
+    if (list->pairs != pair_list_buffer(list)) {
+        _pair_list_free(list, list->pairs);
+        list->pairs = pair_list_buffer(list);
+    }
+    list->compact = !list->calc_ci_indentity;
+    list->capacity = pair_list_buffer_capacity(list);
+    memset(list->signature, 0, sizeof(list->signature));
+    list->signature_stale = false;
+    list->raw_values = false;
+    if (list->ext != NULL) {
+        Py_CLEAR(list->ext->counts);
+        pair_list_index_drop(list);
+        list->ext->tombstones = 0;
     }
 
     return 0;
@@ -0,0 +1,754 @@
+#ifndef _MULTIDICT_RAW_H
+#define _MULTIDICT_RAW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "builder.h"
+#include "istr.h"
+#include "parser.h"
+#include "state.h"
+#include "views.h"
+
+/* Implementation note.
+RawHeadersView(data, offsets=None) is a read-only case-insensitive
+multidict over a raw header block.  It keeps the buffer of data and an
+offsets table of (name, name size, value, value size) entries, the same
+entries CIMultiDictBuilder collects, no strings are created up front.
+
+Each entry also has the FNV-1a hash of its ASCII lowered name, lookups
+compare the hash and then the name bytes in place.  The lowest bit of
+the hash is always set, 0 marks non-ASCII names: they are decoded and
+lowered with str.lower() on every lookup, like CIMultiDict does.
+
+Keys and values are decoded as UTF-8 with surrogateescape on access and
+are not cached, copy() decodes everything once into a CIMultiDict.
+keys(), values() and items() return the views of such a copy: the view
+is read-only, so they behave like the views of CIMultiDictProxy.
+
+The buffer must not be changed while the view is alive.
+*/
+
+#define RAW_FNV_OFFSET 0xcbf29ce484222325ULL
+#define RAW_FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+    PyObject_HEAD
+    mod_state *state;
+    Py_buffer view;
+    builder_entry_t *entries;
+    uint64_t *hashes;  // see the note
+    Py_ssize_t size;
+    Py_ssize_t capacity;
+} RawHeadersViewObject;
+
+typedef struct {
+    PyObject *identity;  // key.lower()
+    uint64_t hash;  // 0 if the identity is not ASCII
+} raw_key_t;
+
+
+PyDoc_STRVAR(raw__doc__,
+"Read-only case-insensitive multidict over a raw header buffer.\n\n"
+"offsets is an iterable of (name_start, name_len, value_start,\n"
+"value_len) tuples, data is parsed as 'Name: value' lines if\n"
+"it is omitted.  Names and values are decoded on access.");
+
+PyDoc_STRVAR(raw_getall_doc,
+"Return a list of all values matching the key.");
+
+PyDoc_STRVAR(raw_getone_doc,
+"Get first value matching the key.\n\n"
+"Raises KeyError if the key is not found and no default is provided.");
+
+PyDoc_STRVAR(raw_get_doc,
+"Get first value matching the key.\n\n"
+"If the key is not found, returns the default (or None if no default is provided)");
+
+PyDoc_STRVAR(raw_keys_doc,
+"Return a new view of the decoded keys.");
+
+PyDoc_STRVAR(raw_values_doc,
+"Return a new view of the decoded values.");
+
+PyDoc_STRVAR(raw_items_doc,
+"Return a new view of the decoded (key, value) pairs.");
+
+PyDoc_STRVAR(raw_copy_doc,
+"Return a CIMultiDict with the decoded headers.");
+
+
+static inline uint64_t
+_raw_hash(const char *s, Py_ssize_t size)
+{
+    // FNV-1a of the ASCII lowered bytes, 0 if any byte is not ASCII
+    uint64_t ret = RAW_FNV_OFFSET;
+    for (Py_ssize_t i = 0; i < size; i++) {
+        unsigned char ch = (unsigned char)s[i];
+        if (ch >= 0x80) {
+            return 0;
+        }
+        if (ch >= 'A' && ch <= 'Z') {
+            ch += 'a' - 'A';
+        }
+        ret = (ret ^ ch) * RAW_FNV_PRIME;
+    }
+    return ret | 1;
+}
+
+
+static inline int
+_raw_append(RawHeadersViewObject *self, Py_ssize_t name, Py_ssize_t name_size,
+            Py_ssize_t value, Py_ssize_t value_size)
+{
+    if (name < 0 || name_size < 0 || value < 0 || value_size < 0
+            || name > self->view.len - name_size
+            || value > self->view.len - value_size) {
+        PyErr_SetString(PyExc_ValueError, "header offsets out of range");
+        return -1;
+    }
+    if (self->size == self->capacity) {
+        Py_ssize_t capacity = self->capacity ? self->capacity * 2 : 16;
+        builder_entry_t *entries = PyMem_Resize(self->entries,
+                                                builder_entry_t,
+                                                (size_t)capacity);
+        if (entries == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->entries = entries;
+        uint64_t *hashes = PyMem_Resize(self->hashes, uint64_t, (size_t)capacity);
+        if (hashes == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->hashes = hashes;
+        self->capacity = capacity;
+    }
+    const char *data = (const char *)self->view.buf;
+    builder_entry_t *entry = &self->entries[self->size];
+    entry->name = name;
+    entry->name_size = name_size;
+    entry->value = value;
+    entry->value_size = value_size;
+    self->hashes[self->size] = _raw_hash(data + name, name_size);
+    self->size++;
+    return 0;
+}
+
+
+static inline int
+_raw_parse(RawHeadersViewObject *self)
+{
+    // Split "Name: value" lines up to the first empty line,
+    // lines end with LF or CRLF, spaces and tabs around values are dropped.
+    // Whitespace around the name is rejected, RFC 9112 section 5.1.
+    const char *data = (const char *)self->view.buf;
+    Py_ssize_t size = self->view.len;
+    Py_ssize_t pos = 0;
+
+    while (pos < size) {
+        const char *eol = memchr(data + pos, '\n', (size_t)(size - pos));
+        Py_ssize_t end = eol != NULL ? eol - data : size;
+        Py_ssize_t next = eol != NULL ? end + 1 : size;
+        if (end > pos && data[end - 1] == '\r') {
+            end--;
+        }
+        if (end == pos) {
+            break;
+        }
+        const char *colon = memchr(data + pos, ':', (size_t)(end - pos));
+        if (colon == NULL || colon == data + pos
+                || data[pos] == ' ' || data[pos] == '\t'
+                || colon[-1] == ' ' || colon[-1] == '\t') {
+            PyErr_Format(PyExc_ValueError,
+                         "invalid header line at offset %zd", pos);
+            return -1;
+        }
+        Py_ssize_t value = colon - data + 1;
+        while (value < end && (data[value] == ' ' || data[value] == '\t')) {
+            value++;
+        }
+        Py_ssize_t value_end = end;
+        while (value_end > value
+               && (data[value_end - 1] == ' ' || data[value_end - 1] == '\t')) {
+            value_end--;
+        }
+        if (_raw_append(self, pos, colon - data - pos,
+                        value, value_end - value) < 0) {
+            return -1;
+        }
+        pos = next;
+    }
+    return 0;
+}
+
+
+static inline int
+_raw_load_offsets(RawHeadersViewObject *self, PyObject *offsets)
+{
+    PyObject *iter = PyObject_GetIter(offsets);
+    if (iter == NULL) {
+        return -1;
+    }
+    PyObject *item;
+    while ((item = PyIter_Next(iter)) != NULL) {
+        Py_ssize_t name, name_size, value, value_size;
+        if (!PyTuple_Check(item)) {
+            PyErr_Format(PyExc_TypeError,
+                         "header offsets should be tuples, not %.100s",
+                         Py_TYPE(item)->tp_name);
+            goto fail;
+        }
+        if (!PyArg_ParseTuple(item, "nnnn;header offsets should be "
+                              "(name_start, name_len, value_start, value_len)",
+                              &name, &name_size, &value, &value_size)) {
+            goto fail;
+        }
+        if (_raw_append(self, name, name_size, value, value_size) < 0) {
+            goto fail;
+        }
+        Py_DECREF(item);
+    }
+    Py_DECREF(iter);
+    return PyErr_Occurred() ? -1 : 0;
+fail:
+    Py_DECREF(item);
+    Py_DECREF(iter);
+    return -1;
+}
+
+
+static inline int
+_raw_key_init(RawHeadersViewObject *self, PyObject *key, raw_key_t *ret)
+{
+    if (!PyUnicode_Check(key)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "CIMultiDict keys should be either str "
+                        "or subclasses of str");
+        return -1;
+    }
+    ret->identity = _builder_identity(self->state, key);
+    if (ret->identity == NULL) {
+        return -1;
+    }
+    ret->hash = 0;
+    if (PyUnicode_IS_ASCII(ret->identity)) {
+        ret->hash = _raw_hash((const char *)PyUnicode_1BYTE_DATA(ret->identity),
+                              PyUnicode_GET_LENGTH(ret->identity));
+    }
+    return 0;
+}
+
+
+static inline PyObject *
+_raw_decode(RawHeadersViewObject *self, Py_ssize_t pos, Py_ssize_t size)
+{
+    return PyUnicode_DecodeUTF8((const char *)self->view.buf + pos,
+                                size, "surrogateescape");
+}
+
+
+static inline PyObject *
+_raw_key(RawHeadersViewObject *self, Py_ssize_t i)
+{
+    // Return the name of the entry as istr
+    builder_entry_t *entry = &self->entries[i];
+    PyObject *name = _raw_decode(self, entry->name, entry->name_size);
+    if (name == NULL) {
+        return NULL;
+    }
+    PyObject *identity = _builder_identity(self->state, name);
+    if (identity == NULL) {
+        Py_DECREF(name);
+        return NULL;
+    }
+    PyObject *ret = IStr_New(self->state, name, identity);
+    Py_DECREF(name);
+    Py_DECREF(identity);
+    return ret;
+}
+
+
+static inline PyObject *
+_raw_value(RawHeadersViewObject *self, Py_ssize_t i)
+{
+    builder_entry_t *entry = &self->entries[i];
+    return _raw_decode(self, entry->value, entry->value_size);
+}
+
+
+static inline int
+_raw_match(RawHeadersViewObject *self, raw_key_t *key, Py_ssize_t i)
+{
+    builder_entry_t *entry = &self->entries[i];
+    uint64_t hash = self->hashes[i];
+    if (hash != 0) {
+        if (hash != key->hash
+                || entry->name_size != PyUnicode_GET_LENGTH(key->identity)) {
+            return 0;
+        }
+        const char *name = (const char *)self->view.buf + entry->name;
+        const Py_UCS1 *identity = PyUnicode_1BYTE_DATA(key->identity);
+        for (Py_ssize_t j = 0; j < entry->name_size; j++) {
+            unsigned char ch = (unsigned char)name[j];
+            if (ch >= 'A' && ch <= 'Z') {
+                ch += 'a' - 'A';
+            }
+            if (ch != identity[j]) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    PyObject *name = _raw_decode(self, entry->name, entry->name_size);
+    if (name == NULL) {
+        return -1;
+    }
+    PyObject *identity = _builder_identity(self->state, name);
+    Py_DECREF(name);
+    if (identity == NULL) {
+        return -1;
+    }
+    int ret = PyObject_RichCompareBool(identity, key->identity, Py_EQ);
+    Py_DECREF(identity);
+    return ret;
+}
+
+
+static inline int
+_raw_find(RawHeadersViewObject *self, raw_key_t *key, Py_ssize_t *pos)
+{
+    // Find the next entry matching the key starting from *pos
+    for (Py_ssize_t i = *pos; i < self->size; i++) {
+        int tmp = _raw_match(self, key, i);
+        if (tmp != 0) {
+            *pos = i;
+            return tmp;
+        }
+    }
+    return 0;
+}
+
+
+static inline PyObject *
+_raw_getone(RawHeadersViewObject *self, PyObject *key, PyObject *_default)
+{
+    raw_key_t rkey;
+    Py_ssize_t pos = 0;
+
+    if (_raw_key_init(self, key, &rkey) < 0) {
+        return NULL;
+    }
+    int tmp = _raw_find(self, &rkey, &pos);
+    Py_DECREF(rkey.identity);
+    if (tmp < 0) {
+        return NULL;
+    }
+    if (tmp > 0) {
+        return _raw_value(self, pos);
+    }
+    if (_default != NULL) {
+        return Py_NewRef(_default);
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+}
+
+
+static inline PyObject *
+raw_getall(RawHeadersViewObject *self, PyObject *const *args,
+           Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+    PyObject *ret = NULL;
+    raw_key_t rkey;
+    Py_ssize_t pos = 0;
+    int tmp;
+
+    if (parse2("getall", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    if (_raw_key_init(self, key, &rkey) < 0) {
+        return NULL;
+    }
+    while ((tmp = _raw_find(self, &rkey, &pos)) > 0) {
+        if (ret == NULL) {
+            ret = PyList_New(0);
+            if (ret == NULL) {
+                goto fail;
+            }
+        }
+        PyObject *value = _raw_value(self, pos);
+        if (value == NULL) {
+            goto fail;
+        }
+        tmp = PyList_Append(ret, value);
+        Py_DECREF(value);
+        if (tmp < 0) {
+            goto fail;
+        }
+        pos++;
+    }
+    if (tmp < 0) {
+        goto fail;
+    }
+    Py_DECREF(rkey.identity);
+    if (ret != NULL) {
+        return ret;
+    }
+    if (_default != NULL) {
+        return Py_NewRef(_default);
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+fail:
+    Py_DECREF(rkey.identity);
+    Py_XDECREF(ret);
+    return NULL;
+}
+
+
+static inline PyObject *
+raw_getone(RawHeadersViewObject *self, PyObject *const *args,
+           Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("getone", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _raw_getone(self, key, _default);
+}
+
+
+static inline PyObject *
+raw_get(RawHeadersViewObject *self, PyObject *const *args,
+        Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("get", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _raw_getone(self, key, _default != NULL ? _default : Py_None);
+}
+
+
+static inline PyObject *
+_raw_list(RawHeadersViewObject *self, bool keys, bool values)
+{
+    PyObject *ret = PyList_New(self->size);
+    if (ret == NULL) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < self->size; i++) {
+        PyObject *key = NULL;
+        PyObject *value = NULL;
+        PyObject *item;
+        if (keys && (key = _raw_key(self, i)) == NULL) {
+            goto fail;
+        }
+        if (values && (value = _raw_value(self, i)) == NULL) {
+            Py_XDECREF(key);
+            goto fail;
+        }
+        if (keys && values) {
+            item = PyTuple_Pack(2, key, value);
+            Py_DECREF(key);
+            Py_DECREF(value);
+            if (item == NULL) {
+                goto fail;
+            }
+        } else {
+            item = keys ? key : value;
+        }
+        PyList_SET_ITEM(ret, i, item);
+    }
+    return ret;
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+
+static inline PyObject *
+raw_copy(RawHeadersViewObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _builder_make_dict(self->state, (const char *)self->view.buf,
+                              self->entries, self->size, false);
+}
+
+
+static inline PyObject *
+_raw_view(RawHeadersViewObject *self,
+          PyObject *(*view_new)(MultiDictObject *md))
+{
+    // The view of the decoded copy, see the note
+    PyObject *md = raw_copy(self, NULL);
+    if (md == NULL) {
+        return NULL;
+    }
+    PyObject *ret = view_new((MultiDictObject *)md);
+    Py_DECREF(md);
+    return ret;
+}
+
+static inline PyObject *
+raw_keys(RawHeadersViewObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _raw_view(self, multidict_keysview_new);
+}
+
+static inline PyObject *
+raw_values(RawHeadersViewObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _raw_view(self, multidict_valuesview_new);
+}
+
+static inline PyObject *
+raw_items(RawHeadersViewObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _raw_view(self, multidict_itemsview_new);
+}
+
+
+static inline PyObject *
+raw_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "offsets", NULL};
+    PyObject *data = NULL;
+    PyObject *offsets = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O:RawHeadersView",
+                                     kwlist, &data, &offsets)) {
+        return NULL;
+    }
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    RawHeadersViewObject *self = (RawHeadersViewObject *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->state = get_mod_state(mod);
+    if (PyObject_GetBuffer(data, &self->view, PyBUF_SIMPLE) < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    int ret = offsets == Py_None ? _raw_parse(self)
+                                 : _raw_load_offsets(self, offsets);
+    if (ret < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+
+static inline void
+raw_tp_dealloc(RawHeadersViewObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    if (self->view.obj != NULL) {
+        PyBuffer_Release(&self->view);
+    }
+    PyMem_Free(self->entries);
+    PyMem_Free(self->hashes);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
+}
+
+
+static inline Py_ssize_t
+raw_mp_len(RawHeadersViewObject *self)
+{
+    return self->size;
+}
+
+static inline PyObject *
+raw_mp_subscript(RawHeadersViewObject *self, PyObject *key)
+{
+    return _raw_getone(self, key, NULL);
+}
+
+static inline int
+raw_sq_contains(RawHeadersViewObject *self, PyObject *key)
+{
+    raw_key_t rkey;
+    Py_ssize_t pos = 0;
+
+    if (!PyUnicode_Check(key)) {
+        return 0;
+    }
+    if (_raw_key_init(self, key, &rkey) < 0) {
+        return -1;
+    }
+    int ret = _raw_find(self, &rkey, &pos);
+    Py_DECREF(rkey.identity);
+    return ret;
+}
+
+static inline PyObject *
+raw_tp_iter(RawHeadersViewObject *self)
+{
+    PyObject *keys = _raw_list(self, true, false);
+    if (keys == NULL) {
+        return NULL;
+    }
+    PyObject *ret = PyObject_GetIter(keys);
+    Py_DECREF(keys);
+    return ret;
+}
+
+static inline PyObject *
+raw_tp_richcompare(PyObject *self, PyObject *other, int op)
+{
+    // Compare as the CIMultiDict copy
+    if (op != Py_EQ && op != Py_NE) {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    PyObject *lft = raw_copy((RawHeadersViewObject *)self, NULL);
+    if (lft == NULL) {
+        return NULL;
+    }
+    PyObject *rht;
+    if (Py_TYPE(other) == Py_TYPE(self)) {
+        rht = raw_copy((RawHeadersViewObject *)other, NULL);
+        if (rht == NULL) {
+            Py_DECREF(lft);
+            return NULL;
+        }
+    } else {
+        rht = Py_NewRef(other);
+    }
+    PyObject *ret = PyObject_RichCompare(lft, rht, op);
+    Py_DECREF(lft);
+    Py_DECREF(rht);
+    return ret;
+}
+
+static inline PyObject *
+raw_tp_repr(RawHeadersViewObject *self)
+{
+    PyObject *name = NULL;
+    PyObject *items = NULL;
+    PyUnicodeWriter *writer = NULL;
+
+    name = PyObject_GetAttrString((PyObject *)Py_TYPE(self), "__name__");
+    if (name == NULL) {
+        goto fail;
+    }
+    items = _raw_list(self, true, true);
+    if (items == NULL) {
+        goto fail;
+    }
+    writer = PyUnicodeWriter_Create(1024);
+    if (writer == NULL) {
+        goto fail;
+    }
+    if (PyUnicodeWriter_WriteChar(writer, '<') < 0
+            || PyUnicodeWriter_WriteStr(writer, name) < 0
+            || PyUnicodeWriter_WriteChar(writer, '(') < 0) {
+        goto fail;
+    }
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(items); i++) {
+        PyObject *item = PyList_GET_ITEM(items, i);
+        if (i > 0 && (PyUnicodeWriter_WriteChar(writer, ',') < 0
+                      || PyUnicodeWriter_WriteChar(writer, ' ') < 0)) {
+            goto fail;
+        }
+        if (PyUnicodeWriter_WriteChar(writer, '\'') < 0
+                || PyUnicodeWriter_WriteStr(writer, PyTuple_GET_ITEM(item, 0)) < 0
+                || PyUnicodeWriter_WriteChar(writer, '\'') < 0
+                || PyUnicodeWriter_WriteChar(writer, ':') < 0
+                || PyUnicodeWriter_WriteChar(writer, ' ') < 0
+                || PyUnicodeWriter_WriteRepr(writer, PyTuple_GET_ITEM(item, 1)) < 0) {
+            goto fail;
+        }
+    }
+    if (PyUnicodeWriter_WriteChar(writer, ')') < 0
+            || PyUnicodeWriter_WriteChar(writer, '>') < 0) {
+        goto fail;
+    }
+    Py_DECREF(name);
+    Py_DECREF(items);
+    return PyUnicodeWriter_Finish(writer);
+fail:
+    Py_XDECREF(name);
+    Py_XDECREF(items);
+    if (writer != NULL) {
+        PyUnicodeWriter_Discard(writer);
+    }
+    return NULL;
+}
+
+
+static PyMethodDef raw_methods[] = {
+    {"getall", (PyCFunction)(void(*)(void))raw_getall,
+     METH_FASTCALL | METH_KEYWORDS, raw_getall_doc},
+    {"getone", (PyCFunction)(void(*)(void))raw_getone,
+     METH_FASTCALL | METH_KEYWORDS, raw_getone_doc},
+    {"get", (PyCFunction)(void(*)(void))raw_get,
+     METH_FASTCALL | METH_KEYWORDS, raw_get_doc},
+    {"keys", (PyCFunction)raw_keys, METH_NOARGS, raw_keys_doc},
+    {"values", (PyCFunction)raw_values, METH_NOARGS, raw_values_doc},
+    {"items", (PyCFunction)raw_items, METH_NOARGS, raw_items_doc},
+    {"copy", (PyCFunction)raw_copy, METH_NOARGS, raw_copy_doc},
+    {"__class_getitem__", (PyCFunction)Py_GenericAlias,
+     METH_O | METH_CLASS, NULL},
+    {NULL, NULL}   /* sentinel */
+};
+
+static PyType_Slot raw_slots[] = {
+    {Py_tp_dealloc, raw_tp_dealloc},
+    {Py_tp_doc, (void *)raw__doc__},
+    {Py_tp_methods, raw_methods},
+    {Py_tp_new, raw_tp_new},
+    {Py_tp_iter, raw_tp_iter},
+    {Py_tp_repr, raw_tp_repr},
+    {Py_tp_richcompare, raw_tp_richcompare},
+    {Py_mp_length, raw_mp_len},
+    {Py_mp_subscript, raw_mp_subscript},
+    {Py_sq_contains, raw_sq_contains},
+    {0, NULL},
+};
+
+static PyType_Spec raw_spec = {
+    .name = "multidict._multidict.RawHeadersView",
+    .basicsize = sizeof(RawHeadersViewObject),
+    .flags = (Py_TPFLAGS_DEFAULT
+#if PY_VERSION_HEX >= 0x030a00f0
+              | Py_TPFLAGS_IMMUTABLETYPE
+#endif
+              ),
+    .slots = raw_slots,
+};
+
+
+static inline int
+raw_init(PyObject *module, mod_state *state)
+{
+    PyObject *tmp = PyType_FromModuleAndSpec(module, &raw_spec, NULL);
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->RawHeadersViewType = (PyTypeObject *)tmp;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,1099 @@
+#ifndef _MULTIDICT_SHARED_H
+#define _MULTIDICT_SHARED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dict.h"
+#include "istr.h"
+#include "pair_list.h"
+#include "parser.h"
+#include "state.h"
+
+/* Implementation note.
+SharedMultiDict.pack(md) writes a multidict with str or bytes values into
+a flat position-independent layout.  SharedMultiDict(buffer) serves lookups
+straight from any buffer holding it, e.g. a mapped file or
+multiprocessing.shared_memory, so the layout can be shared between processes.
+
+All integers are little-endian, offsets are counted from the buffer start:
+
+  header   "MDPK", u16 version, u16 flags (bit 0: case-insensitive),
+           u32 number of entries, u32 number of slots (a power of two),
+           u32 size of the layout, 12 zero bytes
+  entries  u64 hash, u32 offsets of the identity, key and value,
+           u32 1-based index of the next entry with the same identity,
+           u32 flags (bit 0: the value is bytes), 4 zero bytes
+  slots    u32 1-based index of the first entry of an identity, 0 is empty,
+           collisions are resolved by linear probing
+  heap     u32 length followed by UTF-8 (raw for bytes values) data,
+           equal strings are stored once
+
+The identity is key.lower() for case-insensitive multidicts.  The hash is
+FNV-1a of the identity UTF-8 since str hashes are randomized per process.
+Strings are encoded with surrogateescape, so undecodable bytes kept by
+CIMultiDictBuilder round-trip.
+
+The layout is validated on creation.  The buffer may be writable shared
+memory changed by another process later, so string offsets, slots and
+next links are checked again on every access and a corrupted layout
+raises ValueError instead of reading out of bounds.  Next links point
+strictly forward, so a chain visits every entry at most once.
+The buffer stays exported while the object lives.  Keys and values are
+decoded on first access and cached.
+*/
+
+#define SHARED_MAGIC "MDPK"
+#define SHARED_VERSION 1
+#define SHARED_HEADER_SIZE 32
+#define SHARED_ENTRY_SIZE 32
+#define SHARED_SLOT_SIZE 4
+#define SHARED_LEN_SIZE 4
+
+#define SHARED_CI 0x1U  // header flag
+#define SHARED_BYTES 0x1U  // entry flag
+
+// field offsets of an entry
+#define SHARED_HASH 0
+#define SHARED_IDENTITY 8
+#define SHARED_KEY 12
+#define SHARED_VALUE 16
+#define SHARED_NEXT 20
+#define SHARED_FLAGS 24
+
+#define SHARED_FNV_OFFSET 0xcbf29ce484222325ULL
+#define SHARED_FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+    PyObject_HEAD
+    mod_state *state;
+    Py_buffer view;
+    const unsigned char *data;
+    uint32_t count;
+    uint32_t nslots;
+    uint32_t heap;  // offset of the heap
+    uint32_t size;  // size of the layout
+    bool ci;
+    PyObject **keys;  // decoded keys, NULL until accessed
+    PyObject **values;  // decoded values, NULL until accessed
+} SharedMultiDictObject;
+
+
+static inline uint32_t
+_shared_u32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] | (uint32_t)p[1] << 8
+            | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static inline uint64_t
+_shared_u64(const unsigned char *p)
+{
+    return (uint64_t)_shared_u32(p) | (uint64_t)_shared_u32(p + 4) << 32;
+}
+
+static inline void
+_shared_put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static inline void
+_shared_put_u64(unsigned char *p, uint64_t v)
+{
+    _shared_put_u32(p, (uint32_t)v);
+    _shared_put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint64_t
+_shared_hash(const char *s, Py_ssize_t size)
+{
+    uint64_t ret = SHARED_FNV_OFFSET;
+    for (Py_ssize_t i = 0; i < size; i++) {
+        ret = (ret ^ (unsigned char)s[i]) * SHARED_FNV_PRIME;
+    }
+    return ret;
+}
+
+static inline const unsigned char *
+_shared_entry(SharedMultiDictObject *self, uint32_t index)
+{
+    return self->data + SHARED_HEADER_SIZE + (size_t)index * SHARED_ENTRY_SIZE;
+}
+
+static inline void
+_shared_corrupted(void)
+{
+    PyErr_SetString(PyExc_ValueError, "packed multidict is corrupted");
+}
+
+static inline const char *
+_shared_str(SharedMultiDictObject *self, const unsigned char *entry,
+            int field, Py_ssize_t *size)
+{
+    // The buffer can change under us, read every field once
+    uint32_t offset = _shared_u32(entry + field);
+    if (offset < self->heap
+            || (uint64_t)offset + SHARED_LEN_SIZE > self->size) {
+        goto corrupted;
+    }
+    uint32_t len = _shared_u32(self->data + offset);
+    if ((uint64_t)offset + SHARED_LEN_SIZE + len > self->size) {
+        goto corrupted;
+    }
+    *size = (Py_ssize_t)len;
+    return (const char *)self->data + offset + SHARED_LEN_SIZE;
+corrupted:
+    _shared_corrupted();
+    return NULL;
+}
+
+
+static inline int
+_shared_utf8(PyObject *str, PyObject **ptmp, const char **pdata,
+             Py_ssize_t *psize)
+{
+    // Encode with surrogateescape, *ptmp keeps the encoded bytes alive
+    // if the cached UTF-8 of the str can't be used
+    *ptmp = NULL;
+    *pdata = PyUnicode_AsUTF8AndSize(str, psize);
+    if (*pdata != NULL) {
+        return 0;
+    }
+    if (!PyErr_ExceptionMatches(PyExc_UnicodeEncodeError)) {
+        return -1;
+    }
+    PyErr_Clear();
+    *ptmp = PyUnicode_AsEncodedString(str, "utf-8", "surrogateescape");
+    if (*ptmp == NULL) {
+        return -1;
+    }
+    *pdata = PyBytes_AS_STRING(*ptmp);
+    *psize = PyBytes_GET_SIZE(*ptmp);
+    return 0;
+}
+
+
+/******************** Lookups ********************/
+
+static inline int
+_shared_find(SharedMultiDictObject *self, PyObject *key, uint32_t *pindex)
+{
+    // Return 1 and the index of the first entry of the key, 0 if not found
+    PyObject *identity = (self->ci ? _ci_key_to_ident(self->state, key)
+                                   : _key_to_ident(self->state, key));
+    if (identity == NULL) {
+        return -1;
+    }
+    PyObject *tmp;
+    const char *s;
+    Py_ssize_t size;
+    if (_shared_utf8(identity, &tmp, &s, &size) < 0) {
+        Py_DECREF(identity);
+        if (PyErr_ExceptionMatches(PyExc_UnicodeEncodeError)) {
+            // other lone surrogates can't be packed
+            PyErr_Clear();
+            return 0;
+        }
+        return -1;
+    }
+
+    uint64_t hash = _shared_hash(s, size);
+    uint32_t mask = self->nslots - 1;
+    uint32_t pos = (uint32_t)hash & mask;
+    const unsigned char *slots = _shared_entry(self, self->count);
+    int ret = 0;
+
+    for (uint32_t i = 0; i < self->nslots; i++) {
+        uint32_t slot = _shared_u32(slots + (size_t)pos * SHARED_SLOT_SIZE);
+        if (slot == 0) {
+            break;
+        }
+        if (slot > self->count) {
+            _shared_corrupted();
+            ret = -1;
+            break;
+        }
+        const unsigned char *entry = _shared_entry(self, slot - 1);
+        if (_shared_u64(entry + SHARED_HASH) == hash) {
+            Py_ssize_t len;
+            const char *ident = _shared_str(self, entry, SHARED_IDENTITY, &len);
+            if (ident == NULL) {
+                ret = -1;
+                break;
+            }
+            if (len == size && memcmp(ident, s, (size_t)size) == 0) {
+                *pindex = slot - 1;
+                ret = 1;
+                break;
+            }
+        }
+        pos = (pos + 1) & mask;
+    }
+    Py_XDECREF(tmp);
+    Py_DECREF(identity);
+    return ret;
+}
+
+static inline PyObject *
+_shared_key(SharedMultiDictObject *self, uint32_t index)
+{
+    PyObject *ret = self->keys[index];
+    if (ret != NULL) {
+        return Py_NewRef(ret);
+    }
+    const unsigned char *entry = _shared_entry(self, index);
+    Py_ssize_t size;
+    const char *s = _shared_str(self, entry, SHARED_KEY, &size);
+    if (s == NULL) {
+        return NULL;
+    }
+    ret = PyUnicode_DecodeUTF8(s, size, "surrogateescape");
+    if (ret == NULL) {
+        return NULL;
+    }
+    if (self->ci) {
+        s = _shared_str(self, entry, SHARED_IDENTITY, &size);
+        if (s == NULL) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyObject *identity = PyUnicode_DecodeUTF8(s, size, "surrogateescape");
+        if (identity == NULL) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        Py_SETREF(ret, IStr_New(self->state, ret, identity));
+        Py_DECREF(identity);
+        if (ret == NULL) {
+            return NULL;
+        }
+    }
+    self->keys[index] = Py_NewRef(ret);
+    return ret;
+}
+
+static inline PyObject *
+_shared_value(SharedMultiDictObject *self, uint32_t index)
+{
+    PyObject *ret = self->values[index];
+    if (ret != NULL) {
+        return Py_NewRef(ret);
+    }
+    const unsigned char *entry = _shared_entry(self, index);
+    Py_ssize_t size;
+    const char *s = _shared_str(self, entry, SHARED_VALUE, &size);
+    if (s == NULL) {
+        return NULL;
+    }
+    if (_shared_u32(entry + SHARED_FLAGS) & SHARED_BYTES) {
+        ret = PyBytes_FromStringAndSize(s, size);
+    } else {
+        ret = PyUnicode_DecodeUTF8(s, size, "surrogateescape");
+    }
+    if (ret == NULL) {
+        return NULL;
+    }
+    self->values[index] = Py_NewRef(ret);
+    return ret;
+}
+
+static inline int
+_shared_next(SharedMultiDictObject *self, uint32_t index, uint32_t *pnext)
+{
+    // Return 1 and the index of the next entry with the same identity,
+    // 0 at the end of the chain
+    uint32_t next = _shared_u32(_shared_entry(self, index) + SHARED_NEXT);
+    if (next == 0) {
+        return 0;
+    }
+    if (next - 1 <= index || next > self->count) {
+        _shared_corrupted();
+        return -1;
+    }
+    *pnext = next - 1;
+    return 1;
+}
+
+
+/******************** Packing ********************/
+
+typedef struct {
+    uint64_t hash;
+    size_t identity;
+    size_t key;
+    size_t value;
+    uint32_t next;
+    uint32_t flags;
+} _shared_pack_entry_t;
+
+typedef struct {
+    PyObject *strings;  // data -> heap offset, equal strings are stored once
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} _shared_heap_t;
+
+
+static inline int
+_shared_heap_store(_shared_heap_t *heap, const char *s, Py_ssize_t size,
+                   size_t *poffset)
+{
+    PyObject *data = PyBytes_FromStringAndSize(s, size);
+    PyObject *offset = NULL;
+    if (data == NULL) {
+        return -1;
+    }
+    if (PyDict_GetItemRef(heap->strings, data, &offset) < 0) {
+        goto fail;
+    }
+    if (offset != NULL) {
+        *poffset = PyLong_AsSize_t(offset);
+        Py_DECREF(offset);
+        Py_DECREF(data);
+        return 0;
+    }
+
+    size_t required = heap->size + SHARED_LEN_SIZE + (size_t)size;
+    if (required > UINT32_MAX) {
+        PyErr_SetString(PyExc_ValueError, "multidict is too large to pack");
+        goto fail;
+    }
+    if (required > heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity : 256;
+        while (capacity < required) {
+            capacity *= 2;
+        }
+        unsigned char *new_data = PyMem_Realloc(heap->data, capacity);
+        if (new_data == NULL) {
+            PyErr_NoMemory();
+            goto fail;
+        }
+        heap->data = new_data;
+        heap->capacity = capacity;
+    }
+    offset = PyLong_FromSize_t(heap->size);
+    if (offset == NULL || PyDict_SetItem(heap->strings, data, offset) < 0) {
+        goto fail;
+    }
+    Py_DECREF(offset);
+    Py_DECREF(data);
+
+    *poffset = heap->size;
+    _shared_put_u32(heap->data + heap->size, (uint32_t)size);
+    memcpy(heap->data + heap->size + SHARED_LEN_SIZE, s, (size_t)size);
+    heap->size = required;
+    return 0;
+fail:
+    Py_XDECREF(offset);
+    Py_DECREF(data);
+    return -1;
+}
+
+
+static inline PyObject *
+shared_pack_list(pair_list_t *list)
+{
+    Py_ssize_t count = pair_list_len(list);
+    Py_ssize_t pos = 0;  // tombstones are skipped
+    uint64_t version = list->version;
+    _shared_pack_entry_t *entries = NULL;
+    uint32_t *firsts = NULL;
+    uint32_t *slots = NULL;
+    uint32_t nfirsts = 0;
+    PyObject *last = NULL;  // identity -> index of the last entry
+    PyObject *ret = NULL;
+    _shared_heap_t heap = {NULL, NULL, 0, 0};
+    PyObject *tmp = NULL;  // encoded string with surrogates
+
+    if ((uint64_t)count > UINT32_MAX / SHARED_ENTRY_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "multidict is too large to pack");
+        return NULL;
+    }
+    size_t n = count ? (size_t)count : 1;
+    entries = PyMem_Calloc(n, sizeof(_shared_pack_entry_t));
+    firsts = PyMem_Calloc(n, sizeof(uint32_t));
+    if (entries == NULL || firsts == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    heap.strings = PyDict_New();
+    if (heap.strings == NULL) {
+        goto fail;
+    }
+    last = PyDict_New();
+    if (last == NULL) {
+        goto fail;
+    }
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (list->version != version) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "MultiDict changed during iteration");
+            goto fail;
+        }
+        pair_t *pair = pair_list_at(list, pos++);
+        while (pair->identity == NULL) {
+            pair = pair_list_at(list, pos++);
+        }
+        _shared_pack_entry_t *entry = &entries[i];
+        const char *s;
+        Py_ssize_t size;
+        PyObject *value = pair_list_value(list, pair);
+
+        if (value == NULL) {
+            goto fail;
+        } else if (PyUnicode_Check(value)) {
+            entry->flags = 0;
+        } else if (PyBytes_Check(value)) {
+            entry->flags = SHARED_BYTES;
+        } else {
+            PyErr_Format(PyExc_TypeError,
+                         "SharedMultiDict values should be str or bytes, "
+                         "not %.100s", Py_TYPE(value)->tp_name);
+            goto fail;
+        }
+
+        if (_shared_utf8(pair->identity, &tmp, &s, &size) < 0) {
+            goto fail;
+        }
+        entry->hash = _shared_hash(s, size);
+        if (_shared_heap_store(&heap, s, size, &entry->identity) < 0) {
+            goto fail;
+        }
+        Py_CLEAR(tmp);
+        if (_shared_utf8(pair_list_pair_key(list, pair), &tmp, &s, &size) < 0) {
+            goto fail;
+        }
+        if (_shared_heap_store(&heap, s, size, &entry->key) < 0) {
+            goto fail;
+        }
+        Py_CLEAR(tmp);
+        if (entry->flags & SHARED_BYTES) {
+            s = PyBytes_AS_STRING(value);
+            size = PyBytes_GET_SIZE(value);
+        } else if (_shared_utf8(value, &tmp, &s, &size) < 0) {
+            goto fail;
+        }
+        if (_shared_heap_store(&heap, s, size, &entry->value) < 0) {
+            goto fail;
+        }
+        Py_CLEAR(tmp);
+
+        PyObject *prev = NULL;
+        if (PyDict_GetItemRef(last, pair->identity, &prev) < 0) {
+            goto fail;
+        }
+        if (prev == NULL) {
+            firsts[nfirsts++] = (uint32_t)i;
+        } else {
+            entries[PyLong_AsSize_t(prev)].next = (uint32_t)i + 1;
+            Py_DECREF(prev);
+        }
+        PyObject *index = PyLong_FromSsize_t(i);
+        if (index == NULL) {
+            goto fail;
+        }
+        int err = PyDict_SetItem(last, pair->identity, index);
+        Py_DECREF(index);
+        if (err < 0) {
+            goto fail;
+        }
+    }
+
+    uint32_t nslots = 1;
+    while (nslots < 2 * (uint64_t)nfirsts) {
+        nslots *= 2;
+    }
+    uint32_t mask = nslots - 1;
+    slots = PyMem_Calloc(nslots, sizeof(uint32_t));
+    if (slots == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    for (uint32_t i = 0; i < nfirsts; i++) {
+        uint32_t pos = (uint32_t)entries[firsts[i]].hash & mask;
+        while (slots[pos] != 0) {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = firsts[i] + 1;
+    }
+
+    uint64_t base = (SHARED_HEADER_SIZE
+                     + (uint64_t)count * SHARED_ENTRY_SIZE
+                     + (uint64_t)nslots * SHARED_SLOT_SIZE);
+    uint64_t size = base + heap.size;
+    if (size > UINT32_MAX) {
+        PyErr_SetString(PyExc_ValueError, "multidict is too large to pack");
+        goto fail;
+    }
+    ret = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)size);
+    if (ret == NULL) {
+        goto fail;
+    }
+
+    unsigned char *p = (unsigned char *)PyBytes_AS_STRING(ret);
+    memset(p, 0, (size_t)base);
+    memcpy(p, SHARED_MAGIC, 4);
+    p[4] = SHARED_VERSION;
+    p[6] = list->calc_ci_indentity ? SHARED_CI : 0;
+    _shared_put_u32(p + 8, (uint32_t)count);
+    _shared_put_u32(p + 12, nslots);
+    _shared_put_u32(p + 16, (uint32_t)size);
+    p += SHARED_HEADER_SIZE;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        _shared_pack_entry_t *entry = &entries[i];
+        _shared_put_u64(p + SHARED_HASH, entry->hash);
+        _shared_put_u32(p + SHARED_IDENTITY, (uint32_t)(base + entry->identity));
+        _shared_put_u32(p + SHARED_KEY, (uint32_t)(base + entry->key));
+        _shared_put_u32(p + SHARED_VALUE, (uint32_t)(base + entry->value));
+        _shared_put_u32(p + SHARED_NEXT, entry->next);
+        _shared_put_u32(p + SHARED_FLAGS, entry->flags);
+        p += SHARED_ENTRY_SIZE;
+    }
+    for (uint32_t i = 0; i < nslots; i++) {
+        _shared_put_u32(p, slots[i]);
+        p += SHARED_SLOT_SIZE;
+    }
+    if (heap.size) {
+        memcpy(p, heap.data, heap.size);
+    }
+    goto done;
+fail:
+    Py_CLEAR(ret);
+done:
+    Py_XDECREF(tmp);
+    PyMem_Free(entries);
+    PyMem_Free(firsts);
+    PyMem_Free(slots);
+    PyMem_Free(heap.data);
+    Py_XDECREF(heap.strings);
+    Py_XDECREF(last);
+    return ret;
+}
+
+
+/******************** SharedMultiDict ********************/
+
+PyDoc_STRVAR(shared__doc__,
+"Read-only multidict over a buffer written by SharedMultiDict.pack().\n\n"
+"Lookups are served from the buffer, keys and values are\n"
+"materialized on first access and cached.");
+
+PyDoc_STRVAR(shared_pack_doc,
+"Serialize a multidict with str or bytes values.");
+
+PyDoc_STRVAR(shared_getall_doc,
+"Return a list of all values matching the key.");
+
+PyDoc_STRVAR(shared_getone_doc,
+"Get first value matching the key.\n\n"
+"Raises KeyError if the key is not found and no default is provided.");
+
+PyDoc_STRVAR(shared_get_doc,
+"Get first value matching the key.\n\n"
+"If the key is not found, returns the default (or None if no default is provided)");
+
+PyDoc_STRVAR(shared_keys_doc,
+"Return a list of keys, duplicates included.");
+
+PyDoc_STRVAR(shared_values_doc,
+"Return a list of values.");
+
+PyDoc_STRVAR(shared_items_doc,
+"Return a list of (key, value) pairs.");
+
+
+static inline int
+_shared_check_str(const unsigned char *data, uint32_t heap, uint32_t size,
+                  uint32_t offset)
+{
+    if (offset < heap || (uint64_t)offset + SHARED_LEN_SIZE > size) {
+        return 0;
+    }
+    return (uint64_t)offset + SHARED_LEN_SIZE + _shared_u32(data + offset)
+        <= size;
+}
+
+
+static inline int
+_shared_check_next(uint32_t count, uint32_t index, uint32_t next)
+{
+    // 0 ends the chain, other links point strictly forward
+    return next == 0 || (next - 1 > index && next <= count);
+}
+
+
+static inline int
+_shared_validate(SharedMultiDictObject *self)
+{
+    // Check the whole layout and cache the header, lookups recheck
+    // what they read from the rest of the buffer
+    const unsigned char *data = self->data;
+    Py_ssize_t len = self->view.len;
+    if (len < SHARED_HEADER_SIZE) {
+        PyErr_SetString(PyExc_ValueError,
+                        "buffer is too small for a packed multidict");
+        return -1;
+    }
+    if (memcmp(data, SHARED_MAGIC, 4) != 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "buffer doesn't contain a packed multidict");
+        return -1;
+    }
+    unsigned int version = data[4] | (unsigned int)data[5] << 8;
+    if (version != SHARED_VERSION) {
+        PyErr_Format(PyExc_ValueError,
+                     "unsupported packed multidict version %u", version);
+        return -1;
+    }
+    unsigned int flags = data[6] | (unsigned int)data[7] << 8;
+    uint32_t count = _shared_u32(data + 8);
+    uint32_t nslots = _shared_u32(data + 12);
+    uint32_t size = _shared_u32(data + 16);
+    uint64_t heap = (SHARED_HEADER_SIZE
+                     + (uint64_t)count * SHARED_ENTRY_SIZE
+                     + (uint64_t)nslots * SHARED_SLOT_SIZE);
+    if ((Py_ssize_t)size > len || heap > size || nslots == 0
+            || (nslots & (nslots - 1)) != 0 || (flags & ~SHARED_CI) != 0) {
+        goto corrupted;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const unsigned char *entry = (data + SHARED_HEADER_SIZE
+                                      + (size_t)i * SHARED_ENTRY_SIZE);
+        if (!_shared_check_str(data, (uint32_t)heap, size,
+                               _shared_u32(entry + SHARED_IDENTITY))
+                || !_shared_check_str(data, (uint32_t)heap, size,
+                                      _shared_u32(entry + SHARED_KEY))
+                || !_shared_check_str(data, (uint32_t)heap, size,
+                                      _shared_u32(entry + SHARED_VALUE))
+                || !_shared_check_next(count, i,
+                                       _shared_u32(entry + SHARED_NEXT))
+                || (_shared_u32(entry + SHARED_FLAGS) & ~SHARED_BYTES) != 0) {
+            goto corrupted;
+        }
+    }
+    const unsigned char *slots = (data + SHARED_HEADER_SIZE
+                                  + (size_t)count * SHARED_ENTRY_SIZE);
+    for (uint32_t i = 0; i < nslots; i++) {
+        if (_shared_u32(slots + (size_t)i * SHARED_SLOT_SIZE) > count) {
+            goto corrupted;
+        }
+    }
+    self->ci = (flags & SHARED_CI) != 0;
+    self->count = count;
+    self->nslots = nslots;
+    self->heap = (uint32_t)heap;
+    self->size = size;
+    return 0;
+corrupted:
+    _shared_corrupted();
+    return -1;
+}
+
+
+static inline PyObject *
+shared_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"buffer", NULL};
+    PyObject *buffer = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:SharedMultiDict",
+                                     kwlist, &buffer)) {
+        return NULL;
+    }
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    SharedMultiDictObject *self = (SharedMultiDictObject *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->state = get_mod_state(mod);
+    if (PyObject_GetBuffer(buffer, &self->view, PyBUF_SIMPLE) < 0) {
+        goto fail;
+    }
+    self->data = self->view.buf;
+    if (_shared_validate(self) < 0) {
+        goto fail;
+    }
+    if (self->count) {
+        self->keys = PyMem_Calloc(self->count, sizeof(PyObject *));
+        self->values = PyMem_Calloc(self->count, sizeof(PyObject *));
+        if (self->keys == NULL || self->values == NULL) {
+            PyErr_NoMemory();
+            goto fail;
+        }
+    }
+    return (PyObject *)self;
+fail:
+    Py_DECREF(self);
+    return NULL;
+}
+
+
+static inline void
+shared_tp_dealloc(SharedMultiDictObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    if (self->keys != NULL) {
+        for (uint32_t i = 0; i < self->count; i++) {
+            Py_XDECREF(self->keys[i]);
+        }
+        PyMem_Free(self->keys);
+    }
+    if (self->values != NULL) {
+        for (uint32_t i = 0; i < self->count; i++) {
+            Py_XDECREF(self->values[i]);
+        }
+        PyMem_Free(self->values);
+    }
+    if (self->data != NULL) {
+        PyBuffer_Release(&self->view);
+    }
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
+}
+
+
+static inline PyObject *
+_shared_getone(SharedMultiDictObject *self, PyObject *key, PyObject *_default)
+{
+    uint32_t index;
+    int found = _shared_find(self, key, &index);
+    if (found < 0) {
+        return NULL;
+    }
+    if (found) {
+        return _shared_value(self, index);
+    }
+    if (_default != NULL) {
+        return Py_NewRef(_default);
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+}
+
+
+static inline PyObject *
+shared_getall(SharedMultiDictObject *self, PyObject *const *args,
+              Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+    uint32_t index;
+
+    if (parse2("getall", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    int found = _shared_find(self, key, &index);
+    if (found < 0) {
+        return NULL;
+    }
+    if (!found) {
+        if (_default != NULL) {
+            return Py_NewRef(_default);
+        }
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    PyObject *ret = PyList_New(0);
+    if (ret == NULL) {
+        return NULL;
+    }
+    // next links point forward, the chain ends within count steps
+    for (;;) {
+        PyObject *value = _shared_value(self, index);
+        if (value == NULL) {
+            goto fail;
+        }
+        int err = PyList_Append(ret, value);
+        Py_DECREF(value);
+        if (err < 0) {
+            goto fail;
+        }
+        found = _shared_next(self, index, &index);
+        if (found < 0) {
+            goto fail;
+        }
+        if (!found) {
+            break;
+        }
+    }
+    return ret;
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+
+static inline PyObject *
+shared_getone(SharedMultiDictObject *self, PyObject *const *args,
+              Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("getone", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _shared_getone(self, key, _default);
+}
+
+
+static inline PyObject *
+shared_get(SharedMultiDictObject *self, PyObject *const *args,
+           Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *key = NULL;
+    PyObject *_default = NULL;
+
+    if (parse2("get", args, nargs, kwnames, 1,
+               "key", &key, "default", &_default) < 0) {
+        return NULL;
+    }
+    return _shared_getone(self, key, _default != NULL ? _default : Py_None);
+}
+
+
+static inline PyObject *
+_shared_list(SharedMultiDictObject *self, bool keys, bool values)
+{
+    PyObject *ret = PyList_New(self->count);
+    if (ret == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < self->count; i++) {
+        PyObject *item;
+        if (keys && values) {
+            PyObject *key = _shared_key(self, i);
+            if (key == NULL) {
+                goto fail;
+            }
+            PyObject *value = _shared_value(self, i);
+            if (value == NULL) {
+                Py_DECREF(key);
+                goto fail;
+            }
+            item = PyTuple_Pack(2, key, value);
+            Py_DECREF(key);
+            Py_DECREF(value);
+        } else if (keys) {
+            item = _shared_key(self, i);
+        } else {
+            item = _shared_value(self, i);
+        }
+        if (item == NULL) {
+            goto fail;
+        }
+        PyList_SET_ITEM(ret, i, item);
+    }
+    return ret;
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+
+static inline PyObject *
+shared_keys(SharedMultiDictObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _shared_list(self, true, false);
+}
+
+static inline PyObject *
+shared_values(SharedMultiDictObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _shared_list(self, false, true);
+}
+
+static inline PyObject *
+shared_items(SharedMultiDictObject *self, PyObject *Py_UNUSED(unused))
+{
+    return _shared_list(self, true, true);
+}
+
+
+static inline PyObject *
+shared_pack(PyTypeObject *type, PyObject *md)
+{
+    PyObject *mod = PyType_GetModuleByDef(type, &multidict_module);
+    if (mod == NULL) {
+        return NULL;
+    }
+    mod_state *state = get_mod_state(mod);
+    pair_list_t *list = NULL;
+    if (AnyMultiDict_Check(state, md)) {
+        list = &((MultiDictObject *)md)->pairs;
+    } else if (PyObject_TypeCheck(md, state->MultiDictProxyType)) {
+        list = &((MultiDictProxyObject *)md)->md->pairs;
+    }
+    if (list != NULL && list->bytes_keys) {
+        PyErr_SetString(PyExc_TypeError, "pack() doesn't support bytes keys");
+        return NULL;
+    }
+    if (list != NULL) {
+        return shared_pack_list(list);
+    }
+    PyErr_Format(PyExc_TypeError,
+                 "pack() argument should be a multidict, not %.100s",
+                 Py_TYPE(md)->tp_name);
+    return NULL;
+}
+
+
+static inline Py_ssize_t
+shared_mp_len(SharedMultiDictObject *self)
+{
+    return (Py_ssize_t)self->count;
+}
+
+static inline PyObject *
+shared_mp_subscript(SharedMultiDictObject *self, PyObject *key)
+{
+    return _shared_getone(self, key, NULL);
+}
+
+static inline int
+shared_sq_contains(SharedMultiDictObject *self, PyObject *key)
+{
+    uint32_t index;
+    if (!PyUnicode_Check(key)) {
+        return 0;
+    }
+    return _shared_find(self, key, &index);
+}
+
+static inline PyObject *
+shared_tp_iter(SharedMultiDictObject *self)
+{
+    PyObject *keys = _shared_list(self, true, false);
+    if (keys == NULL) {
+        return NULL;
+    }
+    PyObject *ret = PyObject_GetIter(keys);
+    Py_DECREF(keys);
+    return ret;
+}
+
+static inline PyObject *
+shared_tp_repr(SharedMultiDictObject *self)
+{
+    PyObject *name = NULL;
+    PyObject *items = NULL;
+    PyUnicodeWriter *writer = NULL;
+
+    // values are str or bytes, no recursion is possible
+    name = PyObject_GetAttrString((PyObject *)Py_TYPE(self), "__name__");
+    if (name == NULL) {
+        goto fail;
+    }
+    items = _shared_list(self, true, true);
+    if (items == NULL) {
+        goto fail;
+    }
+    writer = PyUnicodeWriter_Create(1024);
+    if (writer == NULL) {
+        goto fail;
+    }
+    if (PyUnicodeWriter_WriteChar(writer, '<') < 0
+            || PyUnicodeWriter_WriteStr(writer, name) < 0
+            || PyUnicodeWriter_WriteChar(writer, '(') < 0) {
+        goto fail;
+    }
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(items); i++) {
+        PyObject *item = PyList_GET_ITEM(items, i);
+        if (i > 0 && (PyUnicodeWriter_WriteChar(writer, ',') < 0
+                      || PyUnicodeWriter_WriteChar(writer, ' ') < 0)) {
+            goto fail;
+        }
+        if (PyUnicodeWriter_WriteChar(writer, '\'') < 0
+                || PyUnicodeWriter_WriteStr(writer, PyTuple_GET_ITEM(item, 0)) < 0
+                || PyUnicodeWriter_WriteChar(writer, '\'') < 0
+                || PyUnicodeWriter_WriteChar(writer, ':') < 0
+                || PyUnicodeWriter_WriteChar(writer, ' ') < 0
+                || PyUnicodeWriter_WriteRepr(writer, PyTuple_GET_ITEM(item, 1)) < 0) {
+            goto fail;
+        }
+    }
+    if (PyUnicodeWriter_WriteChar(writer, ')') < 0
+            || PyUnicodeWriter_WriteChar(writer, '>') < 0) {
+        goto fail;
+    }
+    Py_DECREF(name);
+    Py_DECREF(items);
+    return PyUnicodeWriter_Finish(writer);
+fail:
+    Py_XDECREF(name);
+    Py_XDECREF(items);
+    if (writer != NULL) {
+        PyUnicodeWriter_Discard(writer);
+    }
+    return NULL;
+}
+
+
+static PyMethodDef shared_methods[] = {
+    {"pack", (PyCFunction)shared_pack, METH_O | METH_CLASS, shared_pack_doc},
+    {"getall", (PyCFunction)(void(*)(void))shared_getall,
+     METH_FASTCALL | METH_KEYWORDS, shared_getall_doc},
+    {"getone", (PyCFunction)(void(*)(void))shared_getone,
+     METH_FASTCALL | METH_KEYWORDS, shared_getone_doc},
+    {"get", (PyCFunction)(void(*)(void))shared_get,
+     METH_FASTCALL | METH_KEYWORDS, shared_get_doc},
+    {"keys", (PyCFunction)shared_keys, METH_NOARGS, shared_keys_doc},
+    {"values", (PyCFunction)shared_values, METH_NOARGS, shared_values_doc},
+    {"items", (PyCFunction)shared_items, METH_NOARGS, shared_items_doc},
+    {NULL, NULL}   /* sentinel */
+};
+
+static PyType_Slot shared_slots[] = {
+    {Py_tp_dealloc, shared_tp_dealloc},
+    {Py_tp_doc, (void *)shared__doc__},
+    {Py_tp_methods, shared_methods},
+    {Py_tp_new, shared_tp_new},
+    {Py_tp_iter, shared_tp_iter},
+    {Py_tp_repr, shared_tp_repr},
+    {Py_mp_length, shared_mp_len},
+    {Py_mp_subscript, shared_mp_subscript},
+    {Py_sq_contains, shared_sq_contains},
+    {0, NULL},
+};
+
+static PyType_Spec shared_spec = {
+    .name = "multidict._multidict.SharedMultiDict",
+    .basicsize = sizeof(SharedMultiDictObject),
+    .flags = (Py_TPFLAGS_DEFAULT
+#if PY_VERSION_HEX >= 0x030a00f0
+              | Py_TPFLAGS_IMMUTABLETYPE
+#endif
+              ),
+    .slots = shared_slots,
+};
+
+
+static inline int
+shared_init(PyObject *module, mod_state *state)
+{
+    PyObject *tmp = PyType_FromModuleAndSpec(module, &shared_spec, NULL);
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->SharedMultiDictType = (PyTypeObject *)tmp;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
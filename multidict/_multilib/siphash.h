@@ -0,0 +1,59 @@
+#ifndef _MULTIDICT_SIPHASH_H
+#define _MULTIDICT_SIPHASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Implementation note.
+SipHash-1-3 of a single 64-bit word, the same PRF CPython uses for str
+hashing.  The hash index of large pair lists mixes stored identity hashes
+with a per-process random key, so the slot of an identity cannot be
+predicted from the outside even if PyObject_Hash() values can be.
+*/
+
+#define _SIPHASH_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define _SIPHASH_ROUND(v0, v1, v2, v3)          \
+    do {                                        \
+        v0 += v1; v1 = _SIPHASH_ROTL(v1, 13);   \
+        v1 ^= v0; v0 = _SIPHASH_ROTL(v0, 32);   \
+        v2 += v3; v3 = _SIPHASH_ROTL(v3, 16);   \
+        v3 ^= v2;                               \
+        v0 += v3; v3 = _SIPHASH_ROTL(v3, 21);   \
+        v3 ^= v0;                               \
+        v2 += v1; v1 = _SIPHASH_ROTL(v1, 17);   \
+        v1 ^= v2; v2 = _SIPHASH_ROTL(v2, 32);   \
+    } while (0)
+
+static inline uint64_t
+siphash13_u64(const uint64_t key[2], uint64_t m)
+{
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+    // the last block holds the message length only
+    uint64_t b = (uint64_t)8 << 56;
+
+    v3 ^= m;
+    _SIPHASH_ROUND(v0, v1, v2, v3);
+    v0 ^= m;
+
+    v3 ^= b;
+    _SIPHASH_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    _SIPHASH_ROUND(v0, v1, v2, v3);
+    _SIPHASH_ROUND(v0, v1, v2, v3);
+    _SIPHASH_ROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -5,12 +5,28 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../multidict_api.h"
+#include "stats.h"
+
 /* State of the _multidict module */
 typedef struct {
     PyTypeObject *IStrType;
+    PyTypeObject *ArenaType;
+    PyTypeObject *SharedMultiDictType;
+    PyTypeObject *ChainMultiDictType;
+    PyTypeObject *BuilderType;
+    PyTypeObject *RawHeadersViewType;
 
     PyTypeObject *MultiDictType;
     PyTypeObject *CIMultiDictType;
+    PyTypeObject *BytesMultiDictType;
+    PyTypeObject *CIBytesMultiDictType;
+    // allocate exact multidicts of the smaller size classes, see dict.h
+    PyTypeObject *NoBufferLayoutType;
+    PyTypeObject *SmallLayoutType;
     PyTypeObject *MultiDictProxyType;
     PyTypeObject *CIMultiDictProxyType;
 
@@ -24,6 +40,22 @@ typedef struct {
 
     PyObject *str_lower;
     PyObject *str_canonical;
+
+    PyObject *arena_var;
+    Py_ssize_t active_arenas;
+
+    PyObject *trace_hook;
+    int64_t trace_threshold_ns;
+    Py_ssize_t trace_size_threshold;
+    bool trace_running;
+
+    uint64_t index_key[2];  // the per-process key of pair list hash indexes
+
+    MultiDict_CAPI capi;  // exported as the CAPI capsule
+
+#ifdef MULTIDICT_STATS
+    multidict_stats_t stats;
+#endif
 } mod_state;
 
 static inline mod_state *
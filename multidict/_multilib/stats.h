@@ -0,0 +1,51 @@
+#ifndef _MULTIDICT_STATS_H
+#define _MULTIDICT_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Implementation note.
+Runtime statistics are opt-in: build the extension with MULTIDICT_STATS
+defined (MULTIDICT_STATS=1 environment variable for setup.py) to collect
+them.  The counters live in the module state and are exposed by
+multidict._multidict.stats().  Without the flag the counting macros
+expand to nothing, the release build doesn't pay for them.
+*/
+
+#ifdef MULTIDICT_STATS
+
+typedef struct {
+    // constructions by the embedded buffer size class
+    uint64_t constructed_no_buffer;  // empty or reserved on the heap
+    uint64_t constructed_small;  // SMALL_EMBEDDED_CAPACITY pairs
+    uint64_t constructed_full;  // EMBEDDED_CAPACITY pairs
+
+    uint64_t spills;  // moves from the embedded buffer to the heap
+    uint64_t shrinks;
+
+    uint64_t lookups;
+    uint64_t signature_rejects;  // misses answered by the signature
+    uint64_t lookup_cache_hits;
+    uint64_t probes;  // pairs visited by lookups
+    uint64_t str_cmps;  // identity comparisons after a hash match
+    uint64_t hash_collisions;  // hash matched, identities are different
+
+    uint64_t ci_identities;  // str.lower() calls for CI identities
+    uint64_t istr_materializations;
+} multidict_stats_t;
+
+#define MULTIDICT_STATS_INC(state, name) ((state)->stats.name++)
+
+#else
+
+#define MULTIDICT_STATS_INC(state, name) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
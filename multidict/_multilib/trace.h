@@ -0,0 +1,105 @@
+#include "pythoncapi_compat.h"
+
+#ifndef _MULTIDICT_TRACE_H
+#define _MULTIDICT_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "state.h"
+
+/* Implementation note.
+multidict.set_trace_hook(threshold_ns, fn) installs a callback that is
+called as fn(operation, size, elapsed_ns) for pair list operations that
+take at least threshold_ns nanoseconds or run on a list with at least
+size_threshold items.
+
+pair_list entry points are wrapped with trace_start() / trace_stop().
+Without a hook trace_start() is a single well predicted check of the module
+state, trace_stop() is a check of the local returned by trace_start().
+The report itself lives in a separate non-inlined function.
+
+The hook is not traced recursively, exceptions raised by the hook are
+reported as unraisable, the exception of the traced operation is kept.
+*/
+
+static inline PyTime_t
+trace_start(mod_state *state)
+{
+    // Return the start time or 0 if there is no hook
+    PyTime_t now;
+    if (state->trace_hook == NULL) {
+        return 0;
+    }
+    if (PyTime_PerfCounter(&now) < 0) {
+        PyErr_Clear();
+        return 0;
+    }
+    return now;
+}
+
+
+static void
+_trace_report(mod_state *state, const char *operation,
+              Py_ssize_t size, PyTime_t start)
+{
+    PyObject *hook = state->trace_hook;
+    PyTime_t now;
+
+    if (hook == NULL || state->trace_running) {
+        return;
+    }
+
+#if PY_VERSION_HEX >= 0x030c0000
+    PyObject *exc = PyErr_GetRaisedException();
+#else
+    PyObject *exc_type, *exc_value, *exc_tb;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+#endif
+    if (PyTime_PerfCounter(&now) < 0) {
+        PyErr_Clear();
+        goto done;
+    }
+    int64_t elapsed = (int64_t)(now - start);
+    if (elapsed < state->trace_threshold_ns
+            && size < state->trace_size_threshold) {
+        goto done;
+    }
+
+    Py_INCREF(hook);
+    state->trace_running = true;
+    PyObject *ret = PyObject_CallFunction(hook, "snL", operation, size,
+                                          (long long)elapsed);
+    state->trace_running = false;
+    if (ret == NULL) {
+        PyErr_WriteUnraisable(hook);
+    }
+    Py_XDECREF(ret);
+    Py_DECREF(hook);
+done:
+#if PY_VERSION_HEX >= 0x030c0000
+    PyErr_SetRaisedException(exc);
+#else
+    PyErr_Restore(exc_type, exc_value, exc_tb);
+#endif
+}
+
+
+static inline void
+trace_stop(mod_state *state, const char *operation,
+           Py_ssize_t size, PyTime_t start)
+{
+    if (start == 0) {
+        return;
+    }
+    _trace_report(state, operation, size, start);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
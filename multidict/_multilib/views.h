@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include "dict.h"
+#include "iter.h"
 #include "pair_list.h"
 #include "state.h"
 
@@ -1091,7 +1092,7 @@ multidict_keysview_and1(_Multidict_ViewObject *self, PyObject *other)
         goto fail;
     }
     while ((key = PyIter_Next(iter))) {
-        if (!PyUnicode_Check(key)) {
+        if (!pair_list_is_key(&self->md->pairs, key)) {
             Py_CLEAR(key);
             continue;
         }
@@ -1138,7 +1139,7 @@ multidict_keysview_and2(_Multidict_ViewObject *self, PyObject *other)
         goto fail;
     }
     while ((key = PyIter_Next(iter))) {
-        if (!PyUnicode_Check(key)) {
+        if (!pair_list_is_key(&self->md->pairs, key)) {
             Py_CLEAR(key);
             continue;
         }
@@ -1207,7 +1208,7 @@ multidict_keysview_or1(_Multidict_ViewObject *self, PyObject *other)
         goto fail;
     }
     while ((key = PyIter_Next(iter))) {
-        if (!PyUnicode_Check(key)) {
+        if (!pair_list_is_key(&self->md->pairs, key)) {
             if (PySet_Add(ret, key) < 0) {
                 goto fail;
             }
@@ -1261,7 +1262,7 @@ multidict_keysview_or2(_Multidict_ViewObject *self, PyObject *other)
         goto fail;
     }
     while ((key = PyIter_Next(iter))) {
-        if (!PyUnicode_Check(key)) {
+        if (!pair_list_is_key(&self->md->pairs, key)) {
             Py_CLEAR(key);
             continue;
         }
@@ -1358,7 +1359,7 @@ multidict_keysview_sub1(_Multidict_ViewObject *self, PyObject *other)
         goto fail;
     }
     while ((key = PyIter_Next(iter))) {
-        if (!PyUnicode_Check(key)) {
+        if (!pair_list_is_key(&self->md->pairs, key)) {
             Py_CLEAR(key);
             continue;
         }
@@ -1406,7 +1407,7 @@ multidict_keysview_sub2(_Multidict_ViewObject *self, PyObject *other)
         goto fail;
     }
     while ((key = PyIter_Next(iter))) {
-        if (!PyUnicode_Check(key)) {
+        if (!pair_list_is_key(&self->md->pairs, key)) {
             Py_CLEAR(key);
             continue;
         }
@@ -0,0 +1,111 @@
+#ifndef _MULTIDICT_API_H
+#define _MULTIDICT_API_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* C API of multidict for other extensions.
+
+Usage:
+
+    #include "multidict_api.h"
+
+    MultiDict_CAPI *api = MultiDict_Import();
+    if (api == NULL) {
+        return -1;
+    }
+    PyObject *md = api->MultiDict_New(api->state, 1, 16);
+
+The header lives in the multidict package directory.  All functions take
+api->state as the first argument and follow the CPython conventions:
+NULL or -1 is returned with an exception set on failure.
+
+The structure is append-only: new functions are added at the end and
+bump MULTIDICT_CAPI_VERSION, MultiDict_Import() checks that the installed
+multidict provides at least the version the caller was compiled with.
+*/
+
+#define MULTIDICT_CAPSULE_NAME "multidict._multidict.CAPI"
+#define MULTIDICT_CAPI_VERSION 2
+
+// Builder_NewEx() flags
+#define MULTIDICT_BUILDER_LAZY_VALUES 0x1  // decode values on first access
+
+typedef struct {
+    int version;
+    void *state;
+
+    // Borrowed references to the classes
+    PyTypeObject *(*MultiDict_GetType)(void *state);
+    PyTypeObject *(*CIMultiDict_GetType)(void *state);
+    PyTypeObject *(*MultiDictProxy_GetType)(void *state);
+    PyTypeObject *(*CIMultiDictProxy_GetType)(void *state);
+
+    // Create an empty MultiDict (CIMultiDict if ci is not zero)
+    // with room for capacity items
+    PyObject *(*MultiDict_New)(void *state, int ci, Py_ssize_t capacity);
+
+    // Append a pair, key must be str
+    int (*MultiDict_Add)(void *state, PyObject *md,
+                         PyObject *key, PyObject *value);
+
+    // Append a pair with a precomputed identity and hash.
+    // identity must be an exact str equal to key for case-sensitive
+    // multidicts or key.lower() for case-insensitive ones,
+    // hash must be hash(identity).
+    int (*MultiDict_AddWithHash)(void *state, PyObject *md,
+                                 PyObject *identity, Py_hash_t hash,
+                                 PyObject *key, PyObject *value);
+
+    // Look up the first value of the UTF-8 encoded key in a multidict
+    // or a proxy.  Return 1 and a new reference in *result,
+    // 0 if the key is missing.
+    int (*MultiDict_GetOne)(void *state, PyObject *md,
+                            const char *key, Py_ssize_t size,
+                            PyObject **result);
+
+    // Iterate over pairs of a multidict or a proxy like PyDict_Next():
+    // *pos starts from 0, *key and *value are borrowed references,
+    // either pointer may be NULL.  Return 0 at the end.
+    // The multidict must not be changed during the iteration.
+    // Keys are returned as stored, istr is not created for
+    // case-insensitive multidicts.
+    int (*MultiDict_Next)(void *state, PyObject *md, Py_ssize_t *pos,
+                          PyObject **key, PyObject **value);
+
+    // Return a read-only proxy of the matching kind
+    PyObject *(*MultiDictProxy_New)(void *state, PyObject *md);
+
+    // CIMultiDictBuilder: collect raw headers and build a CIMultiDict
+    PyObject *(*Builder_New)(void *state, Py_ssize_t size_hint);
+    int (*Builder_AddRaw)(void *state, PyObject *builder,
+                          const char *name, Py_ssize_t name_size,
+                          const char *value, Py_ssize_t value_size);
+    PyObject *(*Builder_Build)(void *state, PyObject *builder);
+
+    // Version 2
+
+    // Builder_New() with MULTIDICT_BUILDER_LAZY_VALUES and other flags
+    PyObject *(*Builder_NewEx)(void *state, Py_ssize_t size_hint, int flags);
+} MultiDict_CAPI;
+
+
+static inline MultiDict_CAPI *
+MultiDict_Import(void)
+{
+    MultiDict_CAPI *api = (MultiDict_CAPI *)PyCapsule_Import(
+        MULTIDICT_CAPSULE_NAME, 0);
+    if (api != NULL && api->version < MULTIDICT_CAPI_VERSION) {
+        PyErr_Format(PyExc_ImportError,
+                     "multidict C API version %d is required, %d is installed",
+                     MULTIDICT_CAPI_VERSION, api->version);
+        return NULL;
+    }
+    return api;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
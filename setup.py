@@ -23,11 +23,17 @@ if platform.system() != "Windows":
         ]
     )
 
+# Opt-in runtime counters, see multidict._multidict.stats()
+DEFINE_MACROS = []
+if os.environ.get("MULTIDICT_STATS"):
+    DEFINE_MACROS.append(("MULTIDICT_STATS", "1"))
+
 extensions = [
     Extension(
         "multidict._multidict",
         ["multidict/_multidict.c"],
         extra_compile_args=CFLAGS,
+        define_macros=DEFINE_MACROS,
     ),
 ]
 
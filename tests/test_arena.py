@@ -0,0 +1,109 @@
+from types import ModuleType
+
+import pytest
+
+from multidict import MultiDict
+
+
+@pytest.fixture
+def arena_class(multidict_module: ModuleType) -> type:
+    return multidict_module.MultiDictArena  # type: ignore[no-any-return]
+
+
+def test_items_outlive_arena(
+    any_multidict_class: type[MultiDict[int]],
+    arena_class: type,
+) -> None:
+    with arena_class():
+        small = any_multidict_class(a=1)
+        large = any_multidict_class((str(i), i) for i in range(100))
+        large.add("x", 100)
+        dropped = any_multidict_class((str(i), i) for i in range(1000))
+        del dropped
+
+    assert small == {"a": 1}
+    assert len(large) == 101
+    assert large.getall("x") == [100]
+    assert list(large.values()) == list(range(101))
+
+
+def test_grow_after_close(
+    any_multidict_class: type[MultiDict[int]],
+    arena_class: type,
+) -> None:
+    with arena_class():
+        md = any_multidict_class(a=1)
+        large = any_multidict_class((str(i), i) for i in range(100))
+
+    for i in range(200):
+        md.add(str(i), i)
+        large.add(str(i), i)
+    for i in range(100):
+        del large[str(i)]
+
+    assert len(md) == 201
+    assert md["199"] == 199
+    assert list(large.items()) == [(str(i), i) for i in range(100, 200)]
+
+
+def test_copy_and_update_in_arena(
+    any_multidict_class: type[MultiDict[int]],
+    arena_class: type,
+) -> None:
+    src = any_multidict_class((str(i), i) for i in range(50))
+    with arena_class():
+        copy = src.copy()
+        copy.update((str(i), -i) for i in range(25, 75))
+        copy.extend(src)
+    assert len(copy) == 125
+    assert copy.getall("30") == [-30, 30]
+    assert src.copy() == src
+
+
+def test_close_inside_block(
+    any_multidict_class: type[MultiDict[int]],
+    arena_class: type,
+) -> None:
+    with arena_class() as arena:
+        md = any_multidict_class((str(i), i) for i in range(100))
+        arena.close()
+        md.add("x", 1)
+        created_after = any_multidict_class((str(i), i) for i in range(100))
+    assert len(md) == 101
+    assert len(created_after) == 100
+
+
+def test_nested_arenas(
+    any_multidict_class: type[MultiDict[int]],
+    arena_class: type,
+) -> None:
+    with arena_class():
+        outer = any_multidict_class(a=1)
+        with arena_class():
+            inner = any_multidict_class((str(i), i) for i in range(100))
+        for i in range(100):
+            outer.add(str(i), i)
+            inner.add(str(i), i)
+    assert len(outer) == 101
+    assert len(inner) == 200
+
+
+def test_reenter_active(arena_class: type) -> None:
+    arena = arena_class()
+    with arena:
+        with pytest.raises(RuntimeError, match="already active"):
+            arena.__enter__()
+
+
+def test_reenter_closed(arena_class: type) -> None:
+    arena = arena_class()
+    with arena:
+        pass
+    with pytest.raises(RuntimeError, match="closed"):
+        arena.__enter__()
+    arena.close()
+
+
+def test_no_args(arena_class: type) -> None:
+    with pytest.raises(TypeError):
+        arena_class(1)
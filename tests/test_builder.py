@@ -0,0 +1,234 @@
+import pickle
+import threading
+from collections.abc import Callable
+from types import ModuleType
+
+import pytest
+
+from multidict import CIMultiDict, CIMultiDictBuilder
+
+
+@pytest.fixture
+def builder_class(multidict_module: ModuleType) -> type[CIMultiDictBuilder]:
+    return multidict_module.CIMultiDictBuilder  # type: ignore[no-any-return]
+
+
+def test_build(
+    builder_class: type[CIMultiDictBuilder], multidict_module: ModuleType
+) -> None:
+    builder = builder_class()
+    builder.add(b"Host", b"example.com")
+    builder.add(bytearray(b"content-type"), memoryview(b"xtext/html")[1:])
+    builder.add(b"Set-Cookie", b"a=1")
+    builder.add(b"SET-COOKIE", b"b=2")
+    assert len(builder) == 4
+
+    md = builder.build()
+    assert type(md) is multidict_module.CIMultiDict
+    assert list(md.items()) == [
+        ("Host", "example.com"),
+        ("content-type", "text/html"),
+        ("Set-Cookie", "a=1"),
+        ("SET-COOKIE", "b=2"),
+    ]
+    assert md["HOST"] == "example.com"
+    assert md.getall("set-cookie") == ["a=1", "b=2"]
+    md.add("X-New", "1")
+    assert md["x-new"] == "1"
+
+
+def test_reuse(builder_class: type[CIMultiDictBuilder]) -> None:
+    builder = builder_class(size_hint=10)
+    builder.add(b"A", b"1")
+    first = builder.build()
+    assert len(builder) == 0
+    builder.add(b"B", b"2")
+    second = builder.build()
+    assert list(first.items()) == [("A", "1")]
+    assert list(second.items()) == [("B", "2")]
+    assert len(builder.build()) == 0
+
+
+def test_clear(builder_class: type[CIMultiDictBuilder]) -> None:
+    builder = builder_class()
+    builder.add(b"A", b"1")
+    builder.clear()
+    assert len(builder) == 0
+    assert len(builder.build()) == 0
+
+
+def test_decoding(builder_class: type[CIMultiDictBuilder]) -> None:
+    builder = builder_class()
+    builder.add("Ünïcode".encode(), "välue".encode())
+    builder.add(b"X-Raw", b"\xff\xfe")
+    md = builder.build()
+    assert md["ÜNÏCODE"] == "välue"
+    assert md["x-raw"] == "\udcff\udcfe"
+    assert md["x-raw"].encode("utf-8", "surrogateescape") == b"\xff\xfe"
+
+
+def test_empty_first_header(builder_class: type[CIMultiDictBuilder]) -> None:
+    # nothing is copied before the data buffer exists
+    builder = builder_class()
+    builder.add(b"", b"")
+    builder.add(b"A", b"")
+    assert list(builder.build().items()) == [("", ""), ("A", "")]
+
+
+def test_many_headers(builder_class: type[CIMultiDictBuilder]) -> None:
+    builder = builder_class()
+    for i in range(1000):
+        builder.add(f"X-Header-{i % 100}".encode(), str(i).encode())
+    md = builder.build()
+    assert len(md) == 1000
+    assert md.getall("x-header-7") == [str(i) for i in range(7, 1000, 100)]
+
+
+def test_invalid_args(builder_class: type[CIMultiDictBuilder]) -> None:
+    builder = builder_class()
+    with pytest.raises(TypeError):
+        builder.add("name", b"value")  # type: ignore[arg-type]
+    with pytest.raises(TypeError):
+        builder.add(b"name")  # type: ignore[call-arg]
+    with pytest.raises(ValueError):
+        builder_class(-1)
+    assert len(builder) == 0
+
+
+def _lazy(builder_class: type[CIMultiDictBuilder]) -> CIMultiDict[str]:
+    builder = builder_class(lazy_values=True)
+    builder.add(b"Host", b"example.com")
+    builder.add(b"X-Raw", b"\xff\xfe")
+    builder.add(b"Set-Cookie", b"a=1")
+    builder.add(b"Set-Cookie", b"b=2")
+    builder.add(b"X-Empty", b"")
+    return builder.build()
+
+
+LAZY_ITEMS = [
+    ("Host", "example.com"),
+    ("X-Raw", "\udcff\udcfe"),
+    ("Set-Cookie", "a=1"),
+    ("Set-Cookie", "b=2"),
+    ("X-Empty", ""),
+]
+
+
+def test_lazy_values(
+    builder_class: type[CIMultiDictBuilder], multidict_module: ModuleType
+) -> None:
+    md = _lazy(builder_class)
+    assert md["host"] == "example.com"
+    assert md.get("x-raw") == "\udcff\udcfe"
+    assert md.getall("set-cookie") == ["a=1", "b=2"]
+    assert list(md.items()) == LAZY_ITEMS
+    assert list(md.values()) == [v for k, v in LAZY_ITEMS]
+    assert ("X-Empty", "") in md.items()
+    assert "" in md.values()
+    assert md == multidict_module.CIMultiDict(LAZY_ITEMS)
+    assert multidict_module.CIMultiDict(LAZY_ITEMS) == md
+    assert repr(md) == repr(multidict_module.CIMultiDict(LAZY_ITEMS))
+
+
+def test_lazy_values_pop(builder_class: type[CIMultiDictBuilder]) -> None:
+    md = _lazy(builder_class)
+    assert md.popone("host") == "example.com"
+    assert md.popall("set-cookie") == ["a=1", "b=2"]
+    assert md.popitem() == ("X-Empty", "")
+    assert md.popmany(["x-raw"]) == [("X-Raw", "\udcff\udcfe")]
+    assert len(md) == 0
+
+
+@pytest.mark.parametrize(
+    "store",
+    [
+        lambda md: md.add("X-Bytes", b"raw"),
+        lambda md: md.__setitem__("X-Bytes", b"raw"),
+        lambda md: md.update({"X-Bytes": b"raw"}),
+        lambda md: md.extend({"X-Bytes": b"raw"}),
+        lambda md: md.setdefault("X-Bytes", b"raw"),
+        lambda md: md.add_many(["X-Bytes"], [b"raw"]),
+    ],
+)
+def test_lazy_values_store_bytes(
+    builder_class: type[CIMultiDictBuilder],
+    store: Callable[[CIMultiDict[object]], object],
+) -> None:
+    md = _lazy(builder_class)
+    store(md)  # type: ignore[arg-type]
+    assert md["x-bytes"] == b"raw"
+    assert list(md.items()) == LAZY_ITEMS + [("X-Bytes", b"raw")]
+
+    md = _lazy(builder_class)
+    md["Host"] = b"raw"
+    assert list(md.values()) == [b"raw"] + [v for k, v in LAZY_ITEMS[1:]]
+
+
+def test_lazy_values_copies(
+    builder_class: type[CIMultiDictBuilder], multidict_module: ModuleType
+) -> None:
+    md = _lazy(builder_class)
+    copy = md.copy()
+    copy.add("X-Bytes", b"raw")
+    assert list(copy.items()) == LAZY_ITEMS + [("X-Bytes", b"raw")]
+
+    extended = multidict_module.CIMultiDict([("X-Bytes", b"raw")])
+    extended.extend(md)
+    assert list(extended.items()) == [("X-Bytes", b"raw")] + LAZY_ITEMS
+
+    dropped = md.partition(lambda k, v: k != "Set-Cookie")
+    assert dropped.getall("set-cookie") == ["a=1", "b=2"]
+    dropped.add("X-Bytes", b"raw")
+    assert dropped["x-bytes"] == b"raw"
+
+    md = _lazy(builder_class)
+    chain = multidict_module.ChainMultiDict(md)
+    chain.add("X-Bytes", b"raw")
+    assert chain.copy().getall("set-cookie") == ["a=1", "b=2"]
+    assert chain.copy()["x-bytes"] == b"raw"
+    assert list(chain.items()) == LAZY_ITEMS + [("X-Bytes", b"raw")]
+    # bytes in the place of an overridden key
+    chain["Host"] = b"host"
+    assert list(chain.items()) == [("Host", b"host")] + LAZY_ITEMS[1:] + [
+        ("X-Bytes", b"raw")
+    ]
+
+    del md["x-raw"]
+    shared = multidict_module.SharedMultiDict
+    assert list(shared(shared.pack(md)).items()) == list(md.items())
+
+
+def test_lazy_values_concurrent_reads(
+    builder_class: type[CIMultiDictBuilder],
+) -> None:
+    expected = [f"value{i}" for i in range(200)]
+    results = []
+
+    def read(md: CIMultiDict[str], barrier: threading.Barrier) -> None:
+        barrier.wait()
+        results.append(md.getall("x-header"))
+        results.append(md.copy().getall("x-header"))
+
+    for _ in range(20):
+        builder = builder_class(lazy_values=True)
+        for value in expected:
+            builder.add(b"X-Header", value.encode())
+        md = builder.build()
+        barrier = threading.Barrier(4)
+        threads = [
+            threading.Thread(target=read, args=(md, barrier)) for _ in range(4)
+        ]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+    assert results == [expected] * 160
+
+
+@pytest.mark.parametrize("proto", range(pickle.HIGHEST_PROTOCOL + 1))
+def test_lazy_values_pickle(
+    builder_class: type[CIMultiDictBuilder], proto: int
+) -> None:
+    md = _lazy(builder_class)
+    assert list(pickle.loads(pickle.dumps(md, proto)).items()) == LAZY_ITEMS
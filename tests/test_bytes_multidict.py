@@ -0,0 +1,204 @@
+import copy
+import pickle
+from types import ModuleType
+
+import pytest
+
+from multidict import (
+    BytesMultiDict,
+    CIBytesMultiDict,
+    MultiMapping,
+    MutableMultiMapping,
+)
+
+
+@pytest.fixture(params=["BytesMultiDict", "CIBytesMultiDict"])
+def bytes_multidict_class(
+    request: pytest.FixtureRequest, multidict_module: ModuleType
+) -> type[BytesMultiDict[object]]:
+    return getattr(multidict_module, request.param)  # type: ignore[no-any-return]
+
+
+@pytest.fixture
+def ci_bytes_multidict_class(
+    multidict_module: ModuleType,
+) -> type[CIBytesMultiDict[object]]:
+    return multidict_module.CIBytesMultiDict  # type: ignore[no-any-return]
+
+
+def test_basic(bytes_multidict_class: type[BytesMultiDict[object]]) -> None:
+    md = bytes_multidict_class([(b"a", 1), (b"b", 2)])
+    md.add(b"a", 3)
+    assert len(md) == 3
+    assert md[b"a"] == 1
+    assert md.getall(b"a") == [1, 3]
+    assert md.get(b"missing") is None
+    assert b"b" in md
+    assert "b" not in md
+    assert list(md) == [b"a", b"b", b"a"]
+    assert list(md.items()) == [(b"a", 1), (b"b", 2), (b"a", 3)]
+    assert list(md.values()) == [1, 2, 3]
+    assert isinstance(md, MutableMultiMapping)
+
+    md[b"a"] = 4
+    assert list(md.items()) == [(b"a", 4), (b"b", 2)]
+    assert md.setdefault(b"c", 5) == 5
+    assert md.popone(b"b") == 2
+    assert md.popall(b"c") == [5]
+    assert md.popitem() == (b"a", 4)
+    assert len(md) == 0
+    with pytest.raises(KeyError):
+        md[b"a"]
+
+
+def test_not_a_multidict(
+    bytes_multidict_class: type[BytesMultiDict[object]],
+    multidict_module: ModuleType,
+) -> None:
+    md = bytes_multidict_class([(b"a", 1)])
+    assert isinstance(md, MultiMapping)
+    assert isinstance(md, MutableMultiMapping)
+    assert not isinstance(md, multidict_module.MultiDict)
+    assert not issubclass(bytes_multidict_class, multidict_module.MultiDict)
+    assert issubclass(
+        multidict_module.CIBytesMultiDict, multidict_module.BytesMultiDict
+    )
+
+
+def test_case_sensitive(multidict_module: ModuleType) -> None:
+    md = multidict_module.BytesMultiDict([(b"Host", 1)])
+    assert b"host" not in md
+    md.add(b"host", 2)
+    assert md.getall(b"Host") == [1]
+
+
+def test_case_insensitive(
+    ci_bytes_multidict_class: type[CIBytesMultiDict[object]],
+) -> None:
+    md = ci_bytes_multidict_class([(b"Content-Type", 1), (b"CONTENT-TYPE", 2)])
+    assert md.getall(b"content-type") == [1, 2]
+    assert list(md.keys()) == [b"Content-Type", b"CONTENT-TYPE"]
+    md[b"content-TYPE"] = 3
+    assert list(md.items()) == [(b"content-TYPE", 3)]
+    assert b"CoNtEnT-tYpE" in md
+    assert b"CoNtEnT-tYpE" in md.keys()
+
+
+def test_ascii_folding_only(
+    ci_bytes_multidict_class: type[CIBytesMultiDict[object]],
+) -> None:
+    md = ci_bytes_multidict_class([("X-Ü".encode(), 1), (b"X-\xff", 2)])
+    assert md["x-Ü".encode()] == 1
+    assert "x-ü".encode() not in md
+    assert md[b"x-\xff"] == 2
+
+
+def test_bytes_subclass_key(
+    bytes_multidict_class: type[BytesMultiDict[object]],
+) -> None:
+    class MyBytes(bytes):
+        pass
+
+    md = bytes_multidict_class([(MyBytes(b"a"), 1)])
+    assert md[b"a"] == 1
+    assert md[MyBytes(b"a")] == 1
+    assert type(list(md)[0]) is MyBytes
+
+
+def test_type_errors(
+    bytes_multidict_class: type[BytesMultiDict[object]],
+    multidict_module: ModuleType,
+) -> None:
+    md = bytes_multidict_class()
+    with pytest.raises(TypeError, match="keys should be either bytes"):
+        md.add("a", 1)  # type: ignore[arg-type]
+    with pytest.raises(TypeError, match="keys should be either bytes"):
+        md["a"]  # type: ignore[index]
+    with pytest.raises(TypeError, match="keys should be either bytes"):
+        bytes_multidict_class(a=1)
+    with pytest.raises(TypeError, match="keys should be either bytes"):
+        md.update(multidict_module.MultiDict(a=1))
+    with pytest.raises(TypeError):
+        multidict_module.MultiDict(bytes_multidict_class([(b"a", 1)]))
+    with pytest.raises(TypeError):
+        multidict_module.CIMultiDict().extend(bytes_multidict_class([(b"a", 1)]))
+
+
+def test_unsupported(
+    bytes_multidict_class: type[BytesMultiDict[object]],
+    multidict_module: ModuleType,
+) -> None:
+    md = bytes_multidict_class([(b"a", 1)])
+    with pytest.raises(TypeError, match="bytes keys"):
+        multidict_module.MultiDictProxy(md)
+    with pytest.raises(TypeError):
+        multidict_module.CIMultiDictProxy(md)
+    with pytest.raises(TypeError, match="bytes keys"):
+        multidict_module.ChainMultiDict(md)
+    with pytest.raises(TypeError, match="bytes keys"):
+        multidict_module.SharedMultiDict.pack(md)
+
+
+def test_repr(bytes_multidict_class: type[BytesMultiDict[object]]) -> None:
+    md = bytes_multidict_class([(b"a", 1), (b"b'", b"x")])
+    name = bytes_multidict_class.__name__
+    assert repr(md) == f"<{name}(b'a': 1, b\"b'\": b'x')>"
+    assert repr(md.keys()) == "<_KeysView(b'a', b\"b'\")>"
+    assert repr(md.items()) == "<_ItemsView(b'a': 1, b\"b'\": b'x')>"
+
+
+def test_eq(
+    bytes_multidict_class: type[BytesMultiDict[object]],
+    multidict_module: ModuleType,
+) -> None:
+    md = bytes_multidict_class([(b"a", 1), (b"b", 2)])
+    assert md == bytes_multidict_class([(b"a", 1), (b"b", 2)])
+    assert md != bytes_multidict_class([(b"b", 2), (b"a", 1)])
+    assert md == {b"a": 1, b"b": 2}
+    assert md != multidict_module.MultiDict(a=1, b=2)
+
+
+def test_copy_and_pickle(bytes_multidict_class: type[BytesMultiDict[object]]) -> None:
+    md = bytes_multidict_class([(b"a", 1), (b"A", 2)])
+    for other in (md.copy(), copy.copy(md), pickle.loads(pickle.dumps(md))):
+        assert type(other) is bytes_multidict_class
+        assert list(other.items()) == list(md.items())
+        assert other == md
+
+
+def test_extend_from_bytes_multidict(
+    multidict_module: ModuleType,
+) -> None:
+    cs = multidict_module.BytesMultiDict([(b"A", 1), (b"a", 2)])
+    ci = multidict_module.CIBytesMultiDict(cs)
+    assert ci.getall(b"a") == [1, 2]
+    ci.extend(cs)
+    assert len(ci) == 4
+    cs.update(multidict_module.CIBytesMultiDict([(b"A", 3)]))
+    assert list(cs.items()) == [(b"A", 3), (b"a", 2)]
+
+
+def test_keys_view_set_ops(bytes_multidict_class: type[BytesMultiDict[object]]) -> None:
+    md = bytes_multidict_class([(b"a", 1), (b"b", 2)])
+    assert md.keys() & {b"a", "b"} == {b"a"}
+    assert md.keys() - {b"a"} == {b"b"}
+    assert md.keys() | {"c"} == {b"a", b"b", "c"}
+    assert not md.keys().isdisjoint([b"b"])
+    assert md.keys().isdisjoint(["b"])
+
+
+def test_retain_prefix(bytes_multidict_class: type[BytesMultiDict[object]]) -> None:
+    md = bytes_multidict_class([(b"x-a", 1), (b"y", 2), (b"x-b", 3)])
+    md.retain_prefix((b"x-", b"z"))
+    assert list(md.items()) == [(b"x-a", 1), (b"x-b", 3)]
+    md.retain_prefix(b"x-a", invert=True)
+    assert list(md.items()) == [(b"x-b", 3)]
+
+
+def test_many_keys(bytes_multidict_class: type[BytesMultiDict[object]]) -> None:
+    md = bytes_multidict_class((b"Key-%d" % i, i) for i in range(1000))
+    for i in range(0, 1000, 3):
+        del md[b"Key-%d" % i]
+    for i in range(1000):
+        assert md.get(b"Key-%d" % i) == (None if i % 3 == 0 else i)
+    assert len(md) == 666
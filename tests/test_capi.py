@@ -0,0 +1,216 @@
+import ctypes
+from pathlib import Path
+from types import ModuleType
+from typing import TYPE_CHECKING, Any
+
+import pytest
+
+import multidict
+
+if TYPE_CHECKING:
+    from conftest import MultidictImplementation
+
+P = ctypes.py_object
+S = ctypes.c_ssize_t
+V = ctypes.c_void_p
+F = ctypes.PYFUNCTYPE
+
+
+class CAPI(ctypes.Structure):
+    """Mirror of MultiDict_CAPI from multidict_api.h."""
+
+    _fields_ = [
+        ("version", ctypes.c_int),
+        ("state", V),
+        ("MultiDict_GetType", F(V, V)),
+        ("CIMultiDict_GetType", F(V, V)),
+        ("MultiDictProxy_GetType", F(V, V)),
+        ("CIMultiDictProxy_GetType", F(V, V)),
+        ("MultiDict_New", F(P, V, ctypes.c_int, S)),
+        ("MultiDict_Add", F(ctypes.c_int, V, P, P, P)),
+        ("MultiDict_AddWithHash", F(ctypes.c_int, V, P, P, S, P, P)),
+        (
+            "MultiDict_GetOne",
+            F(ctypes.c_int, V, P, ctypes.c_char_p, S, ctypes.POINTER(V)),
+        ),
+        (
+            "MultiDict_Next",
+            F(
+                ctypes.c_int,
+                V,
+                P,
+                ctypes.POINTER(S),
+                ctypes.POINTER(V),
+                ctypes.POINTER(V),
+            ),
+        ),
+        ("MultiDictProxy_New", F(P, V, P)),
+        ("Builder_New", F(P, V, S)),
+        (
+            "Builder_AddRaw",
+            F(ctypes.c_int, V, P, ctypes.c_char_p, S, ctypes.c_char_p, S),
+        ),
+        ("Builder_Build", F(P, V, P)),
+        ("Builder_NewEx", F(P, V, S, ctypes.c_int)),
+    ]
+
+
+@pytest.fixture
+def c_module(
+    multidict_module: ModuleType,
+    multidict_implementation: "MultidictImplementation",
+) -> ModuleType:
+    if multidict_implementation.is_pure_python:
+        pytest.skip("the C API is provided by the C extension only")
+    return multidict_module
+
+
+@pytest.fixture
+def api(c_module: ModuleType) -> Any:
+    get_pointer = ctypes.pythonapi.PyCapsule_GetPointer
+    get_pointer.restype = V
+    get_pointer.argtypes = [P, ctypes.c_char_p]
+    ptr = get_pointer(c_module.CAPI, b"multidict._multidict.CAPI")
+    return ctypes.cast(ptr, ctypes.POINTER(CAPI)).contents
+
+
+def _steal(ptr: V) -> object:
+    # Turn a new reference returned through a pointer into an object
+    ret = ctypes.cast(ptr, P).value
+    ctypes.pythonapi.Py_DecRef(ptr)
+    return ret
+
+
+def test_get_include() -> None:
+    path = Path(multidict.get_include()) / "multidict_api.h"
+    assert path.is_file()
+    assert "MultiDict_Import" in path.read_text()
+
+
+def test_version(api: Any) -> None:
+    assert api.version == 2
+
+
+def test_types(api: Any, c_module: ModuleType) -> None:
+    assert api.MultiDict_GetType(api.state) == id(c_module.MultiDict)
+    assert api.CIMultiDict_GetType(api.state) == id(c_module.CIMultiDict)
+    assert api.MultiDictProxy_GetType(api.state) == id(c_module.MultiDictProxy)
+    assert api.CIMultiDictProxy_GetType(api.state) == id(c_module.CIMultiDictProxy)
+
+
+def test_new_add_get(api: Any, c_module: ModuleType) -> None:
+    md = api.MultiDict_New(api.state, 1, 10)
+    assert type(md) is c_module.CIMultiDict
+    assert api.MultiDict_Add(api.state, md, "Host", "example.com") == 0
+    assert api.MultiDict_AddWithHash(api.state, md, "x-a", hash("x-a"), "X-A", 1) == 0
+    assert list(md.items()) == [("Host", "example.com"), ("X-A", 1)]
+    assert md["x-a"] == 1
+
+    result = V()
+    assert api.MultiDict_GetOne(api.state, md, b"HOST", 4, ctypes.byref(result)) == 1
+    assert _steal(result) == "example.com"
+    assert api.MultiDict_GetOne(api.state, md, b"missing", 7, ctypes.byref(result)) == 0
+    assert not result
+
+
+def test_add_with_hash_case_sensitive(api: Any, c_module: ModuleType) -> None:
+    md = api.MultiDict_New(api.state, 0, 0)
+    assert type(md) is c_module.MultiDict
+    key = c_module.istr("Key")
+    assert api.MultiDict_AddWithHash(api.state, md, "Key", hash("Key"), key, 1) == 0
+    assert md["Key"] == 1
+    assert list(md.keys())[0] is key
+
+
+def test_next(api: Any, c_module: ModuleType) -> None:
+    md = c_module.MultiDict([("a", 1), ("b", 2), ("a", 3)])
+    proxy = api.MultiDictProxy_New(api.state, md)
+    assert type(proxy) is c_module.MultiDictProxy
+
+    pos = S(0)
+    key = V()
+    value = V()
+    items = []
+    while api.MultiDict_Next(
+        api.state, proxy, ctypes.byref(pos), ctypes.byref(key), ctypes.byref(value)
+    ):
+        items.append((ctypes.cast(key, P).value, ctypes.cast(value, P).value))
+    assert items == [("a", 1), ("b", 2), ("a", 3)]
+    assert pos.value == 3
+
+
+def test_next_after_removals(api: Any, c_module: ModuleType) -> None:
+    md = c_module.MultiDict((str(i), i) for i in range(100))
+    for i in range(0, 99, 3):
+        md.popone(str(i))
+
+    pos = S(0)
+    value = V()
+    values = []
+    while api.MultiDict_Next(
+        api.state, md, ctypes.byref(pos), None, ctypes.byref(value)
+    ):
+        values.append(ctypes.cast(value, P).value)
+    assert values == [i for i in range(100) if i % 3 != 0 or i == 99]
+
+
+def test_proxy_kind(api: Any, c_module: ModuleType) -> None:
+    md = c_module.CIMultiDict(a=1)
+    proxy = api.MultiDictProxy_New(api.state, md)
+    assert type(proxy) is c_module.CIMultiDictProxy
+    assert proxy["A"] == 1
+
+
+def test_builder(api: Any, c_module: ModuleType) -> None:
+    builder = api.Builder_New(api.state, 4)
+    assert type(builder) is c_module.CIMultiDictBuilder
+    assert api.Builder_AddRaw(api.state, builder, b"Host", 4, b"example.com", 11) == 0
+    assert api.Builder_AddRaw(api.state, builder, b"X-Ab", 3, b"12", 1) == 0
+    md = api.Builder_Build(api.state, builder)
+    assert type(md) is c_module.CIMultiDict
+    assert list(md.items()) == [("Host", "example.com"), ("X-A", "1")]
+
+
+def test_builder_lazy_values(api: Any, c_module: ModuleType) -> None:
+    builder = api.Builder_NewEx(api.state, 4, 1)
+    assert type(builder) is c_module.CIMultiDictBuilder
+    assert api.Builder_AddRaw(api.state, builder, b"Host", 4, b"example.com", 11) == 0
+    assert api.Builder_AddRaw(api.state, builder, b"X-A", 3, b"\xff", 1) == 0
+    md = api.Builder_Build(api.state, builder)
+    result = V()
+    assert api.MultiDict_GetOne(api.state, md, b"host", 4, ctypes.byref(result)) == 1
+    assert _steal(result) == "example.com"
+    assert list(md.items()) == [("Host", "example.com"), ("X-A", "\udcff")]
+    with pytest.raises(ValueError, match="unknown builder flags"):
+        api.Builder_NewEx(api.state, 0, 2)
+
+
+def test_type_errors(api: Any, c_module: ModuleType) -> None:
+    proxy = c_module.MultiDictProxy(c_module.MultiDict())
+    with pytest.raises(TypeError, match="a multidict is required"):
+        api.MultiDict_Add(api.state, proxy, "a", 1)
+    with pytest.raises(TypeError, match="a multidict or proxy is required"):
+        api.MultiDict_GetOne(api.state, {}, b"a", 1, ctypes.byref(V()))
+    with pytest.raises(TypeError):
+        api.MultiDict_AddWithHash(api.state, c_module.MultiDict(), 1, 1, "a", 1)
+    with pytest.raises(TypeError, match="CIMultiDictBuilder is required"):
+        api.Builder_Build(api.state, c_module.CIMultiDict())
+    with pytest.raises(ValueError):
+        api.MultiDict_New(api.state, 0, -1)
+
+
+@pytest.mark.parametrize("cls", ["BytesMultiDict", "CIBytesMultiDict"])
+def test_bytes_keys_rejected(api: Any, c_module: ModuleType, cls: str) -> None:
+    md = getattr(c_module, cls)([(b"abc", 1)])
+    with pytest.raises(TypeError, match="a multidict is required"):
+        api.MultiDict_AddWithHash(api.state, md, "abc", hash("abc"), "abc", 1)
+    with pytest.raises(TypeError, match="a multidict is required"):
+        api.MultiDict_Add(api.state, md, "abc", 1)
+    with pytest.raises(TypeError, match="a multidict or proxy is required"):
+        api.MultiDict_GetOne(api.state, md, b"abc", 3, ctypes.byref(V()))
+    pos = S(0)
+    with pytest.raises(TypeError, match="a multidict or proxy is required"):
+        api.MultiDict_Next(
+            api.state, md, ctypes.byref(pos), ctypes.byref(V()), ctypes.byref(V())
+        )
+    assert list(md.items()) == [(b"abc", 1)]
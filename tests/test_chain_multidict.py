@@ -0,0 +1,339 @@
+import gc
+import weakref
+from collections.abc import Mapping
+from types import ModuleType
+
+import pytest
+
+from multidict import ChainMultiDict, MultiDict, MutableMultiMapping
+
+ITEMS = [("a", "1"), ("b", "2"), ("a", "3"), ("c", "4")]
+
+
+@pytest.fixture
+def chain_class(multidict_module: ModuleType) -> type[ChainMultiDict[str]]:
+    return multidict_module.ChainMultiDict  # type: ignore[no-any-return]
+
+
+def test_read_through(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+
+    assert len(chain) == 4
+    assert chain.items() == base.items()
+    assert chain.keys() == base.keys()
+    assert list(chain.items()) == list(base.items())
+    assert list(chain.keys()) == list(base.keys())
+    assert list(chain.values()) == list(base.values())
+    assert list(chain) == list(base.keys())
+    assert chain["a"] == "1"
+    assert chain.getall("a") == ["1", "3"]
+    assert chain.get("missing") is None
+    assert chain.get("missing", "x") == "x"
+    assert "b" in chain
+    assert "missing" not in chain
+    assert 1 not in chain
+    with pytest.raises(KeyError):
+        chain["missing"]
+    with pytest.raises(KeyError):
+        chain.getall("missing")
+    assert repr(chain) == repr(base).replace(type(base).__name__, "ChainMultiDict")
+
+
+def test_proxy_base(
+    any_multidict_class: type[MultiDict[str]],
+    any_multidict_proxy_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    chain = chain_class(any_multidict_proxy_class(any_multidict_class(ITEMS)))
+    chain.add("d", "5")
+    assert list(chain.items()) == ITEMS + [("d", "5")]
+
+
+def test_add(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    chain.add("a", "5")
+    chain.add("d", "6")
+
+    assert len(chain) == 6
+    assert chain.getall("a") == ["1", "3", "5"]
+    assert chain["d"] == "6"
+    assert list(chain.items()) == ITEMS + [("a", "5"), ("d", "6")]
+    assert chain.copy() == any_multidict_class(chain.items())
+    assert base == any_multidict_class(ITEMS)
+
+
+def test_setitem(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    chain.add("a", "5")
+    chain["a"] = "6"
+    chain["d"] = "7"
+
+    assert len(chain) == 4
+    assert chain["a"] == "6"
+    assert chain.getall("a") == ["6"]
+    # like in a multidict the key keeps the place of its first value
+    assert list(chain.items()) == [("a", "6"), ("b", "2"), ("c", "4"), ("d", "7")]
+    assert base.getall("a") == ["1", "3"]
+
+
+def test_delitem(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    chain.add("a", "5")
+    chain.add("d", "6")
+    del chain["a"]
+    del chain["d"]
+
+    assert len(chain) == 2
+    assert "a" not in chain
+    assert "d" not in chain
+    assert chain.get("a") is None
+    assert chain.getall("a", []) == []
+    assert list(chain.items()) == [("b", "2"), ("c", "4")]
+    with pytest.raises(KeyError):
+        del chain["a"]
+    with pytest.raises(KeyError):
+        del chain["missing"]
+
+    chain.add("a", "7")
+    assert chain.getall("a") == ["7"]
+    assert list(chain.items()) == [("b", "2"), ("c", "4"), ("a", "7")]
+    assert base.getall("a") == ["1", "3"]
+
+
+def test_popone(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    chain.add("a", "5")
+
+    assert chain.popone("a") == "1"
+    assert chain.getall("a") == ["3", "5"]
+    assert list(chain.items()) == [("b", "2"), ("a", "3"), ("a", "5"), ("c", "4")]
+    assert chain.pop("a") == "3"
+    assert chain.popone("a") == "5"
+    assert chain.popone("a", None) is None
+    assert chain.pop("c") == "4"
+    with pytest.raises(KeyError):
+        chain.popone("a")
+    assert list(chain.items()) == [("b", "2")]
+    assert len(chain) == 1
+    chain.add("a", "6")
+    assert list(chain.items()) == [("b", "2"), ("a", "6")]
+    assert base == any_multidict_class(ITEMS)
+
+
+def test_popall(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    chain.add("a", "5")
+    chain.add("d", "6")
+
+    assert chain.popall("a") == ["1", "3", "5"]
+    assert chain.popall("d") == ["6"]
+    assert chain.popall("a", None) is None
+    with pytest.raises(KeyError):
+        chain.popall("a")
+    assert list(chain.items()) == [("b", "2"), ("c", "4")]
+    chain["a"] = "7"
+    assert list(chain.items()) == [("b", "2"), ("c", "4"), ("a", "7")]
+
+
+def test_case_insensitive(
+    case_insensitive_multidict_class: type[MultiDict[str]],
+    case_insensitive_str_class: type[str],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = case_insensitive_multidict_class([("Content-Type", "text/html")])
+    chain = chain_class(base)
+    assert chain["content-type"] == "text/html"
+    chain["CONTENT-TYPE"] = "text/plain"
+    chain.add("X-A", "1")
+    assert chain.getall("Content-Type") == ["text/plain"]
+    assert chain[case_insensitive_str_class("x-a")] == "1"
+    assert list(chain.keys()) == ["CONTENT-TYPE", "X-A"]
+    assert all(isinstance(key, case_insensitive_str_class) for key in chain)
+
+    copy = chain.copy()
+    assert type(copy) is case_insensitive_multidict_class
+    assert list(copy.items()) == list(chain.items())
+
+
+def test_copy(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    chain["b"] = "5"
+    chain.add("d", "6")
+
+    copy = chain.copy()
+    assert type(copy) is any_multidict_class
+    assert list(copy.items()) == [
+        ("a", "1"),
+        ("b", "5"),
+        ("a", "3"),
+        ("c", "4"),
+        ("d", "6"),
+    ]
+    assert list(copy.items()) == list(chain.items())
+    copy.add("e", "7")
+    assert "e" not in chain
+
+
+def test_eq(
+    any_multidict_class: type[MultiDict[str]],
+    any_multidict_proxy_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    assert chain == base
+    assert base == chain
+    assert any_multidict_proxy_class(base) == chain
+    assert chain == chain_class(base)
+    assert chain != chain_class(any_multidict_class(ITEMS[:2]))
+    assert chain != ITEMS
+    with pytest.raises(TypeError):
+        hash(chain)
+
+    chain.add("d", "5")
+    assert chain != base
+    assert chain == chain.copy()
+
+    # an overridden key keeps its place
+    chain["a"] = "6"
+    assert chain == any_multidict_class(
+        [("a", "6"), ("b", "2"), ("c", "4"), ("d", "5")]
+    )
+
+    # the order and duplicates matter like for multidicts
+    swapped = chain_class(any_multidict_class([("b", "2"), ("a", "1")]))
+    assert swapped != any_multidict_class([("a", "1"), ("b", "2")])
+    assert any_multidict_class([("a", "1"), ("b", "2")]) != swapped
+    assert swapped == {"a": "1", "b": "2"}
+    assert {"a": "1", "b": "2"} == swapped
+
+
+def test_views(
+    any_multidict_class: type[MultiDict[str]],
+    any_multidict_proxy_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    chain["b"] = "5"
+    chain.add("d", "6")
+    proxy = any_multidict_proxy_class(chain.copy())
+
+    assert type(chain.keys()) is type(proxy.keys())
+    assert type(chain.values()) is type(proxy.values())
+    assert type(chain.items()) is type(proxy.items())
+    assert chain.keys() == proxy.keys()
+    assert chain.items() == proxy.items()
+    assert list(chain.values()) == list(proxy.values())
+    assert len(chain.items()) == len(chain)
+    assert "d" in chain.keys()
+    assert ("b", "5") in chain.items()
+    assert ("b", "2") not in chain.items()
+    assert chain.keys() & {"a", "x"} == {"a"}
+    assert chain.keys() | {"x"} == {"a", "b", "c", "d", "x"}
+    assert chain.keys() - {"a"} == {"b", "c", "d"}
+    assert chain.items() - base.items() == {("b", "5"), ("d", "6")}
+
+    # the views show the pairs at the time of the call
+    keys = chain.keys()
+    chain.add("e", "7")
+    assert "e" not in keys
+    assert "e" in chain.keys()
+
+
+def test_not_a_mapping(chain_class: type[ChainMultiDict[str]]) -> None:
+    # a documented subset of MutableMultiMapping
+    assert not issubclass(chain_class, Mapping)
+    assert not issubclass(chain_class, MutableMultiMapping)
+
+
+def test_base_changed(
+    any_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = any_multidict_class(ITEMS)
+    chain = chain_class(base)
+    base.add("d", "5")
+    with pytest.raises(RuntimeError, match="Base multidict changed"):
+        chain["a"]
+    with pytest.raises(RuntimeError, match="Base multidict changed"):
+        chain.add("a", "6")
+    with pytest.raises(RuntimeError, match="Base multidict changed"):
+        len(chain)
+
+
+def test_bad_base(chain_class: type[ChainMultiDict[str]]) -> None:
+    with pytest.raises(TypeError, match="should be a multidict"):
+        chain_class({"a": "1"})  # type: ignore[arg-type]
+    with pytest.raises(TypeError):
+        chain_class()  # type: ignore[call-arg]
+
+
+def test_many_chains_share_base(
+    case_insensitive_multidict_class: type[MultiDict[str]],
+    chain_class: type[ChainMultiDict[str]],
+) -> None:
+    base = case_insensitive_multidict_class(
+        (f"X-Default-{i}", str(i)) for i in range(100)
+    )
+    chains = [chain_class(base) for _ in range(10)]
+    for i, chain in enumerate(chains):
+        chain["X-Default-0"] = str(-i)
+        chain.add("X-Request", str(i))
+    for i, chain in enumerate(chains):
+        assert len(chain) == 101
+        assert chain["x-default-0"] == str(-i)
+        assert chain["x-default-99"] == "99"
+        assert chain["x-request"] == str(i)
+    assert base["x-default-0"] == "0"
+
+
+def test_class_getitem(chain_class: type[ChainMultiDict[str]]) -> None:
+    assert chain_class[str] is not None
+
+
+def test_cycle_collected(
+    any_multidict_class: type[MultiDict[object]],
+    chain_class: type[ChainMultiDict[object]],
+) -> None:
+    class Value:
+        chain: object
+
+    value = Value()
+    chain = chain_class(any_multidict_class())
+    chain["self"] = chain
+    chain["value"] = value
+    value.chain = chain
+    assert "..." in repr(chain)
+    wr = weakref.ref(value)
+    del chain, value
+    gc.collect()
+    assert wr() is None
@@ -0,0 +1,114 @@
+import gc
+import weakref
+from collections.abc import Callable
+from types import ModuleType
+from typing import TYPE_CHECKING
+
+import pytest
+
+from multidict import MultiDict
+
+if TYPE_CHECKING:
+    from conftest import MultidictImplementation
+
+
+@pytest.fixture
+def cls(
+    any_multidict_class: type[MultiDict[object]],
+    multidict_implementation: "MultidictImplementation",
+) -> type[MultiDict[object]]:
+    if multidict_implementation.is_pure_python:
+        pytest.skip("GC tracking is controlled by the C extension only")
+    return any_multidict_class
+
+
+class Key(str):
+    pass
+
+
+def test_atomic_untracked(
+    cls: type[MultiDict[object]], multidict_module: ModuleType
+) -> None:
+    istr = multidict_module.istr
+    md = cls([("a", "1"), ("b", b"2"), (istr("c"), 3), ("d", 4.0), ("e", None)])
+    md.add("f", True)
+    md["a"] = ("x", "y")
+    md.update(b="z")
+    md.extend(g="h")
+    md.add_many(["i"], [1])
+    md.setdefault("j", "k")
+    assert not gc.is_tracked(md)
+    assert not gc.is_tracked(md.copy())
+    assert not gc.is_tracked(cls())
+
+
+@pytest.mark.parametrize(
+    "store",
+    [
+        lambda md, v: md.add("x", v),
+        lambda md, v: md.__setitem__("a", v),
+        lambda md, v: md.__setitem__("x", v),
+        lambda md, v: md.update(a=v),
+        lambda md, v: md.update(x=v),
+        lambda md, v: md.extend(x=v),
+        lambda md, v: md.add_many(["x"], [v]),
+        lambda md, v: md.setdefault("x", v),
+    ],
+)
+def test_tracked_on_container_value(
+    cls: type[MultiDict[object]],
+    store: Callable[[MultiDict[object], object], None],
+) -> None:
+    md = cls(a="1")
+    assert not gc.is_tracked(md)
+    store(md, [])
+    assert gc.is_tracked(md)
+    assert gc.is_tracked(md.copy())
+
+
+def test_tracked_on_construction(cls: type[MultiDict[object]]) -> None:
+    assert gc.is_tracked(cls(a=[]))
+    assert gc.is_tracked(cls([("a", "1"), ("b", {})]))
+
+
+def test_tracked_on_key(cls: type[MultiDict[object]]) -> None:
+    md = cls(a="1")
+    md.add(Key("x"), "1")
+    assert gc.is_tracked(md)
+
+    md = cls(a="1")
+    md[Key("a")] = "2"
+    assert gc.is_tracked(md)
+
+
+def test_tracked_tuple(cls: type[MultiDict[object]]) -> None:
+    value = ("a", [])
+    assert gc.is_tracked(value)
+    assert gc.is_tracked(cls(a=value))
+
+
+def test_subclass_tracked(cls: type[MultiDict[object]]) -> None:
+    class Sub(cls):  # type: ignore[valid-type,misc]
+        pass
+
+    md = Sub(a="1")
+    assert gc.is_tracked(md)
+    assert gc.is_tracked(md.copy())
+
+
+def test_cycle_collected(cls: type[MultiDict[object]]) -> None:
+    md = cls(a="1")
+    md["self"] = md
+    wr = weakref.ref(md)
+    del md
+    gc.collect()
+    assert wr() is None
+
+    key = Key("a")
+    md = cls()
+    md.add(key, "1")
+    key.md = md  # type: ignore[attr-defined]
+    wr = weakref.ref(md)
+    del md, key
+    gc.collect()
+    assert wr() is None
@@ -0,0 +1,194 @@
+"""codspeed benchmarks for multidict over a realistic HTTP header corpus.
+
+The corpus in ``headers_corpus.json`` contains anonymized request and
+response header sets: browser navigations and XHRs (HTTP/1.1 and
+lowercase HTTP/2 names), API clients, CDN and cache responses, and proxy
+chains with repeated ``Via``, ``X-Forwarded-For`` and ``Set-Cookie``.
+Every benchmark processes the whole corpus per iteration.
+"""
+
+import json
+import pathlib
+from typing import Type
+
+from pytest_codspeed import BenchmarkFixture
+
+from multidict import CIMultiDict
+
+CORPUS_PATH = pathlib.Path(__file__).with_name("headers_corpus.json")
+CORPUS = json.loads(CORPUS_PATH.read_text(encoding="utf-8"))
+
+REQUESTS = [
+    [tuple(pair) for pair in entry["headers"]]
+    for entry in CORPUS
+    if entry["kind"] == "request"
+]
+RESPONSES = [
+    [tuple(pair) for pair in entry["headers"]]
+    for entry in CORPUS
+    if entry["kind"] == "response"
+]
+
+# Header names looked up by a typical request handler and its middlewares,
+# spelled the way application code usually writes them.
+REQUEST_LOOKUPS = (
+    "Host",
+    "Content-Type",
+    "Content-Length",
+    "Transfer-Encoding",
+    "Connection",
+    "Upgrade",
+    "Accept-Encoding",
+    "Authorization",
+    "Cookie",
+    "Origin",
+    "X-Forwarded-For",
+    "X-Request-ID",
+    "If-None-Match",
+)
+
+HOP_BY_HOP = (
+    "Connection",
+    "Keep-Alive",
+    "Proxy-Connection",
+    "TE",
+    "Transfer-Encoding",
+    "Upgrade",
+)
+
+
+def test_headers_corpus_construct(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    headers = REQUESTS + RESPONSES
+
+    @benchmark
+    def _run() -> None:
+        for items in headers:
+            case_insensitive_multidict_class(items)
+
+
+def test_headers_corpus_construct_incremental(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    # Parsers feed headers one by one as they are read from the wire
+    headers = REQUESTS + RESPONSES
+
+    @benchmark
+    def _run() -> None:
+        for items in headers:
+            md = case_insensitive_multidict_class()
+            for key, value in items:
+                md.add(key, value)
+
+
+def test_headers_corpus_handler_lookups(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    mds = [case_insensitive_multidict_class(items) for items in REQUESTS]
+
+    @benchmark
+    def _run() -> None:
+        for md in mds:
+            for name in REQUEST_LOOKUPS:
+                md.get(name)
+            "Expect" in md
+            md.getall("X-Forwarded-For", ())
+            md.getall("Cookie", ())
+            md.get("content-type", "application/octet-stream")
+
+
+def test_headers_corpus_handler_lookups_istr(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+    case_insensitive_str_class: Type[str],
+) -> None:
+    # Frameworks keep header names as pre-built istr constants
+    mds = [case_insensitive_multidict_class(items) for items in REQUESTS]
+    names = [case_insensitive_str_class(name) for name in REQUEST_LOOKUPS]
+
+    @benchmark
+    def _run() -> None:
+        for md in mds:
+            for name in names:
+                md.get(name)
+
+
+def test_headers_corpus_response_lookups(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    # What an HTTP client inspects after receiving a response
+    mds = [case_insensitive_multidict_class(items) for items in RESPONSES]
+
+    @benchmark
+    def _run() -> None:
+        for md in mds:
+            md.get("Content-Type")
+            md.get("Content-Length")
+            md.get("Content-Encoding")
+            md.get("Transfer-Encoding")
+            md.get("Location")
+            md.getall("Set-Cookie", ())
+            md.getall("Vary", ())
+
+
+def test_headers_corpus_proxy_mutation(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    # A reverse proxy: strip hop-by-hop headers and append forwarding info
+    mds = [case_insensitive_multidict_class(items) for items in REQUESTS]
+
+    @benchmark
+    def _run() -> None:
+        for src in mds:
+            md = src.copy()
+            for name in HOP_BY_HOP:
+                md.popall(name, None)
+            md.add("Via", "1.1 proxy.example")
+            md.add("X-Forwarded-For", "192.0.2.1")
+            md["X-Forwarded-Proto"] = "https"
+            md.setdefault("X-Request-ID", "00000000-0000-4000-8000-000000000000")
+
+
+def test_headers_corpus_response_mutation(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    # A response middleware: security headers, CORS and a session cookie
+    mds = [case_insensitive_multidict_class(items) for items in RESPONSES]
+    extra = [
+        ("Access-Control-Allow-Origin", "https://www.example.com"),
+        ("Vary", "Origin"),
+        ("Set-Cookie", "sid=0123456789abcdef; Path=/; HttpOnly; Secure"),
+    ]
+    security = {
+        "Strict-Transport-Security": "max-age=63072000",
+        "X-Content-Type-Options": "nosniff",
+        "X-Frame-Options": "DENY",
+    }
+
+    @benchmark
+    def _run() -> None:
+        for src in mds:
+            md = src.copy()
+            md.update(security)
+            md.extend(extra)
+            md["Server"] = "example"
+            md.popone("X-Powered-By", None)
+
+
+def test_headers_corpus_serialize(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    mds = [case_insensitive_multidict_class(items) for items in REQUESTS + RESPONSES]
+
+    @benchmark
+    def _run() -> None:
+        for md in mds:
+            "".join(f"{k}: {v}\r\n" for k, v in md.items()).encode("latin-1")
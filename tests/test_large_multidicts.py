@@ -0,0 +1,197 @@
+"""Lookups in multidicts large enough to be indexed by the C extension."""
+
+import pickle
+
+import pytest
+
+from multidict import MultiDict
+
+
+def _colliding_keys(count: int, bits: int = 8) -> list[str]:
+    mask = (1 << bits) - 1
+    keys: list[str] = []
+    i = 0
+    while len(keys) < count:
+        key = f"k{i}"
+        if hash(key) & mask == 0:
+            keys.append(key)
+        i += 1
+    return keys
+
+
+@pytest.fixture(params=[200, 2000])
+def size(request: pytest.FixtureRequest) -> int:
+    return request.param  # type: ignore[no-any-return]
+
+
+def test_lookups(any_multidict_class: type[MultiDict[int]], size: int) -> None:
+    md = any_multidict_class((f"k{i % (size // 2)}", i) for i in range(size))
+    for _ in range(3):
+        for i in range(size // 2):
+            assert md.getone(f"k{i}") == i
+            assert md.getall(f"k{i}") == [i, i + size // 2]
+            assert f"k{i}" in md
+        assert "missing" not in md
+        assert md.get("missing") is None
+        assert md.getall("missing", None) is None
+
+
+def test_add_after_lookups(
+    any_multidict_class: type[MultiDict[int]], size: int
+) -> None:
+    md = any_multidict_class((f"k{i}", i) for i in range(size))
+    for i in range(size):
+        md.getone(f"k{i}")
+    md.add("k1", -1)
+    md.add("new", -2)
+    assert md.getall("k1") == [1, -1]
+    assert md.getone("new") == -2
+    assert md.setdefault("new", 0) == -2
+    assert md.setdefault("other", 0) == 0
+    assert md.getall("other") == [0]
+
+
+def test_mutations_after_lookups(
+    any_multidict_class: type[MultiDict[int]], size: int
+) -> None:
+    md = any_multidict_class((f"k{i % 10}", i) for i in range(size))
+    for _ in range(3):
+        md.getall("k9")
+
+    md["k5"] = -1
+    assert md.getall("k5") == [-1]
+    assert md.getall("k6") == list(range(6, size, 10))
+
+    assert md.popone("k6") == 6
+    assert md.getone("k6") == 16
+    assert md.popall("k7") == list(range(7, size, 10))
+    assert "k7" not in md
+
+    del md["k8"]
+    assert "k8" not in md
+    with pytest.raises(KeyError):
+        del md["k8"]
+
+    md.update([("k1", -2), ("k1", -3), ("k2", -4)])
+    assert md.getall("k1") == [-2, -3]
+    assert md.getall("k2") == [-4]
+    assert md.getall("k0") == list(range(0, size, 10))
+
+    md.clear()
+    assert "k0" not in md
+    md.add("k0", 0)
+    assert md.getall("k0") == [0]
+
+
+def test_case_insensitive_lookups(
+    case_insensitive_multidict_class: type[MultiDict[int]], size: int
+) -> None:
+    md = case_insensitive_multidict_class((f"Key-{i}", i) for i in range(size))
+    for _ in range(3):
+        for i in range(0, size, 7):
+            assert md.getone(f"KEY-{i}") == i
+    md.add("key-3", -1)
+    assert md.getall("Key-3") == [3, -1]
+    assert list(md.keys())[-1] == "key-3"
+
+
+def test_colliding_keys(any_multidict_class: type[MultiDict[str]]) -> None:
+    keys = _colliding_keys(200)
+    md = any_multidict_class((k, k) for k in keys)
+    for _ in range(3):
+        for k in keys:
+            assert md.getone(k) == k
+    md.extend((k, k.upper()) for k in keys)
+    for k in keys:
+        assert md.getall(k) == [k, k.upper()]
+    md.update((k, "") for k in keys[::2])
+    assert md.getall(keys[0]) == [""]
+    assert md.getall(keys[1]) == [keys[1], keys[1].upper()]
+
+
+def test_removals_from_front(
+    any_multidict_class: type[MultiDict[str]], size: int
+) -> None:
+    half = size // 2
+    pairs = [(f"k{i % half}", str(i)) for i in range(size)]
+    md = any_multidict_class(pairs)
+    assert md.popone("k0") == "0"
+    del md["k1"]
+    assert md.pop("k2") == "2"
+    assert md.popall("k3") == ["3", str(half + 3)]
+    md["k4"] = "new"
+    dropped = {"0", "1", "2", "3", "4"} | {str(half + i) for i in (1, 3, 4)}
+    expected = [(k, v) for k, v in pairs if v not in dropped]
+    expected.insert(0, ("k4", "new"))
+
+    assert len(md) == len(expected)
+    assert list(md.items()) == expected
+    assert md == any_multidict_class(expected)
+    assert md.copy() == md
+    assert repr(md).count(f"'k{half - 1}'") == 2
+    assert md.getall("k2") == [str(half + 2)]
+    assert md.getall("k0") == [str(half)]
+    assert md.popitem() == expected[-1]
+
+
+def test_drain_from_front(
+    any_multidict_class: type[MultiDict[str]], size: int
+) -> None:
+    md = any_multidict_class((f"k{i}", str(i)) for i in range(size))
+    for i in range(size - 1):
+        assert md.popone(f"k{i}") == str(i)
+        assert len(md) == size - 1 - i
+        if i % 37 == 0:
+            assert list(md.keys()) == [f"k{j}" for j in range(i + 1, size)]
+            assert f"k{i}" not in md
+            assert md.getone(f"k{i + 1}") == str(i + 1)
+    assert list(md.items()) == [(f"k{size - 1}", str(size - 1))]
+    md.add("a", "1")
+    assert md.popitem() == ("a", "1")
+    assert md.popitem() == (f"k{size - 1}", str(size - 1))
+    assert not md
+
+
+def test_copies_after_removals(
+    any_multidict_class: type[MultiDict[str]], size: int
+) -> None:
+    md = any_multidict_class((f"k{i}", str(i)) for i in range(size))
+    for i in range(1, size, 5):
+        md.popone(f"k{i}")
+    expected = [(f"k{i}", str(i)) for i in range(size) if i % 5 != 1]
+    assert list(pickle.loads(pickle.dumps(md, 5)).items()) == expected
+    other = any_multidict_class()
+    other.extend(md)
+    assert list(other.items()) == expected
+    other.update(md)
+    assert list(other.items()) == expected
+    md.shrink_to_fit()
+    assert list(md.items()) == expected
+
+
+def test_remove_many(any_multidict_class: type[MultiDict[str]], size: int) -> None:
+    md = any_multidict_class((f"k{i % 50}", str(i)) for i in range(size))
+    for i in range(1, size, 7):
+        md.popone(f"k{i % 50}", None)
+    expected = list(md.items())
+    keys = [f"k{i}" for i in range(0, 50, 3)] + ["missing"]
+    removed = md.popmany(keys)
+    assert removed == [(k, v) for k, v in expected if k in keys]
+    assert list(md.items()) == [(k, v) for k, v in expected if k not in keys]
+    md.discard_many(f"k{i}" for i in range(50))
+    assert not md
+    md.add("k0", "0")
+    assert list(md.items()) == [("k0", "0")]
+
+
+def test_retain(any_multidict_class: type[MultiDict[str]], size: int) -> None:
+    md = any_multidict_class((f"k{i % 50}", str(i)) for i in range(size))
+    for i in range(1, size, 7):
+        md.popone(f"k{i % 50}", None)
+    expected = list(md.items())
+    removed = md.partition(lambda k, v: int(v) % 3 != 0)
+    assert list(removed.items()) == [(k, v) for k, v in expected if int(v) % 3 == 0]
+    expected = [(k, v) for k, v in expected if int(v) % 3 != 0]
+    assert list(md.items()) == expected
+    md.retain_prefix("k1")
+    assert list(md.items()) == [(k, v) for k, v in expected if k.startswith("k1")]
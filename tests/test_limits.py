@@ -0,0 +1,128 @@
+import pytest
+
+from multidict import MultiDict
+
+
+def test_max_items(any_multidict_class: type[MultiDict[int]]) -> None:
+    md = any_multidict_class()
+    md.set_limits(max_items=3)
+    md.add("a", 1)
+    md.extend([("b", 2), ("c", 3)])
+    with pytest.raises(ValueError, match="too many items, the limit is 3"):
+        md.add("d", 4)
+    with pytest.raises(ValueError, match="the limit is 3"):
+        md["d"] = 4
+    with pytest.raises(ValueError, match="the limit is 3"):
+        md.setdefault("d", 4)
+    with pytest.raises(ValueError, match="the limit is 3"):
+        md.update(d=4)
+    md["a"] = 10
+    assert list(md.items()) == [("a", 10), ("b", 2), ("c", 3)]
+
+    del md["b"]
+    md.add("d", 4)
+    assert len(md) == 3
+
+
+def test_max_items_extend_stops(any_multidict_class: type[MultiDict[int]]) -> None:
+    md = any_multidict_class()
+    md.set_limits(max_items=5)
+    with pytest.raises(ValueError):
+        md.extend((str(i), i) for i in range(10))
+    assert len(md) == 5
+
+
+def test_max_duplicates(any_multidict_class: type[MultiDict[int]]) -> None:
+    md = any_multidict_class([("a", 1), ("a", 2), ("b", 3)])
+    md.set_limits(max_duplicates=2)
+    with pytest.raises(ValueError, match="too many items with key 'a'"):
+        md.add("a", 3)
+    md.add("b", 4)
+    with pytest.raises(ValueError, match="the limit is 2"):
+        md.extend([("c", 1), ("b", 5)])
+    assert md.getall("c") == [1]
+
+    assert md.popone("a") == 1
+    md.add("a", 5)
+    assert md.getall("a") == [2, 5]
+    assert md.popall("a") == [2, 5]
+    md.extend([("a", 6), ("a", 7)])
+    md.clear()
+    md.extend([("a", 8), ("a", 9)])
+    assert md.getall("a") == [8, 9]
+
+
+def test_max_duplicates_case_insensitive(
+    case_insensitive_multidict_class: type[MultiDict[int]],
+) -> None:
+    md = case_insensitive_multidict_class()
+    md.set_limits(max_duplicates=2)
+    md.add("X-A", 1)
+    md.add("x-a", 2)
+    with pytest.raises(ValueError, match="too many items with key 'X-a'"):
+        md.add("X-a", 3)
+
+
+def test_remove_limits(any_multidict_class: type[MultiDict[int]]) -> None:
+    md = any_multidict_class()
+    md.set_limits(max_items=1, max_duplicates=1)
+    md.add("a", 1)
+    md.set_limits()
+    md.add("a", 2)
+    md.add("a", 3)
+    assert md.getall("a") == [1, 2, 3]
+
+
+def test_limits_not_copied(any_multidict_class: type[MultiDict[int]]) -> None:
+    md = any_multidict_class(a=1)
+    md.set_limits(max_items=1)
+    copy = md.copy()
+    copy.add("b", 2)
+    assert len(copy) == 2
+
+
+@pytest.mark.parametrize(
+    ("kwargs", "exc"),
+    [
+        ({"max_items": -1}, ValueError),
+        ({"max_duplicates": -1}, ValueError),
+        ({"max_items": "1"}, TypeError),
+        ({"unknown": 1}, TypeError),
+    ],
+)
+def test_set_limits_invalid(
+    any_multidict_class: type[MultiDict[int]],
+    kwargs: dict[str, object],
+    exc: type[Exception],
+) -> None:
+    md = any_multidict_class()
+    with pytest.raises(exc):
+        md.set_limits(**kwargs)  # type: ignore[arg-type]
+
+
+def test_set_limits_positional(any_multidict_class: type[MultiDict[int]]) -> None:
+    md = any_multidict_class()
+    with pytest.raises(TypeError):
+        md.set_limits(1)  # type: ignore[misc]
+
+
+def test_header_flood_duplicates(
+    case_insensitive_multidict_class: type[MultiDict[str]],
+) -> None:
+    items = [("X-A", "1")] * 10_000 + [("Host", "example.com"), ("x-a", "2")]
+
+    md = case_insensitive_multidict_class(items)
+    md["x-a"] = "v"
+    assert list(md.items()) == [("x-a", "v"), ("Host", "example.com")]
+
+    md = case_insensitive_multidict_class(items)
+    md.update({"X-A": "v", "host": "h"})
+    assert list(md.items()) == [("X-A", "v"), ("host", "h")]
+
+    md = case_insensitive_multidict_class(items)
+    assert md.popall("x-a") == ["1"] * 10_000 + ["2"]
+    assert list(md.items()) == [("Host", "example.com")]
+
+    md = case_insensitive_multidict_class(items)
+    del md["x-a"]
+    assert list(md.items()) == [("Host", "example.com")]
@@ -1,6 +1,8 @@
 """codspeed benchmarks for multidict."""
 
-from typing import Dict, Type, Union
+import pickle
+from types import ModuleType
+from typing import Dict, List, Tuple, Type, Union
 
 from pytest_codspeed import BenchmarkFixture
 
@@ -72,6 +74,20 @@ def test_cimultidict_add_istr(
                 md.add(i, i)
 
 
+def test_cimultidict_add_many_istr(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[istr]],
+) -> None:
+    base_md = case_insensitive_multidict_class()
+    items = [istr(i) for i in range(100)]
+
+    @benchmark
+    def _run() -> None:
+        for _ in range(100):
+            md = base_md.copy()
+            md.add_many(items, items)
+
+
 def test_multidict_pop_str(
     benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
 ) -> None:
@@ -85,6 +101,85 @@ def test_multidict_pop_str(
             md.pop(i)
 
 
+def test_multidict_popone_front_of_large_str(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    md_base = any_multidict_class((str(i), str(i)) for i in range(1000))
+    items = [str(i) for i in range(0, 200, 10)]
+
+    @benchmark
+    def _run() -> None:
+        md = md_base.copy()
+        for i in items:
+            md.popone(i)
+
+
+def test_cimultidict_discard_many_str(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    md_base = case_insensitive_multidict_class(
+        [(f"X-Header-{i}", str(i)) for i in range(30)]
+        + [("Connection", "keep-alive"), ("Keep-Alive", "5"), ("TE", "trailers")]
+    )
+    keys = ["Connection", "Keep-Alive", "TE", "Trailer", "Transfer-Encoding"]
+
+    @benchmark
+    def _run() -> None:
+        for _ in range(100):
+            md = md_base.copy()
+            md.discard_many(keys)
+
+
+def test_cimultidict_retain_prefix_str(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    md_base = case_insensitive_multidict_class(
+        (f"X-Internal-{i}" if i % 4 == 0 else f"X-Header-{i}", str(i))
+        for i in range(40)
+    )
+
+    @benchmark
+    def _run() -> None:
+        for _ in range(100):
+            md = md_base.copy()
+            md.retain_prefix("x-internal-", invert=True)
+
+
+def test_cimultidict_retain_str(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    md_base = case_insensitive_multidict_class(
+        (f"X-Header-{i}", "" if i % 4 == 0 else str(i)) for i in range(40)
+    )
+
+    @benchmark
+    def _run() -> None:
+        for _ in range(100):
+            md = md_base.copy()
+            md.retain(lambda k, v: v)
+
+
+def test_chainmultidict_override_str(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+    multidict_module: ModuleType,
+) -> None:
+    md_base = case_insensitive_multidict_class(
+        (f"X-Default-{i}", str(i)) for i in range(30)
+    )
+    chain_class = multidict_module.ChainMultiDict
+
+    @benchmark
+    def _run() -> None:
+        for _ in range(100):
+            md = chain_class(md_base)
+            md["X-Default-1"] = "1"
+            md.add("Content-Length", "100")
+
+
 def test_cimultidict_pop_istr(
     benchmark: BenchmarkFixture,
     case_insensitive_multidict_class: Type[CIMultiDict[istr]],
@@ -497,6 +592,59 @@ def test_create_cimultidict_with_items_istr_with_kwargs(
         case_insensitive_multidict_class(items, **kwargs)
 
 
+def test_create_many_multidicts_from_empty_list(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    items: List[Tuple[str, str]] = []
+
+    @benchmark
+    def _run() -> None:
+        [any_multidict_class(items) for _ in range(1000)]
+
+
+def test_create_many_multidicts_with_few_items(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    items = [(str(i), str(i)) for i in range(3)]
+
+    @benchmark
+    def _run() -> None:
+        [any_multidict_class(items) for _ in range(1000)]
+
+
+def test_create_many_multidicts_with_headers_count_items(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    items = [(str(i), str(i)) for i in range(20)]
+
+    @benchmark
+    def _run() -> None:
+        [any_multidict_class(items) for _ in range(1000)]
+
+
+def test_create_many_large_multidicts(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    items = [(str(i), str(i)) for i in range(100)]
+
+    @benchmark
+    def _run() -> None:
+        [any_multidict_class(items) for _ in range(100)]
+
+
+def test_create_many_large_multidicts_in_arena(
+    benchmark: BenchmarkFixture,
+    any_multidict_class: Type[MultiDict[str]],
+    multidict_module: ModuleType,
+) -> None:
+    items = [(str(i), str(i)) for i in range(100)]
+
+    @benchmark
+    def _run() -> None:
+        with multidict_module.MultiDictArena():
+            [any_multidict_class(items) for _ in range(100)]
+
+
 def test_create_empty_multidictproxy(benchmark: BenchmarkFixture) -> None:
     md: MultiDict[str] = MultiDict()
 
@@ -603,3 +751,167 @@ def test_iterate_multidict_items(
     def _run() -> None:
         for _, _ in md.items():
             pass
+
+
+def _colliding_keys(count: int, bits: int = 10) -> List[str]:
+    # keys sharing the low bits of hash(), a flooding attack on a table
+    # indexed by hash() directly
+    mask = (1 << bits) - 1
+    keys: List[str] = []
+    i = 0
+    while len(keys) < count:
+        key = f"k{i}"
+        if hash(key) & mask == 0:
+            keys.append(key)
+        i += 1
+    return keys
+
+
+def test_multidict_large_query_getone(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    md = any_multidict_class((f"param{i}", str(i)) for i in range(10_000))
+    keys = [f"param{i}" for i in range(0, 10_000, 100)]
+
+    @benchmark
+    def _run() -> None:
+        for k in keys:
+            md.getone(k)
+
+
+def test_multidict_large_query_get_missing(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    md = any_multidict_class((f"param{i}", str(i)) for i in range(10_000))
+    keys = [f"missing{i}" for i in range(100)]
+
+    @benchmark
+    def _run() -> None:
+        for k in keys:
+            md.get(k)
+
+
+def test_multidict_colliding_keys_getone(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    keys = _colliding_keys(300)
+    md = any_multidict_class((k, k) for k in keys)
+
+    @benchmark
+    def _run() -> None:
+        for k in keys:
+            md.getone(k)
+
+
+def test_cimultidict_colliding_keys_update(
+    benchmark: BenchmarkFixture,
+    case_insensitive_multidict_class: Type[CIMultiDict[str]],
+) -> None:
+    keys = _colliding_keys(300)
+    items = [(k, k) for k in keys]
+    base_md = case_insensitive_multidict_class(items)
+
+    @benchmark
+    def _run() -> None:
+        md = base_md.copy()
+        md.update(items)
+
+
+def test_multidict_pickle_protocol_4(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    md = any_multidict_class((f"key{i}", str(i)) for i in range(100))
+
+    @benchmark
+    def _run() -> None:
+        pickle.loads(pickle.dumps(md, 4))
+
+
+def test_multidict_pickle_protocol_5(
+    benchmark: BenchmarkFixture, any_multidict_class: Type[MultiDict[str]]
+) -> None:
+    md = any_multidict_class((f"key{i}", str(i)) for i in range(100))
+
+    @benchmark
+    def _run() -> None:
+        pickle.loads(pickle.dumps(md, 5))
+
+
+def test_shared_multidict_pack(
+    benchmark: BenchmarkFixture,
+    any_multidict_class: Type[MultiDict[str]],
+    multidict_module: ModuleType,
+) -> None:
+    md = any_multidict_class((f"key{i}", str(i)) for i in range(100))
+    pack = multidict_module.SharedMultiDict.pack
+
+    @benchmark
+    def _run() -> None:
+        pack(md)
+
+
+def test_shared_multidict_getone(
+    benchmark: BenchmarkFixture,
+    any_multidict_class: Type[MultiDict[str]],
+    multidict_module: ModuleType,
+) -> None:
+    cls = multidict_module.SharedMultiDict
+    md = any_multidict_class((f"key{i}", str(i)) for i in range(100))
+    shared = cls(cls.pack(md))
+    keys = [f"key{i}" for i in range(100)]
+
+    @benchmark
+    def _run() -> None:
+        for k in keys:
+            shared.getone(k)
+
+
+def test_cimultidict_builder(
+    benchmark: BenchmarkFixture, multidict_module: ModuleType
+) -> None:
+    headers = [(f"X-Header-{i}".encode(), f"value{i}".encode()) for i in range(20)]
+    builder = multidict_module.CIMultiDictBuilder()
+
+    @benchmark
+    def _run() -> None:
+        for name, value in headers:
+            builder.add(name, value)
+        builder.build()
+
+
+def test_cimultidict_builder_lazy_values(
+    benchmark: BenchmarkFixture, multidict_module: ModuleType
+) -> None:
+    headers = [(f"X-Header-{i}".encode(), f"value{i}".encode()) for i in range(20)]
+    builder = multidict_module.CIMultiDictBuilder(lazy_values=True)
+
+    @benchmark
+    def _run() -> None:
+        for name, value in headers:
+            builder.add(name, value)
+        builder.build()["x-header-0"]
+
+
+def test_raw_headers_view_getone(
+    benchmark: BenchmarkFixture, multidict_module: ModuleType
+) -> None:
+    data = b"".join(f"X-Header-{i}: value{i}\r\n".encode() for i in range(20))
+    cls = multidict_module.RawHeadersView
+
+    @benchmark
+    def _run() -> None:
+        cls(data)["x-header-10"]
+
+
+def test_cibytesmultidict_getone(
+    benchmark: BenchmarkFixture, multidict_module: ModuleType
+) -> None:
+    md = multidict_module.CIBytesMultiDict(
+        (f"X-Header-{i}".encode(), i) for i in range(20)
+    )
+    keys = [f"x-header-{i}".encode() for i in range(20)]
+
+    @benchmark
+    def _run() -> None:
+        for key in keys:
+            md.getone(key)
@@ -1,11 +1,14 @@
 import string
 import sys
-from typing import Union
+from typing import TYPE_CHECKING, Union
 
 import pytest
 
 from multidict import CIMultiDict, CIMultiDictProxy, MultiDictProxy, istr
 
+if TYPE_CHECKING:
+    from conftest import MultidictImplementation
+
 
 class TestMutableMultiDict:
     def test_copy(
@@ -71,6 +74,55 @@ class TestMutableMultiDict:
         assert 3 == len(d)
         assert d.getall("foo") == ["bar"]
 
+    def test_add_many(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class(key="zero")
+        d.add_many(["key", "foo", "key"], ("one", "bar", "two"))
+        assert list(d.items()) == [
+            ("key", "zero"),
+            ("key", "one"),
+            ("foo", "bar"),
+            ("key", "two"),
+        ]
+        d.add_many(iter(["x"]), iter(["y"]))
+        assert d["x"] == "y"
+        d.add_many([], [])
+        assert len(d) == 5
+
+    def test_add_many_invalid(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class()
+        with pytest.raises(ValueError, match="same length"):
+            d.add_many(["a", "b"], ["1"])
+        with pytest.raises(TypeError):
+            d.add_many(["a"])  # type: ignore[call-arg]
+        with pytest.raises(TypeError):
+            d.add_many(1, ["1"])  # type: ignore[arg-type]
+        with pytest.raises(TypeError):
+            d.add_many([1], ["1"])  # type: ignore[list-item]
+        assert len(d) == 0
+
+    def test_add_many_atomic(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class(x="0")
+        with pytest.raises(TypeError):
+            d.add_many(["a", 1, "c"], ["1", "2", "3"])  # type: ignore[list-item]
+        assert list(d.items()) == [("x", "0")]
+        assert "a" not in d
+
+        d.set_limits(max_duplicates=2)
+        with pytest.raises(ValueError, match="too many items with key 'a'"):
+            d.add_many(["a", "b", "a", "a"], ["1", "2", "3", "4"])
+        assert list(d.items()) == [("x", "0")]
+        d.add_many(["a", "a"], ["1", "2"])
+        assert d.getall("a") == ["1", "2"]
+
     def test_extend(
         self,
         case_sensitive_multidict_class: type[CIMultiDict[Union[str, int]]],
@@ -140,6 +192,160 @@ class TestMutableMultiDict:
         with pytest.raises(KeyError, match="key"):
             del d["key"]
 
+    def test_discard_many(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class(
+            [("a", "1"), ("b", "2"), ("a", "3"), ("c", "4"), ("B", "5")]
+        )
+        d.discard_many(["a", "B", "a", "missing"])
+        assert list(d.items()) == [("b", "2"), ("c", "4")]
+        d.discard_many(iter(["c"]))
+        d.discard_many([])
+        assert list(d.items()) == [("b", "2")]
+        with pytest.raises(TypeError):
+            d.discard_many([1])  # type: ignore[list-item]
+        with pytest.raises(TypeError):
+            d.discard_many(1)  # type: ignore[arg-type]
+        assert list(d.items()) == [("b", "2")]
+
+    def test_popmany(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class(
+            [("a", "1"), ("b", "2"), ("a", "3"), ("c", "4")]
+        )
+        assert d.popmany(["c", "a"]) == [("a", "1"), ("a", "3"), ("c", "4")]
+        assert d.popmany(["a"]) == []
+        assert list(d.items()) == [("b", "2")]
+
+    def test_retain(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class(
+            [("a", "1"), ("b", ""), ("a", ""), ("c", "4")]
+        )
+        seen = []
+
+        def pred(key: str, value: str) -> bool:
+            seen.append((key, value))
+            return value != ""
+
+        d.retain(pred)
+        assert seen == [("a", "1"), ("b", ""), ("a", ""), ("c", "4")]
+        assert list(d.items()) == [("a", "1"), ("c", "4")]
+        d.retain(lambda k, v: 1)
+        assert list(d.items()) == [("a", "1"), ("c", "4")]
+
+    def test_retain_errors(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class([("a", "1"), ("b", "2")])
+
+        def pred(key: str, value: str) -> bool:
+            if key == "b":
+                raise ZeroDivisionError
+            return False
+
+        with pytest.raises(ZeroDivisionError):
+            d.retain(pred)
+        with pytest.raises(RuntimeError, match="changed during iteration"):
+            d.retain(lambda k, v: d.add("c", "3"))
+        with pytest.raises(TypeError):
+            d.retain(None)  # type: ignore[arg-type]
+        assert list(d.items()) == [("a", "1"), ("b", "2"), ("c", "3")]
+
+    def test_partition(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class(
+            [("x-a", "1"), ("b", "2"), ("x-a", "3"), ("c", "4")]
+        )
+        removed = d.partition(lambda k, v: not k.startswith("x-"))
+        assert type(removed) is case_sensitive_multidict_class
+        assert list(removed.items()) == [("x-a", "1"), ("x-a", "3")]
+        assert list(d.items()) == [("b", "2"), ("c", "4")]
+        assert removed.getall("x-a") == ["1", "3"]
+        assert not d.partition(lambda k, v: True)
+
+    def test_partition_subclass_with_init(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        class Sub(case_sensitive_multidict_class):  # type: ignore[valid-type,misc]
+            def __init__(self, *args: object) -> None:
+                super().__init__(*args)
+                self.initialized = True
+
+        d = Sub([("a", "1"), ("b", "2")])
+        removed = d.partition(lambda k, v: k == "a")
+        assert type(removed) is Sub
+        assert removed.initialized
+        assert list(removed.items()) == [("b", "2")]
+        assert list(d.copy().items()) == [("a", "1")]
+
+    def test_retain_prefix(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        items = [("x-a", "1"), ("X-b", "2"), ("y-c", "3"), ("x-d", "4")]
+        d = case_sensitive_multidict_class(items)
+        d.retain_prefix("x-")
+        assert list(d.items()) == [("x-a", "1"), ("x-d", "4")]
+
+        d = case_sensitive_multidict_class(items)
+        d.retain_prefix(("x-", "y-"), invert=True)
+        assert list(d.items()) == [("X-b", "2")]
+        d.retain_prefix(())
+        assert not d
+        with pytest.raises(TypeError):
+            d.retain_prefix(1)  # type: ignore[arg-type]
+        with pytest.raises(TypeError):
+            d.retain_prefix("x-", True)  # type: ignore[misc]
+
+    def test_lookup_after_removals(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class((str(i), str(i)) for i in range(200))
+        for i in range(0, 200, 2):
+            del d[str(i)]
+        d.popone("1")
+        d.popitem()
+        for i in range(300):
+            expected = i % 2 == 1 and 1 < i < 199
+            assert (str(i) in d) is expected
+            assert d.getall(str(i), []) == ([str(i)] if expected else [])
+        d.add("0", "new")
+        assert d["0"] == "new"
+
+    def test_repeated_lookups_after_changes(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        d = case_sensitive_multidict_class([("a", "1"), ("b", "2"), ("c", "3")])
+        assert d["c"] == "3"
+        assert "c" in d
+        del d["a"]
+        assert d["c"] == "3"
+        d["c"] = "4"
+        assert d["c"] == "4"
+        d.popone("c")
+        assert "c" not in d
+        assert d.get("c") is None
+        d.add("c", "5")
+        d.add("c", "6")
+        assert d["c"] == "5"
+        d.popitem()
+        d.popitem()
+        assert "c" not in d
+        assert d.copy()["b"] == "2"
+
     def test_set_default(
         self,
         case_sensitive_multidict_class: type[CIMultiDict[str]],
@@ -350,6 +556,58 @@ class TestMutableMultiDict:
         with pytest.raises(TypeError):
             d.update("foo", "bar")  # type: ignore[arg-type, call-arg]
 
+    @pytest.mark.parametrize("size", [3, 20, 30, 40, 100])
+    def test_str_subclass_key_added_later(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+        size: int,
+    ) -> None:
+        class MyStr(str):
+            pass
+
+        d = case_sensitive_multidict_class((str(i), str(i)) for i in range(size))
+        d.add(MyStr("sub"), "added")
+        d[MyStr("0")] = "replaced"
+        d.update([(MyStr("1"), "updated")])
+
+        keys = list(d)
+        assert keys == ["0", "1"] + [str(i) for i in range(2, size)] + ["sub"]
+        assert [type(k) for k in keys[:2]] == [MyStr, MyStr]
+        assert all(type(k) is str for k in keys[2:-1])
+        assert type(keys[-1]) is MyStr
+        assert d["0"] == "replaced"
+        assert d["1"] == "updated"
+        assert d.getall(str(size - 1)) == [str(size - 1)]
+        assert d.copy() == d
+
+        d.clear()
+        d.add("a", "b")
+        assert list(d.items()) == [("a", "b")]
+
+    @pytest.mark.skipif(
+        sys.implementation.name == "pypy",
+        reason="getsizeof() is not implemented on PyPy",
+    )
+    def test_sizeof_compact(
+        self,
+        case_sensitive_multidict_class: type[CIMultiDict[str]],
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+        multidict_implementation: "MultidictImplementation",
+    ) -> None:
+        if multidict_implementation.is_pure_python:
+            pytest.skip("compact pairs are implemented by C extension only")
+        items = [(str(i), str(i)) for i in range(1000)]
+        d = case_sensitive_multidict_class(items)
+        ci_d = case_insensitive_multidict_class(items)
+        assert sys.getsizeof(d) < sys.getsizeof(ci_d)
+
+        class MyStr(str):
+            pass
+
+        d.add(MyStr("key"), "val")
+        assert sys.getsizeof(d) >= sys.getsizeof(ci_d)
+        assert len(d) == 1001
+
 
 class TestCIMutableMultiDict:
     def test_getall(
@@ -451,6 +709,61 @@ class TestCIMutableMultiDict:
         assert 4 == len(d)
         assert d.getall("test") == ["test"]
 
+    def test_add_many(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+        case_insensitive_str_class: type[istr],
+    ) -> None:
+        d = case_insensitive_multidict_class()
+        host = case_insensitive_str_class("Host")
+        d.add_many([host, "HOST", "Accept"], ["a", "b", "c"])
+        assert d.getall("host") == ["a", "b"]
+        assert list(d.keys()) == ["Host", "HOST", "Accept"]
+        assert d["ACCEPT"] == "c"
+
+    def test_retain_prefix(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+        case_insensitive_str_class: type[istr],
+    ) -> None:
+        d = case_insensitive_multidict_class(
+            [("X-Internal-Id", "1"), ("Host", "h"), ("x-internal-trace", "2")]
+        )
+        d.retain_prefix(case_insensitive_str_class("X-INTERNAL-"), invert=True)
+        assert list(d.items()) == [("Host", "h")]
+
+        d = case_insensitive_multidict_class([("X-A", "1"), ("Host", "h")])
+        d.retain_prefix("x-")
+        assert list(d.items()) == [("X-A", "1")]
+        assert list(d.partition(lambda k, v: False).items()) == [("X-A", "1")]
+        assert not d
+
+    def test_popmany(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+        case_insensitive_str_class: type[istr],
+    ) -> None:
+        d = case_insensitive_multidict_class(
+            [
+                ("Connection", "close, X-Trace"),
+                ("Keep-Alive", "5"),
+                ("Host", "example.com"),
+                ("x-trace", "1"),
+                ("TE", "trailers"),
+            ]
+        )
+        removed = d.popmany(
+            ["connection", case_insensitive_str_class("X-TRACE"), "te", "Upgrade"]
+        )
+        assert removed == [
+            ("Connection", "close, X-Trace"),
+            ("x-trace", "1"),
+            ("TE", "trailers"),
+        ]
+        assert all(type(k) is case_insensitive_str_class for k, _ in removed)
+        d.discard_many(["KEEP-ALIVE"])
+        assert list(d.items()) == [("Host", "example.com")]
+
     def test_extend(
         self,
         case_insensitive_multidict_class: type[CIMultiDict[Union[str, int]]],
@@ -658,6 +971,138 @@ class TestCIMutableMultiDict:
         md = case_insensitive_multidict_class()
         assert sys.getsizeof(md) < 1024
 
+    @pytest.mark.skipif(
+        sys.implementation.name == "pypy",
+        reason="getsizeof() is not implemented on PyPy",
+    )
+    def test_sizeof_size_classes(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+        multidict_implementation: "MultidictImplementation",
+    ) -> None:
+        if multidict_implementation.is_pure_python:
+            pytest.skip("size classes are implemented by C extension only")
+        empty = case_insensitive_multidict_class([])
+        small = case_insensitive_multidict_class([("a", "b")])
+        default = case_insensitive_multidict_class()
+        assert sys.getsizeof(empty) < sys.getsizeof(small) < sys.getsizeof(default)
+        assert sys.getsizeof(empty) < 256
+        # a copy keeps the size class of the original
+        assert sys.getsizeof(small.copy()) == sys.getsizeof(small)
+
+        # subclasses may add __slots__ after the buffer, it is never cut
+        class Sub(case_insensitive_multidict_class):  # type: ignore[valid-type,misc]
+            pass
+
+        assert sys.getsizeof(Sub([])) >= sys.getsizeof(default)
+
+        for md in (empty, small, default):
+            size = len(md)
+            for i in range(100):
+                md.add(str(i), str(i))
+            assert len(md) == 100 + size
+            for i in range(100):
+                del md[str(i)]
+            assert len(md) == size
+
+    def test_slots_subclass(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        class Sub(case_insensitive_multidict_class):  # type: ignore[valid-type,misc]
+            __slots__ = ("tag",)
+
+        d = Sub([("a", "b")])
+        d.tag = "x"
+        for i in range(50):
+            d.add(str(i), str(i))
+        assert d.tag == "x"
+        assert d["A"] == "b"
+        assert len(d.copy()) == 51
+
+    @pytest.mark.skipif(
+        sys.implementation.name == "pypy",
+        reason="getsizeof() is not implemented on PyPy",
+    )
+    def test_sizeof_shrinks_after_removal(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        md = case_insensitive_multidict_class()
+        s1 = sys.getsizeof(md)
+        for i in range(1000):
+            md.add(str(i), str(i))
+        s2 = sys.getsizeof(md)
+        assert s2 > s1
+        for i in range(1000):
+            del md[str(i)]
+        assert not md
+        assert sys.getsizeof(md) < s2
+
+        md.add("key", "val")
+        assert md["key"] == "val"
+
+    def test_reserve(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        md = case_insensitive_multidict_class(a="b")
+        md.reserve(1000)
+        assert md == {"a": "b"}
+        for i in range(1000):
+            md.add(str(i), str(i))
+        assert len(md) == 1001
+        assert md["999"] == "999"
+
+    @pytest.mark.skipif(
+        sys.implementation.name == "pypy",
+        reason="getsizeof() is not implemented on PyPy",
+    )
+    def test_reserve_preallocates(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+        multidict_implementation: "MultidictImplementation",
+    ) -> None:
+        if multidict_implementation.is_pure_python:
+            pytest.skip("list capacity is not controllable")
+        md = case_insensitive_multidict_class()
+        md.reserve(1000)
+        s1 = sys.getsizeof(md)
+        for i in range(1000):
+            md.add(str(i), str(i))
+        assert sys.getsizeof(md) <= s1
+
+    def test_reserve_invalid(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+    ) -> None:
+        md = case_insensitive_multidict_class()
+        with pytest.raises(ValueError):
+            md.reserve(-1)
+        with pytest.raises(TypeError):
+            md.reserve("10")  # type: ignore[arg-type]
+
+    @pytest.mark.skipif(
+        sys.implementation.name == "pypy",
+        reason="getsizeof() is not implemented on PyPy",
+    )
+    def test_shrink_to_fit(
+        self,
+        case_insensitive_multidict_class: type[CIMultiDict[str]],
+        multidict_implementation: "MultidictImplementation",
+    ) -> None:
+        md = case_insensitive_multidict_class()
+        md.reserve(1000)
+        md.add("key", "val")
+        s1 = sys.getsizeof(md)
+        md.shrink_to_fit()
+        if multidict_implementation.is_pure_python:
+            # list capacity is not controllable
+            assert sys.getsizeof(md) <= s1
+        else:
+            assert sys.getsizeof(md) < s1
+        assert md == {"key": "val"}
+
     def test_issue_620_items(
         self,
         case_insensitive_multidict_class: type[CIMultiDict[str]],
@@ -82,3 +82,98 @@ def test_load_istr_from_file(
         obj = pickle.load(f)
     assert s == obj
     assert isinstance(obj, case_insensitive_str_class)
+
+
+def test_pickle_flat_format(
+    any_multidict_class: type[MultiDict[int]], pickle_protocol: int
+) -> None:
+    d = any_multidict_class([("a", 1), ("b", 2), ("a", 3)])
+    func, args = d.__reduce_ex__(pickle_protocol)[:2]
+    if pickle_protocol >= 5:
+        assert func == any_multidict_class._from_flat  # type: ignore[attr-defined]
+        assert args == (["a", 1, "b", 2, "a", 3],)
+    else:
+        assert func is any_multidict_class
+    assert func(*args) == d
+
+
+def test_pickle_keeps_keys(
+    case_insensitive_multidict_class: type[MultiDict[int]],
+    case_insensitive_str_class: type[istr],
+    pickle_protocol: int,
+) -> None:
+    d = case_insensitive_multidict_class(
+        [("Aa", 1), (case_insensitive_str_class("bB"), 2), ("AA", 3)]
+    )
+    obj = pickle.loads(pickle.dumps(d, pickle_protocol))
+    assert isinstance(obj, case_insensitive_multidict_class)
+    assert list(obj.items()) == [("Aa", 1), ("bB", 2), ("AA", 3)]
+    assert obj.getall("aa") == [1, 3]
+    assert all(isinstance(k, case_insensitive_str_class) for k in obj.keys())
+
+
+def test_pickle_subclass(
+    any_multidict_class: type[MultiDict[int]], pickle_protocol: int
+) -> None:
+    cls = type("Sub", (any_multidict_class,), {"__module__": __name__})
+    globals()["Sub"] = cls
+    try:
+        d = cls([("a", 1), ("a", 2)])
+        obj = pickle.loads(pickle.dumps(d, pickle_protocol))
+    finally:
+        del globals()["Sub"]
+    assert type(obj) is cls
+    assert obj == d
+
+
+def test_pickle_subclass_with_init(
+    any_multidict_class: type[MultiDict[int]], pickle_protocol: int
+) -> None:
+    def __init__(self: MultiDict[int], *args: object) -> None:
+        super(cls, self).__init__(*args)
+        self.initialized = True  # type: ignore[attr-defined]
+
+    ns = {"__module__": __name__, "__init__": __init__}
+    cls = type("SubInit", (any_multidict_class,), ns)
+    globals()["SubInit"] = cls
+    try:
+        d = cls([("a", 1), ("a", 2)])
+        obj = pickle.loads(pickle.dumps(d, pickle_protocol))
+    finally:
+        del globals()["SubInit"]
+    assert type(obj) is cls
+    assert obj.initialized
+    assert list(obj.items()) == [("a", 1), ("a", 2)]
+
+
+def test_pickle_subclass_with_reduce(
+    any_multidict_class: type[MultiDict[int]], pickle_protocol: int
+) -> None:
+    def __reduce__(self: MultiDict[int]) -> tuple[object, ...]:
+        state = {"tag": self.tag}  # type: ignore[attr-defined]
+        return (cls, (list(self.items()),), state)
+
+    ns = {"__module__": __name__, "__reduce__": __reduce__}
+    cls = type("SubReduce", (any_multidict_class,), ns)
+    globals()["SubReduce"] = cls
+    try:
+        d = cls([("a", 1), ("a", 2)])
+        d.tag = "x"  # type: ignore[attr-defined]
+        obj = pickle.loads(pickle.dumps(d, pickle_protocol))
+    finally:
+        del globals()["SubReduce"]
+    assert type(obj) is cls
+    assert obj.tag == "x"
+    assert list(obj.items()) == [("a", 1), ("a", 2)]
+
+
+def test_from_flat(any_multidict_class: type[MultiDict[int]]) -> None:
+    from_flat = any_multidict_class._from_flat  # type: ignore[attr-defined]
+    assert from_flat(()) == any_multidict_class()
+    assert list(from_flat(("a", 1, "a", 2)).items()) == [("a", 1), ("a", 2)]
+    with pytest.raises(ValueError, match="even number"):
+        from_flat(["a", 1, "b"])
+    with pytest.raises(TypeError):
+        from_flat([1, 2])
+    with pytest.raises(TypeError):
+        from_flat(1)
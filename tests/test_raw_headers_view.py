@@ -0,0 +1,196 @@
+from types import ModuleType
+
+import pytest
+
+from multidict import MultiMapping, RawHeadersView
+
+DATA = (
+    b"Host: example.com\r\n"
+    b"Set-Cookie: a=1\r\n"
+    b"content-type:\ttext/html  \r\n"
+    b"SET-COOKIE: b=2\r\n"
+    b"X-Raw: \xff\r\n"
+    b"X-Empty:\r\n"
+    b"\r\n"
+    b"body"
+)
+
+ITEMS = [
+    ("Host", "example.com"),
+    ("Set-Cookie", "a=1"),
+    ("content-type", "text/html"),
+    ("SET-COOKIE", "b=2"),
+    ("X-Raw", "\udcff"),
+    ("X-Empty", ""),
+]
+
+
+@pytest.fixture
+def view_class(multidict_module: ModuleType) -> type[RawHeadersView]:
+    return multidict_module.RawHeadersView  # type: ignore[no-any-return]
+
+
+def test_lookup(view_class: type[RawHeadersView]) -> None:
+    view = view_class(DATA)
+    assert len(view) == 6
+    assert view["host"] == "example.com"
+    assert view["Content-Type"] == "text/html"
+    assert view.getone("x-raw") == "\udcff"
+    assert view.getall("set-cookie") == ["a=1", "b=2"]
+    assert view.getall("missing", None) is None
+    assert view.getone("missing", "x") == "x"
+    assert view.get("x-empty") == ""
+    assert view.get("missing") is None
+    assert view.get("missing", "x") == "x"
+    assert "SET-cookie" in view
+    assert "set-cookies" not in view
+    assert 1 not in view
+    with pytest.raises(KeyError):
+        view["missing"]
+    with pytest.raises(KeyError):
+        view.getall("missing")
+    with pytest.raises(TypeError):
+        view.getone(1)  # type: ignore[call-overload]
+
+
+def test_istr_key(
+    view_class: type[RawHeadersView], multidict_module: ModuleType
+) -> None:
+    view = view_class(DATA)
+    assert view[multidict_module.istr("HOST")] == "example.com"
+    assert view.getall(multidict_module.istr("Set-Cookie")) == ["a=1", "b=2"]
+
+
+def test_iteration(
+    view_class: type[RawHeadersView], multidict_module: ModuleType
+) -> None:
+    view = view_class(DATA)
+    assert list(view.items()) == ITEMS
+    assert list(view.keys()) == [k for k, v in ITEMS]
+    assert list(view.values()) == [v for k, v in ITEMS]
+    assert list(view) == list(view.keys())
+    assert all(isinstance(key, multidict_module.istr) for key in view)
+    assert isinstance(view, MultiMapping)
+
+
+def test_views(
+    view_class: type[RawHeadersView], multidict_module: ModuleType
+) -> None:
+    view = view_class(DATA)
+    proxy = multidict_module.CIMultiDictProxy(multidict_module.CIMultiDict(ITEMS))
+    assert type(view.keys()) is type(proxy.keys())
+    assert type(view.values()) is type(proxy.values())
+    assert type(view.items()) is type(proxy.items())
+    assert view.keys() == proxy.keys()
+    assert view.items() == proxy.items()
+    assert list(view.values()) == list(proxy.values())
+    assert "HOST" in view.keys()
+    assert ("Host", "example.com") in view.items()
+    assert view.keys() & {"host", "x-other"} == proxy.keys() & {"host", "x-other"}
+    assert view.keys() | {"x-other"} == proxy.keys() | {"x-other"}
+    assert view.keys() - {"Host"} == proxy.keys() - {"Host"}
+    assert view.items() - proxy.items() == set()
+
+
+def test_copy(
+    view_class: type[RawHeadersView], multidict_module: ModuleType
+) -> None:
+    view = view_class(DATA)
+    md = view.copy()
+    assert type(md) is multidict_module.CIMultiDict
+    assert list(md.items()) == ITEMS
+    md.add("X-New", "1")
+    assert "x-new" not in view
+    assert list(multidict_module.CIMultiDict(view).items()) == ITEMS
+
+
+def test_eq(
+    view_class: type[RawHeadersView], multidict_module: ModuleType
+) -> None:
+    view = view_class(DATA)
+    assert view == multidict_module.CIMultiDict(ITEMS)
+    assert view == view_class(DATA)
+    assert view != view_class(DATA[:19])
+    assert view != multidict_module.CIMultiDict(ITEMS[:2])
+    assert view != [1]
+    with pytest.raises(TypeError):
+        hash(view)
+
+
+def test_repr(view_class: type[RawHeadersView]) -> None:
+    view = view_class(b"A: 1\r\nb: 'x'\r\n")
+    assert repr(view) == "<RawHeadersView('A': '1', 'b': \"'x'\")>"
+
+
+def test_offsets(view_class: type[RawHeadersView]) -> None:
+    data = bytearray(b"xxHOSTexample.comcookiea=1Cookieb=2")
+    view = view_class(
+        memoryview(data), [(2, 4, 6, 11), (17, 6, 23, 3), (26, 6, 32, 3)]
+    )
+    assert list(view.items()) == [
+        ("HOST", "example.com"),
+        ("cookie", "a=1"),
+        ("Cookie", "b=2"),
+    ]
+    assert view["Host"] == "example.com"
+    assert view.getall("COOKIE") == ["a=1", "b=2"]
+    assert len(view_class(data, iter([]))) == 0
+
+
+@pytest.mark.parametrize(
+    "offsets",
+    [
+        [(0, 1, 0, 5)],
+        [(-1, 1, 0, 1)],
+        [(0, 1, 0, -1)],
+        [(4, 1, 0, 1)],
+    ],
+)
+def test_offsets_out_of_range(
+    view_class: type[RawHeadersView], offsets: list[tuple[int, int, int, int]]
+) -> None:
+    with pytest.raises(ValueError, match="out of range"):
+        view_class(b"abcd", offsets)
+
+
+def test_bad_offsets(view_class: type[RawHeadersView]) -> None:
+    with pytest.raises(TypeError, match="should be tuples"):
+        view_class(b"abcd", [[0, 1, 2, 1]])  # type: ignore[list-item]
+    with pytest.raises(TypeError):
+        view_class(b"abcd", [(0, 1, 2)])  # type: ignore[list-item]
+    with pytest.raises(TypeError):
+        view_class(b"abcd", 1)  # type: ignore[arg-type]
+    with pytest.raises(TypeError):
+        view_class("abcd")  # type: ignore[arg-type]
+
+
+@pytest.mark.parametrize(
+    "data",
+    [
+        b"no colon\r\n",
+        b": value\r\n",
+        b"A: 1\r\n folded\r\n",
+        b"\tA: 1\n",
+        b"A : b\r\n",  # whitespace before the colon, RFC 9112 section 5.1
+        b"B: 1\nA\t: b\n",
+    ],
+)
+def test_invalid_lines(view_class: type[RawHeadersView], data: bytes) -> None:
+    with pytest.raises(ValueError, match="invalid header line"):
+        view_class(data)
+
+
+def test_parse_edges(view_class: type[RawHeadersView]) -> None:
+    assert len(view_class(b"")) == 0
+    assert len(view_class(b"\r\nA: 1\r\n")) == 0
+    view = view_class(b"A:1\nB: 2")
+    assert list(view.items()) == [("A", "1"), ("B", "2")]
+    assert view_class(b"A: x: y \r\n")["a"] == "x: y"
+
+
+def test_non_ascii_names(view_class: type[RawHeadersView]) -> None:
+    view = view_class("X-Ünï: 1\r\nx-ÜNÏ: 2\r\nX-\xff: 3\r\n".encode() + b"X-\xff: 4")
+    assert view.getall("x-üNï") == ["1", "2"]
+    assert view["X-\xff"] == "3"
+    assert view["X-\udcff"] == "4"
+    assert "x-un" not in view
@@ -0,0 +1,255 @@
+import mmap
+import random
+import struct
+from multiprocessing import shared_memory
+from pathlib import Path
+from types import ModuleType
+
+import pytest
+
+from multidict import MultiDict, SharedMultiDict
+
+ITEMS = [("Ab", "1"), ("b", b"x\x00"), ("ab", "2"), ("É", "é"), ("c", "")]
+
+
+@pytest.fixture
+def shared_class(multidict_module: ModuleType) -> type[SharedMultiDict]:
+    return multidict_module.SharedMultiDict  # type: ignore[no-any-return]
+
+
+def test_round_trip(
+    any_multidict_class: type[MultiDict[object]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    md = any_multidict_class(ITEMS)
+    shared = shared_class(shared_class.pack(md))
+
+    assert len(shared) == 5
+    assert shared.items() == list(md.items())
+    assert shared.keys() == list(md.keys())
+    assert list(shared) == list(md.keys())
+    assert shared.values() == ["1", b"x\x00", "2", "é", ""]
+    for key in ("Ab", "ab", "AB", "b", "É", "é", "c", "missing"):
+        assert shared.getall(key, None) == md.getall(key, None)
+        assert shared.get(key) == md.get(key)
+        assert (key in shared) == (key in md)
+    assert repr(shared) == repr(md).replace(type(md).__name__, "SharedMultiDict")
+
+
+def test_case_insensitive(
+    case_insensitive_multidict_class: type[MultiDict[str]],
+    case_insensitive_str_class: type[str],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    md = case_insensitive_multidict_class([("Content-Type", "text/html")])
+    shared = shared_class(shared_class.pack(md))
+    assert shared["content-type"] == "text/html"
+    assert shared[case_insensitive_str_class("CONTENT-TYPE")] == "text/html"
+    key = shared.keys()[0]
+    assert key == "Content-Type"
+    assert isinstance(key, case_insensitive_str_class)
+
+
+def test_values_cached(
+    case_sensitive_multidict_class: type[MultiDict[str]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    md = case_sensitive_multidict_class(a="value")
+    shared = shared_class(shared_class.pack(md))
+    assert shared["a"] is shared.getone("a")
+    assert shared.keys()[0] is shared.items()[0][0]
+
+
+def test_getone_getall_missing(
+    case_sensitive_multidict_class: type[MultiDict[str]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    shared = shared_class(shared_class.pack(case_sensitive_multidict_class()))
+    assert len(shared) == 0
+    with pytest.raises(KeyError, match="a"):
+        shared["a"]
+    with pytest.raises(KeyError):
+        shared.getall("a")
+    assert shared.getone("a", 1) == 1
+    assert shared.getall("a", []) == []
+    assert shared.get("a") is None
+    assert "\ud800" not in shared
+    assert 1 not in shared  # type: ignore[comparison-overlap]
+    with pytest.raises(TypeError):
+        shared.getone(1)  # type: ignore[call-overload]
+
+
+def test_pack_proxy(
+    any_multidict_class: type[MultiDict[str]],
+    any_multidict_proxy_class: type[MultiDict[str]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    md = any_multidict_class(a="1")
+    proxy = any_multidict_proxy_class(md)
+    assert shared_class.pack(proxy) == shared_class.pack(md)
+
+
+def test_pack_invalid(
+    case_sensitive_multidict_class: type[MultiDict[object]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    with pytest.raises(TypeError, match="should be a multidict"):
+        shared_class.pack({"a": "1"})  # type: ignore[arg-type]
+    with pytest.raises(TypeError, match="should be str or bytes, not int"):
+        shared_class.pack(case_sensitive_multidict_class(a=1))
+
+
+def test_surrogateescape(
+    multidict_module: ModuleType,
+    shared_class: type[SharedMultiDict],
+) -> None:
+    builder = multidict_module.CIMultiDictBuilder()
+    builder.add(b"X-Raw-\xff", b"\xff\xfe")
+    builder.add(b"X-Text", b"v")
+    md = builder.build()
+    shared = shared_class(shared_class.pack(md))
+    assert shared.items() == list(md.items())
+    assert shared["x-raw-\udcff"] == "\udcff\udcfe"
+    assert "X-RAW-\udcff" in shared
+    assert "x-raw-\ud800" not in shared
+
+    with pytest.raises(UnicodeEncodeError):
+        shared_class.pack(multidict_module.MultiDict(a="\ud800"))
+
+
+def test_implementations_compatible(any_multidict_class_name: str) -> None:
+    c_ext = pytest.importorskip("multidict._multidict")
+    from multidict import _multidict_py as py
+
+    items = [(f"k{i % 37}", str(i) if i % 3 else bytes(i)) for i in range(500)]
+    items.append(("k-\udcff", "\udcfe"))
+    c_md = getattr(c_ext, any_multidict_class_name)(items)
+    py_md = getattr(py, any_multidict_class_name)(items)
+    c_packed = c_ext.SharedMultiDict.pack(c_md)
+    py_packed = py.SharedMultiDict.pack(py_md)
+    assert c_packed == py_packed
+
+    for shared in (c_ext.SharedMultiDict(py_packed), py.SharedMultiDict(c_packed)):
+        assert shared.items() == items
+
+
+def test_random_lookups(
+    any_multidict_class: type[MultiDict[str]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    rnd = random.Random(0)
+    keys = [f"Key-{i}" for i in range(300)]
+    md = any_multidict_class((rnd.choice(keys), str(i)) for i in range(1000))
+    shared = shared_class(shared_class.pack(md))
+    for key in keys + [k.upper() for k in keys]:
+        assert shared.getall(key, []) == md.getall(key, [])
+
+
+def test_shared_memory(
+    any_multidict_class: type[MultiDict[object]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    packed = shared_class.pack(any_multidict_class(ITEMS))
+    shm = shared_memory.SharedMemory(create=True, size=len(packed))
+    try:
+        shm.buf[: len(packed)] = packed
+        other = shared_memory.SharedMemory(name=shm.name)
+        shared = shared_class(other.buf)
+        assert shared.getall("ab") == (
+            ["1", "2"] if "CI" in any_multidict_class.__name__ else ["2"]
+        )
+        del shared
+        other.close()
+    finally:
+        shm.close()
+        shm.unlink()
+
+
+def test_mmap(
+    any_multidict_class: type[MultiDict[object]],
+    shared_class: type[SharedMultiDict],
+    tmp_path: Path,
+) -> None:
+    path = tmp_path / "headers.bin"
+    path.write_bytes(shared_class.pack(any_multidict_class(ITEMS)))
+    with path.open("rb") as f:
+        mapped = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    shared = shared_class(mapped)
+    assert shared.items() == ITEMS
+    del shared
+    mapped.close()
+
+
+def _patch(data: bytes, offset: int, fmt: str, value: int) -> bytes:
+    buf = bytearray(data)
+    struct.pack_into(fmt, buf, offset, value)
+    return bytes(buf)
+
+
+def test_corrupted(
+    case_sensitive_multidict_class: type[MultiDict[str]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    packed = shared_class.pack(case_sensitive_multidict_class(a="1", b="2"))
+
+    with pytest.raises(ValueError, match="too small"):
+        shared_class(packed[:10])
+    with pytest.raises(ValueError, match="doesn't contain"):
+        shared_class(b"XXXX" + packed[4:])
+    with pytest.raises(ValueError, match="version 2"):
+        shared_class(_patch(packed, 4, "<H", 2))
+
+    corrupted = [
+        packed[:-1],  # truncated
+        _patch(packed, 6, "<H", 2),  # unknown flag
+        _patch(packed, 8, "<I", 1000),  # too many entries
+        _patch(packed, 12, "<I", 3),  # slots aren't a power of two
+        _patch(packed, 32 + 8, "<I", 0),  # identity in the header
+        _patch(packed, 32 + 16, "<I", len(packed) - 2),  # value out of bounds
+        _patch(packed, 32 + 20, "<I", 3),  # next entry out of range
+        _patch(packed, 32 + 20, "<I", 1),  # next entry loops back
+        _patch(packed, 64 + 20, "<I", 1),  # next entry points backward
+        _patch(packed, 32 + 24, "<I", 2),  # unknown entry flag
+        _patch(packed, 96, "<I", 3),  # slot out of range
+    ]
+    for data in corrupted:
+        with pytest.raises(ValueError, match="corrupted"):
+            shared_class(data)
+
+
+def test_corrupted_after_creation(
+    case_sensitive_multidict_class: type[MultiDict[str]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    md = case_sensitive_multidict_class([("a", "1"), ("b", "2"), ("a", "3")])
+    packed = shared_class.pack(md)
+    buf = bytearray(packed)
+    shared = shared_class(buf)
+
+    # the buffer is writable, another process may change it at any time
+    struct.pack_into("<I", buf, 32 + 16, 0)  # value in the header
+    with pytest.raises(ValueError, match="corrupted"):
+        shared["a"]
+    buf[:] = packed
+    struct.pack_into("<I", buf, 32 + 20, 1)  # next entry loops back
+    with pytest.raises(ValueError, match="corrupted"):
+        shared.getall("a")
+    buf[:] = packed
+    struct.pack_into("<I", buf, 32 + 12, len(buf) - 2)  # key out of bounds
+    with pytest.raises(ValueError, match="corrupted"):
+        shared.keys()
+    buf[:] = packed
+    slots = 32 + 3 * 32
+    for i in range(4):
+        struct.pack_into("<I", buf, slots + 4 * i, 1000)  # slot out of range
+    with pytest.raises(ValueError, match="corrupted"):
+        "a" in shared
+
+
+def test_buffer_larger_than_layout(
+    case_sensitive_multidict_class: type[MultiDict[str]],
+    shared_class: type[SharedMultiDict],
+) -> None:
+    packed = shared_class.pack(case_sensitive_multidict_class(a="1"))
+    shared = shared_class(packed + b"\x00" * 4096)
+    assert shared.items() == [("a", "1")]
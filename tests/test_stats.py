@@ -0,0 +1,112 @@
+from types import ModuleType
+from typing import TYPE_CHECKING
+
+import pytest
+
+if TYPE_CHECKING:
+    from conftest import MultidictImplementation
+
+
+@pytest.fixture
+def stats_module(
+    multidict_module: ModuleType,
+    multidict_implementation: "MultidictImplementation",
+) -> ModuleType:
+    if multidict_implementation.is_pure_python:
+        pytest.skip("statistics are collected by the C extension only")
+    try:
+        multidict_module.stats()
+    except RuntimeError:
+        pytest.skip("the C extension is built without MULTIDICT_STATS")
+    return multidict_module
+
+
+def test_stats_disabled(
+    multidict_module: ModuleType,
+    multidict_implementation: "MultidictImplementation",
+) -> None:
+    if multidict_implementation.is_pure_python:
+        pytest.skip("statistics are collected by the C extension only")
+    try:
+        multidict_module.stats()
+    except RuntimeError:
+        pass
+    else:
+        pytest.skip("the C extension is built with MULTIDICT_STATS")
+    with pytest.raises(RuntimeError, match="MULTIDICT_STATS"):
+        multidict_module.stats()
+
+
+def test_stats_counters(stats_module: ModuleType) -> None:
+    before = stats_module.stats()
+
+    md = stats_module.CIMultiDict((str(i), i) for i in range(40))
+    assert md.get("5") == 5
+    assert "missing" not in md
+    keys = list(md.keys())
+    stats_module.MultiDict(a=1)
+    stats_module.MultiDict([])
+
+    after = stats_module.stats()
+    assert after["constructed"][28] - before["constructed"][28] == 1
+    assert after["constructed"][4] - before["constructed"][4] == 1
+    assert after["constructed"][0] - before["constructed"][0] == 1
+    assert after["spills"] - before["spills"] == 1
+    assert after["lookups"] - before["lookups"] == 2
+    # the miss scans all pairs unless the signature rejects it
+    rejects = after["signature_rejects"] - before["signature_rejects"]
+    assert rejects in (0, 1)
+    assert after["probes"] - before["probes"] == 6 + 40 * (1 - rejects)
+    assert after["str_cmps"] - before["str_cmps"] >= 1
+    assert after["ci_identities"] - before["ci_identities"] == 42
+    assert after["istr_materializations"] - before["istr_materializations"] == len(
+        keys
+    )
+    assert after["avg_scan_length"] > 0
+
+
+def test_stats_shrinks(stats_module: ModuleType) -> None:
+    md = stats_module.MultiDict((str(i), i) for i in range(100))
+    before = stats_module.stats()["shrinks"]
+    for i in range(100):
+        del md[str(i)]
+    assert stats_module.stats()["shrinks"] > before
+
+
+def test_stats_signature_rejects(stats_module: ModuleType) -> None:
+    md = stats_module.MultiDict(a=1)
+    before = stats_module.stats()
+    for i in range(100):
+        assert str(i) not in md
+    after = stats_module.stats()
+    assert after["lookups"] - before["lookups"] == 100
+    assert after["signature_rejects"] - before["signature_rejects"] > 50
+
+
+def test_stats_lookup_cache_hits(stats_module: ModuleType) -> None:
+    md = stats_module.CIMultiDict((str(i), i) for i in range(20))
+    key = stats_module.istr("15")
+    before = stats_module.stats()
+    assert md[key] == 15
+    assert key in md
+    assert md.get(key) == 15
+    after = stats_module.stats()
+    assert after["lookup_cache_hits"] - before["lookup_cache_hits"] == 2
+    assert after["probes"] - before["probes"] == 16
+
+    md["15"] = 0
+    before = stats_module.stats()
+    assert md[key] == 0
+    after = stats_module.stats()
+    assert after["lookup_cache_hits"] == before["lookup_cache_hits"]
+
+
+def test_stats_lookup_cache_per_multidict(stats_module: ModuleType) -> None:
+    first = stats_module.CIMultiDict((str(i), i) for i in range(20))
+    second = stats_module.CIMultiDict((str(i), -i) for i in range(20))
+    before = stats_module.stats()
+    for _ in range(3):
+        assert first["15"] == 15
+        assert second["10"] == -10
+    after = stats_module.stats()
+    assert after["lookup_cache_hits"] - before["lookup_cache_hits"] == 4
@@ -0,0 +1,108 @@
+import sys
+from collections.abc import Iterator
+from types import ModuleType
+from typing import TYPE_CHECKING
+
+import pytest
+
+if TYPE_CHECKING:
+    from conftest import MultidictImplementation
+
+
+Call = tuple[str, int, int]
+
+
+@pytest.fixture
+def calls(multidict_module: ModuleType) -> Iterator[list[Call]]:
+    ret: list[Call] = []
+    try:
+        yield ret
+    finally:
+        multidict_module.set_trace_hook(0, None)
+
+
+@pytest.fixture
+def c_module(
+    multidict_module: ModuleType,
+    multidict_implementation: "MultidictImplementation",
+) -> ModuleType:
+    if multidict_implementation.is_pure_python:
+        pytest.skip("operations are reported by the C extension only")
+    return multidict_module
+
+
+def test_hook_reports_operations(c_module: ModuleType, calls: list[Call]) -> None:
+    md = c_module.CIMultiDict(a=1)
+    c_module.set_trace_hook(0, lambda *args: calls.append(args))
+    md.add("b", 2)
+    assert md.get("A") == 1
+    assert "x" not in md
+    md.popall("b")
+    c_module.set_trace_hook(0, None)
+    md.add("c", 3)
+
+    assert [(op, size) for op, size, _ in calls] == [
+        ("add", 2),
+        ("get_one", 2),
+        ("contains", 2),
+        ("pop_all", 1),
+    ]
+    assert all(elapsed >= 0 for _, _, elapsed in calls)
+
+
+def test_hook_size_threshold(c_module: ModuleType, calls: list[Call]) -> None:
+    small = c_module.MultiDict(a=1)
+    large = c_module.MultiDict((str(i), i) for i in range(100))
+    c_module.set_trace_hook(
+        10**12, lambda *args: calls.append(args), size_threshold=100
+    )
+    small.getone("a")
+    large.getone("5")
+    large.extend(small)
+
+    assert [(op, size) for op, size, _ in calls] == [
+        ("get_one", 100),
+        ("update_from_pair_list", 101),
+    ]
+
+
+def test_hook_not_reentered(c_module: ModuleType, calls: list[Call]) -> None:
+    md = c_module.MultiDict(a=1)
+
+    def hook(*args: int) -> None:
+        calls.append(args)  # type: ignore[arg-type]
+        c_module.MultiDict(x=1).getone("x")
+
+    c_module.set_trace_hook(0, hook)
+    md.getone("a")
+    assert len(calls) == 1
+
+
+def test_hook_error_keeps_operation_error(
+    c_module: ModuleType, calls: list[Call], monkeypatch: pytest.MonkeyPatch
+) -> None:
+    md = c_module.MultiDict()
+    unraisable: list["sys.UnraisableHookArgs"] = []
+    monkeypatch.setattr(sys, "unraisablehook", unraisable.append)
+
+    def hook(*args: object) -> None:
+        raise ZeroDivisionError
+
+    c_module.set_trace_hook(0, hook)
+    with pytest.raises(KeyError, match="missing"):
+        md.popone("missing")
+    assert len(unraisable) == 1
+    assert unraisable[0].exc_type is ZeroDivisionError
+
+
+def test_set_trace_hook_validation(
+    multidict_module: ModuleType, calls: list[Call]
+) -> None:
+    with pytest.raises(ValueError):
+        multidict_module.set_trace_hook(-1, None)
+    with pytest.raises(TypeError):
+        multidict_module.set_trace_hook(0, 1)
+    with pytest.raises(ValueError):
+        multidict_module.set_trace_hook(0, print, size_threshold=-1)
+    with pytest.raises(TypeError):
+        multidict_module.set_trace_hook(0, print, 10)
@@ -38,6 +38,59 @@ def test_add(
     assert multidict_getversion_callable(m) > v
 
 
+def test_add_many(
+    any_multidict_class: type[MultiDict[str]],
+    multidict_getversion_callable: GetVersion[str],
+) -> None:
+    m = any_multidict_class()
+    v = multidict_getversion_callable(m)
+    m.add_many([], [])
+    assert multidict_getversion_callable(m) == v
+    with pytest.raises(TypeError):
+        m.add_many([1], ["val"])  # type: ignore[list-item]
+    assert multidict_getversion_callable(m) == v
+    m.add_many(["key", "key"], ["val", "val2"])
+    assert multidict_getversion_callable(m) > v
+
+
+def test_discard_many(
+    any_multidict_class: type[MultiDict[str]],
+    multidict_getversion_callable: GetVersion[str],
+) -> None:
+    m = any_multidict_class([("a", "1"), ("b", "2"), ("a", "3")])
+    v = multidict_getversion_callable(m)
+    m.discard_many(["c", "d"])
+    assert multidict_getversion_callable(m) == v
+    m.discard_many(["a", "b"])
+    assert multidict_getversion_callable(m) > v
+
+
+def test_popmany(
+    any_multidict_class: type[MultiDict[str]],
+    multidict_getversion_callable: GetVersion[str],
+) -> None:
+    m = any_multidict_class([("a", "1"), ("b", "2")])
+    v = multidict_getversion_callable(m)
+    assert m.popmany(["c"]) == []
+    assert multidict_getversion_callable(m) == v
+    assert m.popmany(["a", "b"]) == [("a", "1"), ("b", "2")]
+    assert multidict_getversion_callable(m) > v
+
+
+def test_retain(
+    any_multidict_class: type[MultiDict[str]],
+    multidict_getversion_callable: GetVersion[str],
+) -> None:
+    m = any_multidict_class([("a", "1"), ("b", "2")])
+    v = multidict_getversion_callable(m)
+    m.retain(lambda k, v: True)
+    m.retain_prefix(("a", "b"))
+    assert not m.partition(lambda k, v: True)
+    assert multidict_getversion_callable(m) == v
+    m.retain_prefix("a")
+    assert multidict_getversion_callable(m) > v
+
+
 def test_delitem(
     any_multidict_class: type[MultiDict[str]],
     multidict_getversion_callable: GetVersion[str],